@@ -0,0 +1,542 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file defines the class AutosaveJournal
+
+  AutosaveJournal records the changes to a worksheet since it was last saved
+  as .wxmx file in a small file next to the .wxmx file.
+*/
+
+#include "AutosaveJournal.h"
+#include "ErrorRedirector.h"
+#include <wx/file.h>
+#include <wx/filename.h>
+#include <wx/intl.h>
+#include <wx/log.h>
+#include <wx/process.h>
+#include <wx/utils.h>
+#include <wx/wfstream.h>
+#include <wx/zipstrm.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+//! The first line of every journal
+static const char journalMagic[] = "wxMaxima autosave journal 1";
+
+//! The modification time of a file as a string, or an empty string
+static wxString ModificationTime(const wxString &file)
+{
+  wxDateTime time = wxFileName(file).GetModificationTime();
+  if (!time.IsValid())
+    return wxEmptyString;
+  return time.GetValue().ToString();
+}
+
+//! Appends a record to a journal
+static bool WriteRecord(wxFile &journal, const wxString &type, const wxString &argument,
+                        const void *data, size_t length)
+{
+  wxScopedCharBuffer head =
+    wxString::Format(wxT("%s %s %lu\n"), type, argument, static_cast<unsigned long>(length)).utf8_str();
+  return
+    (journal.Write(head.data(), head.length()) == head.length()) &&
+    ((length == 0) || (journal.Write(data, length) == length)) &&
+    (journal.Write("\n", 1) == 1);
+}
+
+//! Appends a record containing text to a journal
+static bool WriteRecord(wxFile &journal, const wxString &type, const wxString &argument,
+                        const wxString &text)
+{
+  wxScopedCharBuffer utf8 = text.utf8_str();
+  return WriteRecord(journal, type, argument, utf8.data(), utf8.length());
+}
+
+wxString AutosaveJournal::GetJournalName(const wxString &wxmxFile)
+{
+  return wxmxFile + wxT(".journal");
+}
+
+wxString AutosaveJournal::GetLockName(const wxString &wxmxFile)
+{
+  return GetJournalName(wxmxFile) + wxT(".lock");
+}
+
+void AutosaveJournal::Remove(const wxString &wxmxFile)
+{
+  SuppressErrorDialogs suppressor;
+  wxString journal = GetJournalName(wxmxFile);
+  if (wxFileExists(journal))
+    wxRemoveFile(journal);
+  wxString lock = GetLockName(wxmxFile);
+  if (wxFileExists(lock))
+    wxRemoveFile(lock);
+}
+
+bool AutosaveJournal::CrashDetected(const wxString &wxmxFile)
+{
+  if (!wxFileExists(GetJournalName(wxmxFile)))
+    return false;
+  wxFile lock;
+  {
+    SuppressErrorDialogs suppressor;
+    if (!wxFileExists(GetLockName(wxmxFile)) || !lock.Open(GetLockName(wxmxFile)))
+      return false;
+  }
+  char pid[32] = {0};
+  if (lock.Read(pid, sizeof(pid) - 1) <= 0)
+    return false;
+  // If the process still runs it still is editing the file.
+  return !wxProcess::Exists(std::atoi(pid));
+}
+
+void AutosaveJournal::NewBase(const wxString &wxmxFile,
+                              std::vector<BaseCell> &&cells,
+                              std::unordered_map<wxUint64, size_t> &&hashes,
+                              std::unordered_set<wxString, wxStringHash> &&blobs)
+{
+  Reset();
+  Remove(wxmxFile);
+  wxULongLong size = wxFileName::GetSize(wxmxFile);
+  wxString time = ModificationTime(wxmxFile);
+  if ((size == wxInvalidSize) || time.IsEmpty())
+    return;
+  m_wxmxFile = wxmxFile;
+  m_baseSize = size;
+  m_baseTime = time;
+  m_baseCells = std::move(cells);
+  m_hashes = std::move(hashes);
+  m_blobs = std::move(blobs);
+}
+
+void AutosaveJournal::NewBase(const wxString &wxmxFile)
+{
+  std::unordered_set<wxString, wxStringHash> blobs;
+  {
+    wxFFileInputStream in(wxmxFile);
+    if (!in.IsOk())
+      return;
+    wxZipInputStream zip(in);
+    std::unique_ptr<wxZipEntry> entry;
+    while (entry.reset(zip.GetNextEntry()), entry)
+      if (entry->GetName() != wxT("content.xml"))
+        blobs.insert(entry->GetName());
+  }
+  Reset();
+  wxULongLong size = wxFileName::GetSize(wxmxFile);
+  wxString time = ModificationTime(wxmxFile);
+  if ((size == wxInvalidSize) || time.IsEmpty())
+    return;
+  m_wxmxFile = wxmxFile;
+  m_baseSize = size;
+  m_baseTime = time;
+  m_blobs = std::move(blobs);
+}
+
+void AutosaveJournal::Discard()
+{
+  if (!m_wxmxFile.IsEmpty() && (m_journalSize > 0))
+    Remove(m_wxmxFile);
+  Reset();
+}
+
+void AutosaveJournal::Reset()
+{
+  m_wxmxFile.Clear();
+  m_baseSize = 0;
+  m_baseTime.Clear();
+  m_baseCells.clear();
+  m_hashes.clear();
+  m_blobs.clear();
+  m_header.Clear();
+  m_order.Clear();
+  m_journalSize = 0;
+}
+
+bool AutosaveJournal::CanAppend(const wxString &wxmxFile) const
+{
+  if (m_wxmxFile.IsEmpty() || (wxmxFile != m_wxmxFile))
+    return false;
+  // Has someone else written to the file in the meantime?
+  if (ModificationTime(wxmxFile) != m_baseTime)
+    return false;
+  // Once the journal has grown too big re-writing the .wxmx file is cheaper than
+  // carrying the journal around.
+  return m_journalSize < std::max<wxFileOffset>(4 * 1024 * 1024,
+                                                 m_baseSize.GetValue() / 4);
+}
+
+bool AutosaveJournal::CellChanged(wxUint64 id, size_t hash) const
+{
+  auto cell = m_hashes.find(id);
+  return (cell == m_hashes.end()) || (cell->second != hash);
+}
+
+bool AutosaveJournal::Append(const wxString &header,
+                             const std::vector<OrderEntry> &order,
+                             const std::vector<ChangedCell> &cells,
+                             const std::vector<std::pair<wxString, SharedBlob>> &blobs)
+{
+  wxString orderText;
+  for (auto const &entry : order)
+    orderText << wxString::Format(wxT("%llu %i\n"),
+                                  static_cast<unsigned long long>(entry.id), entry.highlight ? 1 : 0);
+
+  if (cells.empty() && blobs.empty() && (header == m_header) && (orderText == m_order))
+    return true;
+
+  wxString journalName = GetJournalName(m_wxmxFile);
+  wxFile journal;
+  bool newJournal = (m_journalSize == 0);
+  {
+    SuppressErrorDialogs suppressor;
+    if (newJournal)
+      journal.Create(journalName, true);
+    else
+      journal.Open(journalName, wxFile::write_append);
+  }
+  if (!journal.IsOpened())
+  {
+    Reset();
+    return false;
+  }
+
+  // Tell the next wxMaxima that opens the file which process the journal belongs to
+  if (newJournal)
+  {
+    wxFile lock;
+    {
+      SuppressErrorDialogs suppressor;
+      lock.Create(GetLockName(m_wxmxFile), true);
+    }
+    if (!lock.IsOpened() || !lock.Write(wxString::Format(wxT("%lu\n"), wxGetProcessId())))
+    {
+      journal.Close();
+      Remove(m_wxmxFile);
+      Reset();
+      return false;
+    }
+  }
+
+  bool ok = true;
+  if (newJournal)
+  {
+    // The journal starts with the information which part of the .wxmx file's
+    // content.xml belongs to which cell.
+    wxString baseCells;
+    for (auto const &cell : m_baseCells)
+      baseCells << wxString::Format(wxT("%llu %lu %lu\n"),
+                                    static_cast<unsigned long long>(cell.id),
+                                    static_cast<unsigned long>(cell.offset),
+                                    static_cast<unsigned long>(cell.length));
+    ok = (journal.Write(journalMagic, std::strlen(journalMagic)) == std::strlen(journalMagic)) &&
+      (journal.Write("\n", 1) == 1) &&
+      WriteRecord(journal, wxT("base"), m_baseSize.ToString() + wxT(":") + m_baseTime, baseCells);
+  }
+  if (ok && (header != m_header))
+    ok = WriteRecord(journal, wxT("header"), wxT("0"), header);
+  if (ok && (orderText != m_order))
+    ok = WriteRecord(journal, wxT("order"), wxT("0"), orderText);
+  for (auto const &cell : cells)
+    if (ok)
+      ok = WriteRecord(journal, wxT("cell"),
+                       wxString::Format(wxT("%llu"), static_cast<unsigned long long>(cell.id)),
+                       cell.xml);
+  for (auto const &blob : blobs)
+    if (ok)
+      ok = WriteRecord(journal, wxT("blob"), blob.first,
+                       BlobData(blob.second), BlobSize(blob.second));
+  ok = ok && WriteRecord(journal, wxT("commit"), wxT("0"), NULL, 0) && journal.Flush();
+
+  if (!ok)
+  {
+    wxLogMessage(wxString::Format(_("Could not write the autosave journal %s"), journalName.utf8_str()));
+    Reset();
+    return false;
+  }
+
+  m_journalSize = journal.Length();
+  m_header = header;
+  m_order = orderText;
+  for (auto const &cell : cells)
+    m_hashes[cell.id] = cell.hash;
+  for (auto const &blob : blobs)
+    m_blobs.insert(blob.first);
+  return true;
+}
+
+namespace
+{
+//! A record in a journal that has been read into memory
+struct Record
+{
+  std::string type;
+  std::string argument;
+  //! Where in the journal the record's data starts
+  size_t offset = 0;
+  size_t length = 0;
+};
+
+//! Reads the records from a journal
+class JournalReader
+{
+public:
+  explicit JournalReader(const std::string &journal) : m_journal(journal) {}
+
+  bool ReadLine(std::string &line)
+  {
+    size_t end = m_journal.find('\n', m_pos);
+    if (end == std::string::npos)
+      return false;
+    line = m_journal.substr(m_pos, end - m_pos);
+    m_pos = end + 1;
+    return true;
+  }
+
+  //! Reads the next record. Returns false at the end of the journal or if it has been cut off.
+  bool ReadRecord(Record &record)
+  {
+    std::string line;
+    if (!ReadLine(line))
+      return false;
+    size_t first = line.find(' ');
+    size_t last = line.rfind(' ');
+    if ((first == std::string::npos) || (first == last))
+      return false;
+    record.type = line.substr(0, first);
+    record.argument = line.substr(first + 1, last - first - 1);
+    record.length = std::strtoul(line.c_str() + last + 1, NULL, 10);
+    record.offset = m_pos;
+    if ((m_pos + record.length >= m_journal.size()) || (m_journal[m_pos + record.length] != '\n'))
+      return false;
+    m_pos += record.length + 1;
+    return true;
+  }
+
+private:
+  const std::string &m_journal;
+  size_t m_pos = 0;
+};
+}
+
+bool AutosaveJournal::Replay(const wxString &wxmxFile)
+{
+  wxString journalName = GetJournalName(wxmxFile);
+  if (!wxFileExists(journalName) || !wxFileExists(wxmxFile))
+    return false;
+
+  std::string journal;
+  {
+    wxFile file(journalName);
+    if (!file.IsOpened())
+      return false;
+    wxFileOffset length = file.Length();
+    if (length <= 0)
+    {
+      Remove(wxmxFile);
+      return false;
+    }
+    journal.resize(length);
+    if (file.Read(&journal[0], length) != length)
+      return false;
+  }
+
+  JournalReader reader(journal);
+  std::string line;
+  Record record;
+  if (!reader.ReadLine(line) || (line != journalMagic) ||
+      !reader.ReadRecord(record) || (record.type != "base") ||
+      (wxString::FromUTF8(record.argument.c_str()) !=
+       wxFileName::GetSize(wxmxFile).ToString() + wxT(":") + ModificationTime(wxmxFile)))
+  {
+    wxLogMessage(wxString::Format(_("The autosave journal %s doesn't match its .wxmx file and is discarded."), journalName.utf8_str()));
+    Remove(wxmxFile);
+    return false;
+  }
+
+  // The location of the data of a cell or a file: Offset and length
+  typedef std::pair<size_t, size_t> Location;
+  std::unordered_map<wxUint64, Location> baseCells;
+  {
+    const char *pos = journal.c_str() + record.offset;
+    const char *end = pos + record.length;
+    while (pos < end)
+    {
+      char *next;
+      wxUint64 id = std::strtoull(pos, &next, 10);
+      size_t offset = std::strtoul(next, &next, 10);
+      size_t length = std::strtoul(next, &next, 10);
+      if (next == pos)
+        break;
+      baseCells[id] = Location(offset, length);
+      pos = next + 1;
+    }
+  }
+
+  // Apply all changes up to the last commit
+  Location header(0, 0);
+  std::vector<OrderEntry> order;
+  std::unordered_map<wxUint64, Location> journalCells;
+  std::unordered_map<std::string, Location> blobs;
+  std::vector<Record> pending;
+  bool committed = false;
+  while (reader.ReadRecord(record))
+  {
+    if (record.type != "commit")
+    {
+      pending.push_back(record);
+      continue;
+    }
+    for (auto const &change : pending)
+    {
+      Location data(change.offset, change.length);
+      if (change.type == "header")
+        header = data;
+      else if (change.type == "order")
+      {
+        order.clear();
+        const char *pos = journal.c_str() + change.offset;
+        const char *end = pos + change.length;
+        while (pos < end)
+        {
+          char *next;
+          wxUint64 id = std::strtoull(pos, &next, 10);
+          bool highlight = std::strtol(next, &next, 10) != 0;
+          if (next == pos)
+            break;
+          order.push_back({id, highlight});
+          pos = next + 1;
+        }
+      }
+      else if (change.type == "cell")
+        journalCells[std::strtoull(change.argument.c_str(), NULL, 10)] = data;
+      else if (change.type == "blob")
+        blobs[change.argument] = data;
+    }
+    pending.clear();
+    committed = true;
+  }
+  if (!committed || (header.second == 0))
+  {
+    Remove(wxmxFile);
+    return false;
+  }
+
+  wxLogMessage(wxString::Format(_("Replaying the autosave journal %s"), journalName.utf8_str()));
+
+  // Read the content.xml of the .wxmx file
+  std::string content;
+  {
+    wxFFileInputStream in(wxmxFile);
+    wxZipInputStream zip(in);
+    std::unique_ptr<wxZipEntry> entry;
+    while (entry.reset(zip.GetNextEntry()), entry)
+    {
+      if (entry->GetName() == wxT("content.xml"))
+      {
+        char buf[65536];
+        while (zip.Read(buf, sizeof(buf)).LastRead() > 0)
+          content.append(buf, zip.LastRead());
+        break;
+      }
+    }
+  }
+
+  // Write a new .wxmx file that contains the changes
+  wxString backupfile = wxmxFile + wxT("~");
+  {
+    wxFFileInputStream in(wxmxFile);
+    wxZipInputStream inZip(in);
+    wxFFileOutputStream out(backupfile);
+    if (!in.IsOk() || !out.IsOk())
+      return false;
+    wxZipOutputStream outZip(out);
+    outZip.SetLevel(0);
+
+    auto writeContent = [&]() {
+      outZip.PutNextEntry(wxT("content.xml"));
+      outZip.Write(journal.data() + header.first, header.second);
+      bool highlight = false;
+      for (auto const &entry : order)
+      {
+        if (entry.highlight != highlight)
+        {
+          outZip.Write(entry.highlight ? "<hl>\n" : "</hl>\n", entry.highlight ? 5 : 6);
+          highlight = entry.highlight;
+        }
+        auto changed = journalCells.find(entry.id);
+        if (changed != journalCells.end())
+          outZip.Write(journal.data() + changed->second.first, changed->second.second);
+        else
+        {
+          auto unchanged = baseCells.find(entry.id);
+          if ((unchanged != baseCells.end()) &&
+              (unchanged->second.first + unchanged->second.second <= content.size()))
+            outZip.Write(content.data() + unchanged->second.first, unchanged->second.second);
+        }
+      }
+      if (highlight)
+        outZip.Write("</hl>\n", 6);
+      outZip.Write("\n</wxMaximaDocument>", 20);
+    };
+
+    bool contentWritten = false;
+    wxZipEntry *entry;
+    while ((entry = inZip.GetNextEntry()) != NULL)
+    {
+      if (entry->GetName() == wxT("content.xml"))
+      {
+        delete entry;
+        writeContent();
+        contentWritten = true;
+      }
+      else if (blobs.count(std::string(entry->GetName().utf8_str())) > 0)
+        delete entry;
+      else
+        outZip.CopyEntry(entry, inZip);
+    }
+    if (!contentWritten)
+      writeContent();
+
+    for (auto const &blob : blobs)
+    {
+      wxString name = wxString::FromUTF8(blob.first.c_str());
+      // Gnuplot data is stored compressed, like ExportToWXMX does.
+      outZip.SetLevel(name.EndsWith(wxT(".data")) ? 9 : 0);
+      outZip.PutNextEntry(name);
+      outZip.Write(journal.data() + blob.second.first, blob.second.second);
+    }
+    if (!outZip.Close() || !out.Close())
+      return false;
+  }
+
+  {
+    SuppressErrorDialogs suppressor;
+    if (!wxRenameFile(backupfile, wxmxFile, true))
+      return false;
+  }
+  Remove(wxmxFile);
+  return true;
+}
@@ -0,0 +1,175 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file declares the class AutosaveJournal
+
+  AutosaveJournal records the changes to a worksheet since it was last saved
+  as .wxmx file in a small file next to the .wxmx file.
+*/
+
+#ifndef AUTOSAVEJOURNAL_H
+#define AUTOSAVEJOURNAL_H
+
+#include "SharedBlob.h"
+#include <wx/string.h>
+#include <wx/filefn.h>
+#include <wx/hashmap.h>
+#include <wx/longlong.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/*! An append-only log of the changes made to a worksheet since its last full save
+
+  Writing a complete .wxmx file on every autosave means re-writing every image
+  the worksheet contains. Instead only the XML code of the GroupCells that have
+  changed since the last autosave, the files they reference and the current
+  order of the cells is appended to a journal named like the .wxmx file plus
+  ".journal". Cells are identified by GroupCell::GetId().
+
+  The journal consists of records of the form "type argument length\n", followed
+  by length bytes of data and a newline. Changes only become valid when they are
+  followed by a "commit" record, so a journal that has been cut off by a crash
+  still can be replayed up to its last complete autosave. Replay() merges the
+  journal into its .wxmx file.
+
+  While a journal exists a lock file next to it contains the id of the process
+  that writes it. A journal is deleted when its worksheet is saved or closed,
+  which means that a journal whose process doesn't run any more has been left
+  behind by a crash.
+ */
+class AutosaveJournal final
+{
+public:
+  //! The position of a cell in the .wxmx file the journal is based on
+  struct BaseCell
+  {
+    wxUint64 id;
+    //! The offset of the cell's XML code within content.xml
+    size_t offset;
+    //! The length of the cell's XML code in bytes
+    size_t length;
+  };
+  //! A cell and whether it is highlighted
+  struct OrderEntry
+  {
+    wxUint64 id;
+    bool highlight;
+  };
+  //! A cell whose XML code has changed
+  struct ChangedCell
+  {
+    wxUint64 id;
+    //! The hash of xml
+    size_t hash;
+    wxString xml;
+  };
+
+  //! Returns the name of the journal that belongs to a .wxmx file
+  static wxString GetJournalName(const wxString &wxmxFile);
+  //! Returns the name of the lock file of the journal that belongs to a .wxmx file
+  static wxString GetLockName(const wxString &wxmxFile);
+  //! Deletes the journal that belongs to a .wxmx file and its lock, if there is one
+  static void Remove(const wxString &wxmxFile);
+  //! Has the process that wrote the journal of a .wxmx file crashed?
+  static bool CrashDetected(const wxString &wxmxFile);
+  /*! Merges the journal into the .wxmx file it belongs to
+
+    \return true, if the .wxmx file has been updated. Journals that don't match
+    the .wxmx file or that don't contain a complete autosave are discarded.
+   */
+  static bool Replay(const wxString &wxmxFile);
+
+  /*! Tell the journal that a .wxmx file has just been written completely
+
+    Discards an eventual journal for this file: The file now contains all
+    changes the journal has recorded.
+
+    \param wxmxFile The file that was written
+    \param cells Where content.xml contains the XML code of each cell
+    \param hashes A hash of each cell's XML code
+    \param blobs The names of the images and gnuplot files the file contains
+   */
+  void NewBase(const wxString &wxmxFile,
+               std::vector<BaseCell> &&cells,
+               std::unordered_map<wxUint64, size_t> &&hashes,
+               std::unordered_set<wxString, wxStringHash> &&blobs);
+  /*! Tell the journal that a .wxmx file has just been opened
+
+    The first Append() writes all cells to the journal, as it isn't known where
+    the file contains which cell. The images and gnuplot files the file
+    contains don't need to be written again, though.
+   */
+  void NewBase(const wxString &wxmxFile);
+  //! Forget the .wxmx file the journal is based on
+  void Reset();
+  //! Deletes the journal, as its changes have been discarded
+  void Discard();
+
+  /*! Can changes to this file be recorded in the journal?
+
+    false means that there isn't an up-to-date .wxmx file, or that the journal
+    has grown so big that it is time for writing a complete .wxmx file.
+   */
+  bool CanAppend(const wxString &wxmxFile) const;
+  //! Does the cell with this id and hash need to be written to the journal?
+  bool CellChanged(wxUint64 id, size_t hash) const;
+  //! Has the file named name been written to the .wxmx file or the journal?
+  bool HasBlob(const wxString &name) const { return m_blobs.count(name) > 0; }
+
+  /*! Append an autosave to the journal
+
+    \param header The XML code content.xml starts with
+    \param order The cells the worksheet contains, in order
+    \param cells The cells that have changed
+    \param blobs The images and gnuplot files that aren't in the journal, yet
+    \return false if the journal couldn't be written. In this case the journal
+            will accept no more changes until the next NewBase().
+   */
+  bool Append(const wxString &header,
+              const std::vector<OrderEntry> &order,
+              const std::vector<ChangedCell> &cells,
+              const std::vector<std::pair<wxString, SharedBlob>> &blobs);
+
+private:
+  //! The .wxmx file the journal is based on. Empty = none.
+  wxString m_wxmxFile;
+  //! The size of m_wxmxFile right after it was written
+  wxULongLong m_baseSize = 0;
+  //! The modification time of m_wxmxFile right after it was written
+  wxString m_baseTime;
+  //! The cells of m_wxmxFile. Written to the journal by the first Append().
+  std::vector<BaseCell> m_baseCells;
+  //! The hash of the XML code of each cell in the .wxmx file or the journal
+  std::unordered_map<wxUint64, size_t> m_hashes;
+  //! The files that are stored in the .wxmx file or the journal
+  std::unordered_set<wxString, wxStringHash> m_blobs;
+  //! The last header written to the journal
+  wxString m_header;
+  //! The last cell order written to the journal
+  wxString m_order;
+  //! The size of the journal
+  wxFileOffset m_journalSize = 0;
+};
+
+#endif // AUTOSAVEJOURNAL_H
@@ -125,6 +125,15 @@ void BitmapOut::Draw()
 }
 
 wxSize BitmapOut::ToFile(const wxString &file)
+{
+  wxImage img = ToImage();
+  if (SaveImage(img, file))
+    return m_cmn.GetScaledSize();
+  else
+    return wxDefaultSize;
+}
+
+wxImage BitmapOut::ToImage() const
 {
   // Assign a resolution to the bitmap.
   wxImage img = m_bmp.ConvertToImage();
@@ -132,26 +141,24 @@ wxSize BitmapOut::ToFile(const wxString &file)
   if (resolution <= 0)
     resolution = 75;
   img.SetOption(wxIMAGE_OPTION_RESOLUTION, resolution * m_cmn.GetScale());
+  return img;
+}
 
-  bool success = false;
+bool BitmapOut::SaveImage(wxImage &img, const wxString &file)
+{
   if (file.EndsWith(wxT(".bmp")))
-    success = img.SaveFile(file, wxBITMAP_TYPE_BMP);
+    return img.SaveFile(file, wxBITMAP_TYPE_BMP);
   else if (file.EndsWith(wxT(".xpm")))
-    success = img.SaveFile(file, wxBITMAP_TYPE_XPM);
+    return img.SaveFile(file, wxBITMAP_TYPE_XPM);
   else if (file.EndsWith(wxT(".jpg")))
-    success = img.SaveFile(file, wxBITMAP_TYPE_JPEG);
+    return img.SaveFile(file, wxBITMAP_TYPE_JPEG);
   else
   {
     if (file.EndsWith(wxT(".png")))
-      success = img.SaveFile(file, wxBITMAP_TYPE_PNG);
+      return img.SaveFile(file, wxBITMAP_TYPE_PNG);
     else
-      success = img.SaveFile(file + wxT(".png"), wxBITMAP_TYPE_PNG);
+      return img.SaveFile(file + wxT(".png"), wxBITMAP_TYPE_PNG);
   }
-
-  if (success)
-    return m_cmn.GetScaledSize();
-  else
-    return wxDefaultSize;
 }
 
 std::unique_ptr<wxBitmapDataObject> BitmapOut::GetDataObject() const
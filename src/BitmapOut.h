@@ -70,6 +70,17 @@ public:
    */
   wxSize ToFile(const wxString &file);
 
+  /*! Converts the bitmap to an image that knows its resolution
+
+    Needs the GUI. Writing the image using SaveImage() doesn't, which means
+    that the time-consuming part of ToFile() can be done in a background task.
+   */
+  wxImage ToImage() const;
+  //! Writes an image returned by ToImage() to a file. The file type depends on the extension.
+  static bool SaveImage(wxImage &image, const wxString &file);
+  //! The size ToFile() returns if it succeeds
+  wxSize GetScaledSize() const { return m_cmn.GetScaledSize(); }
+
   //! Returns the bitmap representation of the list of cells that was passed to SetData()
   wxBitmap GetBitmap() const { return m_bmp; }
 
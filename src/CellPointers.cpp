@@ -24,6 +24,7 @@
 #include "CellPointers.h"
 #include "GroupCell.h"
 #include <algorithm>
+#include <cstring>
 #include <iterator>
 
 CellPointers::CellPointers(wxScrolledCanvas *worksheet) :
@@ -37,6 +38,36 @@ wxString CellPointers::WXMXGetNewFileName()
   return file;
 }
 
+wxString CellPointers::WXMXStoreBlob(const SharedBlob &data,
+                                     const wxString &prefix, const wxString &extension)
+{
+  // A 64-bit FNV-1a hash of the data
+  wxUint64 hash = 14695981039346656037ULL;
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(BlobData(data));
+  for (size_t i = 0; i < BlobSize(data); i++)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+
+  wxString basename = prefix + wxString::Format(wxT("_%016llx"), (unsigned long long) hash);
+  wxString name = basename + wxT(".") + extension;
+
+  // In the unlikely case of a hash collision we append a counter to the name.
+  int collisions = 0;
+  for (auto stored = m_wxmxBlobs.find(name); stored != m_wxmxBlobs.end(); stored = m_wxmxBlobs.find(name))
+  {
+    if ((stored->second == data) ||
+        ((BlobSize(stored->second) == BlobSize(data)) &&
+         (std::memcmp(BlobData(stored->second), BlobData(data), BlobSize(data)) == 0)))
+      return name;
+    name = basename + wxString::Format(wxT("_%i."), ++collisions) + extension;
+  }
+
+  m_wxmxBlobs[name] = data;
+  return name;
+}
+
 void CellPointers::SetTimerIdForCell(Cell *const cell, int const timerId)
 {
   auto match = std::find_if(m_timerIds.begin(), m_timerIds.end(),
@@ -25,7 +25,9 @@
 #define WXMAXIMA_CELLPOINTERS_H
 
 #include "Cell.h"
+#include "SharedBlob.h"
 #include <wx/string.h>
+#include <unordered_map>
 #include <vector>
 
 class wxWindow;
@@ -57,12 +59,29 @@ public:
   //! Sets the cell maxima currently works on. NULL if there isn't such a cell.
   void SetWorkingGroup(GroupCell *group);
 
-  void WXMXResetCounter() { m_wxmxImgCounter = 0; }
+  void WXMXResetCounter() { m_wxmxImgCounter = 0; m_wxmxBlobs.clear(); }
 
   wxString WXMXGetNewFileName();
 
+  /*! Stores data in the .wxmx file that is currently being written
+
+    The file name is derived from a hash of the data, which means that identical
+    images or gnuplot files that are referenced by several cells are stored only
+    once. The data isn't copied: WXMXBlobs() shares it with the cells.
+
+    \param data The contents of the file
+    \param prefix The start of the file name
+    \param extension The file name extension, without the dot
+    \return The name the data is stored as
+  */
+  wxString WXMXStoreBlob(const SharedBlob &data, const wxString &prefix, const wxString &extension);
+
   int WXMXImageCount() const { return m_wxmxImgCounter; }
 
+  //! The files WXMXStoreBlob() has stored since the last WXMXResetCounter()
+  const std::unordered_map<wxString, SharedBlob, wxStringHash> &WXMXBlobs() const
+  { return m_wxmxBlobs; }
+
   bool HasCellsSelected() const { return m_selectionStart && m_selectionEnd; }
 
   //! A list of editor cells containing error messages.
@@ -109,6 +128,8 @@ public:
   CellPtr<GroupCell> m_lastWorkingGroup;
   //! The textcell the text maxima is sending us was ending in.
   CellPtr<TextCell> m_currentTextCell;
+  //! The EditorCells whose text a background task is tokenizing
+  std::vector<CellPtr<EditorCell>> m_cellsBeingStyled;
   /*! The group cell maxima is currently working on.
 
     NULL means that maxima isn't currently evaluating a cell.
@@ -189,6 +210,8 @@ private:
   wxScrolledCanvas *const m_worksheet;
   //! The image counter for saving .wxmx files
   int m_wxmxImgCounter = 0;
+  //! The files that have already been stored in the .wxmx file we are writing
+  std::unordered_map<wxString, SharedBlob, wxStringHash> m_wxmxBlobs;
 public:
   //! Is scrolling to a cell scheduled?
   bool m_scrollToCell = false;
@@ -24,8 +24,8 @@
 
 const Observed::ControlBlock Observed::ControlBlock::empty{nullptr};
 
-size_t Observed::m_instanceCount;
-size_t CellPtrBase::m_instanceCount;
+std::atomic<size_t> Observed::m_instanceCount;
+std::atomic<size_t> CellPtrBase::m_instanceCount;
 
 // This is a specialization of this method. It's useful when GroupCell
 // is not a fully defined class, but someone wants to use the methods of
@@ -34,6 +34,7 @@
 
 #include <wx/debug.h>
 #include <wx/log.h>
+#include <atomic>
 #include <memory>
 #include <type_traits>
 #include <cstddef>
@@ -57,7 +58,7 @@ class Observed
 {
   friend class CellPtrBase;
 
-  static size_t m_instanceCount;
+  static std::atomic<size_t> m_instanceCount;
 
   class ControlBlock final
   {
@@ -85,6 +86,10 @@ class Observed
     }
     //! References the control block.
     const ControlBlock *Ref(const CellPtrBase *cellptr) const {
+      // The empty block is never deleted, so it needs no reference count. Not
+      // touching it allows cells to be created by several threads at once.
+      if (this == &empty)
+        return this;
       if (CELLPTR_LOG_REFS)
         wxLogMessage("%p CB::Ref (%d->%d) cb=%p obj=%p", cellptr, m_refCount, m_refCount+1, this, m_object);
       else
@@ -105,6 +110,8 @@ class Observed
     //! or its address if the block should be deleted.
     const ControlBlock *Deref(const CellPtrBase *cellptr) const
     {
+      if (this == &empty)
+        return nullptr;
       if (CELLPTR_LOG_REFS)
         wxLogMessage("%p CB::Deref (%d->%d) cb=%p obj=%p", cellptr, m_refCount, m_refCount-1, this, m_object);
       else
@@ -143,7 +150,7 @@ class CellPtrBase
 {
 private:
   using ControlBlock = Observed::ControlBlock;
-  static size_t m_instanceCount;
+  static std::atomic<size_t> m_instanceCount;
 
   const ControlBlock *m_cb = nullptr;
 
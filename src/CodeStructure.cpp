@@ -0,0 +1,396 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file defines the class CodeStructure
+
+  CodeStructure knows which brackets and quotes of a piece of maxima code
+  belong together and whether the code is complete enough to be sent to maxima.
+*/
+
+#include "CodeStructure.h"
+#include <algorithm>
+#include <iterator>
+
+constexpr size_t CodeStructure::checkpointInterval;
+
+void CodeStructure::Clear()
+{
+  m_delimiters.clear();
+  m_checkpoints.clear();
+  m_tokens = 0;
+  m_error = Error::none;
+  m_errorIndex = 0;
+  m_endingNeeded = false;
+  m_lastChar = 0;
+}
+
+void CodeStructure::SetError(State &state, Error error, size_t index)
+{
+  if (state.error != Error::none)
+    return;
+  state.error = error;
+  state.errorIndex = index;
+}
+
+void CodeStructure::Build(const MaximaTokenizer::TokenList &tokens)
+{
+  Clear();
+  State state;
+  while (state.token < tokens.size())
+  {
+    if (state.token % checkpointInterval == 0)
+    {
+      state.delimiters = m_delimiters.size();
+      m_checkpoints.push_back(state);
+    }
+    Step(tokens[state.token], state, m_delimiters, 0);
+  }
+  Finish(tokens, state);
+}
+
+void CodeStructure::Step(const MaximaTokenizer::Token &tok, State &state,
+                         std::vector<Delimiter> &delimiters, size_t base)
+{
+  auto &itemText = tok.GetText();
+  const TextStyle itemStyle = tok.GetStyle();
+  const size_t start = state.pos;
+  state.pos += itemText.Length();
+  state.token++;
+  const size_t pos = state.pos;
+  if (itemText.IsEmpty())
+    return;
+
+  const wxChar lastNonWhitespace = state.lastNonWhitespace;
+
+  wxChar firstC = itemText[0];
+  wxChar lastC = itemText.Last();
+  const bool isWhitespace =
+    (firstC == ' ') || (firstC == '\t') || (firstC == '\r') || (firstC == '\n');
+
+  if (itemStyle == TS_CODE_COMMENT)
+  {
+    if (!itemText.EndsWith("*/"))
+      SetError(state, Error::unterminatedComment, pos);
+    return;
+  }
+
+  // Remember the last non-whitespace character that isn't part of a comment.
+  if (!isWhitespace)
+    state.lastNonWhitespace = lastC;
+
+  if (itemStyle == TS_CODE_STRING)
+  {
+    state.endingNeeded = true;
+    if (!itemText.EndsWith("\""))
+      SetError(state, Error::unterminatedString, pos);
+    if ((itemText.Length() > 1) && itemText.EndsWith("\""))
+    {
+      delimiters.push_back({start, long(pos - 1), true});
+      delimiters.push_back({pos - 1, long(start), true});
+    }
+    else
+      delimiters.push_back({start, -1, true});
+    return;
+  }
+
+  if (itemText.Length() == 1)
+  {
+    std::vector<size_t> *open = nullptr;
+    wxChar closing = wxT(' ');
+    switch (firstC)
+    {
+    case '(': case ')':
+      open = &state.openParens;
+      closing = wxT(')');
+      break;
+    case '[': case ']':
+      open = &state.openBrackets;
+      closing = wxT(']');
+      break;
+    case '{': case '}':
+      open = &state.openBraces;
+      closing = wxT('}');
+      break;
+    }
+
+    if (open && (firstC != closing))
+    {
+      open->push_back(base + delimiters.size());
+      delimiters.push_back({start, -1, false});
+      state.closing.push_back(closing);
+      return;
+    }
+
+    if (open)
+    {
+      state.endingNeeded = true;
+      if (!open->empty())
+      {
+        Delimiter &opening = (open->back() < base) ?
+          m_delimiters[open->back()] : delimiters[open->back() - base];
+        opening.partner = start;
+        delimiters.push_back({start, long(opening.pos), false});
+        open->pop_back();
+      }
+      else
+        delimiters.push_back({start, -1, false});
+
+      if (state.closing.empty() || (firstC != state.closing.back()))
+        SetError(state, Error::mismatchedParenthesis, pos);
+      else
+        state.closing.pop_back();
+      if (lastNonWhitespace == wxT(','))
+        SetError(state, Error::commaBeforeClosingParenthesis, pos);
+      return;
+    }
+  }
+
+  if (itemStyle == TS_CODE_ENDOFLINE)
+  {
+    if (!state.closing.empty())
+      SetError(state, Error::unclosedParenthesisAtEnding, pos);
+    state.endingNeeded = false;
+    return;
+  }
+
+  if (itemStyle == TS_CODE_LISP)
+    state.endingNeeded = false;
+}
+
+void CodeStructure::Finish(const MaximaTokenizer::TokenList &tokens, State &state)
+{
+  if (!state.closing.empty())
+    SetError(state, Error::unclosedParenthesis, state.pos);
+  m_tokens = tokens.size();
+  m_error = state.error;
+  m_errorIndex = state.errorIndex;
+  m_endingNeeded = state.endingNeeded;
+  m_lastChar = LastChar(tokens);
+}
+
+wxChar CodeStructure::LastChar(const MaximaTokenizer::TokenList &tokens)
+{
+  for (auto tok = tokens.rbegin(); tok != tokens.rend(); ++tok)
+  {
+    auto &itemText = tok->GetText();
+    if (itemText.IsEmpty())
+      continue;
+    wxChar firstC = itemText[0];
+    if ((firstC != ' ') && (firstC != '\t') && (firstC != '\r') && (firstC != '\n'))
+      return itemText.Last();
+  }
+  return 0;
+}
+
+template <typename T>
+void CodeStructure::ReplaceRange(std::vector<T> &vector, size_t start, size_t end,
+                                 std::vector<T> &&replacement)
+{
+  // Overwrite what we can and move the rest of the vector only once
+  const size_t common = std::min(end - start, replacement.size());
+  std::move(replacement.begin(), replacement.begin() + common, vector.begin() + start);
+  if (common < end - start)
+    vector.erase(vector.begin() + start + common, vector.begin() + end);
+  else
+    vector.insert(vector.begin() + end, std::make_move_iterator(replacement.begin() + common),
+                  std::make_move_iterator(replacement.end()));
+}
+
+void CodeStructure::Update(const MaximaTokenizer::TokenList &tokens, size_t firstToken,
+                           const MaximaTokenizer::TokenList &oldTokens, size_t newTokens)
+{
+  if (oldTokens.empty() && (newTokens == 0))
+    return;
+  // Without an analysis of the code before the edit we need to start from scratch
+  if (m_checkpoints.empty() || (m_tokens + newTokens != tokens.size() + oldTokens.size()) ||
+      (firstToken + newTokens > tokens.size()))
+  {
+    Build(tokens);
+    return;
+  }
+
+  // The change of the length of the code and of the number of tokens
+  size_t oldLength = 0, newLength = 0;
+  for (auto const &tok : oldTokens)
+    oldLength += tok.GetText().Length();
+  for (size_t i = firstToken; i < firstToken + newTokens; i++)
+    newLength += tokens[i].GetText().Length();
+  const long delta = long(newLength) - long(oldLength);
+  const long tokenDelta = long(newTokens) - long(oldTokens.size());
+
+  // Restart at the last checkpoint in front of the edit
+  const size_t restart = std::upper_bound(
+    m_checkpoints.begin(), m_checkpoints.end(), firstToken,
+    [](size_t token, const State &state){ return token < state.token; }) -
+    m_checkpoints.begin() - 1;
+  State state = m_checkpoints[restart];
+  size_t changeStart = state.pos;
+  for (size_t i = state.token; i < firstToken; i++)
+    changeStart += tokens[i].GetText().Length();
+  // Where a position in front of the edit or behind it is now
+  auto newPos = [changeStart, delta](size_t pos) {
+    return (pos <= changeStart) ? pos : size_t(long(pos) + delta);
+  };
+
+  // The delimiters and checkpoints behind the restart are collected here, at
+  // first. The brackets that were open at the restart will find their partners
+  // there.
+  const size_t base = state.delimiters;
+  std::vector<Delimiter> delimiters;
+  std::vector<State> checkpoints;
+  for (auto const *open : {&state.openParens, &state.openBrackets, &state.openBraces})
+    for (auto index : *open)
+      m_delimiters[index].partner = -1;
+
+  size_t oldCheckpoint = restart + 1;
+  while (state.token < tokens.size())
+  {
+    if (state.token >= firstToken + newTokens)
+    {
+      // Behind the edit: Have we arrived at a checkpoint in the same state?
+      size_t oldToken = size_t(long(state.token) - tokenDelta);
+      while ((oldCheckpoint < m_checkpoints.size()) &&
+             (m_checkpoints[oldCheckpoint].token < oldToken))
+        ++oldCheckpoint;
+      if (oldCheckpoint < m_checkpoints.size())
+      {
+        const State &old = m_checkpoints[oldCheckpoint];
+        if ((old.token == oldToken) &&
+            (old.openParens.size() == state.openParens.size()) &&
+            (old.openBrackets.size() == state.openBrackets.size()) &&
+            (old.openBraces.size() == state.openBraces.size()) &&
+            (old.closing == state.closing) &&
+            (old.endingNeeded == state.endingNeeded) &&
+            (old.lastNonWhitespace == state.lastNonWhitespace) &&
+            (old.error == state.error) &&
+            ((state.error == Error::none) || (newPos(old.errorIndex) == state.errorIndex)))
+          break;
+      }
+    }
+    const size_t lastCheckpoint = checkpoints.empty() ?
+      m_checkpoints[restart].token : checkpoints.back().token;
+    if (state.token >= lastCheckpoint + checkpointInterval)
+    {
+      state.delimiters = base + delimiters.size();
+      checkpoints.push_back(state);
+    }
+    Step(tokens[state.token], state, delimiters, base);
+  }
+
+  if (state.token >= tokens.size())
+  {
+    // Arrived at the end of the code without finding a checkpoint to stop at
+    m_delimiters.resize(base);
+    m_delimiters.insert(m_delimiters.end(), std::make_move_iterator(delimiters.begin()),
+                        std::make_move_iterator(delimiters.end()));
+    m_checkpoints.resize(restart + 1);
+    m_checkpoints.insert(m_checkpoints.end(), std::make_move_iterator(checkpoints.begin()),
+                         std::make_move_iterator(checkpoints.end()));
+    Finish(tokens, state);
+    return;
+  }
+
+  // The brackets that are open at the checkpoint are in the same places of the
+  // stacks as before, but may be different ones.
+  const State &converged = m_checkpoints[oldCheckpoint];
+  std::vector<std::pair<size_t, size_t>> openers;
+  for (auto const &stacks : {std::make_pair(&converged.openParens, &state.openParens),
+                             std::make_pair(&converged.openBrackets, &state.openBrackets),
+                             std::make_pair(&converged.openBraces, &state.openBraces)})
+    for (size_t i = 0; i < stacks.first->size(); i++)
+      openers.emplace_back((*stacks.first)[i], (*stacks.second)[i]);
+  auto opening = [&](size_t index) -> Delimiter & {
+    return (index < base) ? m_delimiters[index] : delimiters[index - base];
+  };
+
+  // The rest of the delimiters only have moved, unless they close a bracket
+  // that is open at the checkpoint.
+  const size_t convergedPos = converged.pos;
+  const size_t convergedDelimiters = converged.delimiters;
+  const long indexDelta = long(base + delimiters.size()) - long(convergedDelimiters);
+  for (size_t i = convergedDelimiters; i < m_delimiters.size(); i++)
+  {
+    Delimiter &delimiter = m_delimiters[i];
+    if ((delimiter.partner >= 0) && (size_t(delimiter.partner) < convergedPos))
+    {
+      for (auto const &opener : openers)
+        if (m_delimiters[opener.first].pos == size_t(delimiter.partner))
+        {
+          delimiter.partner = opening(opener.second).pos;
+          opening(opener.second).partner = long(delimiter.pos) + delta;
+          break;
+        }
+    }
+    else if (delimiter.partner >= 0)
+      delimiter.partner += delta;
+    delimiter.pos = size_t(long(delimiter.pos) + delta);
+  }
+
+  for (size_t i = oldCheckpoint + 1; i < m_checkpoints.size(); i++)
+  {
+    State &checkpoint = m_checkpoints[i];
+    checkpoint.token = size_t(long(checkpoint.token) + tokenDelta);
+    checkpoint.pos = size_t(long(checkpoint.pos) + delta);
+    for (auto *open : {&checkpoint.openParens, &checkpoint.openBrackets, &checkpoint.openBraces})
+      for (auto &index : *open)
+      {
+        if (index >= convergedDelimiters)
+          index = size_t(long(index) + indexDelta);
+        else
+          for (auto const &opener : openers)
+            if (opener.first == index)
+            {
+              index = opener.second;
+              break;
+            }
+      }
+    checkpoint.delimiters = size_t(long(checkpoint.delimiters) + indexDelta);
+    if (checkpoint.error != Error::none)
+      checkpoint.errorIndex = newPos(checkpoint.errorIndex);
+  }
+
+  // The state we have arrived in replaces the checkpoint: It knows which
+  // brackets are open now.
+  state.delimiters = base + delimiters.size();
+  if ((checkpoints.empty() ? m_checkpoints[restart].token : checkpoints.back().token) < state.token)
+    checkpoints.push_back(std::move(state));
+  ReplaceRange(m_delimiters, base, convergedDelimiters, std::move(delimiters));
+  ReplaceRange(m_checkpoints, restart + 1, oldCheckpoint + 1, std::move(checkpoints));
+
+  // The rest of the code still contains the same first error, if it contains one.
+  m_tokens = tokens.size();
+  if (m_error != Error::none)
+    m_errorIndex = newPos(m_errorIndex);
+  m_lastChar = LastChar(tokens);
+}
+
+const CodeStructure::Delimiter *CodeStructure::Find(long pos) const
+{
+  if (pos < 0)
+    return nullptr;
+  auto delimiter = std::lower_bound(
+    m_delimiters.begin(), m_delimiters.end(), size_t(pos),
+    [](const Delimiter &delimiter, size_t pos){ return delimiter.pos < pos; });
+  if ((delimiter == m_delimiters.end()) || (delimiter->pos != size_t(pos)))
+    return nullptr;
+  return &*delimiter;
+}
@@ -0,0 +1,157 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file declares the class CodeStructure
+
+  CodeStructure knows which brackets and quotes of a piece of maxima code
+  belong together and whether the code is complete enough to be sent to maxima.
+*/
+
+#ifndef CODESTRUCTURE_H
+#define CODESTRUCTURE_H
+
+#include "MaximaTokenizer.h"
+#include <vector>
+
+/*! The brackets, strings and syntax errors of a piece of maxima code
+
+  Is built from the tokens MaximaTokenizer has split the code into, which means
+  that brackets and quotes within strings and comments are ignored. Afterwards
+  the partner of a bracket or a quote can be looked up by a binary search.
+
+  Every few tokens the state of the analysis is remembered. After an edit
+  Update() restarts the analysis at the last of these checkpoints in front of
+  the tokens that have changed and stops as soon as it arrives at a checkpoint
+  behind them in the same state as before: From there on the rest of the code
+  will be analyzed the same way as before, only at a different position.
+ */
+class CodeStructure final
+{
+public:
+  //! The errors that make maxima refuse a command
+  enum class Error
+  {
+    none,
+    unterminatedComment,
+    mismatchedParenthesis,
+    commaBeforeClosingParenthesis,
+    unterminatedString,
+    unclosedParenthesisAtEnding,
+    unclosedParenthesis
+  };
+
+  //! A bracket or a quote that starts or ends a string
+  struct Delimiter
+  {
+    //! The index of the char within the code
+    size_t pos;
+    //! The index of the char this one belongs to, or -1, if there is none
+    long partner;
+    bool isQuote;
+  };
+
+  //! Analyzes the tokens a piece of code has been split into
+  void Build(const MaximaTokenizer::TokenList &tokens);
+  /*! Analyzes the tokens that have replaced some of the tokens of the last Build()
+
+    \param tokens All tokens of the edited code
+    \param firstToken The index of the first token that has been replaced
+    \param oldTokens The tokens that have been replaced
+    \param newTokens The number of tokens that have replaced them
+  */
+  void Update(const MaximaTokenizer::TokenList &tokens, size_t firstToken,
+              const MaximaTokenizer::TokenList &oldTokens, size_t newTokens);
+  void Clear();
+
+  //! The bracket or quote at the index pos, or nullptr, if there is none
+  const Delimiter *Find(long pos) const;
+
+  //! The first error the code contains
+  Error GetError() const { return m_error; }
+  //! The index of the char behind the token that contains the first error
+  size_t GetErrorIndex() const { return m_errorIndex; }
+  //! Does the code need a ";" or a "$" at its end?
+  bool EndingNeeded() const { return m_endingNeeded; }
+  //! Does the code consist of nothing but whitespace?
+  bool IsEmpty() const { return m_lastChar == 0; }
+  //! Is the last char that isn't whitespace a backslash?
+  bool EndsInBackslash() const { return m_lastChar == wxT('\\'); }
+
+  //! The number of tokens between two checkpoints Update() can restart at
+  static constexpr size_t checkpointInterval = 256;
+
+private:
+  //! The state of the analysis in front of a token
+  struct State
+  {
+    //! The index of the token
+    size_t token = 0;
+    //! The index of the token's first char
+    size_t pos = 0;
+    //! The number of delimiters in front of the token
+    size_t delimiters = 0;
+    //! The indices of the brackets that are still open. For highlighting each
+    //! kind of bracket is matched separately, which keeps "(]" from spoiling
+    //! all brackets that follow.
+    std::vector<size_t> openParens, openBrackets, openBraces;
+    //! The closing brackets the code needs, in order
+    std::vector<wxChar> closing;
+    bool endingNeeded = true;
+    //! The last char that isn't whitespace or part of a comment
+    wxChar lastNonWhitespace = wxT(' ');
+    //! The first error that has been found
+    Error error = Error::none;
+    size_t errorIndex = 0;
+  };
+
+  //! Remembers the first error that has been found
+  static void SetError(State &state, Error error, size_t index);
+  /*! Analyzes the token in front of which state has been taken
+
+    \param delimiters Receives the brackets and quotes the token contains
+    \param base The index the first of the delimiters will have in m_delimiters
+  */
+  void Step(const MaximaTokenizer::Token &token, State &state,
+            std::vector<Delimiter> &delimiters, size_t base);
+  //! Replaces the elements start...end-1 of a vector
+  template <typename T>
+  static void ReplaceRange(std::vector<T> &vector, size_t start, size_t end,
+                           std::vector<T> &&replacement);
+  //! Stores the result of an analysis that has arrived at the end of the code
+  void Finish(const MaximaTokenizer::TokenList &tokens, State &state);
+  //! The last char of the code that isn't whitespace, or 0, if there is none
+  static wxChar LastChar(const MaximaTokenizer::TokenList &tokens);
+
+  //! All brackets and quotes, ordered by their position
+  std::vector<Delimiter> m_delimiters;
+  //! The states Update() can restart at, ordered by their position
+  std::vector<State> m_checkpoints;
+  //! The number of tokens the code consists of
+  size_t m_tokens = 0;
+  Error m_error = Error::none;
+  size_t m_errorIndex = 0;
+  bool m_endingNeeded = false;
+  //! The last char that isn't whitespace, or 0, if there is none
+  wxChar m_lastChar = 0;
+};
+
+#endif // CODESTRUCTURE_H
@@ -37,10 +37,24 @@ void CompositeDataObject::Add(wxDataObject *object, bool preferred)
     if (entry.object.get() == object)
       return;
 
-  std::shared_ptr<wxDataObject> objPtr{object};
+  AddEntries(std::shared_ptr<wxDataObject>(object), {}, preferred);
+}
+
+void CompositeDataObject::AddDeferred(wxDataObject *prototype, Generator &&generator,
+                                      bool preferred)
+{
+  if (!prototype)
+    return;
 
-  std::vector<wxDataFormat> addedFormats(object->GetFormatCount());
-  object->GetAllFormats(addedFormats.data());
+  AddEntries(std::shared_ptr<wxDataObject>(prototype),
+             std::make_shared<Generator>(std::move(generator)), preferred);
+}
+
+void CompositeDataObject::AddEntries(std::shared_ptr<wxDataObject> objPtr,
+                                     std::shared_ptr<Generator> generator, bool preferred)
+{
+  std::vector<wxDataFormat> addedFormats(objPtr->GetFormatCount());
+  objPtr->GetAllFormats(addedFormats.data());
 
   if (preferred && !addedFormats.empty())
     SetPreferredFormat(addedFormats.front());
@@ -54,6 +68,7 @@ void CompositeDataObject::Add(wxDataObject *object, bool preferred)
       {
         priorEntry.format = *addedFormat;
         priorEntry.object = objPtr;
+        priorEntry.generator = generator;
         addedFormat = addedFormats.erase(addedFormat);
         continue;
       }
@@ -63,7 +78,26 @@ void CompositeDataObject::Add(wxDataObject *object, bool preferred)
   // Add all remaining formats
   for (auto &addedFormat : addedFormats)
     // cppcheck-suppress useStlAlgorithm
-    m_entries.emplace_back(addedFormat, objPtr);
+    m_entries.emplace_back(addedFormat, objPtr, generator);
+}
+
+wxDataObject *CompositeDataObject::GetEntryObject(Entry &entry) const
+{
+  if (entry.generator)
+  {
+    auto generator = entry.generator;
+    std::shared_ptr<wxDataObject> object{(*generator)()};
+    // The generated object serves all formats its prototype was added for. If
+    // the generator has failed the empty prototype stays in place.
+    for (auto &other : m_entries)
+      if (other.generator == generator)
+      {
+        if (object)
+          other.object = object;
+        other.generator.reset();
+      }
+  }
+  return entry.object.get();
 }
 
 wxDataObject *CompositeDataObject::GetObject(const wxDataFormat& format,
@@ -75,7 +109,7 @@ wxDataObject *CompositeDataObject::GetObject(const wxDataFormat& format,
   for (auto &entry : m_entries)
     // cppcheck-suppress useStlAlgorithm
     if (entry.format == format)
-      return entry.object.get();
+      return GetEntryObject(entry);
 
   return {};
 }
@@ -109,7 +143,7 @@ size_t CompositeDataObject::GetDataSize(const wxDataFormat &format) const
   for (auto &entry : m_entries)
     // cppcheck-suppress useStlAlgorithm
     if (entry.format == format)
-      return entry.object->GetDataSize(format);
+      return GetEntryObject(entry)->GetDataSize(format);
 
   return 0;
 }
@@ -119,7 +153,7 @@ bool CompositeDataObject::GetDataHere(const wxDataFormat &format, void *buf) con
   for (auto &entry : m_entries)
     // cppcheck-suppress useStlAlgorithm
     if (entry.format == format)
-      return entry.object->GetDataHere(format, buf);
+      return GetEntryObject(entry)->GetDataHere(format, buf);
 
   return false;
 }
@@ -23,6 +23,7 @@
 #define COMPOSITEDATAOBJECT_H
 
 #include <wx/clipbrd.h>
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -31,15 +32,33 @@
  * of the wxDataObjectComposite functionality.
  */
 
-//! A composite data object like wxDataObjectComposite, but accepts also
-//! non-simple data objects. Only the Get direction is supported.
+/*! A composite data object like wxDataObjectComposite, but accepts also
+  non-simple data objects. Only the Get direction is supported.
+
+  Data objects that are expensive to generate can be added using AddDeferred():
+  Their formats are advertised to the clipboard right away, but they are only
+  generated when an application actually requests their data.
+ */
 class CompositeDataObject final : public wxDataObject
 {
 public:
+  //! Generates a data object. May return nullptr if no data is available.
+  using Generator = std::function<wxDataObject *()>;
+
   CompositeDataObject();
   ~CompositeDataObject() override;
 
   void Add(wxDataObject *object, bool preferred = false);
+  /*! Add a data object that is only generated when its data is first requested
+
+    The object is cached, so it is generated at most once.
+
+    \param prototype An empty object of the type generator returns. Tells
+                     which formats the generated object will provide.
+    \param generator Creates the object
+    \param preferred Is the first format of the object the preferred one?
+   */
+  void AddDeferred(wxDataObject *prototype, Generator &&generator, bool preferred = false);
   wxDataObject *GetObject(const wxDataFormat& format,
                                 wxDataObjectBase::Direction dir = Get) const;
   wxDataFormat GetPreferredFormat(Direction dir=Get) const override;
@@ -62,10 +81,18 @@ private:
   {
     wxDataFormat format;
     std::shared_ptr<wxDataObject> object;
-    Entry(const wxDataFormat &format, std::shared_ptr<wxDataObject> object) :
-        format(format), object(object) {}
+    //! If set: Replaces object as soon as the data is requested
+    std::shared_ptr<Generator> generator;
+    Entry(const wxDataFormat &format, std::shared_ptr<wxDataObject> object,
+          std::shared_ptr<Generator> generator) :
+        format(format), object(object), generator(generator) {}
   };
-  std::vector<Entry> m_entries;
+  void AddEntries(std::shared_ptr<wxDataObject> object, std::shared_ptr<Generator> generator,
+                  bool preferred);
+  //! Returns the entry's object, generating it if necessary
+  wxDataObject *GetEntryObject(Entry &entry) const;
+  //! The entries. Generating an object updates them.
+  mutable std::vector<Entry> m_entries;
   wxDataFormat m_preferredFormat;
 };
 
@@ -315,6 +315,8 @@ void ConfigDialogue::SetProperties()
   m_useUnicodeMaths->SetToolTip(_("If the font provides big parenthesis symbols: Use them when big parenthesis are needed for maths display."));
   m_autoSave->SetToolTip(
           _("If this checkbox is checked wxMaxima automatically saves the file closing and every few minutes giving wxMaxima a more cellphone-app-like feel as the file is virtually always saved. If this checkbox is unchecked from time to time a backup is made in the temp folder instead."));
+  m_wxmxLayoutHints->SetToolTip(
+          _("Store the height of each cell in .wxmx files. If the file is opened again with the same fonts, zoom factor and window width wxMaxima can display it before it has laid out all cells. As the heights depend on the window, changing its width or the zoom factor changes the file, which version control systems will notice."));
   m_defaultFramerate->SetToolTip(_("Define the default speed (in frames per second) animations are played back with."));
   m_maxGnuplotMegabytes->SetToolTip(_("wxMaxima normally stores the gnuplot sources for every plot made using draw() in order to be able to open plots interactively in gnuplot later. This setting defines the limit [in Megabytes per plot] for this feature."));
   m_defaultPlotWidth->SetToolTip(
@@ -323,6 +325,8 @@ void ConfigDialogue::SetProperties()
           _("The default height for embedded plots. Can be read out or overridden by the maxima variable wxplot_size."));
   m_displayedDigits->SetToolTip(
           _("If numbers are getting longer than this number of digits they will be displayed abbreviated by an ellipsis."));
+  m_gifGlobalPalette->SetToolTip(
+          _("Animated .gif files can contain at most 256 colors per frame. Using the same palette for all frames makes the file smaller, the export faster and avoids colors flickering between frames."));
   m_AnimateLaTeX->SetToolTip(
           _("Some PDF viewers are able to display moving images and wxMaxima is able to output them. If this option is selected additional LaTeX packages might be needed in order to compile the output, though."));
   m_TeXExponentsAfterSubscript->SetToolTip(
@@ -383,8 +387,6 @@ void ConfigDialogue::SetProperties()
   bool savePanes = true;
   bool fixedFontTC = true, keepPercent = true;
   bool saveUntitled = true,
-          AnimateLaTeX = true, TeXExponentsAfterSubscript = false,
-          usePartialForDiff = false,
           wrapLatexMath = true,
           exportContainsWXMX = false;
   int exportWithMathJAX = 0;
@@ -408,9 +410,6 @@ void ConfigDialogue::SetProperties()
   config->Read(wxT("defaultPlotWidth"), &defaultPlotWidth);
   int defaultPlotHeight = 400;
   config->Read(wxT("defaultPlotHeight"), &defaultPlotHeight);
-  config->Read(wxT("AnimateLaTeX"), &AnimateLaTeX);
-  config->Read(wxT("TeXExponentsAfterSubscript"), &TeXExponentsAfterSubscript);
-  config->Read(wxT("usePartialForDiff"), &usePartialForDiff);
   config->Read(wxT("wrapLatexMath"), &wrapLatexMath);
   config->Read(wxT("exportContainsWXMX"), &exportContainsWXMX);
   config->Read(wxT("HTMLequationFormat"), &exportWithMathJAX);
@@ -433,6 +432,7 @@ void ConfigDialogue::SetProperties()
   m_noAutodetectMathJaX->SetValue(configuration->MathJaXURL_UseUser());
   m_texPreamble->SetValue(texPreamble);
   m_autoSave->SetValue(!configuration->AutoSaveAsTempFile());
+  m_wxmxLayoutHints->SetValue(configuration->WxmxLayoutHints());
 
   m_maximaUserLocation->SetValue(configuration->MaximaUserLocation());
   wxCommandEvent dummy;
@@ -443,9 +443,9 @@ void ConfigDialogue::SetProperties()
   m_usesvg->SetValue(configuration->UseSVG());
   m_antialiasLines->SetValue(configuration->AntiAliasLines());
 
-  m_AnimateLaTeX->SetValue(AnimateLaTeX);
-  m_TeXExponentsAfterSubscript->SetValue(TeXExponentsAfterSubscript);
-  m_usePartialForDiff->SetValue(usePartialForDiff);
+  m_AnimateLaTeX->SetValue(configuration->AnimateLaTeX());
+  m_TeXExponentsAfterSubscript->SetValue(configuration->TeXExponentsAfterSubscript());
+  m_usePartialForDiff->SetValue(configuration->UsePartialForDiff());
   m_wrapLatexMath->SetValue(wrapLatexMath);
   m_exportContainsWXMX->SetValue(exportContainsWXMX);
   m_printBrackets->SetValue(configuration->PrintBrackets());
@@ -483,6 +483,7 @@ void ConfigDialogue::SetProperties()
   m_restartOnReEvaluation->SetValue(configuration->RestartOnReEvaluation());
   m_defaultFramerate->SetValue(defaultFramerate);
   m_maxGnuplotMegabytes->SetValue(configuration->MaxGnuplotMegabytes());
+  m_gifGlobalPalette->SetValue(configuration->GifGlobalPalette());
   m_defaultPlotWidth->SetValue(defaultPlotWidth);
   m_defaultPlotHeight->SetValue(defaultPlotHeight);
   m_displayedDigits->SetValue(configuration->GetDisplayedDigits());
@@ -789,6 +790,9 @@ wxPanel *ConfigDialogue::CreateExportPanel()
   m_exportContainsWXMX = new wxCheckBox(panel, -1, _("Add the .wxmx file to the HTML export"));
   vsizer->Add(m_exportContainsWXMX, 0, wxALL, 5);
 
+  m_gifGlobalPalette = new wxCheckBox(panel, -1, _("Use one color palette for all frames of exported animations"));
+  vsizer->Add(m_gifGlobalPalette, 0, wxALL, 5);
+
   m_printBrackets = new wxCheckBox(panel, -1, _("Print the cell brackets [drawn to their left]"));
   vsizer->Add(m_printBrackets, 0, wxALL, 5);
 
@@ -875,6 +879,9 @@ wxPanel *ConfigDialogue::CreateOptionsPanel()
   m_autoSave = new wxCheckBox(panel, -1, _("Save the worksheet automatically"));
   vsizer->Add(m_autoSave, 0, wxALL, 5);
 
+  m_wxmxLayoutHints = new wxCheckBox(panel, -1, _("Store the height of cells in .wxmx files"));
+  vsizer->Add(m_wxmxLayoutHints, 0, wxALL, 5);
+
   m_usesvg = new wxCheckBox(panel, -1, _("Create scalable plots."));
   m_usesvg->Connect(wxEVT_CHECKBOX,
                          wxCommandEventHandler(ConfigDialogue::UsesvgChanged),
@@ -1212,12 +1219,13 @@ void ConfigDialogue::WriteSettings()
   configuration->AntiAliasLines(m_antialiasLines->GetValue());
   config->Write(wxT("DefaultFramerate"), m_defaultFramerate->GetValue());
   configuration->MaxGnuplotMegabytes(m_maxGnuplotMegabytes->GetValue());
+  configuration->GifGlobalPalette(m_gifGlobalPalette->GetValue());
   config->Write(wxT("defaultPlotWidth"), m_defaultPlotWidth->GetValue());
   config->Write(wxT("defaultPlotHeight"), m_defaultPlotHeight->GetValue());
   configuration->SetDisplayedDigits(m_displayedDigits->GetValue());
-  config->Write(wxT("AnimateLaTeX"), m_AnimateLaTeX->GetValue());
-  config->Write(wxT("TeXExponentsAfterSubscript"), m_TeXExponentsAfterSubscript->GetValue());
-  config->Write(wxT("usePartialForDiff"), m_usePartialForDiff->GetValue());
+  configuration->AnimateLaTeX(m_AnimateLaTeX->GetValue());
+  configuration->TeXExponentsAfterSubscript(m_TeXExponentsAfterSubscript->GetValue());
+  configuration->UsePartialForDiff(m_usePartialForDiff->GetValue());
   config->Write(wxT("wrapLatexMath"), m_wrapLatexMath->GetValue());
   config->Write(wxT("exportContainsWXMX"), m_exportContainsWXMX->GetValue());
   configuration->PrintBrackets(m_printBrackets->GetValue());
@@ -1226,6 +1234,7 @@ void ConfigDialogue::WriteSettings()
   config->Write(wxT("keepPercent"), m_keepPercentWithSpecials->GetValue());
   config->Write(wxT("texPreamble"), m_texPreamble->GetValue());
   configuration->AutoSaveAsTempFile(!m_autoSave->GetValue());
+  configuration->WxmxLayoutHints(m_wxmxLayoutHints->GetValue());
   configuration->Documentclass(m_documentclass->GetValue());
   configuration->DocumentclassOptions(m_documentclassOptions->GetValue());
   configuration->MathJaXURL(m_mathJaxURL->GetValue());
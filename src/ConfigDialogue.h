@@ -238,6 +238,7 @@ protected:
   wxTextCtrl *m_documentclassOptions;
   wxTextCtrl *m_texPreamble;
   wxCheckBox *m_autoSave;
+  wxCheckBox *m_wxmxLayoutHints;
   wxButton *m_mpBrowse;
   wxTextCtrl *m_additionalParameters;
   wxTextCtrl *m_mathJaxURL;
@@ -262,6 +263,8 @@ protected:
   wxCheckBox *m_usePartialForDiff;
   //! A checkbox that asks if all newlines in text cells have to be passed to HTML.
   wxCheckBox *m_exportContainsWXMX;
+  //! A checkbox that asks if all frames of an animated .gif share one palette
+  wxCheckBox *m_gifGlobalPalette;
   wxCheckBox *m_printBrackets;
   wxChoice *m_exportWithMathJAX;
   wxCheckBox *m_matchParens;
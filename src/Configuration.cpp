@@ -30,6 +30,7 @@
 #include "Dirstructure.h"
 #include "ErrorRedirector.h"
 #include "StringUtils.h"
+#include "TextWidthCache.h"
 #include <wx/wx.h>
 #include <wx/mimetype.h>
 #include <wx/string.h>
@@ -58,10 +59,14 @@ Configuration::Configuration(wxDC *dc, InitOpt options) :
   #endif
 
   m_autoSaveAsTempFile = false;
+  // The heights depend on the window width, the zoom factor and the installed
+  // fonts => storing them would make resizing the window change the file.
+  m_wxmxLayoutHints = false;
   m_inLispMode = false;
   m_htmlEquationFormat = mathJaX_TeX;
   m_autodetectMaxima = true;
   m_clipToDrawRegion = true;
+  m_headless = false;
   m_fontChanged = true;
   m_mathJaxURL_UseUser = false;
   m_TOCshowsSectionNumbers = false;
@@ -91,6 +96,10 @@ Configuration::Configuration(wxDC *dc, InitOpt options) :
   m_abortOnError = true;
   m_defaultPort = 49152;
   m_maxGnuplotMegabytes = 12;
+  m_gifGlobalPalette = true;
+  m_animateLaTeX = true;
+  m_TeXExponentsAfterSubscript = false;
+  m_usePartialForDiff = false;
   m_clientWidth = 1024;
   m_clientHeight = 768;
   m_indentMaths=true;
@@ -405,12 +414,17 @@ void Configuration::ReadConfig()
     config->Read(wxT("autoSaveMinutes"), &autoSaveMinutes);
     m_autoSaveAsTempFile = (autoSaveMinutes == 0);
   }
+  config->Read(wxT("wxmxLayoutHints"), &m_wxmxLayoutHints);
   config->Read("language", &m_language);
   if (m_language == wxLANGUAGE_UNKNOWN)
     m_language = wxLANGUAGE_DEFAULT;
 
   config->Read("invertBackground", &m_invertBackground);
   config->Read("maxGnuplotMegabytes", &m_maxGnuplotMegabytes);
+  config->Read("gifGlobalPalette", &m_gifGlobalPalette);
+  config->Read("AnimateLaTeX", &m_animateLaTeX);
+  config->Read("TeXExponentsAfterSubscript", &m_TeXExponentsAfterSubscript);
+  config->Read("usePartialForDiff", &m_usePartialForDiff);
   config->Read("offerKnownAnswers", &m_offerKnownAnswers);
   config->Read(wxT("documentclass"), &m_documentclass);
   config->Read(wxT("documentclassoptions"), &m_documentclassOptions);
@@ -700,7 +714,18 @@ void Configuration::SetZoomFactor(double newzoom)
 
   m_zoomFactor = newzoom;
   wxConfig::Get()->Write(wxT("ZoomFactor"), m_zoomFactor);
-  RecalculationForce(true);
+  FontChanged(true);
+}
+
+void Configuration::FontChanged(bool fontChanged)
+{
+  m_fontChanged = fontChanged;
+  if(fontChanged)
+  {
+    RecalculationForce(true);
+    TextWidthCache::Get().Clear();
+  }
+  m_charsInFont.clear();
 }
 
 Configuration::~Configuration()
@@ -794,6 +819,19 @@ AFontName Configuration::GetFontName(long type) const
   return retval;
 }
 
+wxString Configuration::LayoutSignature() const
+{
+  return wxString::Format(wxT("%i;%s;%g;%s;%g;%s;%g;%li"),
+                          int(100.0 * GetZoomFactor()),
+                          GetFontName(TS_DEFAULT).GetAsString(),
+                          GetDefaultFontSize().Get(),
+                          GetFontName(TS_VARIABLE).GetAsString(),
+                          GetMathFontSize().Get(),
+                          GetFontName(TS_TEXT).GetAsString(),
+                          m_styles[TS_TEXT].GetFontSize().Get(),
+                          GetClientWidth());
+}
+
 wxString Configuration::MaximaLocation() const
 {
   if(m_autodetectMaxima)
@@ -350,14 +350,12 @@ public:
   };
   std::vector<CharsExist> m_charsInFont;
 
-  //! Has a font changed?
-  void FontChanged(bool fontChanged)
-    {
-      m_fontChanged = fontChanged;
-      if(fontChanged)
-        RecalculationForce(true);
-      m_charsInFont.clear();
-    }
+  /*! Has a font changed?
+
+    If it has, the sizes of text that have been measured in the old fonts are
+    forgotten, too.
+  */
+  void FontChanged(bool fontChanged);
   
   //! Set the height of the visible window for GetClientHeight()
   void SetClientHeight(long height)
@@ -392,6 +390,16 @@ public:
   bool AutoSaveAsTempFile() const {return m_autoSaveAsTempFile;}
   void AutoSaveAsTempFile(bool asTempFile){wxConfig::Get()->Write(wxT("AutoSaveAsTempFile"), m_autoSaveAsTempFile = asTempFile);}
 
+  //! Store the height of each cell in .wxmx files? Is off by default.
+  bool WxmxLayoutHints() const {return m_wxmxLayoutHints;}
+  void WxmxLayoutHints(bool hints){wxConfig::Get()->Write(wxT("wxmxLayoutHints"), m_wxmxLayoutHints = hints);}
+  /*! Describes everything the height of the cells depends on
+
+    The heights a .wxmx file contains are only used if the file was saved with
+    the same layout signature.
+  */
+  wxString LayoutSignature() const;
+
   //! Set the minimum sensible line width in widths of a letter.
   void LineWidth_em(long width)
   { m_lineWidth_em = width; }
@@ -854,10 +862,32 @@ public:
   void MaxGnuplotMegabytes(long megaBytes)
     {wxConfig::Get()->Write("maxGnuplotMegabytes",m_maxGnuplotMegabytes = megaBytes);}
 
+  /*! Use one palette for all frames of an animated .gif?
+
+    Quantizing all frames to the same palette makes the .gif file smaller,
+    the export faster and avoids colors flickering between frames.
+  */
+  bool GifGlobalPalette() const {return m_gifGlobalPalette;}
+  void GifGlobalPalette(bool global)
+    {wxConfig::Get()->Write("gifGlobalPalette",m_gifGlobalPalette = global);}
+
   bool OfferKnownAnswers() const {return m_offerKnownAnswers;}
   void OfferKnownAnswers(bool offerKnownAnswers)
     {wxConfig::Get()->Write("offerKnownAnswers",m_offerKnownAnswers = offerKnownAnswers);}
   
+  //! Export animations to TeX using the animate package?
+  bool AnimateLaTeX() const {return m_animateLaTeX;}
+  void AnimateLaTeX(bool animate)
+    {wxConfig::Get()->Write("AnimateLaTeX",m_animateLaTeX = animate);}
+  //! In TeX output: Place exponents after, instead of above subscripts?
+  bool TeXExponentsAfterSubscript() const {return m_TeXExponentsAfterSubscript;}
+  void TeXExponentsAfterSubscript(bool after)
+    {wxConfig::Get()->Write("TeXExponentsAfterSubscript",m_TeXExponentsAfterSubscript = after);}
+  //! In TeX output: Use partial derivative symbols for all derivatives?
+  bool UsePartialForDiff() const {return m_usePartialForDiff;}
+  void UsePartialForDiff(bool partial)
+    {wxConfig::Get()->Write("usePartialForDiff",m_usePartialForDiff = partial);}
+
   wxString Documentclass() const {return m_documentclass;}
   void Documentclass(wxString clss){wxConfig::Get()->Write("documentclass",m_documentclass = clss);}
   wxString DocumentclassOptions() const {return m_documentclassOptions;}
@@ -886,6 +916,10 @@ public:
   bool ClipToDrawRegion() const {return m_clipToDrawRegion;}
   //! Do we want to save time by only redrawing the area currently shown on the screen?
   void ClipToDrawRegion(bool clipToDrawRegion){m_clipToDrawRegion = clipToDrawRegion; m_forceUpdate = true;}
+  //! Is the worksheet evaluated without being displayed (wxmaxima --batch)?
+  bool Headless() const {return m_headless;}
+  //! Don't lay out or draw the worksheet as nobody is going to look at it?
+  void Headless(bool headless){m_headless = headless;}
   //! Request adjusting the worksheet size?
   void AdjustWorksheetSize(bool adjust)
     { m_adjustWorksheetSizeNeeded = adjust; }
@@ -908,6 +942,8 @@ private:
 
   //! true = Autosave doesn't save into the current file.
   bool m_autoSaveAsTempFile;
+  //! true = .wxmx files contain the height of each cell.
+  bool m_wxmxLayoutHints;
   //! The number of the language wxMaxima uses.
   long m_language;
   //! Autodetect maxima's location?
@@ -985,6 +1021,7 @@ private:
   wxString m_maximaShareDir;
   bool m_forceUpdate;
   bool m_clipToDrawRegion;
+  bool m_headless;
   bool m_outdated;
   wxString m_maximaParameters;
   bool m_TeXFonts;
@@ -1019,6 +1056,10 @@ private:
   bool m_offerKnownAnswers;
   long m_defaultPort;
   long m_maxGnuplotMegabytes;
+  bool m_gifGlobalPalette;
+  bool m_animateLaTeX;
+  bool m_TeXExponentsAfterSubscript;
+  bool m_usePartialForDiff;
   std::unique_ptr<CellRedrawTrace> m_cellRedrawTrace;
   wxString m_documentclass;
   wxString m_documentclassOptions;
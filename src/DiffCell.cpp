@@ -145,9 +145,7 @@ wxString DiffCell::ToTeX() const
   wxString diff = m_diffCell->ListToTeX();
   wxString function = m_baseCell->ListToTeX();
 
-  bool usePartialForDiff = false;
-  wxConfig::Get()->Read(wxT("usePartialForDiff"), &usePartialForDiff);
-  if (usePartialForDiff)
+  if ((*m_configuration)->UsePartialForDiff())
     diff.Replace(wxT("\\frac{d}{d"), wxT("\\frac{\\partial}{\\partial"));
 
   wxString s = diff + function;
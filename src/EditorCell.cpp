@@ -35,7 +35,12 @@
 #include "wxMaximaFrame.h"
 #include <wx/clipbrd.h>
 #include <wx/regex.h>
+#include <wx/thread.h>
 #include <wx/tokenzr.h>
+#include <algorithm>
+#include <iterator>
+
+std::atomic<wxUint64> EditorCell::m_lastTextRevision{0};
 
 EditorCell::EditorCell(GroupCell *parent, Configuration **config, const wxString &text) :
     Cell(parent, config),
@@ -145,11 +150,10 @@ void EditorCell::AddDrawParameter(wxString param)
     param += ",";
 
   wxString textAfterParameter = m_text.Right(m_text.Length() - m_positionOfCaret);
-  m_text = m_text.Left(m_positionOfCaret);
-  m_text.Trim();
+  SetText(m_text.Left(m_positionOfCaret).Trim());
   if(commaNeededBefore)
   {
-    m_text += wxT(",");
+    ReplaceText(m_text.Length(), m_text.Length(), wxT(","));
     m_positionOfCaret ++;
   }
 
@@ -160,10 +164,10 @@ void EditorCell::AddDrawParameter(wxString param)
     ProcessNewline(false);
     wxString line = lines.GetNextToken();
     line.Trim(false);
-    m_text += line;
+    ReplaceText(m_text.Length(), m_text.Length(), line);
     m_positionOfCaret += line.Length();
   }
-  m_text += textAfterParameter;
+  ReplaceText(m_text.Length(), m_text.Length(), textAfterParameter);
   StyleText();
   ResetSize();
   if (m_group)
@@ -596,9 +600,7 @@ void EditorCell::ConvertNumToUNicodeChar()
     wxLogNull suppressConversationErrors;
     newChar = wxChar(number);
   }
-  m_text = m_text.Left(m_positionOfCaret) +
-    newChar +
-    m_text.Right(m_text.Length() - m_positionOfCaret - numLen);
+  ReplaceText(m_positionOfCaret, m_positionOfCaret + numLen, newChar);
   m_positionOfCaret+= newChar.Length();
 }
 
@@ -606,12 +608,17 @@ void EditorCell::Recalculate(AFontSize fontsize)
 {
   Configuration *configuration = (*m_configuration);
   if (IsZoomFactorChanged())
-    m_widths.clear();
+    ResetTextWidths();
 
   m_isDirty = false;
   if (NeedsRecalculation(fontsize))
   {
-    StyleText();
+    // A cell that is being styled in the background keeps displaying its plain
+    // text until the background task has finished.
+    if (!m_backgroundStyling)
+      StyleText(true);
+    else if (BackgroundStylingDone())
+      ApplyBackgroundStyling();
     m_fontSize_Last = Scale_Px(fontsize);
     wxDC *dc = configuration->GetDC();
     SetFont();
@@ -623,27 +630,23 @@ void EditorCell::Recalculate(AFontSize fontsize)
 
     // We want a little bit of vertical space between two text lines (and between two labels).
     m_charHeight += 2 * MC_TEXT_PADDING;
-    int width = 0, tokenwidth, tokenheight, linewidth = 0;
+    int width = 0, linewidth = 0;
 
     m_numberOfLines = 1;
 
-    std::vector<StyledText>::const_iterator textSnippet;
-
-    for (
-      textSnippet = m_styledText.begin();
-      textSnippet != m_styledText.end();
-      ++textSnippet
-      )
+    for (auto &textSnippet : m_styledText)
     {
-      if ((textSnippet->GetText().StartsWith(wxT('\n')) || (textSnippet->GetText().StartsWith(wxT('\r')))))
+      if ((textSnippet.GetText().StartsWith(wxT('\n')) || (textSnippet.GetText().StartsWith(wxT('\r')))))
       {
         m_numberOfLines++;
-        linewidth = textSnippet->GetIndentPixels();
+        linewidth = textSnippet.GetIndentPixels();
       }
       else
       {
-        dc->GetTextExtent(textSnippet->GetText(), &tokenwidth, &tokenheight);
-        linewidth += tokenwidth;
+        // Snippets that have survived restyling already know their width.
+        if (!textSnippet.SizeKnown())
+          textSnippet.SetWidth(GetTextSize(textSnippet.GetText()).GetWidth());
+        linewidth += textSnippet.GetWidth();
         width = wxMax(width, linewidth);
       }
     }
@@ -772,7 +775,9 @@ void EditorCell::MarkSelection(long start, long end, TextStyle style, AFontSize
 
    The text is not taken from m_text but from the list of styled text snippets
    StyleText() converts m_text into. This way the decisions needed for styling
-   text are cached for later use.
+   text are cached for later use. Adjacent snippets of the same style are drawn
+   by a single DrawText() and lines outside the update region aren't drawn at
+   all.
 */
 void EditorCell::Draw(wxPoint point)
 {
@@ -888,79 +893,122 @@ void EditorCell::Draw(wxPoint point)
     // Draw the text
     //
     SetPen();
-
-    wxPoint TextStartingpoint = point;
-    wxPoint TextCurrentPoint = TextStartingpoint;
-    int lastStyle = -1;
-    int lastIndent = 0;
-    for (std::vector<StyledText>::iterator textSnippet = m_styledText.begin();
-         textSnippet != m_styledText.end(); ++textSnippet)
+    IndexStyledLines();
+
+    // Only the lines that overlap the update region need to be drawn
+    const int top = point.y - m_center;
+    const bool clip = configuration->ClipToDrawRegion();
+    const wxRect updateRegion = configuration->GetUpdateRegion();
+    long firstLine = 0;
+    long lastLine = static_cast<long>(m_styledLineStarts.size()) - 1;
+    if (clip && (m_charHeight > 0))
     {
-      auto &TextToDraw = textSnippet->GetText();
-      int width, height;
+      firstLine = wxMax(firstLine, (updateRegion.GetTop() - top) / m_charHeight);
+      lastLine = wxMin(lastLine, (updateRegion.GetBottom() - top) / m_charHeight);
+    }
 
-      // A newline is a separate token.
-      if ((TextToDraw == wxT("\n")) || (TextToDraw == wxT("\r")))
+    // The style the text foreground of the dc has been set to. -1 means the
+    // default color of this cell, -2 that it hasn't been set yet.
+    int dcStyle = -2;
+    // Adjacent snippets of the same style are drawn as one run of text
+    wxString run;
+    int runStyle = -1;
+    int runX = 0, runWidth = 0, runY = 0;
+    auto DrawRun = [&]() {
+      if (run.IsEmpty())
+        return;
+      if (!clip || updateRegion.Intersects(wxRect(runX, runY, runWidth, m_charHeight)))
       {
-        if ((TextToDraw == wxT("\n")))
-          lastIndent = textSnippet->GetIndentPixels();
-
-        // A newline =>
-        // set the point to the beginning of the next line.
-        TextCurrentPoint.x = TextStartingpoint.x;
-        TextCurrentPoint.y += m_charHeight;
-        TextCurrentPoint.x += textSnippet->GetIndentPixels();
+        if (dcStyle != runStyle)
+        {
+          if (runStyle >= 0)
+            dc->SetTextForeground(configuration->GetColor(static_cast<TextStyle>(runStyle)));
+          else
+            SetForeground();
+          dcStyle = runStyle;
+        }
+        dc->DrawText(run, runX, runY);
       }
-      else
-      {
-        // We need to draw some text.
+      run.Clear();
+    };
 
-        // Grab a pen of the right color.
-        if (textSnippet->IsStyleSet())
+    for (long line = firstLine; line <= lastLine; ++line)
+    {
+      const size_t firstSnippet = m_styledLineStarts[line];
+      const size_t endSnippet = (line + 1 < static_cast<long>(m_styledLineStarts.size())) ?
+        m_styledLineStarts[line + 1] - 1 : m_styledText.size();
+      int x = point.x;
+      // The line ending in front of this line knows how much it is indented
+      int lastIndent = 0;
+      if (line > 0)
+      {
+        x += m_styledText[firstSnippet - 1].GetIndentPixels();
+        for (long i = line; i > 0; --i)
         {
-          if (lastStyle != textSnippet->GetStyle())
+          auto const &lineEnding = m_styledText[m_styledLineStarts[i] - 1];
+          if (lineEnding.GetText() == wxT("\n"))
           {
-            dc->SetTextForeground(configuration->GetColor(textSnippet->GetStyle()));
-            lastStyle = textSnippet->GetStyle();
+            lastIndent = lineEnding.GetIndentPixels();
+            break;
           }
         }
-        else
+      }
+      const int y = top + line * m_charHeight;
+
+      for (size_t i = firstSnippet; i < endSnippet; ++i)
+      {
+        StyledText &textSnippet = m_styledText[i];
+        auto &textToDraw = textSnippet.GetText();
+        if (!textSnippet.SizeKnown())
+          textSnippet.SetWidth(GetTextSize(textToDraw).GetWidth());
+        const int width = textSnippet.GetWidth();
+        const int style = textSnippet.IsStyleSet() ? textSnippet.GetStyle() : -1;
+
+        // Whitespace has no color: It can join any run of text.
+        bool whitespace = true;
+        for (auto const &ch : textToDraw)
+          if ((ch != wxT(' ')) && (ch != wxT('\t')))
+          {
+            whitespace = false;
+            break;
+          }
+
+        if (whitespace)
         {
-          lastStyle = -1;
-          SetForeground();
+          if (!run.IsEmpty())
+          {
+            run += textToDraw;
+            runWidth += width;
+          }
+          x += width;
+          continue;
         }
-        
+
         // Draw a char that shows we continue an indentation - if this is needed.
-        if (textSnippet->GetIndentChar() != wxEmptyString)
-          dc->DrawText(textSnippet->GetIndentChar(),
-                       TextStartingpoint.x + lastIndent,
-                       TextCurrentPoint.y - m_center);
+        if (!textSnippet.GetIndentChar().IsEmpty())
+        {
+          DrawRun();
+          run = textSnippet.GetIndentChar();
+          runStyle = style;
+          runX = point.x + lastIndent;
+          runY = y;
+          runWidth = GetTextSize(run).GetWidth();
+          DrawRun();
+        }
 
-        // Determine the box the will be is in.
-        if(!textSnippet->SizeKnown())
+        if (run.IsEmpty() || (runStyle != style))
         {
-          dc->GetTextExtent(TextToDraw, &width, &height);
-          textSnippet->SetWidth(width);
+          DrawRun();
+          runStyle = style;
+          runX = x;
+          runY = y;
+          runWidth = 0;
         }
-        else
-          width = textSnippet->GetWidth();
-        wxRect textRect(TextCurrentPoint.x,
-                        TextCurrentPoint.y - m_center,
-                        TextCurrentPoint.x + width,
-                        TextCurrentPoint.y - m_center + m_charHeight);
-
-        // Draw the text only if it overlaps the update region
-        wxRect updateRegion = (*m_configuration)->GetUpdateRegion();
-        if(((!(*m_configuration)->ClipToDrawRegion())) ||
-           (updateRegion.Intersects(textRect) ||
-            updateRegion.Contains(textRect) ||
-            (updateRegion == textRect) || textRect.Contains(updateRegion)))
-          dc->DrawText(TextToDraw,
-                       TextCurrentPoint.x,
-                       TextCurrentPoint.y - m_center);
-        
-        TextCurrentPoint.x += width;
+        run += textToDraw;
+        runWidth += width;
+        x += width;
       }
+      DrawRun();
     }
     //
     // Draw the caret
@@ -996,18 +1044,28 @@ void EditorCell::Draw(wxPoint point)
 
 void EditorCell::SetType(CellType type)
 {
-  m_widths.clear();
+  ResetTextWidths();
   Cell::SetType(type);
 }
 
 void EditorCell::SetStyle(TextStyle style)
 {
-  m_widths.clear();
+  ResetTextWidths();
   Cell::SetStyle(style);
 }
 
+void EditorCell::ResetTextWidths()
+{
+  // The font may have changed: SetFont() will find out which sizes to use
+  m_widths = nullptr;
+  for (auto &textSnippet : m_styledText)
+    textSnippet.ResetSize();
+}
+
 void EditorCell::SetFont()
 {
+  // Fonts, the device context and the TextWidthCache may only be used by the main thread
+  wxASSERT(wxThread::IsMain());
   Configuration *configuration = (*m_configuration);
   wxDC *dc = configuration->GetDC();
 
@@ -1053,21 +1111,16 @@ void EditorCell::SetFont()
   wxASSERT_MSG(style.IsFontOk(),
                _("Seems like something is broken with a font."));
   dc->SetFont(style.GetFont());
+  m_widths = &TextWidthCache::Get().GetWidths(style, configuration->GetPrinting());
 }
 
 wxSize EditorCell::GetTextSize(wxString const &text)
 {
-  wxDC *dc = (*m_configuration)->GetDC();
-  StringHash::const_iterator it = m_widths.find(text);
-
-  // If we already know this text piece's size we return the cached value
-  if(it != m_widths.end())
-    return it->second;
-
-  // Ask wxWidgets to return this text piece's size (slow!)
-  wxSize sz = dc->GetTextExtent(text);
-  m_widths[text] = sz;
-  return sz;
+  // Measuring text uses the device context all cells share
+  wxASSERT(wxThread::IsMain());
+  if (!m_widths)
+    SetFont();
+  return TextWidthCache::Get().GetTextSize(*m_widths, *(*m_configuration)->GetDC(), text);
 }
 
 void EditorCell::SetForeground()
@@ -1152,18 +1205,19 @@ wxString EditorCell::GetCurrentCommand()
   return command;
 }
 
-wxString EditorCell::TabExpand(const wxString &input_, long posInLine)
+wxString EditorCell::TabExpand(const wxString &input, long posInLine)
 {
   if (posInLine < 0) posInLine = 0;
   wxString retval;
-
-  // Convert the text to our line endings.
-  wxString input = input_; // TODO the state machine below can be changed instead
-  input.Replace(wxT("\r\n"), wxT("\n"));
+  retval.reserve(input.Length());
 
   wxString::const_iterator ch = input.begin();
   while (ch < input.end())
   {
+    // Convert the text to our line endings.
+    if ((*ch == wxT('\r')) && (ch + 1 < input.end()) && (*(ch + 1) == wxT('\n')))
+      ++ch;
+
     if ((*ch == wxT('\n')))
     {
       posInLine = 0;
@@ -1210,28 +1264,49 @@ size_t EditorCell::BeginningOfLine(long pos) const
     return 0;
   if (pos > long(m_text.size()))
     pos = long(m_text.size());
-  if (pos > 0)
-    pos--;
-  if (pos < 0)
-    pos = 0;
-  while (pos > 0)
-  {
-    if ((m_text[pos] == wxT('\n')) || (m_text[pos] == wxT('\r')))
-      break;
-    pos--;
-  }
-  if ((m_text[pos] == wxT('\n')) || (m_text[pos] == wxT('\r')))
-    pos++;
-  return pos;
+  // A line ending at the very start of the text is treated as if the caret was
+  // behind it.
+  if (pos < 1)
+    pos = 1;
+  return m_lines.GetLineStart(m_lines.GetLine(pos));
 }
 
-size_t EditorCell::EndOfLine(long pos)
+size_t EditorCell::EndOfLine(long pos) const
 {
   if (pos < 0)
     pos = 0;
-  while (pos < (long)m_text.length() && m_text[pos] != wxT('\n') && m_text[pos] != wxT('\r'))
-    pos++;
-  return pos;
+  if (pos >= (long)m_text.length())
+    return pos;
+  size_t nextLine = m_lines.GetLine(pos) + 1;
+  if (nextLine >= m_lines.GetLineCount())
+    return m_text.length();
+  return m_lines.GetLineStart(nextLine) - 1;
+}
+
+void EditorCell::ReplaceText(long start, long end, const wxString &newText)
+{
+  const long length = m_text.Length();
+  start = wxMax(0, wxMin(start, length));
+  end = wxMax(start, wxMin(end, length));
+
+  m_lines.Replace(start, end, newText);
+  m_tokenLines.Replace(start, end, newText.Length());
+  m_text.replace(start, end - start, newText);
+  TextChanged();
+  m_codeStructureValid = false;
+}
+
+void EditorCell::IndexStyledLines()
+{
+  if (!m_styledLineStarts.empty())
+    return;
+  m_styledLineStarts.push_back(0);
+  for (size_t i = 0; i < m_styledText.size(); ++i)
+  {
+    auto const &text = m_styledText[i].GetText();
+    if ((text.Length() == 1) && LineIndex::IsLineEnding(text[0]))
+      m_styledLineStarts.push_back(i + 1);
+  }
 }
 
 #if defined __WXOSX__
@@ -1255,7 +1330,7 @@ bool EditorCell::HandleCtrlCommand(wxKeyEvent &ev)
     size_t end = EndOfLine(m_positionOfCaret);
     if (end == (size_t) m_positionOfCaret)
       end++;
-    m_text = m_text.SubString(0, m_positionOfCaret - 1) + m_text.SubString(end, m_text.length());
+    ReplaceText(m_positionOfCaret, end, wxEmptyString);
     m_isDirty = true;
     break;
   }
@@ -1507,8 +1582,7 @@ void EditorCell::ProcessNewline(bool keepCursorAtStartOfLine)
     SaveValue();
     long start = wxMin(m_selectionEnd, m_selectionStart);
     long end = wxMax(m_selectionEnd, m_selectionStart);
-    m_text = m_text.SubString(0, start - 1) +
-      m_text.SubString(end, m_text.Length());
+    ReplaceText(start, end, wxEmptyString);
     m_positionOfCaret = start;
     ClearSelection();
   }
@@ -1541,9 +1615,7 @@ void EditorCell::ProcessNewline(bool keepCursorAtStartOfLine)
       for (int i = 0; i < indentChars; i++)
         indentString += wxT(" ");
 
-    m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-      wxT("\n") + indentString +
-      m_text.SubString(m_positionOfCaret, m_text.Length());
+    ReplaceText(m_positionOfCaret, m_positionOfCaret, wxT("\n") + indentString);
     m_positionOfCaret++;
     if ((indentChars > 0) && (autoIndent))
     {
@@ -1935,8 +2007,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent &event)
         {
           m_isDirty = true;
           m_containsChanges = true;
-          m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-            m_text.SubString(m_positionOfCaret + 1, m_text.Length());
+          ReplaceText(m_positionOfCaret, m_positionOfCaret + 1, wxEmptyString);
         }
       }
       else
@@ -1947,8 +2018,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent &event)
         m_saveValue = true;
         long start = wxMin(m_selectionEnd, m_selectionStart);
         long end = wxMax(m_selectionEnd, m_selectionStart);
-        m_text = m_text.SubString(0, start - 1) +
-          m_text.SubString(end, m_text.Length());
+        ReplaceText(start, end, wxEmptyString);
         m_positionOfCaret = start;
         ClearSelection();
       }
@@ -1966,23 +2036,20 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent &event)
       while (m_positionOfCaret > 0 && wxIsalnum(m_text[m_positionOfCaret - 1]))
       {
         m_positionOfCaret--;
-        m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-          m_text.SubString(m_positionOfCaret + 1, m_text.Length());
+        ReplaceText(m_positionOfCaret, m_positionOfCaret + 1, wxEmptyString);
       }
       // Delete Spaces, Tabs and Newlines until the next printable character
       while (m_positionOfCaret > 0 && wxIsspace(m_text[m_positionOfCaret - 1]))
       {
         m_positionOfCaret--;
-        m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-          m_text.SubString(m_positionOfCaret + 1, m_text.Length());
+        ReplaceText(m_positionOfCaret, m_positionOfCaret + 1, wxEmptyString);
       }
 
       // If we didn't delete anything till now delete one single character.
       if (lastpos == m_positionOfCaret)
       {
         m_positionOfCaret--;
-        m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-          m_text.SubString(m_positionOfCaret + 1, m_text.Length());
+        ReplaceText(m_positionOfCaret, m_positionOfCaret + 1, wxEmptyString);
       }
     }
     StyleText();
@@ -1998,8 +2065,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent &event)
       m_isDirty = true;
       long start = wxMin(m_selectionEnd, m_selectionStart);
       long end = wxMax(m_selectionEnd, m_selectionStart);
-      m_text = m_text.SubString(0, start - 1) +
-        m_text.SubString(end, m_text.Length());
+      ReplaceText(start, end, wxEmptyString);
       m_positionOfCaret = start;
       ClearSelection();
       StyleText();
@@ -2017,8 +2083,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent &event)
 
           if (m_text.SubString(0, m_positionOfCaret - 1).Right(4) == wxT("    "))
           {
-            m_text = m_text.SubString(0, m_positionOfCaret - 5) +
-              m_text.SubString(m_positionOfCaret, m_text.Length());
+            ReplaceText(m_positionOfCaret - 4, m_positionOfCaret, wxEmptyString);
             m_positionOfCaret -= 4;
           }
           else
@@ -2031,8 +2096,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent &event)
                  (m_text.GetChar(m_positionOfCaret - 1) == '{' && m_text.GetChar(m_positionOfCaret) == '}') ||
                  (m_text.GetChar(m_positionOfCaret - 1) == '"' && m_text.GetChar(m_positionOfCaret) == '"')))
               right++;
-            m_text = m_text.SubString(0, m_positionOfCaret - 2) +
-              m_text.SubString(right, m_text.Length());
+            ReplaceText(m_positionOfCaret - 1, right, wxEmptyString);
             m_positionOfCaret--;
           }
         }
@@ -2051,23 +2115,20 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent &event)
         while (m_positionOfCaret > 0 && wxIsalnum(m_text[m_positionOfCaret - 1]))
         {
           m_positionOfCaret--;
-          m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-            m_text.SubString(m_positionOfCaret + 1, m_text.Length());
+          ReplaceText(m_positionOfCaret, m_positionOfCaret + 1, wxEmptyString);
         }
         // Delete Spaces, Tabs and Newlines until the next printable character
         while (m_positionOfCaret > 0 && wxIsspace(m_text[m_positionOfCaret - 1]))
         {
           m_positionOfCaret--;
-          m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-            m_text.SubString(m_positionOfCaret + 1, m_text.Length());
+          ReplaceText(m_positionOfCaret, m_positionOfCaret + 1, wxEmptyString);
         }
 
         // If we didn't delete anything till now delete one single character.
         if (lastpos == m_positionOfCaret)
         {
           m_positionOfCaret--;
-          m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-            m_text.SubString(m_positionOfCaret + 1, m_text.Length());
+          ReplaceText(m_positionOfCaret, m_positionOfCaret + 1, wxEmptyString);
         }
       }
     }
@@ -2109,19 +2170,14 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent &event)
                 for (int i = 0; i < 4; i++)
                   if (m_text[pos] == wxT(' '))
                   {
-                    m_text =
-                      m_text.SubString(0, pos - 1) +
-                      m_text.SubString(pos + 1, m_text.Length());
+                    ReplaceText(pos, pos + 1, wxEmptyString);
                     if (end > 0)
                       end--;
                   }
               }
               else
               {
-                m_text =
-                  m_text.SubString(0, pos - 1) +
-                  wxT("    ") +
-                  m_text.SubString(pos, m_text.Length());
+                ReplaceText(pos, pos, wxT("    "));
                 end += 4;
                 pos += 4;
               }
@@ -2134,8 +2190,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent &event)
           }
           else
           {
-            m_text = m_text.SubString(0, start - 1) +
-              m_text.SubString(end, m_text.Length());
+            ReplaceText(start, end, wxEmptyString);
             ClearSelection();
           }
           m_positionOfCaret = start;
@@ -2156,9 +2211,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent &event)
               ins += wxT(" ");
             } while (col % 4 != 0);
 
-            m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-              ins +
-              m_text.SubString(m_positionOfCaret, m_text.Length());
+            ReplaceText(m_positionOfCaret, m_positionOfCaret, ins);
             m_positionOfCaret += ins.Length();
           }
           else
@@ -2167,9 +2220,7 @@ bool EditorCell::HandleSpecialKey(wxKeyEvent &event)
             long start = BeginningOfLine(m_positionOfCaret);
             if (m_text.SubString(start, start + 3) == wxT("    "))
             {
-              m_text =
-                m_text.SubString(0, start - 1) +
-                m_text.SubString(start + 4, m_text.Length());
+              ReplaceText(start, start + 4, wxEmptyString);
               if (m_positionOfCaret > start)
               {
                 m_positionOfCaret = start;
@@ -2227,14 +2278,9 @@ bool EditorCell::HandleOrdinaryKey(wxKeyEvent &event)
     return false;
   }
 
-  // It may be not too intelligent to cache all pieces of a word we arrived at
-  // during typing
-  if(keyCode == ' ')
-    m_widths.clear();
-
   if (m_historyPosition != -1)
   {
-    m_history.erase(m_history.begin() + m_historyPosition + 1, m_history.end());
+    m_history.Truncate(m_historyPosition + 1);
     m_historyPosition = -1;
   }
 
@@ -2249,57 +2295,49 @@ bool EditorCell::HandleOrdinaryKey(wxKeyEvent &event)
     switch (keyCode)
     {
     case '(':
-      m_text = m_text.SubString(0, start - 1) + wxT("(") +
-        m_text.SubString(start, end - 1) + wxT(")") +
-        m_text.SubString(end, m_text.Length());
+      ReplaceText(end, end, wxT(")"));
+      ReplaceText(start, start, wxT("("));
       m_positionOfCaret = start;
       insertLetter = false;
       break;
     case '\"':
-      m_text = m_text.SubString(0, start - 1) + wxT("\"") +
-        m_text.SubString(start, end - 1) + wxT("\"") +
-        m_text.SubString(end, m_text.Length());
+      ReplaceText(end, end, wxT("\""));
+      ReplaceText(start, start, wxT("\""));
       m_positionOfCaret = start;
       insertLetter = false;
       break;
     case '{':
-      m_text = m_text.SubString(0, start - 1) + wxT("{") +
-        m_text.SubString(start, end - 1) + wxT("}") +
-        m_text.SubString(end, m_text.Length());
+      ReplaceText(end, end, wxT("}"));
+      ReplaceText(start, start, wxT("{"));
       m_positionOfCaret = start;
       insertLetter = false;
       break;
     case '[':
-      m_text = m_text.SubString(0, start - 1) + wxT("[") +
-        m_text.SubString(start, end - 1) + wxT("]") +
-        m_text.SubString(end, m_text.Length());
+      ReplaceText(end, end, wxT("]"));
+      ReplaceText(start, start, wxT("["));
       m_positionOfCaret = start;
       insertLetter = false;
       break;
     case ')':
-      m_text = m_text.SubString(0, start - 1) + wxT("(") +
-        m_text.SubString(start, end - 1) + wxT(")") +
-        m_text.SubString(end, m_text.Length());
+      ReplaceText(end, end, wxT(")"));
+      ReplaceText(start, start, wxT("("));
       m_positionOfCaret = end + 2;
       insertLetter = false;
       break;
     case '}':
-      m_text = m_text.SubString(0, start - 1) + wxT("{") +
-        m_text.SubString(start, end - 1) + wxT("}") +
-        m_text.SubString(end, m_text.Length());
+      ReplaceText(end, end, wxT("}"));
+      ReplaceText(start, start, wxT("{"));
       m_positionOfCaret = end + 2;
       insertLetter = false;
       break;
     case ']':
-      m_text = m_text.SubString(0, start - 1) + wxT("[") +
-        m_text.SubString(start, end - 1) + wxT("]") +
-        m_text.SubString(end, m_text.Length());
+      ReplaceText(end, end, wxT("]"));
+      ReplaceText(start, start, wxT("["));
       m_positionOfCaret = end + 2;
       insertLetter = false;
       break;
     default: // delete selection
-      m_text = m_text.SubString(0, start - 1) +
-        m_text.SubString(end, m_text.Length());
+      ReplaceText(start, end, wxEmptyString);
       m_positionOfCaret = start;
       break;
     }
@@ -2317,9 +2355,7 @@ bool EditorCell::HandleOrdinaryKey(wxKeyEvent &event)
     if (event.ShiftDown())
       chr.Replace(wxT(" "), wxT("\u00a0"));
 
-    m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-      chr +
-      m_text.SubString(m_positionOfCaret, m_text.Length());
+    ReplaceText(m_positionOfCaret, m_positionOfCaret, chr);
 
     m_positionOfCaret++;
 
@@ -2328,46 +2364,35 @@ bool EditorCell::HandleOrdinaryKey(wxKeyEvent &event)
       switch (keyCode)
       {
       case '(':
-        m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-          wxT(")") +
-          m_text.SubString(m_positionOfCaret, m_text.Length());
+        ReplaceText(m_positionOfCaret, m_positionOfCaret, wxT(")"));
         break;
       case '[':
-        m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-          wxT("]") +
-          m_text.SubString(m_positionOfCaret, m_text.Length());
+        ReplaceText(m_positionOfCaret, m_positionOfCaret, wxT("]"));
         break;
       case '{':
-        m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-          wxT("}") +
-          m_text.SubString(m_positionOfCaret, m_text.Length());
+        ReplaceText(m_positionOfCaret, m_positionOfCaret, wxT("}"));
         break;
       case '"':
         if (m_positionOfCaret < (long) m_text.Length() &&
             m_text.GetChar(m_positionOfCaret) == '"')
-          m_text = m_text.SubString(0, m_positionOfCaret - 2) +
-            m_text.SubString(m_positionOfCaret, m_text.Length());
+          ReplaceText(m_positionOfCaret - 1, m_positionOfCaret, wxEmptyString);
         else
-          m_text = m_text.SubString(0, m_positionOfCaret - 1) +
-            wxT("\"") + m_text.SubString(m_positionOfCaret, m_text.Length());
+          ReplaceText(m_positionOfCaret, m_positionOfCaret, wxT("\""));
         break;
       case ')': // jump over ')'
         if (m_positionOfCaret < (long) m_text.Length() &&
             m_text.GetChar(m_positionOfCaret) == ')')
-          m_text = m_text.SubString(0, m_positionOfCaret - 2) +
-            m_text.SubString(m_positionOfCaret, m_text.Length());
+          ReplaceText(m_positionOfCaret - 1, m_positionOfCaret, wxEmptyString);
         break;
       case ']': // jump over ']'
         if (m_positionOfCaret < (long) m_text.Length() &&
             m_text.GetChar(m_positionOfCaret) == ']')
-          m_text = m_text.SubString(0, m_positionOfCaret - 2) +
-            m_text.SubString(m_positionOfCaret, m_text.Length());
+          ReplaceText(m_positionOfCaret - 1, m_positionOfCaret, wxEmptyString);
         break;
       case '}': // jump over '}'
         if (m_positionOfCaret < (long) m_text.Length() &&
             m_text.GetChar(m_positionOfCaret) == '}')
-          m_text = m_text.SubString(0, m_positionOfCaret - 2) +
-            m_text.SubString(m_positionOfCaret, m_text.Length());
+          ReplaceText(m_positionOfCaret - 1, m_positionOfCaret, wxEmptyString);
         break;
       case '+':
         // case '-': // this could mean negative.
@@ -2382,8 +2407,7 @@ bool EditorCell::HandleOrdinaryKey(wxKeyEvent &event)
           // Insert an "%" before an operator that begins this cell
           if(len == 1 && m_positionOfCaret == 1)
           {
-            m_text = m_text.SubString(0, m_positionOfCaret - 2) + wxT("%") +
-              m_text.SubString(m_positionOfCaret - 1, m_text.Length());
+            ReplaceText(m_positionOfCaret - 1, m_positionOfCaret - 1, wxT("%"));
             m_positionOfCaret += 1;
           }
 
@@ -2392,7 +2416,7 @@ bool EditorCell::HandleOrdinaryKey(wxKeyEvent &event)
           // comment in the obvious way tends to surprise users.
           if((len == 3) && (m_positionOfCaret == 3) && (m_text.StartsWith(wxT("%/*"))))
           {
-            m_text = m_text.SubString(m_positionOfCaret - 2, m_text.Length());
+            ReplaceText(0, m_positionOfCaret - 2, wxEmptyString);
             m_positionOfCaret -= 1;
           }
 
@@ -2406,146 +2430,40 @@ bool EditorCell::HandleOrdinaryKey(wxKeyEvent &event)
   return true;
 }
 
-/**
- * For a given quotation mark ("), find a matching quote.
- * Since there are no nested quotes, an odd-numbered, non-escaped quote
- * is an opening quote, and an even-numbered non-escaped quote
- * is a closing quote.
- *
- * @return true if matching quotation marks were found; false otherwise
- */
 bool EditorCell::FindMatchingQuotes()
 {
-  int pos = m_positionOfCaret;
-  if (pos < 0)
-  {
-    m_paren1 = m_paren2 = -1;
+  m_paren1 = m_paren2 = -1;
+  if ((m_positionOfCaret < 0) || !m_codeStructureValid)
     return false;
-  }
-
-  if (pos > (long) m_text.Length())
-    pos = (long) m_text.Length();
-  if ((pos == (long) m_text.Length()) ||
-      (wxString(wxT("\"")).Find(m_text.GetChar(pos)) == -1))
-  {
-    pos--;
-    if (pos < 0 ||
-        wxString(wxT("\"")).Find(m_text.GetChar(pos)) == -1)
-    {
-      m_paren1 = m_paren2 = -1;
-      return false;
-    }
-  }
 
-  decltype(m_text)::char_type prevCh = {};
-  int count = 0;
-  int i = 0;
-  for (auto ch : m_text) {
-    if (ch == '"' && prevCh != '\\')
-    {
-      ++count;
-      if (count & 1)
-      {
-        m_paren1 = i;  // open quote here
-      }
-      else
-      {
-        m_paren2 = i;  // close quote here
-        if (m_paren1 == pos || m_paren2 == pos)
-        {
-          // found the pair of quotes under the cursor
-          return true;
-        }
-      }
-    }
-    ++i;
-    prevCh = ch;
-  }
+  // A quote right of the caret wins over one left of it
+  const CodeStructure::Delimiter *quote = m_codeStructure.Find(m_positionOfCaret);
+  if (!quote || !quote->isQuote)
+    quote = m_codeStructure.Find(m_positionOfCaret - 1);
+  if (!quote || !quote->isQuote || (quote->partner < 0))
+    return false;
 
-  // didn't find matching quotes; do not highlight quotes
-  m_paren1 = m_paren2 = -1;
-  return false;
+  m_paren1 = wxMin(long(quote->pos), quote->partner);
+  m_paren2 = wxMax(long(quote->pos), quote->partner);
+  return true;
 }
 
 void EditorCell::FindMatchingParens()
 {
   if (FindMatchingQuotes())
-  {
     return;
-  }
-
-  m_paren2 = m_positionOfCaret;
-  if(m_paren2 >= (long)m_text.Length())
-    m_paren2 = m_text.Length() - 1;
-  if (m_paren2 < 0)
-  {
-    m_paren1 = m_paren2 = -1;
+  if ((m_positionOfCaret < 0) || !m_codeStructureValid)
     return;
-  }
 
-  if ((m_paren2 >= (long) m_text.Length())||
-      (wxString(wxT("([{}])")).Find(m_text.GetChar(m_paren2)) == -1))
-  {
-    m_paren2--;
-    if (m_paren2 < 0 ||
-        wxString(wxT("([{}])")).Find(m_text.GetChar(m_paren2)) == -1)
-    {
-      m_paren1 = m_paren2 = -1;
-      return;
-    }
-  }
-
-  wxChar first = m_text.GetChar(m_paren2);
-  wxChar second;
-  int dir;
-
-  switch (first)
-  {
-  case '(':
-    second = ')';
-    dir = 1;
-    break;
-  case '[':
-    second = ']';
-    dir = 1;
-    break;
-  case '{':
-    second = '}';
-    dir = 1;
-    break;
-  case ')':
-    second = '(';
-    dir = -1;
-    break;
-  case ']':
-    second = '[';
-    dir = -1;
-    break;
-  case '}':
-    second = '{';
-    dir = -1;
-    break;
-  default:
+  // A bracket right of the caret wins over one left of it
+  const CodeStructure::Delimiter *paren = m_codeStructure.Find(m_positionOfCaret);
+  if (!paren || paren->isQuote)
+    paren = m_codeStructure.Find(m_positionOfCaret - 1);
+  if (!paren || paren->isQuote || (paren->partner < 0))
     return;
-  }
-
-  m_paren1 = m_paren2 + dir;
-  int depth = 1;
-
-  while (m_paren1 >= 0 && m_paren1 < (int) m_text.Length())
-  {
-    if (m_text.GetChar(m_paren1) == second)
-      depth--;
-    else if (m_text.GetChar(m_paren1) == first)
-      depth++;
 
-    if (depth == 0)
-      break;
-    m_paren1 += dir;
-  }
-
-  if (m_paren1 < 0 || m_paren1 >= (int) m_text.Length())
-    m_paren1 = m_paren2 = -1;
+  m_paren2 = paren->pos;
+  m_paren1 = paren->partner;
 }
 
 wxString EditorCell::InterpretEscapeString(const wxString &txt) const
@@ -2629,7 +2547,7 @@ bool EditorCell::AddEnding()
 
   if(endingNeeded)
   {
-    m_text += wxT(";");
+    ReplaceText(m_text.Length(), m_text.Length(), wxT(";"));
     m_paren1 = m_paren2 = m_width = -1;
     StyleText();
     return true;
@@ -2642,53 +2560,27 @@ bool EditorCell::AddEnding()
 // position of caret is pos if caret is just before the character
 //   at position pos in m_text.
 //
-void EditorCell::PositionToXY(int position, unsigned int *x, unsigned int *y)
+void EditorCell::PositionToXY(int position, unsigned int *x, unsigned int *y) const
 {
-  int col = 0, lin = 0;
-  int pos = 0;
-
-  wxString::const_iterator it = m_text.begin();
-  while ((pos < position) && (it < m_text.end()))
-  {
-    if ((*it == '\n') || (*it == '\r'))
-    {
-      col = 0;
-      lin++;
-    }
-    else
-      col++;
-
-    ++it;
-    ++pos;
-  }
-
-  *x = col;
-  *y = lin;
+  size_t pos = wxMax(0, wxMin(position, (int)m_text.Length()));
+  size_t line = m_lines.GetLine(pos);
+  *x = pos - m_lines.GetLineStart(line);
+  *y = line;
 }
 
-int EditorCell::XYToPosition(int x, int y)
+int EditorCell::XYToPosition(int x, int y) const
 {
-  int col = 0, lin = 0, pos = 0;
-
-  wxString::const_iterator it = m_text.begin();
-  while ((it < m_text.end()) && (lin < y))
-  {
-    if ((*it == '\n') || (*it == '\r'))
-      lin++;
-
-    ++it;++pos;
-  }
-
-  while ((it < m_text.end()) && (pos < (int) m_text.Length()) && (col < x))
-  {
-    if ((*it == '\n') || (*it == '\r'))
-      break;
-    ++pos;
-    ++col;
-    ++it;
-  }
-
-  return pos;
+  if (y < 0)
+    y = 0;
+  if (y >= (int)m_lines.GetLineCount())
+    return m_text.Length();
+
+  // The last char of the line is its line ending
+  int lineStart = m_lines.GetLineStart(y);
+  int lineEnd = m_text.Length();
+  if (y + 1 < (int)m_lines.GetLineCount())
+    lineEnd = m_lines.GetLineStart(y + 1) - 1;
+  return lineStart + wxMax(0, wxMin(x, lineEnd - lineStart));
 }
 
 wxPoint EditorCell::PositionToPoint(AFontSize WXUNUSED(fontsize), int pos)
@@ -2741,18 +2633,14 @@ void EditorCell::SelectPointText(const wxPoint point)
   int lineStart = XYToPosition(0, lin);
   m_positionOfCaret = lineStart;
   // Find the text snippet the line we search for begins with
-  int currentLine = 1;
+  IndexStyledLines();
   int indentPixels = 0;
-  std::vector<StyledText>::const_iterator textSnippet;
-  for (textSnippet = m_styledText.begin();
-       ((textSnippet != m_styledText.end()) && (currentLine <= lin)); ++textSnippet)
-  {
-      if ((textSnippet->GetText() == '\n') || (textSnippet->GetText() == '\r'))
-      {
-        indentPixels = textSnippet->GetIndentPixels();
-        currentLine++;
-      }
-  }
+  std::vector<StyledText>::const_iterator textSnippet = m_styledText.end();
+  if (lin < (int)m_styledLineStarts.size())
+    textSnippet = m_styledText.begin() + m_styledLineStarts[lin];
+  if ((lin > 0) && (m_styledLineStarts.size() > 1))
+    indentPixels = m_styledText[
+      m_styledLineStarts[wxMin(lin, (int)m_styledLineStarts.size() - 1)] - 1].GetIndentPixels();
 
   if (GetType() == MC_TYPE_INPUT)
   {
@@ -2912,7 +2800,6 @@ bool EditorCell::IsPointInSelection(wxPoint point)
 
 wxString EditorCell::DivideAtCaret()
 {
-  wxString original = m_text;
   m_containsChanges = true;
   wxString newText = m_text.SubString(0, m_positionOfCaret - 1);
 
@@ -2934,6 +2821,9 @@ wxString EditorCell::DivideAtCaret()
       newText = newText.SubString(0, whiteSpaceEnd - 1);
   }
 
+  // SetValue() replaces the text anyway, so there is no need for copying it
+  wxString original;
+  original.swap(m_text);
   SetValue(newText);
   ResetSize();
   GetGroup()->ResetSize();
@@ -3133,8 +3023,7 @@ bool EditorCell::CutToClipboard()
   m_positionOfCaret = start;
 
   // We cannot use SetValue() here, since SetValue() tends to move the cursor.
-  m_text = m_text.SubString(0, start - 1) +
-           m_text.SubString(end, m_text.Length());
+  ReplaceText(start, end, wxEmptyString);
   StyleText();
 
   ClearSelection();
@@ -3154,20 +3043,14 @@ void EditorCell::InsertText(wxString text)
     SetSelection(m_positionOfCaret, m_positionOfCaret);
 
   text = TabExpand(text, m_positionOfCaret - BeginningOfLine(m_positionOfCaret));
+  text.Replace(wxT("\u2028"), "\n");
+  text.Replace(wxT("\u2029"), "\n");
 
+  // Also finds the matching parenthesis and styles the text
   ReplaceSelection(
           GetSelectionString(),
           text
   );
-
-  if (GetType() == MC_TYPE_INPUT)
-    FindMatchingParens();
-
-  m_text.Replace(wxT("\u2028"), "\n");
-  m_text.Replace(wxT("\u2029"), "\n");
-
-//  m_width = m_height = m_maxDrop = m_center = -1;
-  StyleText();
 }
 
 void EditorCell::PasteFromClipboard(const bool primary)
@@ -3179,8 +3062,6 @@ void EditorCell::PasteFromClipboard(const bool primary)
     wxTextDataObject obj;
     wxTheClipboard->GetData(obj);
     InsertText(obj.GetText());
-    m_containsChanges = true;
-    StyleText();
   }
   if (primary)
     wxTheClipboard->UsePrimarySelection(false);
@@ -3190,36 +3071,23 @@ int EditorCell::GetLineWidth(unsigned int line, int pos)
 {
   // Find the text snippet the line we search for begins with for determining
   // the indentation needed.
-  unsigned int currentLine = 1;
+  IndexStyledLines();
   int indentPixels = 0;
-  std::vector<StyledText>::const_iterator textSnippet;
-  for (textSnippet = m_styledText.begin();
-       ((textSnippet < m_styledText.end()) && (currentLine <= line)); ++textSnippet)
-  {
-    if ((textSnippet->GetText() == '\n') || (textSnippet->GetText() == '\r'))
-    {
-      indentPixels = textSnippet->GetIndentPixels();
-      currentLine++;
-    }
-  }
+  unsigned int lines = m_styledLineStarts.size();
+  if ((line > 0) && (lines > 1))
+    indentPixels = m_styledText[m_styledLineStarts[wxMin(line, lines - 1)] - 1].GetIndentPixels();
 
   if (pos == 0)
   {
     return indentPixels;
   }
 
-  unsigned int i = 0;
-
-  for (textSnippet = m_styledText.begin(); (textSnippet < m_styledText.end()) && (i < line); ++textSnippet)
-  {
-    wxString text = textSnippet->GetText();
-    if ((text.Right(1) == '\n') || (text.Right(1) == '\r'))
-      i++;
-  }
-
-  if (i < line)
+  if (line >= lines)
     return 0;
 
+  std::vector<StyledText>::const_iterator textSnippet =
+    m_styledText.begin() + m_styledLineStarts[line];
+
   SetFont();
   int width = 0;
   wxString text;
@@ -3246,17 +3114,18 @@ int EditorCell::GetLineWidth(unsigned int line, int pos)
   return width;
 }
 
-void EditorCell::SetState(const HistoryEntry &state)
+void EditorCell::SetState(size_t historyPosition)
 {
-  m_text = state.text;
+  SetText(m_history.GetText(historyPosition));
   StyleText();
-  m_positionOfCaret = state.caretPosition;
-  SetSelection(state.selStart, state.selEnd);
+  const UndoHistory::Caret &caret = m_history.GetCaret(historyPosition);
+  m_positionOfCaret = caret.position;
+  SetSelection(caret.selStart, caret.selEnd);
 }
 
 void EditorCell::AppendStateToHistory()
 {
-  m_history.emplace_back(m_text, m_positionOfCaret, m_selectionStart, m_selectionEnd);
+  m_history.Append(m_text, m_positionOfCaret, m_selectionStart, m_selectionEnd);
 }
 
 bool EditorCell::IsActive() const
@@ -3264,14 +3133,14 @@ bool EditorCell::IsActive() const
 
 bool EditorCell::CanUndo() const
 {
-  return !m_history.empty() && m_historyPosition != 0;
+  return !m_history.IsEmpty() && m_historyPosition != 0;
 }
 
 void EditorCell::Undo()
 {
   if (m_historyPosition == -1)
   {
-    m_historyPosition = m_history.size() - 1;
+    m_historyPosition = m_history.GetSize() - 1;
     AppendStateToHistory();
   }
   else
@@ -3281,7 +3150,7 @@ void EditorCell::Undo()
     return;
 
   // We cannot use SetValue() here, since SetValue() tends to move the cursor.
-  SetState(m_history[m_historyPosition]);
+  SetState(m_historyPosition);
 
   m_paren1 = m_paren2 = -1;
   m_isDirty = true;
@@ -3291,9 +3160,9 @@ void EditorCell::Undo()
 
 bool EditorCell::CanRedo() const
 {
-  return !m_history.empty() &&
+  return !m_history.IsEmpty() &&
          m_historyPosition >= 0 &&
-         m_historyPosition < ((long) m_history.size()) - 1;
+         m_historyPosition < ((long) m_history.GetSize()) - 1;
 }
 
 void EditorCell::Redo()
@@ -3303,11 +3172,11 @@ void EditorCell::Redo()
 
   m_historyPosition++;
 
-  if (m_historyPosition >= (long) m_history.size())
+  if (m_historyPosition >= (long) m_history.GetSize())
     return;
 
   // We cannot use SetValue() here, since SetValue() tends to move the cursor.
-  SetState(m_history[m_historyPosition]);
+  SetState(m_historyPosition);
 
   m_paren1 = m_paren2 = -1;
   m_isDirty = true;
@@ -3317,21 +3186,25 @@ void EditorCell::Redo()
 
 void EditorCell::SaveValue()
 {
-  if (!m_history.empty() && m_history.back().text == m_text)
+  if (!m_history.IsEmpty() && m_history.GetLastText() == m_text)
     return;
 
   if (m_historyPosition != -1)
-  {
-    m_history.erase(m_history.begin() + m_historyPosition, m_history.end());
-  }
+    m_history.Truncate(m_historyPosition);
 
+  size_t checkpoints = m_history.GetCheckpoints();
   AppendStateToHistory();
   m_historyPosition = -1;
+
+  size_t dropped = m_history.Trim(maxHistoryBytes);
+  if ((dropped > 0) || (m_history.GetCheckpoints() > checkpoints))
+    wxLogDebug("Undo history of a cell: %zu steps in %zu bytes, %zu of them full copies, %zu steps dropped",
+               m_history.GetSize(), m_history.GetMemoryUsage(), m_history.GetCheckpoints(), dropped);
 }
 
 void EditorCell::ClearUndo()
 {
-  m_history.clear();
+  m_history.Clear();
   m_historyPosition = -1;
 }
 
@@ -3372,16 +3245,75 @@ void EditorCell::HandleSoftLineBreaks_Code(StyledText *&lastSpace, int &lineWidt
   }
 }
 
+void EditorCell::AppendStyledToken(const MaximaTokenizer::Token &token)
+{
+  auto &tokenString = token.GetText();
+  if (tokenString.IsEmpty())
+    return;
+
+  // Handle Spaces
+  if (tokenString[0] == wxT(' '))
+  {
+    // All spaces except the last one (that could cause a line break)
+    // share the same token
+    if (tokenString.Length() > 1)
+      m_styledText.push_back(StyledText(tokenString.Right(tokenString.Length()-1)));
+
+    // Now we push the last space to the list of tokens: It is the space that
+    // potentially serves as the next point to introduce a soft line break.
+    m_styledText.push_back(StyledText(wxT(" ")));
+    return;
+  }
+
+  // Most of the other item types can contain Newlines - that we want as separate tokens
+  wxString line;
+  for (wxString::const_iterator it = tokenString.begin(); it < tokenString.end(); ++it)
+  {
+    if(*it != '\n')
+      line +=wxString(*it);
+    else
+    {
+      if(line != wxEmptyString)
+        m_styledText.push_back(StyledText(token.GetStyle(), line));
+      m_styledText.push_back(StyledText(token.GetStyle(), "\n"));
+      line = wxEmptyString;
+    }
+  }
+  if(line != wxEmptyString)
+    m_styledText.push_back(StyledText(token.GetStyle(), line));
+}
+
+size_t EditorCell::StyledTokenSnippets(const MaximaTokenizer::Token &token)
+{
+  auto &tokenString = token.GetText();
+  if (tokenString.IsEmpty())
+    return 0;
+  if (tokenString[0] == wxT(' '))
+    return (tokenString.Length() > 1) ? 2 : 1;
+
+  // Each newline and each piece of text between them is a snippet of its own
+  size_t snippets = 0;
+  bool inLine = false;
+  for (auto const &ch : tokenString)
+  {
+    if (ch != '\n')
+      inLine = true;
+    else
+    {
+      if (inLine)
+        snippets++;
+      snippets++;
+      inLine = false;
+    }
+  }
+  if (inLine)
+    snippets++;
+  return snippets;
+}
+
 void EditorCell::StyleTextCode()
 {
   // We have to style code
-  StyledText *lastSpace = NULL;
-  size_t lastSpacePos = 0;
-  // If a space is part of the initial spaces that do the indentation of a cell it is
-  // not eligible for soft line breaks: It would add a soft line break that causes
-  // the same indentation to be introduced in the new line again and therefore would not
-  // help at all.
-  int indentationPixels = 0;
   wxString textToStyle = m_text;
   SetFont();
   
@@ -3403,72 +3335,110 @@ void EditorCell::StyleTextCode()
 
   // Split the line into commands, numbers etc.
   m_tokens = MaximaTokenizer(textToStyle, *m_configuration).PopTokens();
+  m_tokenizedInLispMode = (*m_configuration)->InLispMode();
+  m_tokenizedChangeAsterisk = (*m_configuration)->GetChangeAsterisk();
+  StyleTokens();
+}
+
+void EditorCell::StyleTokens()
+{
+  StyledText *lastSpace = NULL;
+  size_t lastSpacePos = 0;
+  // If a space is part of the initial spaces that do the indentation of a cell it is
+  // not eligible for soft line breaks: It would add a soft line break that causes
+  // the same indentation to be introduced in the new line again and therefore would not
+  // help at all.
+  int indentationPixels = 0;
 
   // Now handle the text pieces one by one
-  wxString lastTokenWithText;
   int pos = 0;
   int lineWidth = 0;
 
-  for (auto const &token : m_tokens)
+  for (size_t i = 0; i < m_tokens.size(); ++i)
   {
+    auto const &token = m_tokens[i];
     pos += token.GetText().Length();
     auto &tokenString = token.GetText();
     if (tokenString.IsEmpty())
       continue;
-    wxChar Ch = tokenString[0];
-    
+    AppendStyledToken(token);
+
     // Handle Spaces
-    if (Ch == wxT(' '))
+    if (tokenString[0] == wxT(' '))
     {
-      // All spaces except the last one (that could cause a line break)
-      // share the same token
-      if (tokenString.Length() > 1)
-        m_styledText.push_back(StyledText(tokenString.Right(tokenString.Length()-1)));
-      
-      // Now we push the last space to the list of tokens and remember this
-      // space as the space that potentially serves as the next point to
-      // introduce a soft line break.
-      m_styledText.push_back(StyledText(wxT(" ")));
-      if (!m_styledText.empty())
-      {
-        lastSpace = &m_styledText.back();
-        lastSpacePos = pos + tokenString.Length() - 1;
-      }
-      else
-      {
-        // FIXME m_styledText is **never** empty!
-        lastSpace = NULL;
-        lastSpacePos = 0;
-      }      
+      // Remember the last space as the space that potentially serves as the
+      // next point to introduce a soft line break.
+      lastSpace = &m_styledText.back();
+      lastSpacePos = pos + tokenString.Length() - 1;
       continue;
     }
-    
-    // Most of the other item types can contain Newlines - that we want as separate tokens
-    wxString txt = tokenString;
-    wxString line;
-    for (wxString::const_iterator it2 = txt.begin(); it2 < txt.end(); ++it2)
-    {
-      if(*it2 != '\n')
-        line +=wxString(*it2);
-      else
-      {
-        if(line != wxEmptyString)
-          m_styledText.push_back(StyledText(token.GetStyle(), line));
-        m_styledText.push_back(StyledText(token.GetStyle(), "\n"));
-        line = wxEmptyString;
-      }
-    }
-    if(line != wxEmptyString)
-      m_styledText.push_back(StyledText(token.GetStyle(), line));
+
     HandleSoftLineBreaks_Code(lastSpace, lineWidth, token, pos, m_text, lastSpacePos,
                               indentationPixels);
     if ((token.GetStyle() == TS_CODE_VARIABLE) || (token.GetStyle() == TS_CODE_FUNCTION))
-    {
       m_wordList.push_back(token);
-      continue;
-    }
   }
   std::sort(m_wordList.begin(), m_wordList.end());
+
+  // Remember where the lines start so the next StyleText() can restyle only
+  // the lines that have changed.
+  if (m_firstLineOnly)
+    m_tokenLines.Clear();
+  else
+    m_tokenLines.Build(m_text, m_tokens, StyledTokenSnippets);
+}
+
+bool EditorCell::StyleTextCodeIncrementally(TokenLines::Change &change)
+{
+  Configuration *configuration = (*m_configuration);
+  if (m_tokenLines.IsEmpty() || m_firstLineOnly || m_text.IsEmpty() ||
+      configuration->GetAutoWrapCode() ||
+      (m_tokenizedInLispMode != configuration->InLispMode()) ||
+      (m_tokenizedChangeAsterisk != configuration->GetChangeAsterisk()))
+    return false;
+
+  // Remove all soft line breaks. Only an edit can have introduced them, as the
+  // rest of the text has already been styled, so only the chars the edits have
+  // touched need to be looked at. ReplaceText() keeps m_lines in sync with the
+  // text.
+  const size_t changeEnd = wxMin(m_tokenLines.GetChangeEnd(), m_text.Length());
+  for (size_t pos = m_tokenLines.GetChangeStart(); pos < changeEnd; ++pos)
+    if (m_text[pos] == wxT('\r'))
+      ReplaceText(pos, pos + 1, wxT(" "));
+
+  if (!m_tokenLines.Update(m_text, configuration, m_tokens, StyledTokenSnippets, change))
+    return true;
+
+  // Update the list of autocompletable words
+  for (auto const &token : change.oldTokens)
+  {
+    if ((token.GetStyle() != TS_CODE_VARIABLE) && (token.GetStyle() != TS_CODE_FUNCTION))
+      continue;
+    auto word = std::lower_bound(m_wordList.begin(), m_wordList.end(), token.GetText());
+    if ((word != m_wordList.end()) && (*word == token.GetText()))
+      m_wordList.erase(word);
+  }
+  for (size_t i = change.firstToken; i < change.firstToken + change.newTokens; ++i)
+  {
+    auto const &token = m_tokens[i];
+    if ((token.GetStyle() != TS_CODE_VARIABLE) && (token.GetStyle() != TS_CODE_FUNCTION))
+      continue;
+    m_wordList.insert(std::upper_bound(m_wordList.begin(), m_wordList.end(), token.GetText()),
+                      token.GetText());
+  }
+
+  // Replace the styled text of the lines that have been tokenized anew. The
+  // snippets are generated at the end of m_styledText and then moved into
+  // place.
+  const size_t oldStyledSize = m_styledText.size();
+  for (size_t i = change.firstToken; i < change.firstToken + change.newTokens; ++i)
+    AppendStyledToken(m_tokens[i]);
+  std::vector<StyledText> newSnippets(std::make_move_iterator(m_styledText.begin() + oldStyledSize),
+                                      std::make_move_iterator(m_styledText.end()));
+  m_styledText.erase(m_styledText.begin() + oldStyledSize, m_styledText.end());
+  TokenLines::ReplaceRange(m_styledText, change.firstSnippet, change.endSnippet,
+                           std::move(newSnippets));
+  return true;
 }
 
 void EditorCell::StyleTextTexts()
@@ -3498,9 +3468,26 @@ void EditorCell::StyleTextTexts()
 
     unsigned int i = 0;
     signed int indent;
+
+    // The width of the current line up to the char end is the sum of the
+    // widths of the words in front of it: The words are measured only once,
+    // for all lines and all line widths.
+    unsigned int measuredUpTo = 0;
+    int measuredWidth = 0;
+    auto LineWidth = [&](unsigned int end) {
+      if (end + 1 > measuredUpTo)
+      {
+        measuredWidth += GetTextSize(m_text.SubString(measuredUpTo, end)).GetWidth();
+        measuredUpTo = end + 1;
+      }
+      return measuredWidth;
+    };
+
     wxString::const_iterator it = m_text.begin();
     while (it < m_text.end())
     {
+      measuredUpTo = lastLineStart;
+      measuredWidth = 0;
       // Extract a line inserting a soft linebreak if necessary
       while (it < m_text.end())
       {
@@ -3520,7 +3507,7 @@ void EditorCell::StyleTextTexts()
               indent = 0;
 
             // How long is the current line already?
-            width = GetTextSize(m_text.SubString(lastLineStart, i)).GetWidth();
+            width = LineWidth(i);
             // Do we need to introduce a soft line break?
             if (width + indent >= configuration->GetLineWidth())
             {
@@ -3562,7 +3549,7 @@ void EditorCell::StyleTextTexts()
           {
             
             // Determine the current line's length
-            width = GetTextSize(m_text.SubString(lastLineStart, i)).GetWidth();
+            width = LineWidth(i);
             // Determine the current indentation
             if ((!indentPixels.empty()) && (!newLine))
               indent = indentPixels.back();
@@ -3757,27 +3744,218 @@ void EditorCell::StyleTextTexts()
   ResetSize();
 } // Style text, not code?
 
-void EditorCell::StyleText()
+void EditorCell::StyleText(bool inBackground)
 {
   // We will need to determine the width of text and therefore need to set
-  // the font type and size.
-  SetFont();
+  // the font type and size. Fonts and the device context may only be used by
+  // the main thread, though: Cells that are created while loading a file in
+  // parallel set their font when they are recalculated.
+  if (wxThread::IsMain())
+    SetFont();
+
+  m_styledLineStarts.clear();
+  m_codeStructureValid = false;
+  // The result of a background task that is still running would be outdated
+  m_backgroundStyling.reset();
+  // Styling replaces soft line breaks and, in text cells, bullets
+  TextChanged();
 
+  // Most edits change only a few lines of code
+  TokenLines::Change change;
+  if ((m_type == MC_TYPE_INPUT) && StyleTextCodeIncrementally(change))
+  {
+    UpdateCodeStructure(&change);
+    return;
+  }
 
   m_wordList.clear();
   m_styledText.clear();
+  m_tokens.clear();
+  m_tokenLines.Clear();
 
   if(m_text == wxEmptyString)
+  {
+    m_lines.Build(m_text);
+    UpdateCodeStructure();
     return;
+  }
 
   // Remove all soft line breaks. They will be re-added in the right places
   // in the next step
   m_text.Replace(wxT("\r"), wxT(" "));
   // Do we need to style code or text?
   if (m_type == MC_TYPE_INPUT)
-    StyleTextCode();
-  else
+  {
+    if (!wxThread::IsMain())
+      TokenizeForMainThread();
+    else if (!inBackground || !StyleTextCodeInBackground())
+      StyleTextCode();
+  }
+  else if (wxThread::IsMain())
     StyleTextTexts();
+  else
+  {
+    // Wrapping a text measures it, which needs the fonts and the device
+    // context => a cell that is created by a background task while loading a
+    // file is styled when the main thread recalculates it.
+    m_isDirty = true;
+    ResetSize();
+  }
+
+  // Styling has changed the line breaks
+  m_lines.Build(m_text);
+  UpdateCodeStructure();
+}
+
+void EditorCell::UpdateCodeStructure(const TokenLines::Change *change)
+{
+  // The tokens of a folded cell describe only its first line, and a cell that
+  // is being styled in the background doesn't have any tokens, yet.
+  m_codeStructureValid = (m_type == MC_TYPE_INPUT) && !m_firstLineOnly && !m_backgroundStyling;
+  if (m_codeStructureValid && change)
+    m_codeStructure.Update(m_tokens, change->firstToken, change->oldTokens, change->newTokens);
+  else if (m_codeStructureValid)
+    m_codeStructure.Build(m_tokens);
+  else
+    m_codeStructure.Clear();
+}
+
+bool EditorCell::StyleTextCodeInBackground()
+{
+#ifdef HAVE_OPENMP_TASKS
+  // Small cells are styled faster than a task is scheduled. Cells that are
+  // created by a background task while loading a file are styled by it, too.
+  if ((m_text.Length() < backgroundStylingThreshold) || m_firstLineOnly ||
+      !wxThread::IsMain() || !GetWorksheet())
+    return false;
+
+  Configuration *configuration = (*m_configuration);
+  auto styling = std::make_shared<BackgroundStyling>();
+  // The reference counting of wxString isn't thread-safe => the task gets a
+  // copy of the text that doesn't share its data with m_text.
+  styling->text = wxString(m_text.wc_str(), m_text.Length());
+  styling->inLispMode = configuration->InLispMode();
+  styling->changeAsterisk = configuration->GetChangeAsterisk();
+  m_backgroundStyling = styling;
+  auto &cellsBeingStyled = GetCellPointers()->m_cellsBeingStyled;
+  if (std::none_of(cellsBeingStyled.begin(), cellsBeingStyled.end(),
+                   [this](const CellPtr<EditorCell> &cell){ return cell.get() == this; }))
+    cellsBeingStyled.push_back(this);
+
+  // The main thread may change the configuration while the task runs.
+  #pragma omp task firstprivate(styling)
+  {
+    auto tokens =
+      MaximaTokenizer(styling->text, styling->inLispMode, styling->changeAsterisk).PopTokens();
+    #pragma omp critical (EditorCellStyling)
+    {
+      styling->tokens = std::move(tokens);
+      styling->done = true;
+    }
+    // Make the worksheet look for cells whose styling is ready
+    wxWakeUpIdle();
+  }
+
+  StylePlainText();
+  return true;
+#else
+  return false;
+#endif
+}
+
+void EditorCell::TokenizeForMainThread()
+{
+  // Styling the tokens may measure them, which needs the fonts and the device
+  // context => the main thread applies the tokens on recalculating the cell.
+  m_isDirty = true;
+  ResetSize();
+  if (m_firstLineOnly)
+    return;
+
+  Configuration *configuration = (*m_configuration);
+  auto styling = std::make_shared<BackgroundStyling>();
+  styling->text = m_text;
+  styling->inLispMode = configuration->InLispMode();
+  styling->changeAsterisk = configuration->GetChangeAsterisk();
+  styling->tokens =
+    MaximaTokenizer(m_text, styling->inLispMode, styling->changeAsterisk).PopTokens();
+  styling->done = true;
+  m_backgroundStyling = styling;
+}
+
+void EditorCell::StylePlainText()
+{
+  size_t start = 0;
+  while (start <= m_text.Length())
+  {
+    size_t end = m_text.find(wxT('\n'), start);
+    if (end == wxString::npos)
+      end = m_text.Length();
+    if (end > start)
+      m_styledText.push_back(StyledText(m_text.SubString(start, end - 1)));
+    if (end < m_text.Length())
+      m_styledText.push_back(StyledText(wxT("\n")));
+    start = end + 1;
+  }
+}
+
+bool EditorCell::BackgroundStylingDone() const
+{
+  if (!m_backgroundStyling)
+    return false;
+  bool done;
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp critical (EditorCellStyling)
+  #endif
+  done = m_backgroundStyling->done;
+  return done;
+}
+
+void EditorCell::ApplyBackgroundStyling()
+{
+  std::shared_ptr<BackgroundStyling> styling;
+  styling.swap(m_backgroundStyling);
+  if (!styling)
+    return;
+
+  Configuration *configuration = (*m_configuration);
+  if ((styling->text != m_text) ||
+      (styling->inLispMode != configuration->InLispMode()) ||
+      (styling->changeAsterisk != configuration->GetChangeAsterisk()))
+  {
+    // The tokens are outdated
+    StyleText(true);
+    return;
+  }
+
+  SetFont();
+  TextChanged();
+  m_styledLineStarts.clear();
+  m_wordList.clear();
+  m_styledText.clear();
+  m_tokens = std::move(styling->tokens);
+  m_tokenizedInLispMode = styling->inLispMode;
+  m_tokenizedChangeAsterisk = styling->changeAsterisk;
+  StyleTokens();
+
+  // Styling has changed the line breaks
+  m_lines.Build(m_text);
+  UpdateCodeStructure();
+}
+
+void EditorCell::FinishBackgroundStyling()
+{
+  if (!m_backgroundStyling)
+    return;
+
+  if (BackgroundStylingDone())
+    ApplyBackgroundStyling();
+  else
+    // Tokenizing the text once more doesn't need to wait for the task to get its turn
+    StyleText();
+  ResetSize();
+  if (m_group)
+    m_group->ResetSize();
 }
 
 
@@ -3842,14 +4020,15 @@ void EditorCell::SetValue(const wxString &text)
   if(m_positionOfCaret < 0)
     m_positionOfCaret = 0;
 
-  FindMatchingParens();
-  m_containsChanges = true;
-
   m_text.Replace(wxT("\u2028"), "\n");
   m_text.Replace(wxT("\u2029"), "\n");
+  m_lines.Build(m_text);
+  m_tokenLines.ReplaceAll();
+  m_containsChanges = true;
 
   // Style the text.
-  StyleText();
+  StyleText(true);
+  FindMatchingParens();
   if (m_group)
     m_group->ResetSize();
   ResetData();
@@ -3866,146 +4045,68 @@ bool EditorCell::CheckChanges()
   return false;
 }
 
-int EditorCell::ReplaceAll(wxString oldString, const wxString &newString, bool ignoreCase)
+void EditorCell::ReplaceAll(wxString newText)
 {
-  if (oldString == wxEmptyString)
-    return 0;
-
   SaveValue();
-  wxString newText;
-  int count = 0;
-  if(!ignoreCase)
-  {
-    newText = m_text;
-    newText.Replace(wxT("\r"), wxT(" "));
-    count = newText.Replace(oldString, newString);
-  }
-  else
-  {
-    int pos;
-    wxString src = m_text;
-    src.Replace(wxT("\r"), wxT(" "));
-    wxString src_LowerCase = src;
-    src_LowerCase.MakeLower();
-    oldString.MakeLower();
-    do{
-      pos = src_LowerCase.Find(oldString);
-      if(pos == wxNOT_FOUND)
-        newText += src;
-      else
-      {
-        newText += src.Left(pos);
-        newText += newString;
-        src_LowerCase = src_LowerCase.Right(src_LowerCase.Length()-pos-newString.Length());
-        src = src.Right(src.Length()-pos-oldString.Length());
-        count ++;
-      }
-    } while((pos != wxNOT_FOUND) && (src != wxEmptyString));
-  }
-  if (count > 0)
-  {
-    m_text = newText;
-    m_containsChanges = true;
-    ClearSelection();
-    StyleText();
-  }
-
-  // If text is selected setting the selection again updates m_selectionString
-  if (m_selectionStart > 0)
-    SetSelection(m_selectionStart, m_selectionEnd);
-
-  m_text.Replace(wxT("\u2028"), "\n");
-  m_text.Replace(wxT("\u2029"), "\n");
-
-  return count;
+  newText.Replace(wxT("\u2028"), "\n");
+  newText.Replace(wxT("\u2029"), "\n");
+  SetText(newText);
+  m_containsChanges = true;
+  ClearSelection();
+  StyleText();
 }
 
-bool EditorCell::FindNext(wxString str, bool down, bool ignoreCase)
+int EditorCell::GetSearchStart(bool down) const
 {
-  int start = down ? 0 : m_text.Length();
-  wxString text(m_text);
-
-  text.Replace(wxT('\r'), wxT(' '));
-
-  if (ignoreCase)
-  {
-    str.MakeLower();
-    text.MakeLower();
-  }
-
   if (m_selectionStart >= 0)
-  {
-    if (down)
-      start = m_selectionStart + 1;
-    else
-      start = m_selectionStart ;
-  }
-  else if (IsActive())
-    start = m_positionOfCaret;
-
-  if (!down && m_selectionStart == 0)
-    return false;
-
-  int strStart = wxNOT_FOUND;
-  if (down)
-    strStart = text.find(str, start);
-  else
-    strStart = text.rfind(str, start);
-
-  if (strStart != wxNOT_FOUND)
-  {
-    SetSelection(strStart, strStart + str.Length());
-    return true;
-  }
-  return false;
+    return down ? m_selectionStart + 1 : m_selectionStart;
+  if (IsActive())
+    return m_positionOfCaret;
+  return down ? 0 : m_text.Length();
 }
 
 bool EditorCell::ReplaceSelection(const wxString &oldStr, const wxString &newString,
                                   bool keepSelected, bool ignoreCase,
                                   bool replaceMaximaString)
 {
-  wxString text(m_text);
-  text.Replace(wxT("\r"), wxT(" "));
-
   long start = wxMin(m_selectionStart, m_selectionEnd);
   long end = wxMax(m_selectionStart, m_selectionEnd);
   if (m_selectionStart < 0)
   {
     if (oldStr == wxEmptyString)
-      SetSelection(m_positionOfCaret, m_positionOfCaret);
+      start = end = m_positionOfCaret;
     else
       return false;
   }
 
+  // Only the selection is compared, so replacing a few chars doesn't copy the
+  // whole text.
+  wxString selection = m_text.SubString(start, end - 1);
+  selection.Replace(wxT("\r"), wxT(" "));
   if (ignoreCase)
   {
-    if (text.SubString(start, end - 1).Upper() !=
-        wxString(oldStr).Upper()
-            )
+    if (selection.Upper() != oldStr.Upper())
       return false;
   }
   else
   {
-    if (text.SubString(start, end - 1) != oldStr)
+    if (selection != oldStr)
       return false;
   }
 
   // We cannot use SetValue() here, since SetValue() tends to move the cursor.
-  wxString text_left = text.SubString(0, start - 1);
-  wxString text_right = text.SubString(end, text.Length());
-  m_text = text_left+
-    newString +
-    text_right;
-  StyleText();
-  
+  ReplaceText(start, end, newString);
+
   m_containsChanges = true;
   m_positionOfCaret = start + newString.Length();
   
   if(replaceMaximaString)
   {
-    if((newString.EndsWith("\"") || (text_right.StartsWith("\""))))
+    bool quoteRight = (m_positionOfCaret < (long)m_text.Length()) &&
+      (m_text.GetChar(m_positionOfCaret) == wxT('"'));
+    if((newString.EndsWith("\"") || quoteRight))
     {
-      if(!((newString.EndsWith("\"") && (text_right.StartsWith("\"")))))
+      if(!((newString.EndsWith("\"") && quoteRight)))
         m_positionOfCaret--;
     }
   }
@@ -4015,10 +4116,9 @@ bool EditorCell::ReplaceSelection(const wxString &oldStr, const wxString &newStr
   else
     ClearSelection();
   
+  StyleText(true);
   if (GetType() == MC_TYPE_INPUT)
     FindMatchingParens();
-  
-  StyleText();
   return true;
 }
 
@@ -25,10 +25,17 @@
 #define EDITORCELL_H
 
 #include "Cell.h"
+#include "CodeStructure.h"
 #include "FontAttribs.h"
+#include "LineIndex.h"
 #include "MaximaTokenizer.h"
+#include "TextWidthCache.h"
+#include "TokenLines.h"
+#include "UndoHistory.h"
 #include <vector>
+#include <atomic>
 #include <list>
+#include <memory>
 
 /*! \file
 
@@ -163,10 +170,50 @@ public:
 
     For cells containing text instead of code this function adds a <code>\\r</code> as a marker
     that this line is to be broken here until the window's width changes.
+    Text is measured and wrapped only by the main thread: If a background task calls
+    this function the cell stays unstyled until the main thread recalculates it.
+
+    \param inBackground true = If this is a code cell of at least backgroundStylingThreshold
+                        chars the cell is displayed as plain text first and the text is
+                        tokenized by a background task. The styled text is swapped in by
+                        the first Recalculate() after the task has finished.
    */
-  void StyleText();
+  void StyleText(bool inBackground = false);
   /*! Is Called by StyleText() if this is a code cell */
   void StyleTextCode();
+  //! Converts m_tokens into styled text snippets and soft line breaks
+  void StyleTokens();
+  /*! Starts tokenizing the text in the background and displays it as plain text meanwhile
+
+    \return false, if the text is to be styled right away, instead.
+   */
+  bool StyleTextCodeInBackground();
+  /*! Tokenizes the text of a cell that a background task creates
+
+    The tokens are converted to styled text by the first Recalculate(), which
+    runs in the main thread.
+   */
+  void TokenizeForMainThread();
+  //! Splits m_text into unstyled lines
+  void StylePlainText();
+  /*! Restyles only the lines of a code cell that have changed since the last StyleText()
+
+    Re-tokenizes the text starting at the last line in front of the change that
+    doesn't begin within a string or a comment and stops as soon as a line start
+    is reached that the old token list has a line start for, too. All other
+    tokens and styled text snippets - including their widths - are kept.
+
+    \param change Receives the tokens that have been replaced
+    \return false, if the cell needs to be styled from scratch instead.
+   */
+  bool StyleTextCodeIncrementally(TokenLines::Change &change);
+  /*! Analyzes the brackets and strings of m_tokens
+
+    \param change The tokens StyleTextCodeIncrementally() has replaced. If this
+    is given only the code from the last checkpoint in front of the change on is
+    analyzed anew.
+   */
+  void UpdateCodeStructure(const TokenLines::Change *change = nullptr);
   void StyleTextTexts();
 
   void Reset();
@@ -188,16 +235,16 @@ public:
   size_t BeginningOfLine(long pos) const;
 
   //! Return the index of the last char of the line containing the letter \#pos,
-  size_t EndOfLine(long pos);
+  size_t EndOfLine(long pos) const;
 
   //! Adds a ";" to the end of the last command in this cell in case that it doesn't end in $ or ;
   bool AddEnding() override;
 
   //! Determines which line and column the pos'th char is at.
-  void PositionToXY(int position, unsigned int *x, unsigned int *y);
+  void PositionToXY(int position, unsigned int *x, unsigned int *y) const;
 
   //! Determines which index the char at the position "x chars left, y chars down" is at.
-  int XYToPosition(int x, int y);
+  int XYToPosition(int x, int y) const;
 
   //! The screen coordinates of the cursor
   wxPoint PositionToPoint(AFontSize fontsize, int pos = -1) override;
@@ -259,10 +306,23 @@ public:
     return m_selectionStart != -1;
   }
 
+  /*! Sets m_paren1 and m_paren2 to the quotes of the string the caret is at
+
+    \return true if matching quotation marks were found; false otherwise
+  */
   bool FindMatchingQuotes();
 
+  //! Sets m_paren1 and m_paren2 to the quotes or brackets the caret is at
   void FindMatchingParens();
 
+  /*! The brackets, strings and syntax errors of the code in this cell
+
+    nullptr, if this isn't a code cell, if the cell displays only a part of
+    its code or if its code is still being tokenized in the background.
+  */
+  const CodeStructure *GetCodeStructure() const
+  { return m_codeStructureValid ? &m_codeStructure : nullptr; }
+
   int GetLineWidth(unsigned int line, int pos);
 
   //! true, if this cell's width has to be recalculated.
@@ -349,21 +409,26 @@ public:
 
   bool CheckChanges();
 
-  /*! Replaces all occurrences of a given string
+  /*! Replaces the text by the result of a "replace all"
+
+    Unlike SetValue() this records the change in the undo history and doesn't
+    auto-complete brackets.
    */
-  int ReplaceAll(wxString oldString, const wxString &newString, bool ignoreCase);
+  void ReplaceAll(wxString newText);
 
-  /*! Finds the next occurrences of a string
+  /*! The index a search in this cell starts at
 
-    \param str The string to search for
-    \param down 
-     - true: search downwards
-     - false: search upwards
-    \param ignoreCase
-     - true: Case-insensitive search
-     - false: Case-sensitive search
+    Searching down finds the matches that start at this index or later,
+    searching up the ones that start in front of it.
    */
-  bool FindNext(wxString str, bool down, bool ignoreCase);
+  int GetSearchStart(bool down) const;
+
+  /*! A number that changes whenever the text of this cell changes
+
+    Is unique among all cells, which allows SearchIndex to tell if it has
+    already seen this text.
+  */
+  wxUint64 GetTextRevision() const { return m_textRevision; }
 
   bool IsSelectionChanged() const { return m_selectionChanged; }
 
@@ -453,9 +518,22 @@ public:
     SetSelection(m_lastSelectionStart, m_text.Length());
   }
 
-  //! Get the list of commands, parenthesis, strings and whitespaces in a code cell
+  /*! Get the list of commands, parenthesis, strings and whitespaces in a code cell
+
+    Is empty while the cell is being styled in the background: Call
+    FinishBackgroundStyling() first if the tokens are needed right away.
+  */
   const MaximaTokenizer::TokenList &GetTokens() const {return m_tokens;}
 
+  //! Is a background task tokenizing the text of this cell or has it finished doing so?
+  bool BackgroundStylingPending() const { return bool(m_backgroundStyling); }
+  //! Has the background task that tokenizes the text of this cell finished?
+  bool BackgroundStylingDone() const;
+  //! Swaps in the result of the background styling now, or styles the text in the foreground
+  void FinishBackgroundStyling();
+  //! Code cells with at least this many chars are styled in the background
+  static constexpr size_t backgroundStylingThreshold = 20000;
+
   void SetNextToDraw(Cell *next) override;
 
   Cell *GetNextToDraw() const override {return m_nextToDraw;}
@@ -533,8 +611,35 @@ private:
   {
     ResetSize();
     ResetData();
-    m_widths.clear();
+    ResetTextWidths();
+  }
+
+  //! Forget all text widths we have measured with the old font
+  void ResetTextWidths();
+
+  /*! Replaces the chars start...end-1 of the text by newText
+
+    All changes to parts of m_text are made by this function, which keeps the
+    index of the line starts up-to-date and tells m_tokenLines which part of
+    the code needs to be tokenized anew.
+   */
+  void ReplaceText(long start, long end, const wxString &newText);
+  //! Replaces the whole text
+  void SetText(const wxString &text)
+  {
+    m_text = text;
+    TextChanged();
+    m_lines.Build(m_text);
+    m_tokenLines.ReplaceAll();
+    m_codeStructureValid = false;
   }
+  //! Builds the index of the styled text snippets each line starts with, if necessary
+  void IndexStyledLines();
+
+  //! Appends the snippets a token of code is displayed as to m_styledText
+  void AppendStyledToken(const MaximaTokenizer::Token &token);
+  //! The number of snippets AppendStyledToken() appends for a token
+  static size_t StyledTokenSnippets(const MaximaTokenizer::Token &token);
 
   /*! Adds soft line breaks to code cells, if needed.
 
@@ -566,27 +671,21 @@ private:
   //! Determines the size of a text snippet
   wxSize GetTextSize(const wxString &text);
 
-  struct HistoryEntry // 64 bytes
-  {
-    wxString text;
-    int caretPosition = -1;
-    int selStart = -1;
-    int selEnd = -1;
-    HistoryEntry() = default;
-    HistoryEntry(const wxString &text, int caretPosition, int selStart, int selEnd) :
-      text(text), caretPosition(caretPosition), selStart(selStart), selEnd(selEnd) {}
-  };
-  //! Set the editor's state from a history entry
-  void SetState(const HistoryEntry &state);
+  //! Set the editor's state from an entry of the undo history
+  void SetState(size_t historyPosition);
   //! Append the editor's state to the history
   void AppendStateToHistory();
+  //! Gives the text a new revision
+  void TextChanged() { m_textRevision = ++m_lastTextRevision; }
+  /*! Styles the text from the tokens the background task has generated
+
+    Discards them and styles the text anew if they don't match the current text
+    or configuration any more.
+   */
+  void ApplyBackgroundStyling();
 
 //** Large fields
 //**
-  WX_DECLARE_STRING_HASH_MAP(wxSize, StringHash);
-  //! Cached widths of text snippets, one width per style
-  StringHash m_widths;
-
   //! A list of all potential autoComplete targets within this cell
   std::vector<wxString> m_wordList;
 
@@ -596,12 +695,56 @@ private:
   wxString m_text;
   std::vector<StyledText> m_styledText;
 
-  std::vector<HistoryEntry> m_history;
+  //! Where the lines of m_text start. Hard and soft line breaks both start a new line.
+  LineIndex m_lines;
+  /*! The index of the first snippet of each line in m_styledText
+
+    Is built from scratch by IndexStyledLines() after the text has been styled.
+   */
+  std::vector<size_t> m_styledLineStarts;
+
+  //! The brackets and strings of a code cell. Is rebuilt after each styling.
+  CodeStructure m_codeStructure;
+
+  //! The lines m_tokens can be re-tokenized from. Empty = restyle from scratch.
+  TokenLines m_tokenLines;
+
+  /*! The work of a background task that tokenizes a snapshot of m_text
+
+    Is shared with the task, which means that the cell may be deleted while the
+    task is still running.
+   */
+  struct BackgroundStyling
+  {
+    //! A copy of m_text that shares no data with it
+    wxString text;
+    bool inLispMode = false;
+    bool changeAsterisk = false;
+    //! The tokens text is split into. Valid once done is true.
+    MaximaTokenizer::TokenList tokens;
+    //! Is set by the task once it has finished. Guarded by the EditorCellStyling critical section.
+    bool done = false;
+  };
+  //! The background styling of the current text, if there is one
+  std::shared_ptr<BackgroundStyling> m_backgroundStyling;
+
+  UndoHistory m_history;
+  //! The number of bytes the undo history of a cell may occupy
+  static constexpr size_t maxHistoryBytes = 8 * 1024 * 1024;
+
+//** 8 bytes
+//**
+  //! The revision of m_text, see GetTextRevision()
+  wxUint64 m_textRevision = ++m_lastTextRevision;
+  //! The last revision any cell's text has been given
+  static std::atomic<wxUint64> m_lastTextRevision;
 
 //** 8/4 bytes
 //**
   AFontName m_fontName;
   CellPtr<Cell> m_nextToDraw;
+  //! The sizes of text snippets in the current font. Shared with all cells using this font.
+  TextWidthCache::Widths *m_widths = nullptr;
 
 //** 4 bytes
 //**
@@ -664,6 +807,9 @@ private:
     m_saveValue = false;
     m_selectionChanged = false;
     m_underlined = false;
+    m_tokenizedInLispMode = false;
+    m_tokenizedChangeAsterisk = false;
+    m_codeStructureValid = false;
   }
 
   //! Mark this cell as "Automatically answer questions".
@@ -680,6 +826,12 @@ private:
   bool m_selectionChanged : 1 /* InitBitFields */;
   //! Does this cell's size have to be recalculated?
   bool m_underlined : 1 /* InitBitFields */;
+  //! Was maxima in lisp mode when m_tokens was generated?
+  bool m_tokenizedInLispMode : 1 /* InitBitFields */;
+  //! Did m_tokens replace "*" by a centered dot?
+  bool m_tokenizedChangeAsterisk : 1 /* InitBitFields */;
+  //! Does m_codeStructure describe the current text?
+  bool m_codeStructureValid : 1 /* InitBitFields */;
 };
 
 #endif // EDITORCELL_H
@@ -131,6 +131,7 @@ void EvaluationQueue::AddTokens(GroupCell *cell)
     return;
   wxString token;
   int index = 0;
+  cell->GetEditable()->FinishBackgroundStyling();
   for (auto const &tok : cell->GetEditable()->GetTokens())
   {
     const TextStyle itemStyle = tok.GetStyle();
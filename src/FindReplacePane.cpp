@@ -111,15 +111,26 @@ FindReplacePane::FindReplacePane(wxWindow *parent, wxFindReplaceData *data) :
 
   grid_sizer->AddSpacer(0);
 
+  wxBoxSizer *optionsbox = new wxBoxSizer(wxHORIZONTAL);
   m_matchCase = new wxCheckBox(this, -1, _("Match Case"));
   m_matchCase->SetValue(!!(data->GetFlags() & wxFR_MATCHCASE));
-  grid_sizer->Add(m_matchCase, wxSizerFlags().Expand().Border(wxALL, 5));
+  optionsbox->Add(m_matchCase, wxSizerFlags().Expand().Border(wxALL, 5));
   m_matchCase->Connect(
           wxEVT_CHECKBOX,
           wxCommandEventHandler(FindReplacePane::OnMatchCase),
           NULL, this
   );
 
+  m_regex = new wxCheckBox(this, -1, _("Regular expression"));
+  m_regex->SetValue(!!(data->GetFlags() & regexFlag));
+  optionsbox->Add(m_regex, wxSizerFlags().Expand().Border(wxALL, 5));
+  m_regex->Connect(
+          wxEVT_CHECKBOX,
+          wxCommandEventHandler(FindReplacePane::OnRegex),
+          NULL, this
+  );
+  grid_sizer->Add(optionsbox, wxSizerFlags().Expand());
+
   // If I press <tab> in the search text box I want to arrive in the
   // replacement text box immediately.
   m_replaceText->MoveAfterInTabOrder(m_searchText);
@@ -175,6 +186,13 @@ void FindReplacePane::OnMatchCase(wxCommandEvent &event)
   wxConfig::Get()->Write(wxT("findFlags"), m_findReplaceData->GetFlags());  
 }
 
+void FindReplacePane::OnRegex(wxCommandEvent &event)
+{
+  m_findReplaceData->SetFlags(
+          (m_findReplaceData->GetFlags() & (~regexFlag)) | (event.IsChecked() * regexFlag));
+  wxConfig::Get()->Write(wxT("findFlags"), m_findReplaceData->GetFlags());  
+}
+
 void FindReplacePane::OnActivate(wxActivateEvent &event)
 {
   if (event.GetActive())
@@ -55,10 +55,14 @@ private:
   wxRadioButton *m_forward;
   wxRadioButton *m_backwards;
   wxCheckBox *m_matchCase;
+  wxCheckBox *m_regex;
 
 public:
   FindReplacePane(wxWindow *parent, wxFindReplaceData *data);
 
+  //! The flag that marks the search string as a regular expression. wxFR_* lacks one.
+  static constexpr int regexFlag = 0x100;
+
   wxString GetFindString()
   { return m_findReplaceData->GetFindString(); }
 
@@ -84,6 +88,8 @@ protected:
 
   void OnMatchCase(wxCommandEvent &event);
 
+  void OnRegex(wxCommandEvent &event);
+
   void OnKeyDown(wxKeyEvent &event);
 
 };
@@ -40,6 +40,10 @@
 #include "stx/unique_cast.hpp"
 #include <wx/config.h>
 #include <wx/clipbrd.h>
+#include <locale>
+#include <sstream>
+
+std::atomic<wxUint64> GroupCell::m_lastId{0};
 
 #if wxUSE_ACCESSIBILITY
   // TODO This class is not used anywhere.
@@ -454,6 +458,19 @@ void GroupCell::Recalculate()
   {
     m_mathFontSize = (*m_configuration)->GetMathFontSize();
     Configuration *configuration = (*m_configuration);
+
+    // If we know how high the cell will be we can postpone laying it out
+    // until it scrolls into view: Worksheet::OnPaint() discards the hint of
+    // every cell it has to draw.
+    if (HasHeightHint() && configuration->ClipToDrawRegion())
+    {
+      m_center = 0;
+      m_height = m_heightHint;
+      ResetCellListSizes();
+      UpdateYPosition();
+      return;
+    }
+    m_heightHint = -1;
     m_recalculateWidths = false;
     // Recalculating pagebreaks is simple
     if (m_groupType == GC_TYPE_PAGEBREAK)
@@ -1100,16 +1117,15 @@ wxString GroupCell::ToTeX(wxString imgDir, wxString filename, int *imgCounter) c
     case GC_TYPE_IMAGE:
       if (imgDir != wxEmptyString)
       {
-        auto const copy = m_output->Copy();
-        auto *const imgCopy = dynamic_cast<ImgCell *>(copy.get());
+        auto *const img = dynamic_cast<ImgCell *>(m_output.get());
         (*imgCounter)++;
         wxString image = filename + wxString::Format(wxT("_%d"), *imgCounter);
-        wxString file = imgDir + wxT("/") + image + wxT(".") + imgCopy->GetExtension();
+        wxString file = imgDir + wxT("/") + image + wxT(".") + img->GetExtension();
 
         if (!wxDirExists(imgDir))
           wxMkdir(imgDir);
 
-        if (imgCopy->ToImageFile(file).x >= 0)
+        if (img->IsStoredIn(file) || (img->ToImageFile(file).x >= 0))
         {
           str << wxT("\\begin{figure}[htb]\n")
               << wxT("  \\centering\n")
@@ -1183,16 +1199,15 @@ wxString GroupCell::ToTeXCodeCell(wxString imgDir, wxString filename, int *imgCo
   // Input cells
   if (configuration->ShowCodeCells())
   {
-    // For LaTeX export we must use a dot as decimal separator
-    // Save LC_NUMERIC, set it to "C", print out the float and then restore it.
-    const std::string saved_lc_numeric{setlocale(LC_NUMERIC, NULL)}; // get current LC_NUMERIC locale
-    setlocale(LC_NUMERIC, "C");
-    str += wxString::Format(
-      "\n\n\\noindent\n%%%%%%%%%%%%%%%%\n%%%% INPUT:\n\\begin{minipage}[t]{%fem}\\color{red}\\bfseries\n",
-      (double)configuration->GetLabelWidth()/14
-      ) + m_inputLabel->ToTeX() +
+    // For LaTeX export we must use a dot as decimal separator. Cells are
+    // exported in parallel => we cannot temporarily switch LC_NUMERIC to "C".
+    std::ostringstream labelWidth;
+    labelWidth.imbue(std::locale::classic());
+    labelWidth << std::fixed << (double)configuration->GetLabelWidth()/14;
+    str += wxT("\n\n\\noindent\n%%%%%%%%\n%% INPUT:\n\\begin{minipage}[t]{") +
+      wxString(labelWidth.str()) + wxT("em}\\color{red}\\bfseries\n") +
+      m_inputLabel->ToTeX() +
       wxString("\n\\end{minipage}");
-    setlocale(LC_NUMERIC, saved_lc_numeric.c_str());
 
     if (m_inputLabel->m_next)
     {
@@ -1275,7 +1290,26 @@ wxString GroupCell::ToTeXCodeCell(wxString imgDir, wxString filename, int *imgCo
   return str;
 }
 
-wxString GroupCell::ToTeXImage(Cell *tmp, wxString imgDir, wxString filename, int *imgCounter)
+int GroupCell::TeXImageCount() const
+{
+  switch (m_groupType)
+  {
+  case GC_TYPE_IMAGE:
+    return 1;
+  case GC_TYPE_CODE:
+  {
+    int count = 0;
+    for (Cell *tmp = m_output.get(); tmp; tmp = tmp->GetNextToDraw())
+      if (tmp->GetType() == MC_TYPE_IMAGE || tmp->GetType() == MC_TYPE_SLIDE)
+        count++;
+    return count;
+  }
+  default:
+    return 0;
+  }
+}
+
+wxString GroupCell::ToTeXImage(Cell *tmp, wxString imgDir, wxString filename, int *imgCounter) const
 {
   wxASSERT_MSG((imgCounter != NULL), _("Bug: No image counter to write to!"));
   if (imgCounter == NULL) return wxEmptyString;
@@ -1284,8 +1318,7 @@ wxString GroupCell::ToTeXImage(Cell *tmp, wxString imgDir, wxString filename, in
 
   if (imgDir != wxEmptyString)
   {
-    auto const copy = tmp->Copy();
-    auto *const imgCopy = dynamic_cast<ImgCell *>(copy.get());
+    auto *const img = dynamic_cast<ImgCell *>(tmp);
     (*imgCounter)++;
     wxString image = filename + wxString::Format(wxT("_%d"), *imgCounter);
     if (!wxDirExists(imgDir))
@@ -1293,16 +1326,14 @@ wxString GroupCell::ToTeXImage(Cell *tmp, wxString imgDir, wxString filename, in
         return wxEmptyString;
 
     // Do we want to output LaTeX animations?
-    bool AnimateLaTeX = true;
-    wxConfig::Get()->Read(wxT("AnimateLaTeX"), &AnimateLaTeX);
-    if ((tmp->GetType() == MC_TYPE_SLIDE) && (AnimateLaTeX))
+    if ((tmp->GetType() == MC_TYPE_SLIDE) && (*m_configuration)->AnimateLaTeX())
     {
       SlideShow *src = dynamic_cast<SlideShow *>(tmp);
       str << wxT("\\begin{animateinline}{") + wxString::Format(wxT("%i"), src->GetFrameRate()) + wxT("}\n");
       for (int i = 0; i < src->Length(); i++)
       {
         wxString Frame = imgDir + wxT("/") + image + wxString::Format(wxT("_%i"), i);
-        if ((src->GetBitmap(i)).SaveFile(Frame + wxT(".png")))
+        if (src->ToImageFile(i, Frame + wxT(".png")).x >= 0)
           str << wxT("\\includegraphics[width=.95\\linewidth,height=.80\\textheight,keepaspectratio]{") + Frame +
                  wxT("}\n");
         else
@@ -1314,8 +1345,10 @@ wxString GroupCell::ToTeXImage(Cell *tmp, wxString imgDir, wxString filename, in
     }
     else
     {
-      wxString file = imgDir + wxT("/") + image + wxT(".") + imgCopy->GetExtension();
-      if (imgCopy->ToImageFile(file).x >= 0)
+      if (!img)
+        return wxT("\n\\verb|<<GRAPHICS>>|\n");
+      wxString file = imgDir + wxT("/") + image + wxT(".") + img->GetExtension();
+      if (img->IsStoredIn(file) || (img->ToImageFile(file).x >= 0))
         str += wxT("\\includegraphics[width=.95\\linewidth,height=.80\\textheight,keepaspectratio]{") +
                filename + wxT("_img/") + image + wxT("}");
       else
@@ -1398,6 +1431,11 @@ wxString GroupCell::ToXML() const
   if(GetSuppressTooltipMarker())
     str += wxT(" hideToolTip=\"true\"");
 
+  // The height of the cell allows to display the file faster the next time it
+  // is opened
+  if ((*m_configuration)->WxmxLayoutHints() && !m_isHidden && (m_height > 0))
+    str += wxString::Format(wxT(" height=\"%i\""), m_height);
+
   // write hidden status
   if (m_isHidden)
     str += wxT(" hide=\"true\"");
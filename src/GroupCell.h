@@ -32,9 +32,10 @@
 
 #include "Cell.h"
 #include "EditorCell.h"
+#include <atomic>
 
 //! All types a GroupCell can be of
-// This enum's elements must be synchronized with (WXMFormat.h) WXMHeaderId.
+// This enum's elements must be synchronized with (WXMParser.h) WXMHeaderId.
 enum GroupType : int8_t
 {
   GC_TYPE_INVALID = -1,
@@ -167,13 +168,27 @@ public:
   //! GroupCells warn if they contain both greek and latin lookalike chars.
   void UpdateConfusableCharWarnings();
   
+  /*! Returns the TeX code for this cell and writes the images it contains
+
+    Images that already exist in imgDir and haven't changed aren't rewritten.
+    Doesn't need the GUI, which means that this can be called from a
+    background thread while other cells are converted to TeX.
+
+    \param imgDir The directory the images are written to
+    \param filename The base name of the image files
+    \param imgCounter The number of the last image that was written. Is
+                      increased by TeXImageCount().
+   */
   wxString ToTeX(wxString imgDir, wxString filename, int *imgCounter) const;
 
+  //! The number of images ToTeX() writes
+  int TeXImageCount() const;
+
   wxString ToRTF() const override;
 
   wxString ToTeXCodeCell(wxString imgDir, wxString filename, int *imgCounter) const;
 
-  static wxString ToTeXImage(Cell *tmp, wxString imgDir, wxString filename, int *imgCounter);
+  wxString ToTeXImage(Cell *tmp, wxString imgDir, wxString filename, int *imgCounter) const;
 
   wxString ToTeX() const override;
 
@@ -416,6 +431,25 @@ public:
   bool GetSuppressTooltipMarker() const { return m_suppressTooltipMarker; }
   void SetSuppressTooltipMarker(bool suppress)
     {m_suppressTooltipMarker = suppress;}
+
+  /*! A number that identifies this cell as long as wxMaxima runs
+
+    Copies of a cell get a new number. The autosave journal uses this number
+    in order to find out which cells have changed since the last save.
+  */
+  wxUint64 GetId() const { return m_id; }
+
+  /*! Tell the cell how high it was when its file was saved
+
+    Until the cell scrolls into view Recalculate() uses this height instead of
+    laying out the cell. Only valid as long as the zoom factor, the fonts and
+    the worksheet width are the ones the file was saved with.
+  */
+  void SetHeightHint(int height) { m_heightHint = height; }
+  //! Does the cell use the height the file it was loaded from told it?
+  bool HasHeightHint() const { return m_heightHint >= 0; }
+  //! Lay the cell out exactly the next time it is recalculated
+  void DiscardHeightHint() { m_heightHint = -1; }
 protected:
   bool NeedsRecalculation(AFontSize fontSize) const override;
   int GetInputIndent();
@@ -426,10 +460,15 @@ protected:
 //**
   wxRect m_outputRect{-1, -1, 0, 0};
 
-//** 8/4 byte objects (40 bytes)
+//** 8/4 byte objects (48 bytes)
 //**
   CellPtr<Cell> m_nextToDraw;
 
+  //! The number GetId() returns
+  const wxUint64 m_id = ++m_lastId;
+  //! The last number a GroupCell has been assigned as its id
+  static std::atomic<wxUint64> m_lastId;
+
   GroupCell *m_hiddenTree = {}; //!< here hidden (folded) tree of GCs is stored
   GroupCell *m_hiddenTreeParent = {}; //!< store linkage to the parent of the fold
 
@@ -442,10 +481,12 @@ protected:
   std::unique_ptr<Cell> m_output;
   // The pointers above point to inner cells and must be kept contiguous.
 
-//** 4-byte objects (12 bytes)
+//** 4-byte objects (16 bytes)
 //**
   int m_labelWidth_cached = 0;
   int m_inputWidth, m_inputHeight;
+  //! The height SetHeightHint() has set. -1 = none.
+  int m_heightHint = -1;
 
 //** 2-byte objects (6 bytes)
 //**
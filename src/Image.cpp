@@ -36,6 +36,64 @@
 #include "SvgBitmap.h"
 #include "ErrorRedirector.h"
 #include "StringUtils.h"
+#include <cstring>
+#include <vector>
+
+std::unordered_map<wxString, Image::BlobCache::Entry, wxStringHash> Image::BlobCache::m_entries;
+wxFileSystem *Image::BlobCache::m_lastFilesystem = NULL;
+
+bool Image::BlobCache::Get(const std::shared_ptr<wxFileSystem> &filesystem, const wxString &name,
+                           SharedBlob &data)
+{
+  bool found = false;
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp critical (ImageBlobCache)
+  #endif
+  {
+    auto entry = m_entries.find(Key(filesystem, name));
+    if((entry != m_entries.end()) && (entry->second.filesystem.lock() == filesystem))
+    {
+      data = entry->second.data;
+      found = true;
+    }
+  }
+  return found;
+}
+
+void Image::BlobCache::Add(const std::shared_ptr<wxFileSystem> &filesystem, const wxString &name,
+                           const SharedBlob &data)
+{
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp critical (ImageBlobCache)
+  #endif
+  {
+    // A new file is being loaded => forget about the files that no cell loads
+    // from anymore.
+    if(filesystem.get() != m_lastFilesystem)
+    {
+      for (auto entry = m_entries.begin(); entry != m_entries.end();)
+      {
+        if(entry->second.filesystem.expired())
+          entry = m_entries.erase(entry);
+        else
+          ++entry;
+      }
+      m_lastFilesystem = filesystem.get();
+    }
+    m_entries[Key(filesystem, name)] = {filesystem, data};
+  }
+}
+
+void Image::BlobCache::Clear()
+{
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp critical (ImageBlobCache)
+  #endif
+  {
+    m_entries.clear();
+    m_lastFilesystem = NULL;
+  }
+}
 
 Image::Image(Configuration **config)
 {
@@ -62,7 +120,7 @@ Image::Image(Configuration **config, wxMemoryBuffer image, wxString type)
   #endif
   m_configuration = config;
   m_scaledBitmap.Create(1, 1);
-  m_compressedImage = image;
+  m_compressedImage = MakeSharedBlob(image.GetData(), image.GetDataLen());
   m_extension = type;
   m_isOk = false;
   m_width = 1;
@@ -71,9 +129,9 @@ Image::Image(Configuration **config, wxMemoryBuffer image, wxString type)
   m_originalHeight = 480;
   
   wxImage Image;
-  if (m_compressedImage.GetDataLen() > 0)
+  if (BlobSize(m_compressedImage) > 0)
   {
-    wxMemoryInputStream istream(m_compressedImage.GetData(), m_compressedImage.GetDataLen());
+    wxMemoryInputStream istream(BlobData(m_compressedImage), BlobSize(m_compressedImage));
     Image.LoadFile(istream);
     m_isOk = Image.IsOk();
     m_originalWidth = Image.GetWidth();
@@ -158,18 +216,18 @@ Image::~Image()
     free(m_svgImage);
 }
 
-wxMemoryBuffer Image::ReadCompressedImage(wxInputStream *data)
+SharedBlob Image::ReadCompressedImage(wxInputStream *data)
 {
-  wxMemoryBuffer retval;
+  std::vector<char> retval;
   std::vector<char> buf(8192);
 
   while (data->CanRead())
   {
     data->Read(buf.data(), buf.size());
-    retval.AppendData(buf.data(), data->LastRead());
+    retval.insert(retval.end(), buf.data(), buf.data() + data->LastRead());
   }
 
-  return retval;
+  return MakeSharedBlob(std::move(retval));
 }
 
 wxBitmap Image::GetUnscaledBitmap()
@@ -194,7 +252,7 @@ wxBitmap Image::GetUnscaledBitmap()
   }
   else
   {
-    wxMemoryInputStream istream(m_compressedImage.GetData(), m_compressedImage.GetDataLen());
+    wxMemoryInputStream istream(BlobData(m_compressedImage), BlobSize(m_compressedImage));
     wxImage img(istream, wxBITMAP_TYPE_ANY);
     wxBitmap bmp;
     if (img.Ok())
@@ -203,7 +261,31 @@ wxBitmap Image::GetUnscaledBitmap()
   }
 }
 
-wxMemoryBuffer Image::GetCompressedImage()
+wxImage Image::GetUnscaledImage()
+{
+  #ifdef HAVE_OMP_HEADER
+  WaitForLoad waitforload(&m_imageLoadLock);
+  #endif
+
+  if(!m_isOk)
+    return wxImage();
+
+  if (m_svgRast)
+  {
+    std::vector<unsigned char> imgdata(m_originalWidth*m_originalHeight*4);
+
+    nsvgRasterize(m_svgRast.get(), m_svgImage, 0,0,1, imgdata.data(),
+                  m_originalWidth, m_originalHeight, m_originalWidth*4);
+    return SvgBitmap::RGBA2wxImage(imgdata.data(), m_originalWidth, m_originalHeight);
+  }
+  else
+  {
+    wxMemoryInputStream istream(BlobData(m_compressedImage), BlobSize(m_compressedImage));
+    return wxImage(istream, wxBITMAP_TYPE_ANY);
+  }
+}
+
+SharedBlob Image::GetCompressedImage()
 {
   #ifdef HAVE_OMP_HEADER
   WaitForLoad waitforload(&m_imageLoadLock);
@@ -270,7 +352,7 @@ void Image::LoadGnuplotSource_Backgroundtask(wxString gnuplotFilename, wxString
       if (strucStat.st_size > (*m_configuration)->MaxGnuplotMegabytes()*1000*1000)
       {
         wxLogMessage(_("Too much gnuplot data => Not storing it in the worksheet"));
-        m_gnuplotData_Compressed.Clear();
+        m_gnuplotData_Compressed.reset();
         #ifdef HAVE_OMP_HEADER
         omp_unset_lock(&m_gnuplotLock);
         #endif
@@ -315,9 +397,8 @@ void Image::LoadGnuplotSource_Backgroundtask(wxString gnuplotFilename, wxString
           textOut.Flush();
           zstream.Close();
       
-          m_gnuplotSource_Compressed.Clear();
-          m_gnuplotSource_Compressed.AppendData(mstream.GetOutputStreamBuffer()->GetBufferStart(),
-                                                mstream.GetOutputStreamBuffer()->GetBufferSize());
+          m_gnuplotSource_Compressed = MakeSharedBlob(mstream.GetOutputStreamBuffer()->GetBufferStart(),
+                                                      mstream.GetOutputStreamBuffer()->GetBufferSize());
         }
     
         {
@@ -344,9 +425,8 @@ void Image::LoadGnuplotSource_Backgroundtask(wxString gnuplotFilename, wxString
             textOut.Flush();
             zstream.Close();
       
-            m_gnuplotData_Compressed.Clear();
-            m_gnuplotData_Compressed.AppendData(mstream.GetOutputStreamBuffer()->GetBufferStart(),
-                                                mstream.GetOutputStreamBuffer()->GetBufferSize());
+            m_gnuplotData_Compressed = MakeSharedBlob(mstream.GetOutputStreamBuffer()->GetBufferStart(),
+                                                      mstream.GetOutputStreamBuffer()->GetBufferSize());
           }
         }
       }
@@ -354,6 +434,7 @@ void Image::LoadGnuplotSource_Backgroundtask(wxString gnuplotFilename, wxString
   }
   else
   {
+    if(!BlobCache::Get(filesystem, m_gnuplotSource, m_gnuplotSource_Compressed))
     {
       wxFSFile *fsfile;
       #ifdef HAVE_OPENMP_TASKS
@@ -400,14 +481,15 @@ void Image::LoadGnuplotSource_Backgroundtask(wxString gnuplotFilename, wxString
               }
               textOut.Flush();
               zstream.Close();
-              m_gnuplotSource_Compressed.Clear();
-              m_gnuplotSource_Compressed.AppendData(mstream.GetOutputStreamBuffer()->GetBufferStart(),
-                                                    mstream.GetOutputStreamBuffer()->GetBufferSize());
+              m_gnuplotSource_Compressed = MakeSharedBlob(mstream.GetOutputStreamBuffer()->GetBufferStart(),
+                                                          mstream.GetOutputStreamBuffer()->GetBufferSize());
+              BlobCache::Add(filesystem, m_gnuplotSource, m_gnuplotSource_Compressed);
             }
           }
         }
       }
     }
+    if(!BlobCache::Get(filesystem, m_gnuplotData, m_gnuplotData_Compressed))
     {
       wxFSFile *fsfile;
       #ifdef HAVE_OPENMP_TASKS
@@ -443,9 +525,9 @@ void Image::LoadGnuplotSource_Backgroundtask(wxString gnuplotFilename, wxString
               textOut.Flush();
               zstream.Close();
               
-              m_gnuplotData_Compressed.Clear();
-              m_gnuplotData_Compressed.AppendData(mstream.GetOutputStreamBuffer()->GetBufferStart(),
-                                                  mstream.GetOutputStreamBuffer()->GetBufferSize());
+              m_gnuplotData_Compressed = MakeSharedBlob(mstream.GetOutputStreamBuffer()->GetBufferStart(),
+                                                        mstream.GetOutputStreamBuffer()->GetBufferSize());
+              BlobCache::Add(filesystem, m_gnuplotData, m_gnuplotData_Compressed);
             }
           }
         }
@@ -458,9 +540,9 @@ void Image::LoadGnuplotSource_Backgroundtask(wxString gnuplotFilename, wxString
   #endif
 }
 
-wxMemoryBuffer Image::GetGnuplotSource()
+SharedBlob Image::GetGnuplotSource()
 {
-  wxMemoryBuffer retval;
+  SharedBlob retval;
   #ifdef HAVE_OMP_HEADER
   omp_set_lock(&m_gnuplotLock);
   #else
@@ -470,8 +552,8 @@ wxMemoryBuffer Image::GetGnuplotSource()
   #endif
   {  
     if(
-      (m_gnuplotSource_Compressed.GetDataLen() < 2) || 
-      (m_gnuplotData_Compressed.GetDataLen() < 2))
+      (BlobSize(m_gnuplotSource_Compressed) < 2) || 
+      (BlobSize(m_gnuplotData_Compressed) < 2))
     {
       #ifdef HAVE_OMP_HEADER
       omp_unset_lock(&m_gnuplotLock);
@@ -483,8 +565,8 @@ wxMemoryBuffer Image::GetGnuplotSource()
     if(output.IsOk())
     {
       wxMemoryInputStream mstream(
-        m_gnuplotSource_Compressed.GetData(),
-        m_gnuplotSource_Compressed.GetDataLen()
+        BlobData(m_gnuplotSource_Compressed),
+        BlobSize(m_gnuplotSource_Compressed)
         );
       wxZlibInputStream zstream(mstream);
       wxTextInputStream textIn(zstream);
@@ -497,8 +579,8 @@ wxMemoryBuffer Image::GetGnuplotSource()
       }
       textOut.Flush();
 
-      retval.AppendData(output.GetOutputStreamBuffer()->GetBufferStart(),
-                        output.GetOutputStreamBuffer()->GetBufferSize());
+      retval = MakeSharedBlob(output.GetOutputStreamBuffer()->GetBufferStart(),
+                              output.GetOutputStreamBuffer()->GetBufferSize());
     }
   }
   #ifdef HAVE_OMP_HEADER
@@ -508,9 +590,9 @@ wxMemoryBuffer Image::GetGnuplotSource()
   return retval;
 }
 
-wxMemoryBuffer Image::GetGnuplotData()
+SharedBlob Image::GetGnuplotData()
 {
-  wxMemoryBuffer retval;
+  SharedBlob retval;
   #ifdef HAVE_OMP_HEADER
   omp_set_lock(&m_gnuplotLock);
   #else
@@ -520,8 +602,8 @@ wxMemoryBuffer Image::GetGnuplotData()
   #endif
   {
     if(
-      (m_gnuplotSource_Compressed.GetDataLen() < 2) || 
-      (m_gnuplotData_Compressed.GetDataLen() < 2))
+      (BlobSize(m_gnuplotSource_Compressed) < 2) || 
+      (BlobSize(m_gnuplotData_Compressed) < 2))
     {
       #ifdef HAVE_OMP_HEADER
       omp_unset_lock(&m_gnuplotLock);
@@ -534,8 +616,8 @@ wxMemoryBuffer Image::GetGnuplotData()
     if(output.IsOk())
     {
       wxMemoryInputStream mstream(
-        m_gnuplotData_Compressed.GetData(),
-        m_gnuplotData_Compressed.GetDataLen()
+        BlobData(m_gnuplotData_Compressed),
+        BlobSize(m_gnuplotData_Compressed)
         );
       wxZlibInputStream zstream(mstream);
       wxTextInputStream textIn(zstream);
@@ -548,8 +630,8 @@ wxMemoryBuffer Image::GetGnuplotData()
       }
       textOut.Flush();
 
-      retval.AppendData(output.GetOutputStreamBuffer()->GetBufferStart(),
-                        output.GetOutputStreamBuffer()->GetBufferSize());
+      retval = MakeSharedBlob(output.GetOutputStreamBuffer()->GetBufferStart(),
+                              output.GetOutputStreamBuffer()->GetBufferSize());
     }
   }
   #ifdef HAVE_OMP_HEADER
@@ -558,6 +640,16 @@ wxMemoryBuffer Image::GetGnuplotData()
   return retval;
 }
 
+wxString Image::TempFileName(const wxString &file) const
+{
+  wxString name = wxFileName(file).GetFullName();
+  const wxString prefix = wxString::Format(wxT("wxmaxima_%p_"), (const void *)this);
+  // The file may have been restored already
+  if (!name.StartsWith(prefix))
+    name = prefix + name;
+  return wxStandardPaths::Get().GetTempDir() + "/" + name;
+}
+
 wxString Image::GnuplotData()
 {
   if((!m_gnuplotData.IsEmpty()) && (!wxFileExists(m_gnuplotData)))
@@ -571,23 +663,21 @@ wxString Image::GnuplotData()
     #endif
     {
     // Move the gnuplot data and data file into our temp directory
-      wxFileName gnuplotSourceFile(m_gnuplotSource);
-      m_gnuplotSource = wxStandardPaths::Get().GetTempDir() + "/" + gnuplotSourceFile.GetFullName();
-      wxFileName gnuplotDataFile(m_gnuplotData);
-      m_gnuplotData = wxStandardPaths::Get().GetTempDir() + "/" + gnuplotDataFile.GetFullName();
+      m_gnuplotSource = TempFileName(m_gnuplotSource);
+      m_gnuplotData = TempFileName(m_gnuplotData);
 
       wxFileOutputStream output(m_gnuplotData);
       wxTextOutputStream textOut(output);
       if(output.IsOk())
       {
-        if(m_gnuplotData_Compressed.GetDataLen() <= 1)
+        if(BlobSize(m_gnuplotData_Compressed) <= 1)
         {
           wxLogMessage(_("No gnuplot data!"));
           return wxEmptyString;
         }
         wxMemoryInputStream mstream(
-          m_gnuplotData_Compressed.GetData(),
-          m_gnuplotData_Compressed.GetDataLen()
+          BlobData(m_gnuplotData_Compressed),
+          BlobSize(m_gnuplotData_Compressed)
           );
         wxZlibInputStream zstream(mstream);
         wxTextInputStream textIn(zstream);
@@ -621,24 +711,22 @@ wxString Image::GnuplotSource()
     #endif
     {
       // Move the gnuplot source and data file into our temp directory
-      wxFileName gnuplotSourceFile(m_gnuplotSource);
-      m_gnuplotSource = wxStandardPaths::Get().GetTempDir() + "/" + gnuplotSourceFile.GetFullName();
-      wxFileName gnuplotDataFile(m_gnuplotData);
-      m_gnuplotData = wxStandardPaths::Get().GetTempDir() + "/" + gnuplotDataFile.GetFullName();
+      m_gnuplotSource = TempFileName(m_gnuplotSource);
+      m_gnuplotData = TempFileName(m_gnuplotData);
   
       wxFileOutputStream output(m_gnuplotSource);
       wxTextOutputStream textOut(output);
       if(output.IsOk())
       {
 
-        if(m_gnuplotSource_Compressed.GetDataLen() <= 1)
+        if(BlobSize(m_gnuplotSource_Compressed) <= 1)
         {
           wxLogMessage(_("No gnuplot source!"));
           return wxEmptyString;
         }
         wxMemoryInputStream mstream(
-          m_gnuplotSource_Compressed.GetData(),
-          m_gnuplotSource_Compressed.GetDataLen()
+          BlobData(m_gnuplotSource_Compressed),
+          BlobSize(m_gnuplotSource_Compressed)
           );
         wxZlibInputStream zstream(mstream);
         if(zstream.IsOk())
@@ -665,6 +753,47 @@ wxString Image::GnuplotSource()
   return m_gnuplotSource;
 }
  
+bool Image::IsStoredIn(const wxString &filename)
+{
+  #ifdef HAVE_OMP_HEADER
+  WaitForLoad waitforload(&m_imageLoadLock);
+  #endif
+  if (!wxFileExists(filename))
+    return false;
+  wxFile file(filename);
+  if (!file.IsOpened() || (file.Length() != (wxFileOffset)BlobSize(m_compressedImage)))
+    return false;
+
+  // Compare the file in chunks instead of reading it as a whole
+  const char *data = BlobData(m_compressedImage);
+  std::vector<char> buffer(65536);
+  size_t pos = 0;
+  while (pos < BlobSize(m_compressedImage))
+  {
+    ssize_t len = file.Read(buffer.data(), buffer.size());
+    if ((len <= 0) || (memcmp(buffer.data(), data + pos, len) != 0))
+      return false;
+    pos += len;
+  }
+  return true;
+}
+
+//! Do two file name extensions denote the same image format?
+static bool SameImageFormat(wxString ext1, wxString ext2)
+{
+  ext1.MakeLower();
+  ext2.MakeLower();
+  if (ext1 == wxT("jpeg"))
+    ext1 = wxT("jpg");
+  if (ext2 == wxT("jpeg"))
+    ext2 = wxT("jpg");
+  if (ext1 == wxT("tiff"))
+    ext1 = wxT("tif");
+  if (ext2 == wxT("tiff"))
+    ext2 = wxT("tif");
+  return ext1 == ext2;
+}
+
 wxSize Image::ToImageFile(wxString filename)
 {
   #ifdef HAVE_OMP_HEADER
@@ -672,49 +801,43 @@ wxSize Image::ToImageFile(wxString filename)
   #endif
   wxFileName fn(filename);
   wxString ext = fn.GetExt();
-  if (filename.Lower().EndsWith(GetExtension().Lower()))
+  if ((BlobSize(m_compressedImage) > 0) && SameImageFormat(ext, m_extension))
   {
+    // The file format matches => write the original bytes. This is fast,
+    // doesn't need the GUI and doesn't change a single pixel.
     wxFile file(filename, wxFile::write);
     if (!file.IsOpened())
       return wxSize(-1, -1);
 
-    file.Write(m_compressedImage.GetData(), m_compressedImage.GetDataLen());
-    if (file.Close())
+    bool written = (file.Write(BlobData(m_compressedImage), BlobSize(m_compressedImage)) ==
+                    BlobSize(m_compressedImage));
+    if (file.Close() && written)
       return wxSize(m_originalWidth, m_originalHeight);
     else
       return wxSize(-1, -1);
   }
 
-  if((filename.Lower().EndsWith(".svg")) && (m_extension == "svgz"))
+  if((ext.Lower() == wxT("svg")) && (m_extension == "svgz"))
   {
-    // Unzip the .svgz image
-    wxString svgContents_string;
-    wxMemoryInputStream istream(m_compressedImage.GetData(), m_compressedImage.GetDataLen());
+    // Unzip the .svgz image directly into the file
+    wxMemoryInputStream istream(BlobData(m_compressedImage), BlobSize(m_compressedImage));
     wxZlibInputStream zstream(istream);
     if(!zstream.IsOk())
       return wxSize(-1, -1);
-    wxTextInputStream textIn(zstream);
-    wxString line;
-    while(!zstream.Eof())
-    {
-      line = textIn.ReadLine();
-      svgContents_string += line + wxT("\n");
-    }
-    wxFile file(filename, wxFile::write);
-    if (!file.IsOpened())
+    wxFileOutputStream output(filename);
+    if (!output.IsOk())
       return wxSize(-1, -1);
-    wxFileOutputStream output(file);
-    wxTextOutputStream text(output);
-    text << svgContents_string;
-    if (file.Close())
+    output.Write(zstream);
+    bool written = (zstream.GetLastError() == wxSTREAM_EOF) && output.IsOk();
+    if (output.Close() && written)
       return wxSize(m_originalWidth, m_originalHeight);
     else
-      return wxSize(-1, -1);    
+      return wxSize(-1, -1);
   }
   else
   {
-    wxBitmap bitmap = GetUnscaledBitmap();
-    wxImage image = bitmap.ConvertToImage();
+    // Only transcode the image if the file format differs from the image's
+    wxImage image = GetUnscaledImage();
     wxBitmapType mimetype = wxBITMAP_TYPE_ANY;
     if ((ext.Lower() == wxT("jpg")) || (ext.Lower() == wxT("jpeg")))
       mimetype = wxBITMAP_TYPE_JPEG;
@@ -776,9 +899,9 @@ wxBitmap Image::GetBitmap(double scale)
   else
   {
     wxImage img;
-    if (m_compressedImage.GetDataLen() > 0)
+    if (BlobSize(m_compressedImage) > 0)
     {
-      wxMemoryInputStream istream(m_compressedImage.GetData(), m_compressedImage.GetDataLen());
+      wxMemoryInputStream istream(BlobData(m_compressedImage), BlobSize(m_compressedImage));
 
       img = wxImage(istream, wxBITMAP_TYPE_ANY);
     }
@@ -847,8 +970,8 @@ void Image::LoadImage(const wxBitmap &bitmap)
   m_isOk = image.IsOk();
   wxMemoryOutputStream stream;
   image.SaveFile(stream, wxBITMAP_TYPE_PNG);
-  m_compressedImage.AppendData(stream.GetOutputStreamBuffer()->GetBufferStart(),
-                               stream.GetOutputStreamBuffer()->GetBufferSize());
+  m_compressedImage = MakeSharedBlob(stream.GetOutputStreamBuffer()->GetBufferStart(),
+                                     stream.GetOutputStreamBuffer()->GetBufferSize());
 
   // Set the info about the image.
   m_extension = wxT("png");
@@ -892,22 +1015,26 @@ void Image::LoadImage_Backgroundtask(wxString image, std::shared_ptr<wxFileSyste
   #endif
 
   m_imageName = image;
-  m_compressedImage.Clear();
+  m_compressedImage.reset();
   m_scaledBitmap.Create(1, 1);
 
   if (filesystem)
   {
-    wxFSFile * fsfile;
-    #ifdef HAVE_OPENMP_TASKS
-    #pragma omp critical (OpenFSFile)
-    #endif
-    fsfile = filesystem->OpenFile(image);
-    if (fsfile)
-    { // open successful
+    if(!BlobCache::Get(filesystem, image, m_compressedImage))
+    {
+      wxFSFile * fsfile;
+      #ifdef HAVE_OPENMP_TASKS
+      #pragma omp critical (OpenFSFile)
+      #endif
+      fsfile = filesystem->OpenFile(image);
+      if (fsfile)
+      { // open successful
 
-      wxInputStream *istream = fsfile->GetStream();
+        wxInputStream *istream = fsfile->GetStream();
 
-      m_compressedImage = ReadCompressedImage(istream);
+        m_compressedImage = ReadCompressedImage(istream);
+        BlobCache::Add(filesystem, image, m_compressedImage);
+      }
     }
 
     // Closing and deleting fsfile is important: If this line is missing
@@ -942,7 +1069,7 @@ void Image::LoadImage_Backgroundtask(wxString image, std::shared_ptr<wxFileSyste
   m_isOk = false;
 
   wxImage Image;
-  if (m_compressedImage.GetDataLen() > 0)
+  if (BlobSize(m_compressedImage) > 0)
   {
     if((m_extension == "svg") || (m_extension == "svgz"))
     {
@@ -953,8 +1080,8 @@ void Image::LoadImage_Backgroundtask(wxString image, std::shared_ptr<wxFileSyste
       {
         // We can read the file from memory without much ado...
         svgContents_string = wxString::FromUTF8(
-          (char *)m_compressedImage.GetData(),
-          m_compressedImage.GetDataLen());
+          BlobData(m_compressedImage),
+          BlobSize(m_compressedImage));
         
         // ...but we want to compress the in-memory image for saving memory
         wxMemoryOutputStream mstream;
@@ -963,16 +1090,15 @@ void Image::LoadImage_Backgroundtask(wxString image, std::shared_ptr<wxFileSyste
         textOut << svgContents_string;
         textOut.Flush();
         zstream.Close();
-        m_compressedImage.Clear();
-        m_compressedImage.AppendData(mstream.GetOutputStreamBuffer()->GetBufferStart(),
-                                     mstream.GetOutputStreamBuffer()->GetBufferSize());
+        m_compressedImage = MakeSharedBlob(mstream.GetOutputStreamBuffer()->GetBufferStart(),
+                                           mstream.GetOutputStreamBuffer()->GetBufferSize());
         m_extension += "z";
         m_imageName += "z";
       }
       else
       {
         // Unzip the .svgz image
-        wxMemoryInputStream istream(m_compressedImage.GetData(), m_compressedImage.GetDataLen());
+        wxMemoryInputStream istream(BlobData(m_compressedImage), BlobSize(m_compressedImage));
         wxZlibInputStream zstream(istream);
         wxTextInputStream textIn(zstream);
         wxString line;
@@ -1011,7 +1137,7 @@ void Image::LoadImage_Backgroundtask(wxString image, std::shared_ptr<wxFileSyste
     }
     else
     {   
-      wxMemoryInputStream istream(m_compressedImage.GetData(), m_compressedImage.GetDataLen());
+      wxMemoryInputStream istream(BlobData(m_compressedImage), BlobSize(m_compressedImage));
       Image.LoadFile(istream);
       m_originalWidth = 700;
       m_originalHeight = 300;
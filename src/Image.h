@@ -31,12 +31,15 @@
 
 #include "precomp.h"
 #include "Cell.h"
+#include "SharedBlob.h"
 #include "Version.h"
 #include <wx/image.h>
 
 #include <wx/filesys.h>
 #include <wx/fs_arc.h>
 #include <wx/buffer.h>
+#include <memory>
+#include <unordered_map>
 #include "nanoSVG/nanosvg.h"
 #include "nanoSVG/nanosvgrast.h"
 
@@ -133,9 +136,9 @@ public:
   wxString GnuplotData();
 
   //! Returns the gnuplot source of this image
-  wxMemoryBuffer GetGnuplotSource();
+  SharedBlob GetGnuplotSource();
   //! Returns the gnuplot data of this image
-  wxMemoryBuffer GetGnuplotData();
+  SharedBlob GetGnuplotData();
   
   /*! Temporarily forget the scaled image in order to save memory
 
@@ -164,6 +167,13 @@ public:
   //! Saves the image in its original form, or as .png if it originates in a bitmap
   wxSize ToImageFile(wxString filename);
 
+  /*! Does a file already contain exactly this image in its original form?
+
+    Allows exports to skip writing images that haven't changed since the
+    document was last exported.
+   */
+  bool IsStoredIn(const wxString &filename);
+
   //! Returns the bitmap being displayed with custom scale
   wxBitmap GetBitmap(double scale = 1.0);
 
@@ -173,6 +183,14 @@ public:
   //! Returns the image in its unscaled form
   wxBitmap GetUnscaledBitmap();
 
+  /*! Returns the image in its unscaled form as a wxImage
+
+    Doesn't create any GUI objects and therefore can be called from a background
+    task. If the image isn't Ok an invalid wxImage is returned instead of an
+    "image broken" sign.
+   */
+  wxImage GetUnscaledImage();
+
   //! Can be called to specify a specific scale
   void Recalculate(double scale = 1.0);
 
@@ -182,7 +200,7 @@ public:
   long m_height;
 
   //! Returns the original image in its compressed form
-  wxMemoryBuffer GetCompressedImage();
+  SharedBlob GetCompressedImage();
 
   //! Returns the original width
   size_t GetOriginalWidth();
@@ -210,7 +228,7 @@ public:
   #endif
   
   //! The image in its original compressed form
-  wxMemoryBuffer m_compressedImage;
+  SharedBlob m_compressedImage;
 
   //! Can this image be exported in SVG format?
   bool CanExportSVG() const {return m_svgRast != nullptr;}
@@ -218,11 +236,48 @@ public:
   //! The tooltip to use wherever an image that's not Ok is shown.
   static const wxString &GetBadImageToolTip();
 
+  //! Forgets the files that have been read from .wxmx files, for example when a document is closed
+  static void ClearBlobCache() { BlobCache::Clear(); }
+
 private:
+  /*! The files we have already read from .wxmx files
+
+    Identical images and gnuplot files are stored only once in a .wxmx file.
+    Caching what we have read by filesystem and file name allows all cells that
+    refer to the same file to read and decompress it only once.
+
+    The data is immutable and its reference count thread-safe => the cache and
+    all images that show the same file share one copy of it, even if they are
+    loaded by different background tasks.
+   */
+  class BlobCache
+  {
+  public:
+    //! Looks up a file. Returns false, if it isn't in the cache.
+    static bool Get(const std::shared_ptr<wxFileSystem> &filesystem, const wxString &name,
+                    SharedBlob &data);
+    //! Adds a file to the cache
+    static void Add(const std::shared_ptr<wxFileSystem> &filesystem, const wxString &name,
+                    const SharedBlob &data);
+    //! Forgets all files
+    static void Clear();
+  private:
+    struct Entry
+    {
+      std::weak_ptr<wxFileSystem> filesystem;
+      SharedBlob data;
+    };
+    static wxString Key(const std::shared_ptr<wxFileSystem> &filesystem, const wxString &name)
+      { return wxString::Format(wxT("%p:"), (void *)filesystem.get()) + name; }
+    static std::unordered_map<wxString, Entry, wxStringHash> m_entries;
+    //! The filesystem the last file was added from
+    static wxFileSystem *m_lastFilesystem;
+  };
+
   //! A zipped version of the gnuplot commands that produced this image.
-  wxMemoryBuffer m_gnuplotSource_Compressed;
+  SharedBlob m_gnuplotSource_Compressed;
   //! A zipped version of the gnuplot data needed in order to create this image.
-  wxMemoryBuffer m_gnuplotData_Compressed;
+  SharedBlob m_gnuplotData_Compressed;
   //! The width of the unscaled image
   size_t m_originalWidth;
   //! The height of the unscaled image
@@ -237,13 +292,19 @@ private:
   wxString m_gnuplotSource;
   //! The gnuplot data file for this image, if any.
   wxString m_gnuplotData;
+  /*! The name in the temp directory a gnuplot file of this image is restored as
+
+    Images that share a file in a .wxmx file must not share the temp file, as each
+    image deletes its temp files when it is deleted.
+   */
+  wxString TempFileName(const wxString &file) const;
   void LoadImage_Backgroundtask(wxString image, std::shared_ptr<wxFileSystem> filesystem, bool remove);
   void LoadGnuplotSource_Backgroundtask(wxString gnuplotFilename, wxString dataFilename, std::shared_ptr<wxFileSystem> filesystem);
 
   //! Loads an image from a file
   void LoadImage(wxString image, std::shared_ptr<wxFileSystem> filesystem, bool remove = true);
   //! Reads the compressed image into a memory buffer
-  static wxMemoryBuffer ReadCompressedImage(wxInputStream *data);
+  static SharedBlob ReadCompressedImage(wxInputStream *data);
   Configuration **m_configuration;
   //! The upper width limit for displaying this image
   double m_maxWidth;
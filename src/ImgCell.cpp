@@ -37,7 +37,6 @@
 #include <wx/file.h>
 #include <wx/filename.h>
 #include <wx/filesys.h>
-#include <wx/fs_mem.h>
 #include <wx/clipbrd.h>
 #include <wx/mstream.h>
 
@@ -228,11 +227,11 @@ wxSize ImgCell::ToImageFile(wxString filename)
   return m_image->ToImageFile(filename);
 }
 
-static void writeHex(void *data, size_t length, wxStringCharType *out)
+static void writeHex(const char *data, size_t length, wxStringCharType *out)
 {
   using char_t = wxStringCharType;
-  char *const end = static_cast<char*>(data) + length;
-  for (char *in = static_cast<char*>(data); in != end; in++)
+  const char *const end = data + length;
+  for (const char *in = data; in != end; in++)
   {
     char c = *in;
     unsigned char const h = (c >> 4) & 0xF, l = c & 0xF;
@@ -251,7 +250,7 @@ wxString ImgCell::ToRTF() const
 
   // Extract the description of the image data
   wxString image;
-  wxMemoryBuffer imgdata;
+  SharedBlob imgdata;
   if (m_image->GetExtension().Lower() == wxT("png"))
   {
     imgdata = GetCompressedImage();
@@ -272,8 +271,8 @@ wxString ImgCell::ToRTF() const
     wxImage imagedata = m_image->GetUnscaledBitmap().ConvertToImage();
     wxMemoryOutputStream stream;
     imagedata.SaveFile(stream, wxBITMAP_TYPE_PNG);
-    imgdata.AppendData(stream.GetOutputStreamBuffer()->GetBufferStart(),
-                       stream.GetOutputStreamBuffer()->GetBufferSize());
+    imgdata = MakeSharedBlob(stream.GetOutputStreamBuffer()->GetBufferStart(),
+                             stream.GetOutputStreamBuffer()->GetBufferSize());
   }
 
   image += wxString::Format(wxT("\\picw%lu\\pich%lu "),
@@ -283,8 +282,8 @@ wxString ImgCell::ToRTF() const
 
   // Convert the data into a hexadecimal string
   wxString hexString;
-  writeHex(imgdata.GetData(), imgdata.GetDataLen(),
-           wxStringBuffer(hexString, 2*imgdata.GetDataLen()));
+  writeHex(BlobData(imgdata), BlobSize(imgdata),
+           wxStringBuffer(hexString, 2*BlobSize(imgdata)));
 
   wxString result;
   result.reserve(header.size() + image.size() + hexString.size() + footer.size() + 10);
@@ -294,16 +293,16 @@ wxString ImgCell::ToRTF() const
 
 wxString ImgCell::ToXML() const
 {
-  wxString basename = m_cellPointers->WXMXGetNewFileName();
+  wxString imageName;
 
   // add the file to memory
   if (m_image)
   {
-    if (m_image->GetCompressedImage())
-      wxMemoryFSHandler::AddFile(basename + m_image->GetExtension(),
-                                 m_image->GetCompressedImage().GetData(),
-                                 m_image->GetCompressedImage().GetDataLen()
-      );
+    SharedBlob image = m_image->GetCompressedImage();
+    if (BlobSize(image) > 0)
+      imageName = m_cellPointers->WXMXStoreBlob(image, wxT("image"), m_image->GetExtension());
+    else
+      imageName = m_cellPointers->WXMXGetNewFileName() + m_image->GetExtension();
   }
 
   wxString flags;
@@ -321,49 +320,34 @@ wxString ImgCell::ToXML() const
 
   if (m_image)
   {
-    // Anonymize the name of our temp directory for saving
-    wxString gnuplotSource;
-    wxString gnuplotData;
-    if(m_image->GnuplotData() != wxEmptyString)
-    {
-      wxFileName gnuplotDataFile(m_image->GnuplotData());
-      gnuplotData = gnuplotDataFile.GetFullName();
-    }
+    // Identical gnuplot sources and data are stored only once. As the names
+    // are derived from the contents this also anonymizes the name of our temp
+    // directory.
     if(m_image->GnuplotSource() != wxEmptyString)
     {
-      wxFileName gnuplotSourceFile(m_image->GnuplotSource());
-      gnuplotSource = gnuplotSourceFile.GetFullName();
-    }
-
-    // Save the gnuplot source, if necessary.
-    if(gnuplotSource != wxEmptyString)
-    {
-      flags += " gnuplotsource=\"" + gnuplotSource + "\"";
-      wxMemoryBuffer data = m_image->GetGnuplotSource();
-      if(data.GetDataLen() > 0)
+      SharedBlob data = m_image->GetGnuplotSource();
+      if(BlobSize(data) > 0)
       {
-        wxMemoryFSHandler::AddFile(gnuplotSource,
-                                   data.GetData(),
-                                   data.GetDataLen()
-          );
+        wxString extension = wxFileName(m_image->GnuplotSource()).GetExt();
+        if(extension.IsEmpty())
+          extension = wxT("gnuplot");
+        wxString gnuplotSource = m_cellPointers->WXMXStoreBlob(data, wxT("gnuplot"), extension);
+        flags += " gnuplotsource=\"" + gnuplotSource + "\"";
       }
     }
-    if(gnuplotData != wxEmptyString)
+    if(m_image->GnuplotData() != wxEmptyString)
     {
-      flags += " gnuplotdata=\"" + gnuplotData + "\"";
-      wxMemoryBuffer data = m_image->GetGnuplotData();
-      if(data.GetDataLen() > 0)
+      SharedBlob data = m_image->GetGnuplotData();
+      if(BlobSize(data) > 0)
       {
-        wxMemoryFSHandler::AddFile(gnuplotData,
-                                   data.GetData(),
-                                   data.GetDataLen()
-          );
+        wxString gnuplotData = m_cellPointers->WXMXStoreBlob(data, wxT("gnuplot"), wxT("data"));
+        flags += " gnuplotdata=\"" + gnuplotData + "\"";
       }
     }
   }
   
   return (wxT("<img") + flags + wxT(">") +
-          basename + m_image->GetExtension() + wxT("</img>"));
+          imageName + wxT("</img>"));
 }
 
 void ImgCell::DrawBoundingBox(wxDC &WXUNUSED(dc), bool WXUNUSED(all))
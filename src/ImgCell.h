@@ -96,7 +96,19 @@ public:
   { if (m_image)return m_image->GetExtension(); else return wxEmptyString; }
 
   //! Returns the original compressed version of the image
-  wxMemoryBuffer GetCompressedImage() const { return m_image->m_compressedImage; }
+  SharedBlob GetCompressedImage() const { return m_image->m_compressedImage; }
+
+  //! Does the file already contain this image? See Image::IsStoredIn().
+  bool IsStoredIn(const wxString &file) const
+  { return m_image && m_image->IsStoredIn(file); }
+
+  //! Returns the image this cell displays
+  std::shared_ptr<Image> GetImage() const { return m_image; }
+
+  //! Returns the size of the image before it was scaled to fit the worksheet
+  wxSize GetOriginalSize() const
+  { if (m_image) return wxSize(m_image->GetOriginalWidth(), m_image->GetOriginalHeight());
+    else return wxSize(-1, -1); }
 
   double GetMaxWidth() const { return m_image ? m_image->GetMaxWidth() : -1; }
   double GetHeightList() const { return m_image ? m_image->GetHeightList() : -1; }
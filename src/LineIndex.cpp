@@ -0,0 +1,74 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file defines the class LineIndex
+
+  LineIndex knows where each line of a text starts, so the editor can convert
+  between positions and line/column coordinates without scanning the text.
+*/
+
+#include "LineIndex.h"
+#include <algorithm>
+
+void LineIndex::Build(const wxString &text)
+{
+  m_lineStarts.clear();
+  m_lineStarts.push_back(0);
+  size_t pos = 0;
+  for (auto const &ch : text)
+  {
+    ++pos;
+    if (IsLineEnding(ch))
+      m_lineStarts.push_back(pos);
+  }
+}
+
+void LineIndex::Replace(size_t start, size_t end, const wxString &newText)
+{
+  // Lines that started behind a line ending we delete now belong to the line
+  // in front of them.
+  auto first = std::upper_bound(m_lineStarts.begin(), m_lineStarts.end(), start);
+  auto last = std::upper_bound(first, m_lineStarts.end(), end);
+  first = m_lineStarts.erase(first, last);
+
+  // Move all lines behind the change
+  const size_t added = newText.Length();
+  const size_t removed = end - start;
+  for (auto line = first; line != m_lineStarts.end(); ++line)
+    *line = *line + added - removed;
+
+  // Add the lines the new text starts
+  std::vector<size_t> newLines;
+  size_t pos = start;
+  for (auto const &ch : newText)
+  {
+    ++pos;
+    if (IsLineEnding(ch))
+      newLines.push_back(pos);
+  }
+  m_lineStarts.insert(first, newLines.begin(), newLines.end());
+}
+
+size_t LineIndex::GetLine(size_t pos) const
+{
+  return std::upper_bound(m_lineStarts.begin(), m_lineStarts.end(), pos) - m_lineStarts.begin() - 1;
+}
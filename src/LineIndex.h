@@ -0,0 +1,66 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file declares the class LineIndex
+
+  LineIndex knows where each line of a text starts, so the editor can convert
+  between positions and line/column coordinates without scanning the text.
+*/
+
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include <wx/string.h>
+#include <vector>
+
+/*! The index of the first char of each line of a text
+
+  Both "\n" and "\r" (which EditorCell uses for soft line breaks) end a line.
+  The first line always starts at index 0, so an empty text consists of one
+  empty line. Replace() updates the index for an edit without looking at the
+  rest of the text.
+ */
+class LineIndex final
+{
+public:
+  explicit LineIndex(const wxString &text = {}) { Build(text); }
+
+  //! Indexes a text from scratch
+  void Build(const wxString &text);
+  //! Tells the index that the chars start...end-1 have been replaced by newText
+  void Replace(size_t start, size_t end, const wxString &newText);
+
+  //! The number of lines
+  size_t GetLineCount() const { return m_lineStarts.size(); }
+  //! The index of the first char of the line number line
+  size_t GetLineStart(size_t line) const { return m_lineStarts[line]; }
+  //! The number of the line the char at the index pos belongs to
+  size_t GetLine(size_t pos) const;
+
+  //! Does this char end a line?
+  static bool IsLineEnding(wxUniChar ch) { return (ch == wxT('\n')) || (ch == wxT('\r')); }
+
+private:
+  std::vector<size_t> m_lineStarts;
+};
+
+#endif // LINEINDEX_H
@@ -84,7 +84,19 @@ wxXmlNode *MathParser::GetNextTag(wxXmlNode *node)
   return SkipWhitespaceNode(node);
 }
 
-MathParser::MathParser(Configuration **cfg, const wxString &zipfile)
+MathParser::MathParser(Configuration **cfg, const wxString &zipfile) :
+  MathParser(cfg, std::shared_ptr<wxFileSystem>())
+{
+  if (zipfile.Length() > 0)
+  {
+    m_fileSystem = std::unique_ptr<wxFileSystem>(new wxFileSystem());
+    m_fileSystem->ChangePathTo(zipfile + wxT("#zip:/"), true);
+  }
+}
+
+// cppcheck-suppress performance symbolName=filesystem
+MathParser::MathParser(Configuration **cfg, std::shared_ptr<wxFileSystem> filesystem) :
+  m_fileSystem(filesystem)
 {
   // We cannot do this at the startup of the program as we first need to wait
   // for the language selection to take place
@@ -155,11 +167,6 @@ MathParser::MathParser(Configuration **cfg, const wxString &zipfile)
     m_groupTags[wxT("heading6")] = &MathParser::GroupCellHeading6Tag;
   }
   m_highlight = false;
-  if (zipfile.Length() > 0)
-  {
-    m_fileSystem = std::unique_ptr<wxFileSystem>(new wxFileSystem());
-    m_fileSystem->ChangePathTo(zipfile + wxT("#zip:/"), true);
-  }
 }
 
 MathParser::~MathParser()
@@ -405,9 +412,10 @@ Cell *MathParser::ParseCellTag(wxXmlNode *node)
   // read (group)cell type
   wxString type = node->GetAttribute(wxT("type"), wxT("text"));
 
-  GroupCell * (MathParser::* function)(wxXmlNode *node) = m_groupTags[type];
-  if (function != NULL)
-    group =  CALL_MEMBER_FN(*this,function)(node);
+  // Several parsers might run in parallel => only read the tag table.
+  auto function = m_groupTags.find(type);
+  if ((function != m_groupTags.end()) && (function->second != NULL))
+    group =  CALL_MEMBER_FN(*this,function->second)(node);
   else  
     return group;
   
@@ -469,6 +477,10 @@ Cell *MathParser::ParseCellTag(wxXmlNode *node)
 
   group->SetGroup(group); //-V678
   group->Hide(hide);
+
+  long height;
+  if (m_heightHints && node->GetAttribute(wxT("height"), wxT("-1")).ToLong(&height) && (height > 0))
+    group->SetHeightHint(height);
   return group;
 }
 
@@ -1069,9 +1081,9 @@ Cell *MathParser::ParseTag_(wxXmlNode *node, bool all)
 
       Cell *tmp = NULL;
 
-      Cell * (MathParser::* function)(wxXmlNode *node) = m_innerTags[tagName];
-      if (function != NULL)
-        tmp =  CALL_MEMBER_FN(*this, function)(node);
+      auto function = m_innerTags.find(tagName);
+      if ((function != m_innerTags.end()) && (function->second != NULL))
+        tmp =  CALL_MEMBER_FN(*this, function->second)(node);
 //      if ((tmp == NULL) && (node->GetChildren()))
 //        tmp = ParseTag(node->GetChildren());
 
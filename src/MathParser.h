@@ -55,6 +55,12 @@ public:
      most-frequently-used tags to the front of the list.
    */
   explicit MathParser(Configuration **cfg, const wxString &zipfile = {});
+  /*! A parser that loads images from the same file system as another parser
+
+    Used for parsing different parts of a document in parallel: The file system
+    is only accessed while holding the OpenFSFile lock.
+   */
+  MathParser(Configuration **cfg, std::shared_ptr<wxFileSystem> filesystem);
   //! This class doesn't have a copy constructor
   MathParser(const MathParser&) = delete;
   //! This class doesn't have a = operator
@@ -75,6 +81,16 @@ public:
   std::unique_ptr<Cell> ParseTag(wxXmlNode *node, bool all = true);
   Cell *ParseRowTag(wxXmlNode *node);
 
+  //! The file system images are loaded from, if we parse the contents of a .wxmx file
+  std::shared_ptr<wxFileSystem> GetFileSystem() const { return m_fileSystem; }
+  /*! Shall the cells we create use the heights stored in the file?
+
+    Only makes sense if the file was saved with the same zoom factor, fonts and
+    worksheet width wxMaxima currently uses: See Configuration::LayoutSignature().
+   */
+  void UseHeightHints(bool use) { m_heightHints = use; }
+  bool UsesHeightHints() const { return m_heightHints; }
+
 private:
   //! A storage for a tag and the function to call if one encounters it
   class TagFunction
@@ -285,6 +301,7 @@ private:
   FracCell::FracType m_FracStyle;
   Configuration **m_configuration;
   bool m_highlight;
+  bool m_heightHints = false;
   std::shared_ptr<wxFileSystem> m_fileSystem; // used for loading pictures in <img> and <slide>
   static wxString m_unknownXMLTagToolTip;
 };
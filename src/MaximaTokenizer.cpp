@@ -29,375 +29,409 @@
 #include "MaximaTokenizer.h"
 #include <wx/wx.h>
 #include <wx/string.h>
+#include <array>
 #include <vector>
 
-
-MaximaTokenizer::MaximaTokenizer(wxString commands, Configuration *configuration)
+class MaximaTokenizer::CharClassTable
 {
-  if(m_hardcodedFunctions.empty())
+public:
+  CharClassTable()
+  {
+    // Letters
+    for (int ch = 'a'; ch <= 'z'; ch++)
+      m_ascii[ch] |= CC_ALPHA;
+    for (int ch = 'A'; ch <= 'Z'; ch++)
+      m_ascii[ch] |= CC_ALPHA;
+    for (int ch = '0'; ch <= '9'; ch++)
+      m_ascii[ch] |= CC_DIGIT;
+    // Chars beyond ASCII are letters unless we know better
+    m_pageIndex.fill(0);
+    m_pages.emplace_back();
+    m_pages[0].fill(CC_ALPHA);
+
+    Add(m_additional_alphas, CC_ALPHA);
+    for (auto const &ch : m_not_alphas)
+      Class(ch) &= ~CC_ALPHA;
+    for (auto const &ch : m_spaces)
+      Class(ch) = (Class(ch) & ~CC_ALPHA) | CC_SPACE;
+    Add(m_linebreaks, CC_LINEBREAK);
+    Add(m_operators, CC_OPERATOR);
+    Add(m_plusSigns, CC_PLUS);
+    Add(m_minusSigns, CC_MINUS);
+    Add(m_unicodeNumbers, CC_UNICODENUMBER);
+  }
+
+  wxUint8 Get(wxChar ch) const
+  {
+    const wxUint32 code = static_cast<wxUint32>(ch);
+    if (code < 128)
+      return m_ascii[code];
+    if (code > 0xFFFF)
+      return CC_ALPHA;
+    return m_pages[m_pageIndex[code >> 8]][code & 0xFF];
+  }
+
+private:
+  void Add(const wxString &chars, wxUint8 charClass)
   {
-    m_hardcodedFunctions["for"] = 1;
-    m_hardcodedFunctions["in"] = 1;
-    m_hardcodedFunctions["then"] = 1;
-    m_hardcodedFunctions["while"] = 1;
-    m_hardcodedFunctions["do"] = 1;
-    m_hardcodedFunctions["thru"] = 1;
-    m_hardcodedFunctions["next"] = 1;
-    m_hardcodedFunctions["step"] = 1;
-    m_hardcodedFunctions["unless"] = 1;
-    m_hardcodedFunctions["from"] = 1;
-    m_hardcodedFunctions["if"] = 1;
-    m_hardcodedFunctions["else"] = 1;
-    m_hardcodedFunctions["elseif"] = 1;
-    m_hardcodedFunctions["and"] = 1;
-    m_hardcodedFunctions["or"] = 1;
-    m_hardcodedFunctions["not"] = 1;
-    m_hardcodedFunctions["true"] = 1;
-    m_hardcodedFunctions["false"] = 1;
+    for (auto const &ch : chars)
+      Class(ch) |= charClass;
   }
-  
-  // ----------------------------------------------------------------
-  // --------------------- Step one:                -----------------
-  // --------------------- Break a line into tokens -----------------
-  // ----------------------------------------------------------------
-  wxString::const_iterator it = commands.begin();
-      
-  if(configuration->InLispMode())
+
+  //! The class of a char. Gives the char a page of its own, if necessary.
+  wxUint8 &Class(wxChar ch)
   {
-    wxString token;
-    while(
-      (it < commands.end()) &&
-      ((!token.EndsWith("(to-maxima)"))) &&
-      ((!token.EndsWith(wxString("(to")+wxT("\u2212")+"maxima)"))))
+    const wxUint32 code = static_cast<wxUint32>(ch);
+    if (code < 128)
+      return m_ascii[code];
+    wxASSERT(code <= 0xFFFF);
+    auto &page = m_pageIndex[code >> 8];
+    if (page == 0)
     {
-      token +=*it;
-      ++it;
+      page = m_pages.size();
+      m_pages.push_back(m_pages[0]);
     }
+    return m_pages[page][code & 0xFF];
+  }
+
+  std::array<wxUint8, 128> m_ascii = {};
+  //! Which entry of m_pages holds the classes of a block of 256 chars
+  std::array<wxUint8, 256> m_pageIndex;
+  std::vector<std::array<wxUint8, 256>> m_pages;
+};
+
+wxUint8 MaximaTokenizer::GetCharClass(wxChar ch)
+{
+  static const CharClassTable table;
+  return table.Get(ch);
+}
+
+//! Does the text at it start with the string text?
+static bool LookingAt(wxString::const_iterator it, const wxString::const_iterator &end,
+                      const wxString &text)
+{
+  for (auto const &ch : text)
+  {
+    if ((it >= end) || (*it != ch))
+      return false;
+    ++it;
+  }
+  return true;
+}
+
+//! The index of the char behind the next "(to-maxima)" from index start on
+static size_t EndOfLisp(const wxString &commands, size_t start)
+{
+  size_t end = commands.Length();
+  for (auto const &toMaxima : {wxString("(to-maxima)"), wxString("(to") + wxT("\u2212") + "maxima)"})
+  {
+    size_t pos = commands.find(toMaxima, start);
+    if (pos != wxString::npos)
+      end = wxMin(end, pos + toMaxima.Length());
+  }
+  return end;
+}
+
+MaximaTokenizer::MaximaTokenizer(wxString commands, Configuration *configuration)
+  : MaximaTokenizer(commands, configuration, 0, {})
+{
+}
+
+MaximaTokenizer::MaximaTokenizer(const wxString &commands, Configuration *configuration,
+                                 size_t start, const std::function<bool (size_t)> &stopAt)
+{
+  Tokenize(commands, configuration->InLispMode(), configuration->GetChangeAsterisk(),
+           start, stopAt);
+}
+
+MaximaTokenizer::MaximaTokenizer(const wxString &commands, bool inLispMode, bool changeAsterisk)
+{
+  Tokenize(commands, inLispMode, changeAsterisk, 0, {});
+}
+
+void MaximaTokenizer::Tokenize(const wxString &commands, bool inLispMode, bool changeAsterisk,
+                               size_t start, const std::function<bool (size_t)> &stopAt)
+{
+  //! The kinds of tokens, as determined by the char they start with
+  enum class State
+  {
+    lineBreak,
+    comment,
+    lisp,
+    op,
+    string,
+    unicodeNumber,
+    number,
+    plus,
+    minus,
+    space,
+    word,
+    endOfLine,
+    other
+  };
+
+  const wxString::const_iterator end = commands.end();
+  wxString::const_iterator it = commands.begin() + start;
+
+  if((start == 0) && inLispMode)
+  {
+    const size_t lispEnd = EndOfLisp(commands, 0);
+    wxString token = commands.Left(lispEnd);
+    it = commands.begin() + lispEnd;
     token.Trim(true);
     if(!token.IsEmpty())
       m_tokens.emplace_back(token, TS_CODE_LISP);
   }
-  while (it < commands.end())
+  bool lineStart = false;
+  while (it < end)
   {
+    // The tokenizer doesn't need to know anything about the text in front of
+    // a token: If the caller knows the rest of the tokens we can stop here.
+    if(lineStart && stopAt && stopAt(it - commands.begin()))
+      break;
+    lineStart = false;
+
     // Determine the current char and the one that will follow it
-    wxChar Ch = *it;
-    wxString::const_iterator it2(it);
-    if(it2 < commands.end())
-      ++it2;
-    wxChar nextChar;
-
-    if(it2 < commands.end())
-      nextChar = *it2;
+    const wxChar ch = *it;
+    const wxUint8 charClass = GetCharClass(ch);
+    const wxChar nextChar = (it + 1 < end) ? wxChar(*(it + 1)) : wxT(' ');
+
+    // Which kind of token does this char start?
+    State state;
+    if (charClass & CC_LINEBREAK)
+      state = State::lineBreak;
+    else if ((ch == '/') && ((nextChar == wxT('*')) || (nextChar == wxT('\u00B7'))))
+      state = State::comment;
+    else if ((ch == ':') &&
+             (LookingAt(it, end, wxT(":lisp ")) || LookingAt(it, end, wxT(":lisp-quiet ")) ||
+              LookingAt(it, end, wxT(":lisp\t")) || LookingAt(it, end, wxT(":lisp-quiet\t"))))
+      state = State::lisp;
+    else if (charClass & CC_OPERATOR)
+      state = State::op;
+    else if (ch == wxT('\"'))
+      state = State::string;
+    else if (charClass & CC_UNICODENUMBER)
+      state = State::unicodeNumber;
+    else if (charClass & CC_DIGIT)
+      state = State::number;
+    else if (charClass & CC_PLUS)
+      state = State::plus;
+    else if (charClass & CC_MINUS)
+      state = State::minus;
+    else if (charClass & CC_SPACE)
+      state = State::space;
+    else if ((charClass & CC_ALPHA) || (ch == '\\') || (ch == '?'))
+      state = State::word;
+    else if ((ch == '$') || (ch == ';'))
+      state = State::endOfLine;
     else
-      nextChar = wxT(' ');
+      state = State::other;
 
-    // Handle newline characters (hard+soft line break)
-    if (m_linebreaks.Contains(Ch))
+    const wxString::const_iterator tokenStart = it;
+    switch (state)
     {
-      m_tokens.emplace_back(wxChar(Ch));
+    case State::lineBreak:
+      m_tokens.emplace_back(wxString(ch));
       ++it;
-      continue;
-    }
-    // Check for comments
-    if ((Ch == '/') && ((nextChar == wxT('*')) || (nextChar == wxT('\u00B7'))))
-    {
-      wxString token;
-      // Add the comment start
-      token+=*it;++it;
-      token+=*it;++it;
+      lineStart = true;
+      break;
 
+    case State::comment:
+    {
+      // Skip the comment start
+      it += 2;
       int commentDepth = 0;
-      while (it < commands.end())
+      while (it < end)
       {
+        const wxChar commentCh = *it;
         // Handle escaped chars
-        if(*it == '\\')
+        if(commentCh == '\\')
         {
-          token += *it;
           ++it;
-          if(it < commands.end())
-          {
-            token += *it;
+          if(it < end)
             ++it;
-          }
           continue;
         }
-        
-        wxString::const_iterator it3(it);
-        if(it3 < commands.end())
-          ++it3;
-        wxChar nextCh = ' ';
-        if(it3 < commands.end())
-          nextCh = *it3;
 
+        const wxChar nextCh = (it + 1 < end) ? wxChar(*(it + 1)) : wxT(' ');
         // handle comment begins within comments.
-        if((*it == '/') && ((nextCh == '*') || (nextCh == wxT('\u00B7'))))
+        if((commentCh == '/') && ((nextCh == '*') || (nextCh == wxT('\u00B7'))))
         {
           commentDepth++;
-          token += *it;
           ++it;
-          if(it < commands.end())
-          {
-            token += *it;
+          if(it < end)
             ++it;
-          }
           continue;
         }
         // handle comment endings
-        if(((*it == '*') || (*it == wxT('\u00B7'))) && (nextCh == '/'))
+        if(((commentCh == '*') || (commentCh == wxT('\u00B7'))) && (nextCh == '/'))
         {
           commentDepth--;
-          token += *it;
           ++it;
-          if(it < commands.end())
-          {
-            token += *it;
+          if(it < end)
             ++it;
-          }
           if(commentDepth < 0)
             break;
           continue;
         }
-        if(it < commands.end())
-        {
-          token += *it;
-          ++it;
-        }
+        ++it;
       }
-      m_tokens.emplace_back(token, TS_CODE_COMMENT);
-      continue;
+      m_tokens.emplace_back(wxString(tokenStart, it), TS_CODE_COMMENT);
+      break;
     }
-    // Handle operators and :lisp commands
-    if (Operators().Find(Ch) != wxNOT_FOUND)
+
+    case State::lisp:
+      while((it < end) && (*it != '\n'))
+        ++it;
+      m_tokens.emplace_back(wxString(tokenStart, it), TS_CODE_LISP);
+      break;
+
+    case State::op:
     {
-      if(Ch == ':')
-      {
-        wxString breakCommand;
-        wxString::const_iterator it3(it);
-        int len = 14;
-        while((len>0) && (it3 < commands.end()))
-        {
-          len--;
-          breakCommand += wxString(*it3);
-          ++it3;
-        }
-        if(
-          breakCommand.StartsWith(":lisp ") ||
-          breakCommand.StartsWith(":lisp-quiet ") ||
-          breakCommand.StartsWith(":lisp\t") ||
-          breakCommand.StartsWith(":lisp-quiet\t"))
-        {
-          wxString token;
-          while((it < commands.end()) && (*it != '\n'))
-          {
-            token += wxString(*it);
-            ++it;
-          }
-          m_tokens.emplace_back(token, TS_CODE_LISP);
-        }
-          else
-          {
-            m_tokens.emplace_back(wxString(Ch), TS_CODE_OPERATOR);
-            ++it;
-          }
-      }
-      else
+      wxString token(ch);
+      if (changeAsterisk)
       {
-        wxString token = wxString(Ch);
-        if (configuration->GetChangeAsterisk())
-        {
-          token.Replace(wxT("*"), wxT("\u00B7"));
-          token.Replace(wxT("-"), wxT("\u2212"));
-        }
-        
-        m_tokens.emplace_back(token, TS_CODE_OPERATOR);
-        ++it;
+        if (ch == wxT('*'))
+          token = wxT("\u00B7");
+        else if (ch == wxT('-'))
+          token = wxT("\u2212");
       }
-      continue;
-    }
-    // Handle strings
-    if (Ch == wxT('\"'))
-    {
-      wxString token;
-      // Add the opening quote
-      token = Ch;
+      m_tokens.emplace_back(token, TS_CODE_OPERATOR);
       ++it;
+      break;
+    }
 
-      // Add the string contents
-      while (it < commands.end())
+    case State::string:
+      // Skip the opening quote and add the string contents
+      ++it;
+      while (it < end)
       {
-        Ch = *it;
-        token += Ch;
+        const wxChar stringCh = *it;
         ++it;
-        if(Ch == wxT('\\'))
+        if(stringCh == wxT('\\'))
         {
-          if(it < commands.end())
-          {
-            token += *it;
+          if(it < end)
             ++it;
-          }
         }
-        else if(Ch == wxT('\"'))
+        else if(stringCh == wxT('\"'))
           break;
       }
-      m_tokens.emplace_back(token, TS_CODE_STRING);
-      continue;
-    }
-    // Handle number-like symbols
-    if(UnicodeNumbers().Find(Ch) != wxNOT_FOUND)
-    {
-       wxString token = Ch;
-       ++it;
-       m_tokens.emplace_back(token, TS_CODE_NUMBER);
-       continue;
-    } 
-    // Handle numbers. Numbers begin with a digit, but can continue with letters and can
-    // contain a + or - that follows an e, f, g, h or l.
-    if (IsNum(Ch))
+      m_tokens.emplace_back(wxString(tokenStart, it), TS_CODE_STRING);
+      break;
+
+    case State::unicodeNumber:
+      m_tokens.emplace_back(wxString(ch), TS_CODE_NUMBER);
+      ++it;
+      break;
+
+    case State::number:
     {
+      // Numbers begin with a digit, but can continue with letters and can
+      // contain a + or - that follows an e, f, g, h or l.
       wxString token;
-      wxChar lastChar = *it;
-      while ((it < commands.end()) &&
-             (
-               (IsNum(*it) ||
-                ((*it >= 'a') && (*it <= 'z')) ||
-                ((*it >= 'A') && (*it <= 'Z'))
-                 )
-               || (
-                 (
-                   (lastChar == 'e') || (lastChar == 'E') ||
-                   (lastChar == 'f') || (lastChar == 'F') ||
-                   (lastChar == 'g') || (lastChar == 'G') ||
-                   (lastChar == 'h') || (lastChar == 'H') ||
-                   (lastChar == 'l') || (lastChar == 'L')
-                   ) && (
-                     (m_plusSigns.Contains(*it)) ||
-                     (m_minusSigns.Contains(*it))
-                     )
-                 )))
+      wxChar lastChar = ch;
+      while (it < end)
       {
-        wxChar ch = *it;
-        for (wxString::const_iterator it3 = m_plusSigns.begin(); it3 != m_plusSigns.end(); ++it3)
-          if(ch == *it3)
-            ch = '+';
-        for (wxString::const_iterator it3 = m_minusSigns.begin(); it3 != m_minusSigns.end(); ++it3)
-          if(ch == *it3)
-            ch = '-';
-        token += ch;
-        lastChar = *it;
+        wxChar numberCh = *it;
+        const wxUint8 numberClass = GetCharClass(numberCh);
+        const bool exponent =
+          (lastChar == 'e') || (lastChar == 'E') ||
+          (lastChar == 'f') || (lastChar == 'F') ||
+          (lastChar == 'g') || (lastChar == 'G') ||
+          (lastChar == 'h') || (lastChar == 'H') ||
+          (lastChar == 'l') || (lastChar == 'L');
+        if (!((numberClass & CC_DIGIT) ||
+              ((numberCh >= 'a') && (numberCh <= 'z')) ||
+              ((numberCh >= 'A') && (numberCh <= 'Z')) ||
+              (exponent && (numberClass & (CC_PLUS | CC_MINUS)))))
+          break;
+        lastChar = numberCh;
+        if (numberClass & CC_PLUS)
+          numberCh = '+';
+        else if (numberClass & CC_MINUS)
+          numberCh = '-';
+        token += numberCh;
         ++it;
       }
-      
       m_tokens.emplace_back(token, TS_CODE_NUMBER);
-      continue;
-    }
-    if (m_plusSigns.Contains(Ch))
-    {
-      wxString token = "+";
-      m_tokens.emplace_back(token);
-      continue;
+      break;
     }
-    if (m_minusSigns.Contains(Ch))
-    {
-      wxString token = "-";
-      m_tokens.emplace_back(token);
-      continue;
-    }
-    // Merge consecutive spaces into one single token
-    if (IsSpace(Ch))
+
+    case State::plus:
+      m_tokens.emplace_back(wxString(wxT("+")));
+      ++it;
+      break;
+
+    case State::minus:
+      m_tokens.emplace_back(wxString(wxT("-")));
+      ++it;
+      break;
+
+    case State::space:
     {
+      // Merge consecutive spaces into one single token
       wxString token;
-      while ((it < commands.end()) && IsSpace(Ch))
-      {
-	if(Ch == '\t')
-          token += "\t";
-        else
-          token += " ";
-        if (++it < commands.end())
-          Ch = *it;
-      }
+      for (; (it < end) && (GetCharClass(*it) & CC_SPACE); ++it)
+        token += (*it == wxT('\t')) ? wxT('\t') : wxT(' ');
       m_tokens.emplace_back(token);
-      continue;
+      break;
     }
-    // Handle keywords
-    if (IsAlpha(Ch) || (Ch == '\\') || (Ch == '?'))
+
+    case State::word:
     {
-      wxString token;
-      if(Ch == '?')
-      {
-        token += Ch;
+      if(ch == '?')
         ++it;
-        Ch = *it;
-      }
 
-      while ((it < commands.end()) && (IsAlphaNum(*it) || (*it == '\\')))
+      bool escapedLinebreak = false;
+      while ((it < end) && ((GetCharClass(*it) & (CC_ALPHA | CC_DIGIT)) || (*it == '\\')))
       {
-        Ch = *it;
-        token += Ch;
-        if (Ch == wxT('\\'))
+        if (*it == wxT('\\'))
         {
           ++it;
-          if (it < commands.end())
+          if ((it < end) && (*it == wxT('\n')))
           {
-            Ch = *it;
-            if (Ch != wxT('\n'))
-              token += Ch;
-            else
-            {
-              m_tokens.emplace_back(token);
-              token = wxEmptyString;
-
-              break;
-            }
+            escapedLinebreak = true;
+            break;
           }
         }
-        if(it < commands.end())
+        if(it < end)
           ++it;
       }
-      if(token == ("to_lisp"))
+      wxString token(tokenStart, it);
+      if (escapedLinebreak)
+        m_tokens.emplace_back(token);
+      else if(token == ("to_lisp"))
       {
-        while((it < commands.end()) && ((!token.EndsWith("(to-maxima)"))) && ((!token.EndsWith(wxString("(to")+wxT("\u2212")+"maxima)"))))
-        {
-          token += wxString(*it);
-          ++it;
-        }
-        m_tokens.emplace_back(token, TS_CODE_LISP);
+        it = commands.begin() + EndOfLisp(commands, tokenStart - commands.begin());
+        m_tokens.emplace_back(wxString(tokenStart, it), TS_CODE_LISP);
       }
+      else if(m_hardcodedFunctions.find(token) != m_hardcodedFunctions.end())
+        m_tokens.emplace_back(token, TS_CODE_FUNCTION);
       else
       {
-        if(m_hardcodedFunctions.find(token) != m_hardcodedFunctions.end())
+        // Let's look what the next char looks like
+        wxString::const_iterator it3(it);
+        while ((it3 < end) &&
+               ((*it3 == ' ') || (*it3 == '\t') || (*it3 == '\n') || (*it3 == '\r')))
+          ++it3;
+        if((it3 < end) && (*it3 == '('))
           m_tokens.emplace_back(token, TS_CODE_FUNCTION);
         else
-        {
-          // Let's look what the next char looks like
-          wxString::const_iterator it3(it);
-          while ((it3 < commands.end()) &&
-                 ((*it3 == ' ') || (*it3 == '\t') || (*it3 == '\n') || (*it3 == '\r')))
-            ++it3;
-          if(it3 >= commands.end())
-            m_tokens.emplace_back(token, TS_CODE_VARIABLE);
-          else
-          {
-            if(*it3 == '(')
-              m_tokens.emplace_back(token, TS_CODE_FUNCTION);
-            else
-              m_tokens.emplace_back(token, TS_CODE_VARIABLE);
-          }
-        }
+          m_tokens.emplace_back(token, TS_CODE_VARIABLE);
       }
-      continue;
-    }   
-    if((Ch == '$') || (Ch == ';'))
-    {
-      m_tokens.emplace_back(wxString(Ch), TS_CODE_ENDOFLINE);
-      ++it;
-      continue;
+      break;
     }
 
-    {
+    case State::endOfLine:
+      m_tokens.emplace_back(wxString(ch), TS_CODE_ENDOFLINE);
+      ++it;
+      break;
+
+    case State::other:
       // Everything that hasn't been handled until now.
-      m_tokens.emplace_back(wxString(Ch));
+      m_tokens.emplace_back(wxString(ch));
       ++it;
-      continue;
+      break;
     }
   }
 }
@@ -411,40 +445,6 @@ MaximaTokenizer::MaximaTokenizer(wxString commands,
   m_tokens = initialTokens;
 }
 
-bool MaximaTokenizer::IsAlpha(wxChar ch)
-{
-  if (wxIsalpha(ch))
-    return true;
-
-  if(m_not_alphas.Find(ch) != wxNOT_FOUND)
-    return false;
-  
-  if(IsSpace(ch))
-    return false;
-
-  // If it cannot be converted to asciiand we didn't detect it as a char we know how to deal with
-  // it (in maxima's view) is an ordinary letter.
-  if(ch > 127)
-    return true;
-  
-  return (m_additional_alphas.Find(ch) != wxNOT_FOUND);
-}
-
-bool MaximaTokenizer::IsSpace(wxChar ch)
-{
-  return m_spaces.Find(ch) != wxNOT_FOUND;
-}
-
-bool MaximaTokenizer::IsNum(wxChar ch)
-{
-  return ch >= '0' && ch <= '9';
-}
-
-bool MaximaTokenizer::IsAlphaNum(wxChar ch)
-{
-  return IsAlpha(ch) || IsNum(ch);
-}
-
 const wxString MaximaTokenizer::m_additional_alphas = wxT("\\_%µ");
 const wxString MaximaTokenizer::m_not_alphas = wxT("\u00B7\u2212\u2260\u2264\u2265\u2265\u2212\u00B2\u00B3\u00BD\u221E\u22C0\u22C1\u22BB\u22BC\u22BD\u00AC\u2264\u2265\u2212")
   wxT("\uFE62")
@@ -496,4 +496,8 @@ const wxString MaximaTokenizer::m_unicodeNumbers =
 const wxString MaximaTokenizer::m_operators =
   wxT("\u221A\u22C0\u22C1\u22BB\u22BC\u22BD\u00AC\u222b\u2264\u2265\u2211\u2260+-*/^:=#'!()[]{}");
 
-MaximaTokenizer::StringHash MaximaTokenizer::m_hardcodedFunctions;
+const std::unordered_set<wxString, wxStringHash> MaximaTokenizer::m_hardcodedFunctions =
+{
+  "for", "in", "then", "while", "do", "thru", "next", "step", "unless", "from",
+  "if", "else", "elseif", "and", "or", "not", "true", "false"
+};
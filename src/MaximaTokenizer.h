@@ -27,8 +27,11 @@
 #include <wx/wx.h>
 #include <wx/string.h>
 #include <wx/arrstr.h>
+#include <wx/hashmap.h>
 #include "TextStyle.h"
 #include "Configuration.h"
+#include <functional>
+#include <unordered_set>
 #include <vector>
 #include <memory>
 
@@ -66,10 +69,25 @@ public:
     wxString m_text;
     TextStyle m_style = TS_DEFAULT;
   };
-  static bool IsAlpha(wxChar ch);
-  static bool IsNum(wxChar ch);
-  static bool IsAlphaNum(wxChar ch);
-  static bool IsSpace(wxChar ch);
+  //! The classes a char can belong to. A char can belong to more than one class.
+  enum CharClass : wxUint8
+  {
+    CC_NONE = 0,
+    CC_ALPHA = 1,          //!< Can be part of a name
+    CC_DIGIT = 2,          //!< 0...9
+    CC_SPACE = 4,          //!< Whitespace that doesn't end a line
+    CC_LINEBREAK = 8,      //!< Ends a line
+    CC_OPERATOR = 16,      //!< Is an operator or a bracket
+    CC_PLUS = 32,          //!< Is a plus sign
+    CC_MINUS = 64,         //!< Is a minus sign
+    CC_UNICODENUMBER = 128 //!< A char that represents a number, like "½"
+  };
+  //! The classes a char belongs to, as a bitmask of CharClass values
+  static wxUint8 GetCharClass(wxChar ch);
+  static bool IsAlpha(wxChar ch) { return GetCharClass(ch) & CC_ALPHA; }
+  static bool IsNum(wxChar ch) { return GetCharClass(ch) & CC_DIGIT; }
+  static bool IsAlphaNum(wxChar ch) { return GetCharClass(ch) & (CC_ALPHA | CC_DIGIT); }
+  static bool IsSpace(wxChar ch) { return GetCharClass(ch) & CC_SPACE; }
   static const wxString &UnicodeNumbers() { return m_unicodeNumbers; }
   static const wxString &Operators() { return m_operators; }
 
@@ -80,9 +98,47 @@ public:
   MaximaTokenizer(wxString commands, Configuration *configuration,
                   const TokenList &initialTokens);
 
+  /*! A constructor that tokenizes only a part of a string
+
+    \param commands The string to tokenize
+    \param configuration The configuration
+    \param start The index of the char to start at. Must be the start of one of
+                 the tokens the whole string would have been split into.
+    \param stopAt Is called with the index of the first char of each line that
+                  follows a line ending. If it returns true, the tokenizer stops
+                  at this line.
+   */
+  MaximaTokenizer(const wxString &commands, Configuration *configuration,
+                  size_t start, const std::function<bool (size_t)> &stopAt);
+
+  /*! A constructor that doesn't read the configuration
+
+    For background tasks, as the main thread may change the configuration while
+    they run.
+
+    \param commands The string to tokenize
+    \param inLispMode The value of Configuration::InLispMode() to tokenize with
+    \param changeAsterisk The value of Configuration::GetChangeAsterisk() to tokenize with
+   */
+  MaximaTokenizer(const wxString &commands, bool inLispMode, bool changeAsterisk);
+
 protected:
+  //! Splits the string into tokens. See the constructors for the parameters.
+  void Tokenize(const wxString &commands, bool inLispMode, bool changeAsterisk,
+                size_t start, const std::function<bool (size_t)> &stopAt);
+
   //! The tokens the string is divided into
   TokenList m_tokens;
+
+  /*! The classes of all chars
+
+    A table for ASCII chars and a two-level table for the rest of the basic
+    multilingual plane: The upper byte of a char selects a page of 256 classes,
+    the lower byte the class within that page. All pages that don't contain any
+    special char share the same page. Chars outside the basic multilingual plane
+    are letters, in maxima's view.
+   */
+  class CharClassTable;
   //! ASCII symbols that wxIsalnum() doesn't see as chars, but maxima does.
   static const wxString m_additional_alphas;
   //! Unicode Operators and other special non-ascii characters
@@ -99,16 +155,15 @@ protected:
   static const wxString m_unicodeNumbers;
   //! Operators
   static const wxString m_operators;
-  
-  WX_DECLARE_STRING_HASH_MAP(int, StringHash);
+
   /*! Names of functions that don't require parenthesis
 
     The maxima parser automatically parses everything that is followed by
     an opening parenthesis as a function. But a few things like "then"
     are very similar to functions except that they don't require an
-    argument. These fake functions are kept in this hash.
+    argument. These fake functions are kept in this set.
    */
-  static StringHash m_hardcodedFunctions;
+  static const std::unordered_set<wxString, wxStringHash> m_hardcodedFunctions;
 };
 
 #endif // MAXIMATOKENIZER_H
@@ -100,6 +100,11 @@ static wxDataFormat &Format()
   return format;
 }
 
+wxCustomDataObject *Svgout::GetEmptyDataObject()
+{
+  return new wxCustomDataObject(Format());
+}
+
 std::unique_ptr<wxCustomDataObject> Svgout::GetDataObject()
 {
   return m_cmn.GetDataObject(Format());
@@ -58,6 +58,8 @@ public:
 
   //! Returns the svg representation in a format that can be placed on the clipBoard.
   std::unique_ptr<wxCustomDataObject> GetDataObject();
+  //! Returns an empty data object of the format GetDataObject() returns
+  static wxCustomDataObject *GetEmptyDataObject();
 
 private:
   std::unique_ptr<Cell> m_tree;
@@ -0,0 +1,285 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file defines the class SearchIndex
+
+  SearchIndex keeps the matches of a search in all editable cells of a worksheet
+  and updates them only for the cells whose text has changed.
+*/
+
+#include "SearchIndex.h"
+#include <wx/log.h>
+#include <algorithm>
+
+//! The flags regular expressions are compiled with
+static int RegexFlags(bool ignoreCase)
+{
+  // '^' and '$' match at the start and the end of each line
+  return wxRE_DEFAULT | wxRE_NEWLINE | (ignoreCase ? wxRE_ICASE : 0);
+}
+
+void SearchIndex::BeginUpdate()
+{
+  m_oldTexts.clear();
+  for (auto &text : m_texts)
+    m_oldTexts[text.key] = std::move(text);
+  m_texts.clear();
+}
+
+void SearchIndex::Add(Key key, wxUint64 revision, const wxString &text)
+{
+  auto old = m_oldTexts.find(key);
+  if ((old != m_oldTexts.end()) && (old->second.revision == revision))
+  {
+    m_texts.push_back(std::move(old->second));
+    m_oldTexts.erase(old);
+    return;
+  }
+
+  Text entry;
+  entry.key = key;
+  entry.revision = revision;
+  // The reference counting of wxString isn't thread-safe, and the texts are
+  // searched by background tasks => copy the chars instead of sharing them.
+  entry.text = wxString(text.wc_str(), text.Length());
+  entry.text.Replace(wxT("\r"), wxT(" "));
+  m_texts.push_back(std::move(entry));
+}
+
+void SearchIndex::EndUpdate()
+{
+  m_oldTexts.clear();
+}
+
+bool SearchIndex::Search(const Query &query)
+{
+  const bool sameQuery = m_queryValid && (query.regex == m_query.regex) &&
+    (query.ignoreCase == m_query.ignoreCase) && (query.text == m_query.text);
+  // Each place a string is found at is a place the start of the string has
+  // been found at, too.
+  const bool refine = m_queryValid && !sameQuery && !query.regex && !m_query.regex &&
+    (query.ignoreCase == m_query.ignoreCase) && query.text.StartsWith(m_query.text);
+
+  wxString needle(query.text.wc_str(), query.text.Length());
+  if (query.ignoreCase)
+    needle.MakeLower();
+
+  if (!sameQuery)
+  {
+    m_query = query;
+    m_queryValid = !query.text.IsEmpty();
+    if (m_queryValid && query.regex)
+    {
+      // While a regular expression is typed it is invalid most of the time
+      wxLogNull suppressErrors;
+      m_queryValid = m_regex.Compile(query.text, RegexFlags(query.ignoreCase));
+    }
+
+    for (auto &text : m_texts)
+    {
+      if (refine && text.searched)
+      {
+        const wxString &haystack = query.ignoreCase ? text.folded : text.text;
+        text.matches.erase(
+          std::remove_if(text.matches.begin(), text.matches.end(),
+                         [&](const Span &match){
+                           return haystack.compare(match.start, needle.Length(), needle) != 0;}),
+          text.matches.end());
+        for (auto &match : text.matches)
+          match.length = needle.Length();
+      }
+      else
+      {
+        text.matches.clear();
+        text.searched = false;
+      }
+    }
+  }
+
+  if (!m_queryValid)
+    return query.text.IsEmpty();
+
+  std::vector<Text *> pending;
+  for (auto &text : m_texts)
+    if (!text.searched)
+      pending.push_back(&text);
+
+  if (m_query.regex)
+  {
+    // A wxRegEx remembers its last match => it cannot be shared between tasks
+    for (auto text : pending)
+      SearchRegex(*text);
+  }
+  else
+  {
+    const bool ignoreCase = m_query.ignoreCase;
+    #ifdef HAVE_OPENMP_TASKS
+    #pragma omp taskloop shared(pending, needle)
+    #endif
+    for (size_t i = 0; i < pending.size(); i++)
+      SearchPlain(*pending[i], needle, ignoreCase);
+  }
+  return true;
+}
+
+void SearchIndex::SearchPlain(Text &text, const wxString &needle, bool ignoreCase)
+{
+  text.matches.clear();
+  text.searched = true;
+  if (ignoreCase && text.folded.IsEmpty() && !text.text.IsEmpty())
+  {
+    text.folded = wxString(text.text.wc_str(), text.text.Length());
+    text.folded.MakeLower();
+  }
+
+  const wxString &haystack = ignoreCase ? text.folded : text.text;
+  for (size_t pos = haystack.find(needle); pos != wxString::npos;
+       pos = haystack.find(needle, pos + 1))
+    text.matches.push_back({pos, needle.Length()});
+}
+
+void SearchIndex::SearchRegex(Text &text)
+{
+  text.matches.clear();
+  text.searched = true;
+
+  const wxString &str = text.text;
+  const size_t length = str.Length();
+  size_t offset = 0;
+  while (offset <= length)
+  {
+    size_t start, matchLength;
+    if (!m_regex.Matches(str.wc_str() + offset, (offset > 0) ? wxRE_NOTBOL : 0, length - offset) ||
+        !m_regex.GetMatch(&start, &matchLength))
+      break;
+    // An empty match cannot be selected
+    if (matchLength > 0)
+      text.matches.push_back({offset + start, matchLength});
+    offset += start + wxMax(matchLength, size_t(1));
+  }
+}
+
+size_t SearchIndex::GetMatchCount() const
+{
+  size_t count = 0;
+  for (auto const &text : m_texts)
+    count += text.matches.size();
+  return count;
+}
+
+bool SearchIndex::FindNext(size_t text, size_t pos, bool down, Match &match) const
+{
+  const size_t count = m_texts.size();
+  if (text >= count)
+    return false;
+
+  // The start text is visited twice: First its part in the direction of search,
+  // and after wrapping around the rest of it.
+  for (size_t i = 0; i <= count; i++)
+  {
+    const size_t current = down ? (text + i) % count : (text + count - i % count) % count;
+    auto const &matches = m_texts[current].matches;
+    if (matches.empty())
+      continue;
+
+    auto found = down ? matches.begin() : matches.end() - 1;
+    if (i == 0)
+    {
+      auto split = std::lower_bound(matches.begin(), matches.end(), pos,
+                                    [](const Span &span, size_t pos){ return span.start < pos; });
+      if (down ? (split == matches.end()) : (split == matches.begin()))
+        continue;
+      found = down ? split : split - 1;
+    }
+    match.text = current;
+    match.start = found->start;
+    match.length = found->length;
+    return true;
+  }
+  return false;
+}
+
+std::vector<SearchIndex::Replacement> SearchIndex::ReplaceAll(const wxString &replacement)
+{
+  std::vector<Replacement> replacements;
+  for (size_t i = 0; i < m_texts.size(); i++)
+    if (!m_texts[i].matches.empty())
+    {
+      Replacement result;
+      result.text = i;
+      replacements.push_back(result);
+    }
+
+  if (m_query.regex)
+  {
+    for (auto &result : replacements)
+    {
+      result.newText = m_texts[result.text].text;
+      int count = m_regex.ReplaceAll(&result.newText, replacement);
+      result.count = wxMax(count, 0);
+    }
+    return replacements;
+  }
+
+  // The tasks get a copy of the replacement that isn't shared with the caller
+  const wxString replacementChars(replacement.wc_str(), replacement.Length());
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp taskloop shared(replacements, replacementChars)
+  #endif
+  for (size_t i = 0; i < replacements.size(); i++)
+    ReplacePlain(m_texts[replacements[i].text], replacementChars, replacements[i]);
+  return replacements;
+}
+
+void SearchIndex::ReplacePlain(const Text &text, const wxString &replacement,
+                               Replacement &result)
+{
+  const wxString &src = text.text;
+  wxString &newText = result.newText;
+  newText.reserve(src.Length());
+  size_t start = 0;
+  for (auto const &match : text.matches)
+  {
+    // A match that overlaps the previous one has been destroyed by replacing it
+    if (match.start < start)
+      continue;
+    newText.append(src, start, match.start - start);
+    newText.append(replacement.wc_str(), replacement.Length());
+    start = match.start + match.length;
+    result.count++;
+  }
+  newText.append(src, start, wxString::npos);
+}
+
+bool SearchIndex::ReplaceRegexMatch(const wxString &text, const Query &query,
+                                    const wxString &replacement, wxString &newText)
+{
+  wxLogNull suppressErrors;
+  wxRegEx regex;
+  size_t start, length;
+  if (!regex.Compile(query.text, RegexFlags(query.ignoreCase)) || !regex.Matches(text) ||
+      !regex.GetMatch(&start, &length) || (start != 0) || (length != text.Length()))
+    return false;
+  newText = text;
+  regex.Replace(&newText, replacement, 1);
+  return true;
+}
@@ -0,0 +1,176 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file declares the class SearchIndex
+
+  SearchIndex keeps the matches of a search in all editable cells of a worksheet
+  and updates them only for the cells whose text has changed.
+*/
+
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <wx/string.h>
+#include <wx/regex.h>
+#include <unordered_map>
+#include <vector>
+
+/*! The matches of a search string in a list of texts
+
+  The worksheet tells the index which texts it consists of, in order, before
+  each search. Each text comes with a revision that changes whenever the text
+  does: Only texts with a new revision are copied, case-folded and searched
+  again. If the search string is just extended, as it is while it is typed into
+  the find dialog, only the places the shorter string was found at are checked.
+
+  The matches of a plain search string are all places the string occurs at,
+  even if they overlap. The matches of a regular expression don't overlap.
+ */
+class SearchIndex final
+{
+public:
+  //! Identifies a text, for example by the address of the cell it belongs to
+  using Key = const void *;
+
+  //! What to search for
+  struct Query
+  {
+    wxString text;
+    bool ignoreCase = true;
+    //! Is text a regular expression?
+    bool regex = false;
+  };
+
+  //! A place the query was found at
+  struct Match
+  {
+    //! The number of the text
+    size_t text = 0;
+    //! The index of the first char of the match within the text
+    size_t start = 0;
+    size_t length = 0;
+  };
+
+  //! A text with all matches replaced
+  struct Replacement
+  {
+    //! The number of the text
+    size_t text = 0;
+    wxString newText;
+    //! The number of matches that have been replaced
+    size_t count = 0;
+  };
+
+  //! Starts telling the index which texts there are
+  void BeginUpdate();
+  /*! Adds the next text
+
+    \param key Identifies the text
+    \param revision Must change whenever the text with this key changes.
+    \param text The text. Soft line breaks (<code>\\r</code>) are treated as spaces.
+  */
+  void Add(Key key, wxUint64 revision, const wxString &text);
+  //! Forgets all texts that haven't been added since BeginUpdate()
+  void EndUpdate();
+
+  //! The number of texts
+  size_t GetTextCount() const { return m_texts.size(); }
+  //! The text number text, with its soft line breaks replaced by spaces
+  const wxString &GetText(size_t text) const { return m_texts[text].text; }
+
+  /*! Finds all matches of a query
+
+    \return false, if the query is an invalid regular expression
+  */
+  bool Search(const Query &query);
+  //! The number of matches the last search has found
+  size_t GetMatchCount() const;
+  //! The number of matches the last search has found in the text number text
+  size_t GetMatchCount(size_t text) const { return m_texts[text].matches.size(); }
+
+  /*! Finds the next match, wrapping around at the end of the list of texts
+
+    \param text The number of the text to start in
+    \param pos Searching down finds matches that start at pos or later,
+               searching up matches that start before pos.
+    \param down The direction to search in
+    \param match The match that has been found
+    \return false, if the last search hasn't found anything
+  */
+  bool FindNext(size_t text, size_t pos, bool down, Match &match) const;
+
+  /*! Replaces all matches of the last search
+
+    Returns one entry for each text that contains a match. The new texts are
+    assembled in parallel unless the search string is a regular expression.
+  */
+  std::vector<Replacement> ReplaceAll(const wxString &replacement);
+
+  /*! Replaces a string that matches a regular expression as a whole
+
+    \return false, if the string doesn't match
+  */
+  static bool ReplaceRegexMatch(const wxString &text, const Query &query,
+                                const wxString &replacement, wxString &newText);
+
+private:
+  //! The start and the length of a match
+  struct Span
+  {
+    size_t start;
+    size_t length;
+  };
+
+  struct Text
+  {
+    Key key = nullptr;
+    wxUint64 revision = 0;
+    //! A copy of the text that shares no data with any other string
+    wxString text;
+    //! The lower-case version of text. Is generated by the first search that ignores the case.
+    wxString folded;
+    //! The matches of m_query, in order
+    std::vector<Span> matches;
+    //! Are matches the result of searching for m_query?
+    bool searched = false;
+  };
+
+  //! Finds the matches of the plain search string needle. May run in a background task.
+  static void SearchPlain(Text &text, const wxString &needle, bool ignoreCase);
+  //! Finds the matches of m_regex
+  void SearchRegex(Text &text);
+  //! Replaces the matches of a plain search string that don't overlap
+  static void ReplacePlain(const Text &text, const wxString &replacement,
+                           Replacement &result);
+
+  std::vector<Text> m_texts;
+  //! The texts of the last update, while the next update is in progress
+  std::unordered_map<Key, Text> m_oldTexts;
+  //! The last query
+  Query m_query;
+  //! Was the last query valid?
+  bool m_queryValid = false;
+  //! The last query, if it is a regular expression
+  wxRegEx m_regex;
+};
+
+#endif // SEARCHINDEX_H
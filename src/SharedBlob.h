@@ -0,0 +1,69 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file declares SharedBlob, the contents of an image or gnuplot file
+  several owners can share.
+*/
+
+#ifndef SHAREDBLOB_H
+#define SHAREDBLOB_H
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/*! The immutable contents of an image or gnuplot file
+
+  The reference count of a wxMemoryBuffer isn't thread-safe, and images are
+  loaded by background tasks and saved by background tasks. The reference
+  count of a std::shared_ptr is thread-safe, and as nobody may modify the data
+  the cache of the files read from a .wxmx file, the images, and the snapshots
+  that are written to a .wxmx file all can share the same copy.
+
+  A null pointer means: No data.
+*/
+using SharedBlob = std::shared_ptr<const std::vector<char>>;
+
+//! Creates a blob that owns a copy of the data
+inline SharedBlob MakeSharedBlob(const void *data, std::size_t length)
+{
+  const char *bytes = static_cast<const char *>(data);
+  return std::make_shared<const std::vector<char>>(bytes, bytes + length);
+}
+
+//! Creates a blob that takes over the data
+inline SharedBlob MakeSharedBlob(std::vector<char> &&data)
+{
+  return std::make_shared<const std::vector<char>>(std::move(data));
+}
+
+//! The number of bytes in a blob
+inline std::size_t BlobSize(const SharedBlob &blob) { return blob ? blob->size() : 0; }
+
+//! The bytes in a blob. Never NULL, so it can be handed to wxMemoryInputStream.
+inline const char *BlobData(const SharedBlob &blob)
+{
+  return (blob && !blob->empty()) ? blob->data() : "";
+}
+
+#endif // SHAREDBLOB_H
@@ -39,13 +39,14 @@
 #include <wx/file.h>
 #include <wx/filename.h>
 #include <wx/filesys.h>
-#include <wx/fs_mem.h>
 #include <wx/utils.h>
 #include <wx/clipbrd.h>
 #include <wx/config.h>
 #include <wx/mstream.h>
 #include <wx/wfstream.h>
 #include <wx/anidecod.h>
+#include <algorithm>
+#include <limits>
 
 // filesystem cannot be passed by const reference as we want to keep the
 // pointer to the file system alive in a background task
@@ -365,58 +366,37 @@ wxString SlideShow::ToXML() const
 
   for (int i = 0; i < m_size; i++)
   {
-    wxString basename = m_cellPointers->WXMXGetNewFileName();
     // add the file to memory
     if (m_images[i])
     {
-      // Anonymize the name of our temp directory for saving
-      wxString gnuplotSource;
-      wxString gnuplotData;
-      if(m_images[i]->GnuplotData() != wxEmptyString)
-      {
-        wxFileName gnuplotDataFile(m_images[i]->GnuplotData());
-        gnuplotData = gnuplotDataFile.GetFullName();
-      }
+      // Identical frames, gnuplot sources and data are stored only once. As
+      // the names are derived from the contents this also anonymizes the name
+      // of our temp directory.
       if(m_images[i]->GnuplotSource() != wxEmptyString)
       {
-        wxFileName gnuplotSourceFile(m_images[i]->GnuplotSource());
-        gnuplotSource = gnuplotSourceFile.GetFullName();
-      }
-
-      // Save the gnuplot source, if necessary.
-      if(gnuplotSource != wxEmptyString)
-      {
-        gnuplotSourceFiles += gnuplotSource + ";";
-        wxMemoryBuffer data = m_images[i]->GetGnuplotSource();
-        if(data.GetDataLen() > 0)
+        SharedBlob data = m_images[i]->GetGnuplotSource();
+        if(BlobSize(data) > 0)
         {
-          wxMemoryFSHandler::AddFile(gnuplotSource,
-                                     data.GetData(),
-                                     data.GetDataLen()
-            );
+          wxString extension = wxFileName(m_images[i]->GnuplotSource()).GetExt();
+          if(extension.IsEmpty())
+            extension = wxT("gnuplot");
+          gnuplotSourceFiles += m_cellPointers->WXMXStoreBlob(data, wxT("gnuplot"), extension) + ";";
         }
       }
-      if(gnuplotData != wxEmptyString)
+      if(m_images[i]->GnuplotData() != wxEmptyString)
       {
-        gnuplotDataFiles += gnuplotData + ";";
-        wxMemoryBuffer data = m_images[i]->GetGnuplotData();
-        if(data.GetDataLen() > 0)
-        {
-          wxMemoryFSHandler::AddFile(gnuplotData,
-                                     data.GetData(),
-                                     data.GetDataLen()
-            );
-        }
+        SharedBlob data = m_images[i]->GetGnuplotData();
+        if(BlobSize(data) > 0)
+          gnuplotDataFiles += m_cellPointers->WXMXStoreBlob(data, wxT("gnuplot"), wxT("data")) + ";";
       }
-      
-      if (m_images[i]->GetCompressedImage())
-        wxMemoryFSHandler::AddFile(basename + m_images[i]->GetExtension(),
-                                   m_images[i]->GetCompressedImage().GetData(),
-                                   m_images[i]->GetCompressedImage().GetDataLen()
-        );
-    }
 
-    images += basename + m_images[i]->GetExtension() + wxT(";");
+      SharedBlob image = m_images[i]->GetCompressedImage();
+      if (BlobSize(image) > 0)
+        images += m_cellPointers->WXMXStoreBlob(image, wxT("image"), m_images[i]->GetExtension());
+      else
+        images += m_cellPointers->WXMXGetNewFileName() + m_images[i]->GetExtension();
+      images += wxT(";");
+    }
   }
 
   wxString flags;
@@ -440,6 +420,11 @@ wxSize SlideShow::ToImageFile(wxString file)
   return m_images[m_displayed]->ToImageFile(file);
 }
 
+wxSize SlideShow::ToImageFile(int frame, wxString file)
+{
+  return m_images[frame]->ToImageFile(file);
+}
+
 wxString SlideShow::ToRTF() const
 {
   // Animations aren't supported by RTF so we just export the currently shown
@@ -451,7 +436,7 @@ wxString SlideShow::ToRTF() const
 
   // Extract the description of the image data
   wxString image;
-  wxMemoryBuffer imgdata;
+  SharedBlob imgdata;
   if (m_images[m_displayed]->GetExtension().Lower() == wxT("png"))
   {
     imgdata = m_images[m_displayed]->GetCompressedImage();
@@ -472,8 +457,8 @@ wxString SlideShow::ToRTF() const
     wxImage imagedata = m_images[m_displayed]->GetUnscaledBitmap().ConvertToImage();
     wxMemoryOutputStream stream;
     imagedata.SaveFile(stream, wxBITMAP_TYPE_PNG);
-    imgdata.AppendData(stream.GetOutputStreamBuffer()->GetBufferStart(),
-                       stream.GetOutputStreamBuffer()->GetBufferSize());
+    imgdata = MakeSharedBlob(stream.GetOutputStreamBuffer()->GetBufferStart(),
+                             stream.GetOutputStreamBuffer()->GetBufferSize());
   }
 
   image += wxString::Format(wxT("\\picw%lu\\pich%lu "),
@@ -482,8 +467,8 @@ wxString SlideShow::ToRTF() const
   );
 
   // Convert the data into a hexadecimal string
-  for (size_t i = 0; i <= imgdata.GetDataLen(); i++)
-    image += wxString::Format("%02x", ((unsigned char *) imgdata.GetData())[i]);
+  for (size_t i = 0; i < BlobSize(imgdata); i++)
+    image += wxString::Format("%02x", ((const unsigned char *) BlobData(imgdata))[i]);
 
   return header + image + footer;
 }
@@ -501,39 +486,219 @@ const wxString &SlideShow::GetToolTip(const wxPoint point) const
   return GetLocalToolTip();
 }
 
-wxSize SlideShow::ToGif(wxString file)
+//! Is the pixel rgb of frame transparent?
+static bool IsMasked(const wxImage &frame, const unsigned char *rgb)
 {
-  // Show a busy cursor as long as we export a .gif file (which might be a lengthy
-  // action).
-  wxBusyCursor crs;
+  return frame.HasMask() && (rgb[0] == frame.GetMaskRed()) &&
+    (rgb[1] == frame.GetMaskGreen()) && (rgb[2] == frame.GetMaskBlue());
+}
 
-  wxImageArray gifFrames;
+wxImageArray SlideShow::GifFrames()
+{
+  std::vector<wxImage> frames(m_size);
+
+  // Decoding the frames doesn't need the GUI => can be done in parallel.
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp taskloop shared(frames)
+  #endif
+  for (int i = 0; i < m_size; i++)
+    frames[i] = m_images[i]->GetUnscaledImage();
 
+  // Images that cannot be decoded are shown as an "image broken" sign, which
+  // is drawn using the GUI => must be done in the main thread.
   for (int i = 0; i < m_size; i++)
+    if(!frames[i].IsOk())
+      frames[i] = m_images[i]->GetUnscaledBitmap().ConvertToImage();
+
+  // Gif supports only fully transparent or not transparent at all. Quantizing
+  // drops the alpha channel and might map the mask colour onto a visible
+  // colour => the transparent pixels are marked by a mask colour that is
+  // unique within each frame before quantizing and get a palette entry of
+  // their own afterwards.
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp taskloop shared(frames)
+  #endif
+  for (int i = 0; i < m_size; i++)
+    frames[i].ConvertAlphaToMask();
+
+  // The number of colours the quantizer may choose. Together with the 20
+  // windows colours this leaves one palette entry for the mask colour.
+  const int quantizedColours = 235;
+
+  if((*m_configuration)->GifGlobalPalette() && (m_size > 1))
   {
-    wxImage frame;
-    // Reduce the frame to at most 256 colors
-    wxQuantize::Quantize(m_images[i]->GetUnscaledBitmap().ConvertToImage(),frame);
-    // Gif supports only fully transparent or not transparent at all.
-    frame.ConvertAlphaToMask();
-    gifFrames.Add(frame);
+    // Quantize a sample of the pixels of all frames in order to find a palette
+    // that fits the whole animation
+    const long maxSamplesPerFrame = 65536;
+    long samplesPerFrame = 1;
+    for (int i = 0; i < m_size; i++)
+      samplesPerFrame = std::max(samplesPerFrame,
+                                 std::min(maxSamplesPerFrame,
+                                          (long)frames[i].GetWidth() * frames[i].GetHeight()));
+    wxImage sample(samplesPerFrame, m_size, false);
+    for (int i = 0; i < m_size; i++)
+    {
+      long pixels = (long)frames[i].GetWidth() * frames[i].GetHeight();
+      const unsigned char *src = frames[i].GetData();
+      unsigned char *dst = sample.GetData() + 3 * samplesPerFrame * i;
+      // Transparent pixels repeat the last visible pixel instead of adding
+      // their mask colour to the palette.
+      unsigned char visible[3] = {0, 0, 0};
+      for (long j = 0; j < samplesPerFrame; j++)
+      {
+        long pixel = (pixels > 0) ? (j * pixels / samplesPerFrame) : 0;
+        if ((pixels > 0) && !IsMasked(frames[i], src + 3 * pixel))
+          std::copy(src + 3 * pixel, src + 3 * pixel + 3, visible);
+        for (int c = 0; c < 3; c++)
+          *dst++ = visible[c];
+      }
+    }
+    wxImage quantizedSample;
+    wxPalette *palette = NULL;
+    if(wxQuantize::Quantize(sample, quantizedSample, &palette, quantizedColours, NULL,
+                            wxQUANTIZE_INCLUDE_WINDOWS_COLOURS) && palette)
+    {
+      int paletteSize = std::min(palette->GetColoursCount(), quantizedColours + 20);
+      std::vector<unsigned char> red(paletteSize), green(paletteSize), blue(paletteSize);
+      for (int i = 0; i < paletteSize; i++)
+        palette->GetRGB(i, &red[i], &green[i], &blue[i]);
+      delete palette;
+
+      // A lookup table from 15-bit rgb values to the nearest palette entry
+      std::vector<unsigned char> lookup(32768);
+      #ifdef HAVE_OPENMP_TASKS
+      #pragma omp taskloop shared(lookup, red, green, blue)
+      #endif
+      for (int r = 0; r < 32; r++)
+        for (int g = 0; g < 32; g++)
+          for (int b = 0; b < 32; b++)
+          {
+            long bestDistance = std::numeric_limits<long>::max();
+            for (int i = 0; i < paletteSize; i++)
+            {
+              long dr = (r << 3) + 4 - red[i];
+              long dg = (g << 3) + 4 - green[i];
+              long db = (b << 3) + 4 - blue[i];
+              long distance = dr * dr + dg * dg + db * db;
+              if(distance < bestDistance)
+              {
+                bestDistance = distance;
+                lookup[(r << 10) | (g << 5) | b] = i;
+              }
+            }
+          }
+
+      // The last palette entry is a colour no visible pixel is mapped to and
+      // marks the transparent pixels of all frames.
+      unsigned char maskRed = 0, maskGreen = 0, maskBlue = 0;
+      for (long colour = 0; colour < 0x1000000; colour++)
+      {
+        maskRed = colour & 0xff;
+        maskGreen = (colour >> 8) & 0xff;
+        maskBlue = (colour >> 16) & 0xff;
+        bool used = false;
+        for (int i = 0; (i < paletteSize) && !used; i++)
+          used = (red[i] == maskRed) && (green[i] == maskGreen) && (blue[i] == maskBlue);
+        if (!used)
+          break;
+      }
+      red.push_back(maskRed);
+      green.push_back(maskGreen);
+      blue.push_back(maskBlue);
+
+      #ifdef HAVE_OPENMP_TASKS
+      #pragma omp taskloop shared(frames, lookup, red, green, blue)
+      #endif
+      for (int i = 0; i < m_size; i++)
+      {
+        unsigned char *rgb = frames[i].GetData();
+        long pixels = (long)frames[i].GetWidth() * frames[i].GetHeight();
+        for (long j = 0; j < pixels; j++)
+        {
+          int index = paletteSize;
+          if (!IsMasked(frames[i], rgb))
+            index = lookup[((rgb[0] >> 3) << 10) | ((rgb[1] >> 3) << 5) | (rgb[2] >> 3)];
+          *rgb++ = red[index];
+          *rgb++ = green[index];
+          *rgb++ = blue[index];
+        }
+        if (frames[i].HasMask())
+          frames[i].SetMaskColour(maskRed, maskGreen, maskBlue);
+      }
+
+      // wxPalette is reference-counted => shouldn't be shared between tasks.
+      palette = new wxPalette(paletteSize + 1, red.data(), green.data(), blue.data());
+      for (int i = 0; i < m_size; i++)
+        frames[i].SetPalette(*palette);
+      delete palette;
+
+      wxImageArray gifFrames;
+      for (int i = 0; i < m_size; i++)
+        gifFrames.Add(frames[i]);
+      return gifFrames;
+    }
+    delete palette;
   }
 
-  wxFile fl(file, wxFile::write);
-  if(fl.IsOpened())
+  // Reduce each frame to at most 256 colors of its own.
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp taskloop shared(frames)
+  #endif
+  for (int i = 0; i < m_size; i++)
   {
-    wxFileOutputStream outStream(fl);
-    if(outStream.IsOk())
+    wxImage frame;
+    wxQuantize::Quantize(frames[i], frame, quantizedColours);
+    if (frames[i].HasMask())
     {
-      wxGIFHandler gif;
-      
-      if(gif.SaveAnimation(gifFrames, &outStream, true, 1000 / GetFrameRate()))
-        return wxSize(m_images[1]->GetOriginalWidth(), m_images[1]->GetOriginalHeight());
+      // Mark the transparent pixels by a colour the quantized frame doesn't use
+      unsigned char maskRed, maskGreen, maskBlue;
+      frame.FindFirstUnusedColour(&maskRed, &maskGreen, &maskBlue);
+      const unsigned char *src = frames[i].GetData();
+      unsigned char *dst = frame.GetData();
+      long pixels = (long)frame.GetWidth() * frame.GetHeight();
+      for (long j = 0; j < pixels; j++, src += 3, dst += 3)
+        if (IsMasked(frames[i], src))
+        {
+          dst[0] = maskRed;
+          dst[1] = maskGreen;
+          dst[2] = maskBlue;
+        }
+      frame.SetMaskColour(maskRed, maskGreen, maskBlue);
     }
+    frames[i] = frame;
   }
+
+  wxImageArray gifFrames;
+  for (int i = 0; i < m_size; i++)
+    gifFrames.Add(frames[i]);
+  return gifFrames;
+}
+
+wxSize SlideShow::ToGif(wxString file)
+{
+  // Show a busy cursor as long as we export a .gif file (which might be a lengthy
+  // action).
+  wxBusyCursor crs;
+
+  if (SaveGif(GifFrames(), GetGifDelay(), file))
+    return wxSize(m_images[1]->GetOriginalWidth(), m_images[1]->GetOriginalHeight());
   return wxSize(-1,-1);
 }
 
+bool SlideShow::SaveGif(const wxImageArray &frames, int delay, const wxString &file)
+{
+  wxFile fl(file, wxFile::write);
+  if(!fl.IsOpened())
+    return false;
+
+  wxFileOutputStream outStream(fl);
+  if(!outStream.IsOk())
+    return false;
+
+  wxGIFHandler gif;
+  return gif.SaveAnimation(frames, &outStream, true, delay);
+}
+
 void SlideShow::ClearCache()
 {
   for (int i = 0; i < m_size; i++)
@@ -567,17 +732,7 @@ bool SlideShow::CopyAnimationToClipboard()
     // action).
     wxBusyCursor crs;
     
-    wxImageArray gifFrames;
-    
-    for (int i = 0; i < m_size; i++)
-    {
-      wxImage frame;
-      // Reduce the frame to at most 256 colors
-      wxQuantize::Quantize(m_images[i]->GetUnscaledBitmap().ConvertToImage(),frame);
-      // Gif supports only fully transparent or not transparent at all.
-      frame.ConvertAlphaToMask();
-      gifFrames.Add(frame);
-    }
+    wxImageArray gifFrames = GifFrames();
 
     wxMemoryOutputStream stream;
     wxGIFHandler gif;
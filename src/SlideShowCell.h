@@ -109,10 +109,30 @@ public:
 
   //! Exports the image the slideshow currently displays
   wxSize ToImageFile(wxString file);
+  //! Exports one frame of the animation. See Image::ToImageFile().
+  wxSize ToImageFile(int frame, wxString file);
 
   //! Exports the whole animation as animated gif
   wxSize ToGif(wxString file);
 
+  /*! Returns all frames of the animation, reduced to at most 256 colors each
+
+    Decoding and quantizing the frames is done in parallel. Depending on
+    Configuration::GifGlobalPalette() all frames either share one palette
+    or each frame gets a palette of its own. Images that cannot be decoded are
+    drawn using the GUI => Must be called from the main thread.
+   */
+  wxImageArray GifFrames();
+
+  //! The delay between two frames of the .gif file [in ms]
+  int GetGifDelay() const { return 1000 / GetFrameRate(); }
+
+  /*! Writes frames returned by GifFrames() to an animated .gif file
+
+    Doesn't use the GUI => can be called from a background task.
+   */
+  static bool SaveGif(const wxImageArray &frames, int delay, const wxString &file);
+
   bool CopyToClipboard() const override;
   
   //! Put the animation on the clipboard.
@@ -302,11 +302,7 @@ wxString SubSupCell::ToMatlab() const
 
 wxString SubSupCell::ToTeX() const
 {
-  wxConfigBase *config = wxConfig::Get();
-
-  bool TeXExponentsAfterSubscript = false;
-
-  config->Read("TeXExponentsAfterSubscript", &TeXExponentsAfterSubscript);
+  bool TeXExponentsAfterSubscript = (*m_configuration)->TeXExponentsAfterSubscript();
 
   wxString s;
 
@@ -180,12 +180,18 @@ void TextCell::UpdateToolTip()
   
   else if (m_textStyle == TS_NUMBER)
   {
-    if(
+    // wxRegEx stores the last match => Cells that are created by different
+    // threads mustn't use it at the same time.
+    bool roundingError;
+    #ifdef HAVE_OPENMP_TASKS
+    #pragma omp critical (TextCellRoundingErrorRegEx)
+    #endif
+    roundingError =
       (m_roundingErrorRegEx1.Matches(m_text)) ||
       (m_roundingErrorRegEx2.Matches(m_text)) ||
       (m_roundingErrorRegEx3.Matches(m_text)) ||
-      (m_roundingErrorRegEx4.Matches(m_text))
-      )
+      (m_roundingErrorRegEx4.Matches(m_text));
+    if(roundingError)
       SetToolTip(&T_("As calculating 0.1^12 demonstrates maxima by default doesn't tend to "
                        "hide what looks like being the small error using floating-point "
                      "numbers introduces.\n"
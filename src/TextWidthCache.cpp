@@ -0,0 +1,71 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+
+/*! \file
+  This file defines the class TextWidthCache
+
+  TextWidthCache remembers the sizes of the pieces of text EditorCells have
+  measured, for all cells that use the same font.
+*/
+
+#include "TextWidthCache.h"
+
+constexpr size_t TextWidthCache::maxWidthsPerFont;
+constexpr size_t TextWidthCache::maxWidths;
+
+TextWidthCache::Widths &TextWidthCache::GetWidths(const Style &style, bool printing)
+{
+  return m_widths[printing ? 1 : 0][style];
+}
+
+wxSize TextWidthCache::GetTextSize(Widths &widths, wxDC &dc, const wxString &text)
+{
+  Widths::const_iterator it = widths.find(text);
+
+  // If we already know this text piece's size we return the cached value
+  if (it != widths.end())
+    return it->second;
+
+  if (m_size >= maxWidths)
+    Clear();
+  else if (widths.size() >= maxWidthsPerFont)
+  {
+    m_size -= widths.size();
+    Widths().swap(widths);
+  }
+
+  // Ask wxWidgets to return this text piece's size (slow!)
+  wxSize size = dc.GetTextExtent(text);
+  widths[text] = size;
+  m_size++;
+  return size;
+}
+
+void TextWidthCache::Clear()
+{
+  // The maps of the fonts are only emptied: The cells still point to them.
+  // Swapping them with empty maps frees their buckets, too.
+  for (auto &fontWidths : m_widths)
+    for (auto &widths : fontWidths)
+      Widths().swap(widths.second);
+  m_size = 0;
+}
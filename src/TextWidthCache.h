@@ -0,0 +1,107 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+
+/*! \file
+  This file declares the class TextWidthCache
+
+  TextWidthCache remembers the sizes of the pieces of text EditorCells have
+  measured, for all cells that use the same font.
+*/
+
+#ifndef TEXTWIDTHCACHE_H
+#define TEXTWIDTHCACHE_H
+
+#include "precomp.h"
+#include "TextStyle.h"
+#include <wx/dc.h>
+#include <wx/hashmap.h>
+#include <wx/string.h>
+#include <unordered_map>
+
+/*! The sizes of pieces of text, by font
+
+  Measuring text using wxDC::GetTextExtent() is slow. But code and text cells
+  consist of the same words and tokens again and again, and a cell that is
+  restyled or rewrapped after a keystroke or a change of the window width
+  mostly consists of words that have been measured before. This cache stores
+  their sizes for each font, so they need to be measured only once for all
+  cells of the worksheet.
+
+  Like the fonts themselves the cache may only be used by the main thread.
+ */
+class TextWidthCache final
+{
+public:
+  //! The sizes of the pieces of text that have been measured in one font
+  using Widths = std::unordered_map<wxString, wxSize, wxStringHash>;
+
+  /*! The sizes of the text measured in the font of style
+
+    The reference stays valid as long as the cache exists.
+    \param style The font
+    \param printing true = the sizes on the printer, which differ from the ones
+                    on the screen.
+  */
+  Widths &GetWidths(const Style &style, bool printing = false);
+
+  /*! The size of a piece of text
+
+    \param widths The sizes that have been measured in the font the dc uses
+    \param dc The dc that measures the text if its size isn't known, yet
+    \param text The piece of text
+  */
+  wxSize GetTextSize(Widths &widths, wxDC &dc, const wxString &text);
+
+  /*! Forgets all sizes
+
+    Needs to be called whenever the fonts change their size in pixels, for
+    example if the zoom factor, the resolution of the screen or the styles
+    change. Configuration::FontChanged() does that.
+  */
+  void Clear();
+  //! The number of sizes that are known
+  size_t GetSize() const { return m_size; }
+
+  /*! The maximum number of sizes that are stored for one font
+
+    Text cells measure the lines up to each space they can be broken at. This
+    limit keeps these pieces of text from accumulating forever.
+  */
+  static constexpr size_t maxWidthsPerFont = 100000;
+  //! The maximum number of sizes that are stored for all fonts together
+  static constexpr size_t maxWidths = 300000;
+
+  static TextWidthCache &Get()
+  {
+    static TextWidthCache globalCache;
+    return globalCache;
+  }
+
+private:
+  using FontWidths = std::unordered_map<Style, Widths, StyleFontHasher, StyleFontEquals>;
+  //! The widths on the screen and on the printer
+  FontWidths m_widths[2];
+  //! The number of sizes stored in m_widths
+  size_t m_size = 0;
+};
+
+#endif // TEXTWIDTHCACHE_H
@@ -0,0 +1,246 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file defines the class TokenLines
+
+  TokenLines remembers where the lines of a piece of tokenized maxima code
+  start, which allows to tokenize only the lines of the code that have been
+  edited.
+*/
+
+#include "TokenLines.h"
+#include <algorithm>
+#include <cstdint>
+
+void TokenLines::Clear()
+{
+  m_lines.clear();
+  m_length = 0;
+  m_snippets = 0;
+  ResetChange();
+}
+
+void TokenLines::ResetChange()
+{
+  m_changeKnown = true;
+  m_changeStart = wxString::npos;
+  m_changeEnd = 0;
+  m_lengthChange = 0;
+}
+
+void TokenLines::Replace(size_t start, size_t end, size_t length)
+{
+  // The chars behind the edit move, and the edit may extend the range of chars
+  // that have changed in both directions
+  if (m_changeEnd >= end)
+    m_changeEnd = m_changeEnd - end + start + length;
+  m_changeEnd = std::max(m_changeEnd, start + length);
+  m_changeStart = std::min(m_changeStart, start);
+  m_lengthChange += long(length) - long(end - start);
+}
+
+size_t TokenLines::Hash(const wxString &text, size_t start, size_t end)
+{
+  // FNV-1a
+  std::uint64_t hash = 14695981039346656037ULL;
+  const wxString::const_iterator last = text.begin() + end;
+  for (wxString::const_iterator it = text.begin() + start; it != last; ++it)
+  {
+    hash ^= static_cast<std::uint64_t>(static_cast<wxChar>(*it));
+    hash *= 1099511628211ULL;
+  }
+  return static_cast<size_t>(hash);
+}
+
+size_t TokenLines::GetLineEnd(size_t line) const
+{
+  if (line + 1 < m_lines.size())
+    return m_lines[line + 1].pos;
+  return m_length;
+}
+
+bool TokenLines::LineFound(const wxString &text, size_t line, size_t pos) const
+{
+  const size_t end = pos + GetLineEnd(line) - m_lines[line].pos;
+  return (end <= text.Length()) && (Hash(text, pos, end) == m_lines[line].hash);
+}
+
+void TokenLines::HashLines(const wxString &text, size_t first, size_t end)
+{
+  for (size_t line = first; line < end; ++line)
+    m_lines[line].hash = Hash(text, m_lines[line].pos, GetLineEnd(line));
+}
+
+void TokenLines::Build(const wxString &text, const MaximaTokenizer::TokenList &tokens,
+                       const SnippetCount &snippets)
+{
+  Clear();
+  m_lines.push_back({0, 0, 0, 0});
+  size_t pos = 0;
+  for (size_t i = 0; i < tokens.size(); ++i)
+  {
+    pos += tokens[i].GetText().Length();
+    m_snippets += snippets(tokens[i]);
+    if (tokens[i].GetText() == wxT("\n"))
+      m_lines.push_back({pos, i + 1, m_snippets, 0});
+  }
+  m_length = text.Length();
+  HashLines(text, 0, m_lines.size());
+}
+
+bool TokenLines::Update(const wxString &text, Configuration *configuration,
+                        MaximaTokenizer::TokenList &tokens, const SnippetCount &snippets,
+                        Change &change)
+{
+  const size_t oldLength = m_length;
+  const size_t newLength = text.Length();
+
+  size_t prefix, suffix;
+  if (m_changeKnown && (long(oldLength) + m_lengthChange == long(newLength)))
+  {
+    if (m_changeStart == wxString::npos)
+      return false;
+    // The line the first edit is in and the first line that starts behind the
+    // last edit
+    const size_t firstChanged = std::upper_bound(
+      m_lines.begin(), m_lines.end(), m_changeStart,
+      [](size_t pos, const Line &line){ return pos < line.pos; }) - m_lines.begin() - 1;
+    prefix = m_lines[firstChanged].pos;
+    suffix = std::lower_bound(
+      m_lines.begin() + firstChanged + 1, m_lines.end(), size_t(long(m_changeEnd) - m_lengthChange),
+      [](const Line &line, size_t pos){ return line.pos < pos; }) - m_lines.begin();
+  }
+  else
+  {
+    // The first line that has changed
+    size_t firstChanged = 0;
+    while ((firstChanged < m_lines.size()) &&
+           LineFound(text, firstChanged, m_lines[firstChanged].pos))
+      ++firstChanged;
+    if ((firstChanged == m_lines.size()) && (newLength == oldLength))
+    {
+      ResetChange();
+      return false;
+    }
+    // If all lines are unchanged text has been appended to the last one
+    prefix = (firstChanged < m_lines.size()) ? m_lines[firstChanged].pos : oldLength;
+
+    // The first line behind the change that hasn't changed, either
+    suffix = m_lines.size();
+    while ((suffix > firstChanged) &&
+           (m_lines[suffix - 1].pos + newLength >= prefix + oldLength) &&
+           LineFound(text, suffix - 1, m_lines[suffix - 1].pos + newLength - oldLength))
+      --suffix;
+  }
+  ResetChange();
+  const size_t changeEndOld = (suffix < m_lines.size()) ? m_lines[suffix].pos : oldLength;
+  const size_t changeEndNew = changeEndOld + newLength - oldLength;
+
+  // The last line that starts in front of the change. Whether a word is a
+  // function depends on whether the next char that isn't whitespace is a "(":
+  // If only whitespace lies between the change and the start of this line we
+  // need to tokenize the line before, too.
+  size_t first = std::upper_bound(
+    m_lines.begin(), m_lines.end(), prefix,
+    [](size_t pos, const Line &line){ return pos < line.pos; }) - m_lines.begin() - 1;
+  while (first > 0)
+  {
+    bool onlyWhitespace = true;
+    size_t pos = m_lines[first].pos;
+    for (size_t i = m_lines[first].token; (i < tokens.size()) && (pos < prefix); ++i)
+    {
+      auto const &tokenString = tokens[i].GetText();
+      if ((!tokenString.IsEmpty()) && (tokenString[0] != wxT('\n')) &&
+          (!MaximaTokenizer::IsSpace(tokenString[0])))
+      {
+        onlyWhitespace = false;
+        break;
+      }
+      pos += tokenString.Length();
+    }
+    if (!onlyWhitespace)
+      break;
+    --first;
+  }
+
+  // Tokenize the text until we reach a line the old tokens start at, too.
+  size_t resync = m_lines.size();
+  auto newTokens = MaximaTokenizer(
+    text, configuration, m_lines[first].pos,
+    [&](size_t pos){
+      if (pos < changeEndNew)
+        return false;
+      size_t oldPos = pos - changeEndNew + changeEndOld;
+      auto found = std::lower_bound(
+        m_lines.begin() + first + 1, m_lines.end(), oldPos,
+        [](const Line &line, size_t linePos){ return line.pos < linePos; });
+      if ((found == m_lines.end()) || (found->pos != oldPos))
+        return false;
+      resync = found - m_lines.begin();
+      return true;
+    }).PopTokens();
+
+  change.firstToken = m_lines[first].token;
+  change.firstSnippet = m_lines[first].snippet;
+  size_t endToken = tokens.size();
+  change.endSnippet = m_snippets;
+  if (resync < m_lines.size())
+  {
+    endToken = m_lines[resync].token;
+    change.endSnippet = m_lines[resync].snippet;
+  }
+  change.newTokens = newTokens.size();
+
+  // The lines the new tokens start
+  std::vector<Line> newLines;
+  size_t pos = m_lines[first].pos;
+  size_t snippet = change.firstSnippet;
+  for (size_t i = 0; i < newTokens.size(); ++i)
+  {
+    pos += newTokens[i].GetText().Length();
+    snippet += snippets(newTokens[i]);
+    if ((newTokens[i].GetText() == wxT("\n")) &&
+        ((resync == m_lines.size()) || (i + 1 < newTokens.size())))
+      newLines.push_back({pos, change.firstToken + i + 1, snippet, 0});
+  }
+  const size_t newSnippets = snippet - change.firstSnippet;
+
+  // Replace the tokens
+  change.oldTokens.assign(std::make_move_iterator(tokens.begin() + change.firstToken),
+                          std::make_move_iterator(tokens.begin() + endToken));
+  ReplaceRange(tokens, change.firstToken, endToken, std::move(newTokens));
+
+  // Move the lines behind the change to their new place
+  for (size_t line = resync; line < m_lines.size(); ++line)
+  {
+    m_lines[line].pos = m_lines[line].pos - changeEndOld + changeEndNew;
+    m_lines[line].token = m_lines[line].token - endToken + change.firstToken + change.newTokens;
+    m_lines[line].snippet = m_lines[line].snippet - change.endSnippet + change.firstSnippet +
+      newSnippets;
+  }
+  m_snippets = m_snippets - change.endSnippet + change.firstSnippet + newSnippets;
+  const size_t changedLines = newLines.size();
+  ReplaceRange(m_lines, first + 1, resync, std::move(newLines));
+  m_length = newLength;
+  HashLines(text, first, first + 1 + changedLines);
+  return true;
+}
@@ -0,0 +1,171 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file declares the class TokenLines
+
+  TokenLines remembers where the lines of a piece of tokenized maxima code
+  start, which allows to tokenize only the lines of the code that have been
+  edited.
+*/
+
+#ifndef TOKENLINES_H
+#define TOKENLINES_H
+
+#include "MaximaTokenizer.h"
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <vector>
+
+/*! The lines of a piece of code MaximaTokenizer has split into tokens
+
+  Only lines that start outside of comments and strings are remembered, as the
+  tokenizer can only be restarted at these. The owner of the text tells
+  Replace() about each edit, which allows Update() to tokenize the lines the
+  edits have touched anew until it reaches the start of a line that hasn't
+  changed and to replace their tokens without looking at the rest of the text.
+
+  If the text has been changed without telling Replace() about it Update()
+  needs to find the lines that have changed, instead: Each line is remembered
+  by a hash of its text, which is compared from both ends of the code.
+ */
+class TokenLines final
+{
+public:
+  //! The number of snippets of styled text a token is displayed as
+  using SnippetCount = std::function<size_t (const MaximaTokenizer::Token &)>;
+
+  //! The tokens and snippets of styled text Update() has replaced
+  struct Change
+  {
+    //! The index of the first token that has been replaced
+    size_t firstToken = 0;
+    //! The tokens that have been replaced
+    MaximaTokenizer::TokenList oldTokens;
+    //! The number of tokens that have replaced them
+    size_t newTokens = 0;
+    //! The index of the first snippet of styled text that needs to be replaced
+    size_t firstSnippet = 0;
+    //! The index behind the last snippet of styled text that needs to be replaced
+    size_t endSnippet = 0;
+  };
+
+  //! Remembers the lines of a text that has been split into tokens from scratch
+  void Build(const wxString &text, const MaximaTokenizer::TokenList &tokens,
+             const SnippetCount &snippets);
+  void Clear();
+  //! Does Update() need a Build() first?
+  bool IsEmpty() const { return m_lines.empty(); }
+
+  //! Tells Update() that the chars start...end-1 have been replaced by length new chars
+  void Replace(size_t start, size_t end, size_t length);
+  //! Tells Update() that the text has changed in places Replace() doesn't know about
+  void ReplaceAll() { m_changeKnown = false; }
+  //! The index of the first char that has changed since the last Build() or Update()
+  size_t GetChangeStart() const { return m_changeKnown ? m_changeStart : 0; }
+  //! The index behind the last char of the edited text that has changed
+  size_t GetChangeEnd() const { return m_changeKnown ? m_changeEnd : wxString::npos; }
+
+  /*! Tokenizes the lines that have changed since the last Build() or Update()
+
+    \param text The edited text
+    \param configuration The configuration the tokens have been generated with
+    \param tokens The tokens of the text before the edit. Are updated to
+           match the edited text.
+    \param snippets The same function the last Build() has been called with
+    \param change Is told which tokens have been replaced
+    \return false, if the text hasn't changed.
+  */
+  bool Update(const wxString &text, Configuration *configuration,
+              MaximaTokenizer::TokenList &tokens, const SnippetCount &snippets,
+              Change &change);
+
+  //! The number of lines the tokenizer can be restarted at
+  size_t GetLineCount() const { return m_lines.size(); }
+  //! The index of the first char of the line number line
+  size_t GetLineStart(size_t line) const { return m_lines[line].pos; }
+  //! The index of the first token of the line number line
+  size_t GetLineToken(size_t line) const { return m_lines[line].token; }
+  //! The index of the first snippet of styled text of the line number line
+  size_t GetLineSnippet(size_t line) const { return m_lines[line].snippet; }
+
+  /*! Replaces the elements start...end-1 of a vector
+
+    Used for the tokens and the snippets of styled text of the lines Update()
+    has tokenized anew: The elements behind them are moved only once, and not
+    at all if the number of elements doesn't change.
+  */
+  template <typename T>
+  static void ReplaceRange(std::vector<T> &vector, size_t start, size_t end,
+                           std::vector<T> &&replacement)
+  {
+    const size_t common = std::min(end - start, replacement.size());
+    std::move(replacement.begin(), replacement.begin() + common, vector.begin() + start);
+    if (common < end - start)
+      vector.erase(vector.begin() + start + common, vector.begin() + end);
+    else
+      vector.insert(vector.begin() + end, std::make_move_iterator(replacement.begin() + common),
+                    std::make_move_iterator(replacement.end()));
+  }
+
+private:
+  //! A line that starts outside of comments and strings
+  struct Line
+  {
+    //! The index of the line's first char
+    size_t pos;
+    //! The index of the line's first token
+    size_t token;
+    //! The index of the line's first snippet of styled text
+    size_t snippet;
+    //! The hash of the line's text
+    size_t hash;
+  };
+
+  //! A hash of the chars start...end-1 of text
+  static size_t Hash(const wxString &text, size_t start, size_t end);
+  //! Does the line number line appear in text at the index pos?
+  bool LineFound(const wxString &text, size_t line, size_t pos) const;
+  //! The index behind the last char of the line number line
+  size_t GetLineEnd(size_t line) const;
+  //! Calculates the hashes of the lines first...end-1
+  void HashLines(const wxString &text, size_t first, size_t end);
+  //! Forgets about the edits Replace() has been told about
+  void ResetChange();
+
+  //! The lines, ordered by their position
+  std::vector<Line> m_lines;
+  //! The length of the text the lines belong to
+  size_t m_length = 0;
+  //! The number of snippets of styled text the tokens are displayed as
+  size_t m_snippets = 0;
+  //! Have all edits since the last Build() or Update() been passed to Replace()?
+  bool m_changeKnown = true;
+  //! The first char that has changed, or wxString::npos, if nothing has changed
+  size_t m_changeStart = wxString::npos;
+  //! The index behind the last char that has changed, in the edited text
+  size_t m_changeEnd = 0;
+  //! The number of chars the edits have added to the text
+  long m_lengthChange = 0;
+};
+
+#endif // TOKENLINES_H
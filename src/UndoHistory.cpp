@@ -0,0 +1,207 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file defines the class UndoHistory
+
+  UndoHistory stores the states an EditorCell has been in as the differences
+  between them instead of as full copies of its text.
+*/
+
+#include "UndoHistory.h"
+#include <utility>
+
+constexpr size_t UndoHistory::checkpointInterval;
+
+void UndoHistory::Append(const wxString &text, int caretPosition, int selStart, int selEnd)
+{
+  Step step;
+  step.caret.position = caretPosition;
+  step.caret.selStart = selStart;
+  step.caret.selEnd = selEnd;
+
+  if (m_steps.empty())
+  {
+    step.isCheckpoint = true;
+    step.text = text;
+    m_text = text;
+    m_textIndex = 0;
+  }
+  else
+  {
+    MoveTo(m_steps.size() - 1);
+
+    // Find the part of the text that has changed
+    const wxString &oldText = m_text;
+    size_t prefix = 0;
+    wxString::const_iterator oldChar = oldText.begin();
+    wxString::const_iterator newChar = text.begin();
+    while ((oldChar != oldText.end()) && (newChar != text.end()) && (*oldChar == *newChar))
+    {
+      ++oldChar;
+      ++newChar;
+      ++prefix;
+    }
+    size_t suffix = 0;
+    wxString::const_reverse_iterator oldRChar = oldText.rbegin();
+    wxString::const_reverse_iterator newRChar = text.rbegin();
+    while ((prefix + suffix < oldText.Length()) && (prefix + suffix < text.Length()) &&
+           (*oldRChar == *newRChar))
+    {
+      ++oldRChar;
+      ++newRChar;
+      ++suffix;
+    }
+    step.start = prefix;
+    step.removed = oldText.Mid(prefix, oldText.Length() - prefix - suffix);
+    step.inserted = text.Mid(prefix, text.Length() - prefix - suffix);
+
+    size_t sinceCheckpoint = 0;
+    for (auto i = m_steps.rbegin(); (i != m_steps.rend()) && !i->isCheckpoint; ++i)
+      sinceCheckpoint++;
+
+    m_text.replace(step.start, step.removed.Length(), step.inserted);
+    m_textIndex = m_steps.size();
+    if (sinceCheckpoint + 1 >= checkpointInterval)
+    {
+      step.isCheckpoint = true;
+      step.text = m_text;
+    }
+  }
+  m_bytes += GetBytes(step);
+  m_steps.push_back(std::move(step));
+}
+
+const wxString &UndoHistory::GetText(size_t index)
+{
+  MoveTo(index);
+  return m_text;
+}
+
+void UndoHistory::MoveTo(size_t index)
+{
+  if (index > m_textIndex)
+  {
+    // Start at the last checkpoint on the way, if there is one
+    size_t checkpoint = index;
+    while ((checkpoint > m_textIndex) && !m_steps[checkpoint].isCheckpoint)
+      checkpoint--;
+    if (checkpoint > m_textIndex)
+    {
+      m_text = m_steps[checkpoint].text;
+      m_textIndex = checkpoint;
+    }
+  }
+  else if (index < m_textIndex)
+  {
+    // Start at a checkpoint if that means applying fewer changes than
+    // walking back
+    size_t checkpoint = index;
+    while ((checkpoint > 0) && !m_steps[checkpoint].isCheckpoint &&
+           (index - checkpoint < m_textIndex - index))
+      checkpoint--;
+    if (m_steps[checkpoint].isCheckpoint && (index - checkpoint < m_textIndex - index))
+    {
+      m_text = m_steps[checkpoint].text;
+      m_textIndex = checkpoint;
+    }
+  }
+
+  while (m_textIndex < index)
+  {
+    const Step &step = m_steps[++m_textIndex];
+    m_text.replace(step.start, step.removed.Length(), step.inserted);
+  }
+  while (m_textIndex > index)
+  {
+    const Step &step = m_steps[m_textIndex--];
+    m_text.replace(step.start, step.inserted.Length(), step.removed);
+  }
+}
+
+void UndoHistory::Truncate(size_t size)
+{
+  if (size == 0)
+  {
+    Clear();
+    return;
+  }
+  if (size >= m_steps.size())
+    return;
+
+  MoveTo(wxMin(m_textIndex, size - 1));
+  for (auto step = m_steps.begin() + size; step != m_steps.end(); ++step)
+    m_bytes -= GetBytes(*step);
+  m_steps.erase(m_steps.begin() + size, m_steps.end());
+}
+
+void UndoHistory::Clear()
+{
+  std::vector<Step>().swap(m_steps);
+  wxString().swap(m_text);
+  m_textIndex = 0;
+  m_bytes = 0;
+}
+
+size_t UndoHistory::Trim(size_t maxBytes)
+{
+  size_t usage = GetMemoryUsage();
+  size_t drop = 0;
+  while ((usage > maxBytes) && (drop + 1 < m_steps.size()))
+    usage -= GetBytes(m_steps[drop++]);
+  if (drop == 0)
+    return 0;
+
+  if (m_textIndex < drop)
+    MoveTo(drop);
+  // The oldest state doesn't need to know how it differs from its predecessor
+  Step &oldest = m_steps[drop];
+  oldest.start = 0;
+  wxString().swap(oldest.removed);
+  wxString().swap(oldest.inserted);
+
+  m_steps.erase(m_steps.begin(), m_steps.begin() + drop);
+  m_textIndex -= drop;
+  m_bytes = 0;
+  for (auto const &step : m_steps)
+    m_bytes += GetBytes(step);
+  return drop;
+}
+
+size_t UndoHistory::GetMemoryUsage() const
+{
+  return m_bytes + m_text.Length() * sizeof(wxChar);
+}
+
+size_t UndoHistory::GetCheckpoints() const
+{
+  size_t checkpoints = 0;
+  for (auto const &step : m_steps)
+    if (step.isCheckpoint)
+      checkpoints++;
+  return checkpoints;
+}
+
+size_t UndoHistory::GetBytes(const Step &step)
+{
+  return sizeof(Step) +
+    (step.removed.Length() + step.inserted.Length() + step.text.Length()) * sizeof(wxChar);
+}
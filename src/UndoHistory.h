@@ -0,0 +1,121 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file declares the class UndoHistory
+
+  UndoHistory stores the states an EditorCell has been in as the differences
+  between them instead of as full copies of its text.
+*/
+
+#ifndef UNDOHISTORY_H
+#define UNDOHISTORY_H
+
+#include <wx/string.h>
+#include <vector>
+
+/*! The undo history of an editor
+
+  Each state is stored as the difference to the state before it: The position
+  of the change, the text that was removed and the text that was inserted. Since
+  the removed text is known, too, the history can be walked in both directions.
+  The history keeps the text of one state, which is the one that was last asked
+  for, so undoing or redoing one step after another only costs one change each.
+  Every checkpointInterval steps a full copy of the text is stored as well, which
+  limits the number of changes that need to be applied for jumping to a state
+  far away.
+
+  Trim() drops the oldest states until the history fits into a given number of
+  bytes.
+ */
+class UndoHistory final
+{
+public:
+  //! Where the caret and the selection were in a state
+  struct Caret
+  {
+    int position = -1;
+    int selStart = -1;
+    int selEnd = -1;
+  };
+
+  //! The number of states
+  size_t GetSize() const { return m_steps.size(); }
+  bool IsEmpty() const { return m_steps.empty(); }
+
+  //! Append a state
+  void Append(const wxString &text, int caretPosition, int selStart, int selEnd);
+  //! The text of the state number index. Stays valid until the history is modified.
+  const wxString &GetText(size_t index);
+  //! The text of the newest state
+  const wxString &GetLastText() { return GetText(m_steps.size() - 1); }
+  //! The position of the caret and the selection in the state number index
+  const Caret &GetCaret(size_t index) const { return m_steps[index].caret; }
+
+  //! Forget all states from the state number size on
+  void Truncate(size_t size);
+  void Clear();
+  /*! Drops the oldest states until the history needs no more than maxBytes
+
+    The newest state is never dropped. Returns the number of states that have
+    been dropped.
+  */
+  size_t Trim(size_t maxBytes);
+
+  //! The number of bytes the history occupies
+  size_t GetMemoryUsage() const;
+  //! The number of full copies of the text the history contains
+  size_t GetCheckpoints() const;
+
+  //! Every how many states a full copy of the text is stored
+  static constexpr size_t checkpointInterval = 100;
+
+private:
+  //! How a state differs from the one before it
+  struct Step
+  {
+    //! The index of the first char that has been changed
+    size_t start = 0;
+    //! The chars of the previous state that have been replaced
+    wxString removed;
+    //! The chars that have replaced them
+    wxString inserted;
+    //! Is this step a checkpoint that contains the full text?
+    bool isCheckpoint = false;
+    //! If isCheckpoint: The full text of this state
+    wxString text;
+    Caret caret;
+  };
+
+  //! The number of bytes a step occupies
+  static size_t GetBytes(const Step &step);
+  //! Changes m_text to the text of the state number index
+  void MoveTo(size_t index);
+
+  std::vector<Step> m_steps;
+  //! The text of the state number m_textIndex
+  wxString m_text;
+  size_t m_textIndex = 0;
+  //! The sum of GetBytes() of all steps
+  size_t m_bytes = 0;
+};
+
+#endif // UNDOHISTORY_H
@@ -0,0 +1,128 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file defines the class Utf8OutputStream
+
+  Utf8OutputStream streams text to a wxOutputStream without first assembling
+  it in one big wxString.
+*/
+
+#include "Utf8OutputStream.h"
+#include <wx/strconv.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+Utf8OutputStream::Utf8OutputStream(wxOutputStream &stream, size_t bufferSize) :
+  m_stream(stream),
+  m_buffer(bufferSize),
+  m_peakBufferSize(bufferSize)
+{
+}
+
+Utf8OutputStream::~Utf8OutputStream()
+{
+  Flush();
+}
+
+bool Utf8OutputStream::Flush()
+{
+  if (m_used > 0)
+  {
+    m_stream.Write(m_buffer.data(), m_used);
+    if (m_stream.LastWrite() != m_used)
+      m_ok = false;
+    m_used = 0;
+  }
+  return m_ok;
+}
+
+void Utf8OutputStream::Reserve(size_t length)
+{
+  if (m_buffer.size() - m_used >= length)
+    return;
+  Flush();
+  if (m_buffer.size() < length)
+  {
+    m_buffer.resize(length);
+    m_peakBufferSize = std::max(m_peakBufferSize, m_buffer.size());
+  }
+}
+
+void Utf8OutputStream::Write(const void *data, size_t length)
+{
+  if (length == 0)
+    return;
+  // Big chunks of data don't profit from being copied to the buffer first.
+  if (length >= m_buffer.size())
+  {
+    Flush();
+    m_stream.Write(data, length);
+    if (m_stream.LastWrite() != length)
+      m_ok = false;
+  }
+  else
+  {
+    Reserve(length);
+    std::memcpy(m_buffer.data() + m_used, data, length);
+    m_used += length;
+  }
+  m_bytesWritten += length;
+}
+
+Utf8OutputStream &Utf8OutputStream::operator<<(const wxString &text)
+{
+  if (text.IsEmpty())
+    return *this;
+#if wxUSE_UNICODE_UTF8
+  Write(text.wx_str(), text.utf8_length());
+#else
+  // Convert the string directly into our buffer
+  const wchar_t *wide = text.wc_str();
+  size_t length = wxConvUTF8.FromWChar(NULL, 0, wide, text.length());
+  if (length == wxCONV_FAILED)
+  {
+    m_ok = false;
+    return *this;
+  }
+  Reserve(length);
+  wxConvUTF8.FromWChar(m_buffer.data() + m_used, length, wide, text.length());
+  m_used += length;
+  m_bytesWritten += length;
+#endif
+  return *this;
+}
+
+Utf8OutputStream &Utf8OutputStream::operator<<(const char *text)
+{
+  Write(text, std::strlen(text));
+  return *this;
+}
+
+Utf8OutputStream &Utf8OutputStream::operator<<(long number)
+{
+  char buf[32];
+  int length = snprintf(buf, sizeof(buf), "%li", number);
+  if (length > 0)
+    Write(buf, length);
+  return *this;
+}
@@ -0,0 +1,88 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file declares the class Utf8OutputStream
+
+  Utf8OutputStream streams text to a wxOutputStream without first assembling
+  it in one big wxString.
+*/
+
+#ifndef UTF8OUTPUTSTREAM_H
+#define UTF8OUTPUTSTREAM_H
+
+#include <wx/string.h>
+#include <wx/stream.h>
+#include <vector>
+
+/*! Writes text to a wxOutputStream in UTF-8 encoding
+
+  The text is converted into a buffer that is re-used for every chunk of text
+  and that is written to the stream only when it is full. This way large files
+  like the content.xml of a .wxmx file can be generated piece by piece without
+  ever holding their complete contents in memory.
+ */
+class Utf8OutputStream final
+{
+public:
+  /*! The constructor
+
+    \param stream The stream to write to. Must outlive this object.
+    \param bufferSize The size of the buffer. Chunks of text that are longer
+                      than that temporarily enlarge the buffer.
+   */
+  explicit Utf8OutputStream(wxOutputStream &stream, size_t bufferSize = 65536);
+  //! The destructor. Flushes the buffer.
+  ~Utf8OutputStream();
+  Utf8OutputStream(const Utf8OutputStream &) = delete;
+  Utf8OutputStream &operator=(const Utf8OutputStream &) = delete;
+
+  //! Append a string
+  Utf8OutputStream &operator<<(const wxString &text);
+  //! Append a string that already is UTF-8 (or plain ASCII)
+  Utf8OutputStream &operator<<(const char *text);
+  //! Append a number
+  Utf8OutputStream &operator<<(long number);
+  //! Append raw bytes
+  void Write(const void *data, size_t length);
+
+  //! Write the buffer's contents to the stream
+  bool Flush();
+  //! Has every write to the stream succeeded until now?
+  bool IsOk() const { return m_ok; }
+  //! The number of bytes that have been handed to this object so far
+  size_t GetBytesWritten() const { return m_bytesWritten; }
+  //! The biggest amount of memory the buffer ever occupied
+  size_t GetPeakBufferSize() const { return m_peakBufferSize; }
+
+private:
+  //! Makes sure that at least length bytes are free in the buffer
+  void Reserve(size_t length);
+  wxOutputStream &m_stream;
+  std::vector<char> m_buffer;
+  //! The number of bytes in m_buffer that are in use
+  size_t m_used = 0;
+  size_t m_bytesWritten = 0;
+  size_t m_peakBufferSize = 0;
+  bool m_ok = true;
+};
+
+#endif // UTF8OUTPUTSTREAM_H
@@ -0,0 +1,632 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file defines the parsers for .wxm and .mac files
+*/
+
+#include "WXMParser.h"
+#include <wx/convauto.h>
+#include <wx/debug.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+
+namespace Format
+{
+
+struct WXMHeader
+{
+  WXMHeaderId id;
+  wxString start = {};
+  wxString end = {};
+};
+
+static const WXMHeader WXMHeaders[] = {
+  {WXM_INPUT, wxT("/* [wxMaxima: input   start ] */"),
+   wxT("/* [wxMaxima: input   end   ] */")},
+  {WXM_TITLE, wxT("/* [wxMaxima: title   start ]"),
+   wxT("   [wxMaxima: title   end   ] */")},
+  {WXM_SECTION, wxT("/* [wxMaxima: section start ]"),
+   wxT("   [wxMaxima: section end   ] */")},
+  {WXM_SUBSECTION, wxT("/* [wxMaxima: subsect start ]"),
+   wxT("   [wxMaxima: subsect end   ] */")},
+  {WXM_SUBSUBSECTION, wxT("/* [wxMaxima: subsubsect start ]"),
+   wxT("   [wxMaxima: subsubsect end   ] */")},
+  {WXM_HEADING5, wxT("/* [wxMaxima: heading5 start ]"),
+   wxT("   [wxMaxima: heading5 end   ] */")},
+  {WXM_HEADING6, wxT("/* [wxMaxima: heading6 start ]"),
+   wxT("   [wxMaxima: heading6 end   ] */")},
+  {WXM_COMMENT,  wxT("/* [wxMaxima: comment start ]"),
+   wxT("   [wxMaxima: comment end   ] */")},
+  {WXM_CAPTION, wxT("/* [wxMaxima: caption start ]"),
+   wxT("   [wxMaxima: caption end   ] */")},
+  {WXM_PAGEBREAK, wxT("/* [wxMaxima: page break    ] */")},
+  {WXM_IMAGE, wxT("/* [wxMaxima: image   start ]"),
+   wxT("   [wxMaxima: image   end   ] */")},
+  {WXM_ANSWER, wxT("/* [wxMaxima: answer  start ] */"),
+   wxT("/* [wxMaxima: answer  end   ] */")},
+  {WXM_QUESTION, wxT("/* [wxMaxima: question  start ] */"),
+   wxT("/* [wxMaxima: question  end   ] */")},
+  {WXM_FOLD, wxT("/* [wxMaxima: fold    start ] */"),
+   wxT("/* [wxMaxima: fold    end   ] */")},
+  {WXM_FOLD_END, wxT("/* [wxMaxima: fold    end   ] */")},
+  {WXM_HIDE, wxT("/* [wxMaxima: hide output   ] */")},
+  {WXM_AUTOANSWER, wxT("/* [wxMaxima: autoanswer    ] */")},
+  };
+
+static constexpr size_t numberOfHeaders = sizeof(WXMHeaders) / sizeof(WXMHeaders[0]);
+
+//! The headers, in the encoding the parsers work with
+struct WXMHeaderBytes
+{
+  WXMHeaderBytes()
+  {
+    for (size_t i = 0; i < numberOfHeaders; i++)
+    {
+      start[i] = std::string(WXMHeaders[i].start.utf8_str());
+      end[i] = std::string(WXMHeaders[i].end.utf8_str());
+    }
+  }
+  std::string start[numberOfHeaders];
+  std::string end[numberOfHeaders];
+};
+
+static const WXMHeaderBytes &HeaderBytes()
+{
+  static const WXMHeaderBytes headers;
+  return headers;
+}
+
+WXMHeaderCollection::WXMHeaderCollection()
+{
+  bool check = std::is_sorted(
+    std::begin(WXMHeaders), std::end(WXMHeaders),
+    [](const WXMHeader &l, const WXMHeader &r){ return l.id < r.id; });
+  if (!check) abort(); // An assertion is not enough - this is a programming bug
+}
+
+const wxString &WXMHeaderCollection::GetStart(WXMHeaderId index)
+{
+  wxASSERT(index >= 0 && size_t(index) < numberOfHeaders);
+  return WXMHeaders[index].start;
+}
+
+const wxString &WXMHeaderCollection::GetEnd(WXMHeaderId index)
+{
+  wxASSERT(index >= 0 && size_t(index) < numberOfHeaders);
+  return WXMHeaders[index].end;
+}
+
+WXMHeaderId WXMHeaderCollection::LookupStart(const wxString &start)
+{
+  for (auto &c : WXMHeaders)
+    // cppcheck-suppress useStlAlgorithm
+    if (c.start == start) return c.id;
+  return WXM_INVALID;
+}
+
+WXMHeaderId WXMHeaderCollection::LookupStart(const std::string &start)
+{
+  // All headers start with a "/* [wxMaxima: " => most lines can be rejected
+  // by looking at their first few characters.
+  if ((start.length() < 14) || (start.compare(0, 14, "/* [wxMaxima: ") != 0))
+    return WXM_INVALID;
+  auto const &headers = HeaderBytes();
+  for (size_t i = 0; i < numberOfHeaders; i++)
+    if (headers.start[i] == start)
+      return WXMHeaders[i].id;
+  return WXM_INVALID;
+}
+
+static WXMHeaderCollection Headers;
+
+wxString WXMTextToString(const std::string &text)
+{
+  if (text.empty())
+    return wxEmptyString;
+  wxString retval = wxString::FromUTF8(text.data(), text.length());
+  // Files that aren't valid UTF-8 are read as ISO-8859-1, as wxConvAuto does.
+  if (retval.empty())
+    retval = wxString(text.data(), wxConvISO8859_1, text.length());
+  return retval;
+}
+
+WXMLineReader::WXMLineReader(wxInputStream &stream) :
+  m_stream(stream),
+  m_buffer(65536)
+{
+  if (!Fill())
+    return;
+
+  // A UTF-8 byte order mark is simply skipped
+  if ((m_end >= 3) && (std::memcmp(m_buffer.data(), "\xEF\xBB\xBF", 3) == 0))
+  {
+    m_pos = 3;
+    return;
+  }
+
+  // UTF-16 and UTF-32 files start with a byte order mark, too. They are rare
+  // enough to not need a streaming parser => we convert them to UTF-8 as a
+  // whole.
+  bool utf16 = (m_end >= 2) &&
+    ((std::memcmp(m_buffer.data(), "\xFF\xFE", 2) == 0) ||
+     (std::memcmp(m_buffer.data(), "\xFE\xFF", 2) == 0));
+  bool utf32 = (m_end >= 4) &&
+    (std::memcmp(m_buffer.data(), "\x00\x00\xFE\xFF", 4) == 0);
+  if (!utf16 && !utf32)
+    return;
+
+  wxMemoryBuffer contents;
+  contents.AppendData(m_buffer.data(), m_end);
+  while (Fill())
+    contents.AppendData(m_buffer.data(), m_end);
+  wxString text(static_cast<const char *>(contents.GetData()), wxConvAuto(), contents.GetDataLen());
+  wxScopedCharBuffer utf8 = text.utf8_str();
+  m_buffer.assign(utf8.data(), utf8.data() + utf8.length());
+  m_pos = 0;
+  m_end = m_buffer.size();
+}
+
+bool WXMLineReader::Fill()
+{
+  if (!m_stream.CanRead())
+    return false;
+  m_stream.Read(m_buffer.data(), m_buffer.size());
+  m_pos = 0;
+  m_end = m_stream.LastRead();
+  return m_end > 0;
+}
+
+bool WXMLineReader::GetLine(std::string &line)
+{
+  line.clear();
+  bool lineFound = false;
+  while ((m_pos < m_end) || Fill())
+  {
+    lineFound = true;
+    const char *start = m_buffer.data() + m_pos;
+    const char *end = m_buffer.data() + m_end;
+    const char *eol = start;
+    while ((eol < end) && (*eol != '\n') && (*eol != '\r'))
+      eol++;
+    line.append(start, eol);
+    m_pos += eol - start;
+    if (eol == end)
+      continue;
+
+    // We have found the end of the line
+    m_pos++;
+    if (*eol == '\r')
+    {
+      // "\r\n" is one line ending, not two.
+      if ((m_pos < m_end) || Fill())
+      {
+        if (m_buffer[m_pos] == '\n')
+          m_pos++;
+      }
+    }
+    return true;
+  }
+  return lineFound;
+}
+
+void WXMParser::AddLine(const std::string &line)
+{
+  switch (m_state)
+  {
+  case State::block:
+    if (line == *m_blockEnd)
+    {
+      m_state = State::idle;
+      EndBlock();
+    }
+    else
+    {
+      // Empty lines at the start of a block are dropped, as they always
+      // have been.
+      if (!m_text.empty())
+        m_text += '\n';
+      m_text += line;
+    }
+    return;
+
+  case State::imageType:
+    m_imageType = line;
+    m_text.clear();
+    m_state = State::block;
+    return;
+
+  case State::fold:
+    if (line == HeaderBytes().end[WXM_FOLD])
+    {
+      std::vector<WXMCell> hiddenTree = m_fold->Finish();
+      m_fold.reset();
+      m_state = State::idle;
+      if (!m_cells.empty())
+        m_cells.back().hiddenTree = std::move(hiddenTree);
+    }
+    else
+      m_fold->AddLine(line);
+    return;
+
+  case State::idle:
+    break;
+  }
+
+  WXMHeaderId headerId = Headers.LookupStart(line);
+  switch (headerId)
+  {
+    // Read hide tag
+  case WXM_HIDE:
+    m_hide = true;
+    break;
+
+    // Read title, section, subsection, subsubsection, heading5, heading6,
+    //      comment, input, image caption, answer and question
+  case WXM_TITLE:
+  case WXM_SECTION:
+  case WXM_SUBSECTION:
+  case WXM_SUBSUBSECTION:
+  case WXM_HEADING5:
+  case WXM_HEADING6:
+  case WXM_COMMENT:
+  case WXM_INPUT:
+  case WXM_CAPTION:
+  case WXM_ANSWER:
+  case WXM_QUESTION:
+    m_block = headerId;
+    m_blockEnd = &HeaderBytes().end[headerId];
+    m_text.clear();
+    m_state = State::block;
+    break;
+
+    // Read an image bitmap
+  case WXM_IMAGE:
+    m_block = headerId;
+    m_blockEnd = &HeaderBytes().end[headerId];
+    m_state = State::imageType;
+    break;
+
+    // Read autoanswer tag
+  case WXM_AUTOANSWER:
+    if (!m_cells.empty())
+      m_cells.back().autoAnswer = true;
+    break;
+
+    // Read a page break tag
+  case WXM_PAGEBREAK:
+    m_cells.emplace_back();
+    m_cells.back().type = WXM_PAGEBREAK;
+    break;
+
+    // Read a folded tree
+  case WXM_FOLD:
+    m_fold = std::unique_ptr<WXMParser>(new WXMParser);
+    m_state = State::fold;
+    break;
+
+  case WXM_INVALID:
+  case WXM_FOLD_END:
+  case WXM_MAX:
+    ;
+  }
+}
+
+void WXMParser::EndBlock()
+{
+  switch (m_block)
+  {
+  case WXM_IMAGE:
+    if (!m_cells.empty() && (m_cells.back().type == WXM_CAPTION))
+    {
+      WXMCell &cell = m_cells.back();
+      cell.hasImage = true;
+      cell.imageType = WXMTextToString(m_imageType);
+      cell.imageData = WXMTextToString(m_text);
+    }
+    break;
+
+  case WXM_ANSWER:
+    if (!m_cells.empty() && !m_question.empty())
+      m_cells.back().answers.emplace_back(m_question, WXMTextToString(m_text));
+    break;
+
+  case WXM_QUESTION:
+    m_question = WXMTextToString(m_text);
+    break;
+
+  default:
+    m_cells.emplace_back();
+    m_cells.back().type = m_block;
+    m_cells.back().text = WXMTextToString(m_text);
+    m_cells.back().hide = m_hide;
+    m_hide = false;
+  }
+  m_text.clear();
+}
+
+std::vector<WXMCell> WXMParser::Finish()
+{
+  // Blocks that are cut off by the end of the file end there.
+  switch (m_state)
+  {
+  case State::block:
+    EndBlock();
+    break;
+  case State::fold:
+    if (!m_cells.empty())
+      m_cells.back().hiddenTree = m_fold->Finish();
+    m_fold.reset();
+    break;
+  case State::imageType:
+  case State::idle:
+    break;
+  }
+  m_state = State::idle;
+  return std::move(m_cells);
+}
+
+//! Does str end in end?
+static bool EndsWith(const std::string &str, const char *end)
+{
+  size_t len = std::strlen(end);
+  return (str.length() >= len) && (str.compare(str.length() - len, len, end) == 0);
+}
+
+//! Does str start with start?
+static bool StartsWith(const std::string &str, const std::string &start)
+{
+  return str.compare(0, start.length(), start) == 0;
+}
+
+//! The characters wxString::Trim() removes
+static bool IsTrimmedSpace(char c)
+{
+  return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r') || (c == '\v') || (c == '\f');
+}
+
+//! Removes whitespace from the start of str
+static void TrimLeft(std::string &str)
+{
+  size_t start = 0;
+  while ((start < str.length()) && IsTrimmedSpace(str[start]))
+    start++;
+  str.erase(0, start);
+}
+
+//! Removes whitespace from both ends of str
+static void Trim(std::string &str)
+{
+  size_t end = str.length();
+  while ((end > 0) && IsTrimmedSpace(str[end - 1]))
+    end--;
+  str.erase(end);
+  TrimLeft(str);
+}
+
+//! Does a line that belongs to a wxMaxima comment end the comment?
+static bool EndsWXMBlock(const std::string &line)
+{
+  return EndsWith(line, " end   ] */") || EndsWith(line, " end   ] */\n");
+}
+
+MACParser::MACParser(WXMLineReader &lines, bool xMaximaFile) :
+  m_lines(lines),
+  m_xMaximaFile(xMaximaFile)
+{
+}
+
+bool MACParser::AtEnd()
+{
+  while (m_pos >= m_line.length())
+  {
+    if (!m_lines.GetLine(m_line))
+      return true;
+    m_pos = 0;
+
+    if (m_xMaximaFile)
+    {
+      // Detect output cells.
+      if (StartsWith(m_line, "(%o"))
+        m_input = false;
+
+      if (StartsWith(m_line, "(%i"))
+      {
+        size_t end = m_line.find(')');
+        if ((end != std::string::npos) && (end > 0) && (end + 1 < m_line.length()))
+        {
+          // Drop the label and the character that follows it.
+          m_pos = end + 2;
+          while ((m_pos < m_line.length()) && ((m_line[m_pos] & 0xC0) == 0x80))
+            m_pos++;
+          m_input = true;
+        }
+        else if (end != std::string::npos)
+          m_input = true;
+      }
+    }
+
+    if (m_input)
+      m_line += '\n';
+    else
+      m_line.clear();
+  }
+  return false;
+}
+
+void MACParser::ReadUntil(std::string &line, char until)
+{
+  while (!AtEnd())
+  {
+    char c = Next();
+    line += m_lastChar = c;
+    if (c == until)
+      break;
+  }
+}
+
+void MACParser::AddCell(WXMHeaderId type, const std::string &text)
+{
+  m_cells.emplace_back();
+  m_cells.back().type = type;
+  m_cells.back().text = WXMTextToString(text);
+}
+
+void MACParser::AddWXMBlock()
+{
+  if (m_wxmLines.empty())
+    return;
+
+  // Interpret the comment block like the contents of a .wxm file. Empty lines
+  // carry no information here.
+  WXMParser parser;
+  size_t start = 0;
+  while (start < m_wxmLines.length())
+  {
+    size_t end = m_wxmLines.find('\n', start);
+    if (end == std::string::npos)
+      end = m_wxmLines.length();
+    if (end > start)
+      parser.AddLine(m_wxmLines.substr(start, end - start));
+    start = end + 1;
+  }
+  std::vector<WXMCell> cells = parser.Finish();
+  if (cells.empty())
+    AddCell(WXM_COMMENT, m_wxmLines);
+  else
+    std::move(cells.begin(), cells.end(), std::back_inserter(m_cells));
+  m_wxmLines.clear();
+}
+
+std::vector<WXMCell> MACParser::Parse()
+{
+  auto const &captionStart = HeaderBytes().start[WXM_CAPTION];
+  std::string line;
+  while (!AtEnd())
+  {
+    char c = Peek();
+    // Handle comments
+    if (m_lastChar == '/' && c == '*')
+    {
+      // Does the current line contain nothing but a comment?
+      bool isCommentLine = false;
+      std::string trimmed = line;
+      TrimLeft(trimmed);
+      if (trimmed == "/")
+      {
+        isCommentLine = true;
+        line = trimmed;
+      }
+
+      // Skip to the end of the comment
+      while (!AtEnd())
+      {
+        char ch = Next();
+        bool finished = (m_lastChar == '*' && ch == '/');
+        line += m_lastChar = ch;
+        if (finished) break;
+      }
+
+      if (isCommentLine)
+      {
+        Trim(line);
+
+        // Is this a comment from wxMaxima?
+        if (StartsWith(line, "/* [wxMaxima: "))
+        {
+          // Add the rest of this comment block to the "line".
+          while (!EndsWXMBlock(line) && !AtEnd())
+            ReadUntil(line, '\n');
+
+          // If the last block was a caption block we need to read in the image
+          // the caption was for, as well.
+          if (StartsWith(line, captionStart))
+          {
+            if (!AtEnd())
+              line += m_lastChar = Next();
+
+            ReadUntil(line, '\n');
+
+            while (!EndsWXMBlock(line) && !AtEnd())
+              ReadUntil(line, '\n');
+          }
+
+          // Add this array of lines to the block of wxm code we will interpret.
+          m_wxmLines += line;
+        }
+        else
+        {
+          AddWXMBlock();
+          if (EndsWith(line, " */") || EndsWith(line, "\n*/"))
+            line.erase(line.length() - 3);
+          else
+            line.erase(line.length() - 2);
+
+          if (StartsWith(line, "/* ") || StartsWith(line, "/*\n"))
+            line.erase(0, 3);
+          else
+            line.erase(0, 2);
+
+          AddCell(WXM_COMMENT, line);
+        }
+        line.clear();
+      }
+    }
+    // Handle strings
+    else if (c == '\"')
+    {
+      // Skip to the end of the string
+      ReadUntil(line, '"');
+    }
+    // Handle escaped chars
+    else if (c == '\\')
+    {
+      line += m_lastChar = c;
+      Next();
+    }
+    // Handle all other chars
+    else
+    {
+      line += c;
+
+      // A line ending followed by a new line means: We want to insert a new code cell.
+      if ((m_lastChar == '$' || m_lastChar == ';') && (c == '\n'))
+      {
+        Trim(line);
+        AddCell(WXM_INPUT, line);
+        line.clear();
+      }
+      m_lastChar = c;
+      Next();
+    }
+  }
+  AddWXMBlock();
+
+  Trim(line);
+  if (!line.empty())
+    AddCell(WXM_INPUT, line);
+
+  return std::move(m_cells);
+}
+
+} // namespace Format
@@ -0,0 +1,225 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file declares the parsers for .wxm and .mac files
+
+  The parsers read the raw bytes of a file in one pass and only convert the
+  contents of the cells to wxStrings. They don't create any GroupCells: What
+  they return is a description of the cells the file contains, which
+  Format::ParseWXMFile() and Format::ParseMACFile() then convert to cells.
+*/
+
+#ifndef WXMPARSER_H
+#define WXMPARSER_H
+
+#include <wx/string.h>
+#include <wx/stream.h>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+//! An identifier for each of the headers in a WXM file
+// This enum's elements must be synchronized with (GroupCell.h) GroupType
+enum WXMHeaderId {
+  WXM_INVALID = -1,
+  WXM_INPUT = 0,
+  WXM_TITLE,
+  WXM_SECTION,
+  WXM_SUBSECTION,
+  WXM_SUBSUBSECTION,
+  WXM_HEADING5,
+  WXM_HEADING6,
+  WXM_COMMENT,
+  WXM_CAPTION,
+  WXM_PAGEBREAK,
+  WXM_IMAGE,
+  WXM_ANSWER,
+  WXM_QUESTION,
+  WXM_FOLD, WXM_FOLD_END,
+  WXM_HIDE,
+  WXM_AUTOANSWER,
+
+  WXM_MAX // Must be the last member
+};
+
+namespace Format
+{
+
+//! The comments that start and end each kind of block in a .wxm file
+class WXMHeaderCollection
+{
+public:
+  WXMHeaderCollection();
+  static const wxString &GetStart(WXMHeaderId index);
+  static const wxString &GetEnd(WXMHeaderId index);
+  //! Returns the id of the block a line starts, or WXM_INVALID
+  static WXMHeaderId LookupStart(const wxString &start);
+  //! Returns the id of the block a line in UTF-8 encoding starts, or WXM_INVALID
+  static WXMHeaderId LookupStart(const std::string &start);
+};
+
+//! A cell, as described by a .wxm or .mac file
+struct WXMCell
+{
+  //! The kind of cell: WXM_INPUT...WXM_PAGEBREAK
+  WXMHeaderId type = WXM_INVALID;
+  //! The contents of the cell's editor
+  wxString text;
+  bool hide = false;
+  bool autoAnswer = false;
+  //! The questions maxima might ask and the answers the user has given
+  std::vector<std::pair<wxString, wxString>> answers;
+  //! For image cells: Does the file contain the image?
+  bool hasImage = false;
+  //! The image's file type
+  wxString imageType;
+  //! The image, base64-encoded
+  wxString imageData;
+  //! The cells that are folded into this one
+  std::vector<WXMCell> hiddenTree;
+};
+
+/*! Splits a file into lines, without ever holding the whole file in memory
+
+  Accepts the same line endings as wxTextFile does: "\n", "\r\n" and "\r".
+  A UTF-8 byte order mark is skipped. Files in UTF-16 or UTF-32 are converted
+  to UTF-8 first, which is the only case in which they are read completely.
+ */
+class WXMLineReader final
+{
+public:
+  //! \param stream The stream to read from. Must outlive this object.
+  explicit WXMLineReader(wxInputStream &stream);
+  WXMLineReader(const WXMLineReader &) = delete;
+  WXMLineReader &operator=(const WXMLineReader &) = delete;
+
+  /*! Reads the next line
+
+    \param line Receives the line, without its line ending, in the file's
+                encoding (which normally is UTF-8)
+    \return false, if the end of the file has been reached
+   */
+  bool GetLine(std::string &line);
+
+private:
+  //! Reads the next chunk of the file. Returns false at the end of the file.
+  bool Fill();
+
+  wxInputStream &m_stream;
+  //! A chunk of the file. Holds the whole file if it had to be converted to UTF-8.
+  std::vector<char> m_buffer;
+  size_t m_pos = 0;
+  size_t m_end = 0;
+};
+
+/*! Converts the lines of a .wxm file to cell descriptions
+
+  The lines are fed to the parser one after another, which means that the
+  parser never needs to know more than the cell that is currently being read.
+ */
+class WXMParser final
+{
+public:
+  WXMParser() = default;
+  //! Interpret the next line
+  void AddLine(const std::string &line);
+  //! Tell the parser that there are no more lines. Returns the cells.
+  std::vector<WXMCell> Finish();
+
+private:
+  //! Called when a block that has an end marker is complete
+  void EndBlock();
+
+  enum class State {
+    idle,      //!< Waiting for the start of a block
+    block,     //!< Reading the contents of a block
+    imageType, //!< The next line contains the type of an image
+    fold       //!< Reading the cells that are folded into the last cell
+  };
+
+  std::vector<WXMCell> m_cells;
+  State m_state = State::idle;
+  //! The block that is being read
+  WXMHeaderId m_block = WXM_INVALID;
+  //! The end marker of that block
+  const std::string *m_blockEnd = nullptr;
+  //! The contents of the block that are read so far
+  std::string m_text;
+  std::string m_imageType;
+  //! Shall the next cell be hidden?
+  bool m_hide = false;
+  //! The last question that has been read
+  wxString m_question;
+  //! While reading a folded tree: The parser for its contents
+  std::unique_ptr<WXMParser> m_fold;
+};
+
+/*! Converts a .mac file to cell descriptions
+
+  Each line that ends in a ";" or "$" ends a code cell, comments become text
+  cells and the comments wxMaxima has generated are interpreted like the
+  contents of a .wxm file.
+ */
+class MACParser final
+{
+public:
+  /*! \param lines The lines of the file
+      \param xMaximaFile true = The file is the output of xMaxima: Its output
+                         is skipped and the labels of its input are removed.
+   */
+  MACParser(WXMLineReader &lines, bool xMaximaFile);
+  //! Reads the file
+  std::vector<WXMCell> Parse();
+
+private:
+  //! Are we at the end of the file? Reads the next line if necessary.
+  bool AtEnd();
+  //! The next character; only valid if !AtEnd().
+  char Peek() const { return m_line[m_pos]; }
+  char Next() { return m_line[m_pos++]; }
+  //! Moves characters to line until the character until or the end of the file
+  void ReadUntil(std::string &line, char until);
+  //! Appends a cell of the type type
+  void AddCell(WXMHeaderId type, const std::string &text);
+  //! Interprets the wxMaxima comments that have been collected
+  void AddWXMBlock();
+
+  WXMLineReader &m_lines;
+  bool m_xMaximaFile;
+  //! In an xMaxima file: Is the current line part of an input?
+  bool m_input = true;
+  //! The current line, including the newline at its end
+  std::string m_line;
+  size_t m_pos = 0;
+  char m_lastChar = ' ';
+  //! The wxMaxima comments that have not been converted to cells, yet
+  std::string m_wxmLines;
+  std::vector<WXMCell> m_cells;
+};
+
+//! Converts text in the encoding WXMLineReader returns to a wxString
+wxString WXMTextToString(const std::string &text);
+
+} // namespace Format
+
+#endif // WXMPARSER_H
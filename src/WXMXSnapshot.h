@@ -0,0 +1,117 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+/*! \file
+  This file declares the class WXMXSnapshot
+
+  WXMXSnapshot holds everything a .wxmx file consists of, so the file can be
+  written without accessing the worksheet.
+*/
+
+#ifndef WXMXSNAPSHOT_H
+#define WXMXSNAPSHOT_H
+
+#include "AutosaveJournal.h"
+#include "SharedBlob.h"
+#include <wx/string.h>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/*! An immutable copy of the contents of a .wxmx file
+
+  Taking a snapshot is cheap: The worksheet only needs to tell it the XML code
+  of each GroupCell and the images and gnuplot files the cells contain. The
+  time-consuming part - validating the XML, zipping everything and writing and
+  re-reading the file - is done by Write(), which doesn't touch the worksheet
+  and therefore can run in a background task while the user continues working.
+
+  The snapshot owns private copies of the XML code. Images and gnuplot files
+  are immutable SharedBlobs, which it shares with the cells.
+ */
+class WXMXSnapshot final
+{
+public:
+  //! Is called with the percentage of the file that has been written
+  using ProgressCallback = std::function<void(int percent)>;
+
+  //! \param header The XML code content.xml starts with
+  explicit WXMXSnapshot(const wxString &header) : m_header(header) {}
+
+  //! Append a GroupCell to the snapshot
+  void AddCell(wxUint64 id, bool highlight, wxString &&xml);
+  //! Add an image or gnuplot file. The data is shared, not copied.
+  void AddFile(const wxString &name, const SharedBlob &data);
+  //! Tell Write() whom to inform about its progress
+  void SetProgressCallback(ProgressCallback callback) { m_onProgress = std::move(callback); }
+
+  /*! Write the .wxmx file
+
+    First writes the data to a backup file ending in .wxmx~ so if anything goes
+    horribly wrong in this step all that is lost is the data that was input
+    since the last save. Then the original .wxmx file is replaced in a
+    (hopefully) atomic operation.
+   */
+  bool Write(const wxString &file);
+
+  /*! Tests if the XML parser can read a part of a .wxmx file's content.xml
+
+    \param xml The XML code to test
+    \param isHeader true = xml is the start of the document up to and including the
+                    opening \<wxMaximaDocument\> tag, false = xml is the XML code of
+                    a cell.
+  */
+  static bool IsValidContentXML(const wxString &xml, bool isHeader);
+
+  //! If Write() has failed as a cell produced invalid XML: The XML code in question.
+  const wxString &GetInvalidXML() const { return m_invalidXML; }
+
+  //! After Write(): Where in content.xml the XML code of each cell can be found
+  std::vector<AutosaveJournal::BaseCell> &&TakeJournalCells() { return std::move(m_journalCells); }
+  //! After Write(): The hash of the XML code of each cell
+  std::unordered_map<wxUint64, size_t> &&TakeJournalHashes() { return std::move(m_journalHashes); }
+  //! After Write(): The names of the files that were stored alongside content.xml
+  std::unordered_set<wxString, wxStringHash> &&TakeJournalFiles() { return std::move(m_journalFiles); }
+
+private:
+  //! A GroupCell, as it was when the snapshot was taken
+  struct CellXML
+  {
+    wxUint64 id;
+    bool highlight;
+    wxString xml;
+  };
+
+  //! Informs the progress callback if the percentage of the data that is written has changed
+  void Progress(size_t done);
+
+  wxString m_header;
+  std::vector<CellXML> m_cells;
+  std::vector<std::pair<wxString, SharedBlob>> m_files;
+  ProgressCallback m_onProgress;
+  int m_lastPercent = -1;
+  wxString m_invalidXML;
+  std::vector<AutosaveJournal::BaseCell> m_journalCells;
+  std::unordered_map<wxUint64, size_t> m_journalHashes;
+  std::unordered_set<wxString, wxStringHash> m_journalFiles;
+};
+
+#endif // WXMXSNAPSHOT_H
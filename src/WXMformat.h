@@ -27,32 +27,17 @@
 #define WXMFORMAT_H
 
 #include "GroupCell.h"
+#include "WXMParser.h"
 
-class wxTextBuffer;
-
-//! An identifier for each of the headers in a WXM file
-// This enum's elements must be synchronized with (GroupCell.h) GroupType
-enum WXMHeaderId {
-  WXM_INVALID = GC_TYPE_INVALID,
-  WXM_INPUT = GC_TYPE_CODE,
-  WXM_TITLE = GC_TYPE_TITLE,
-  WXM_SECTION = GC_TYPE_SECTION,
-  WXM_SUBSECTION = GC_TYPE_SUBSECTION,
-  WXM_SUBSUBSECTION = GC_TYPE_SUBSUBSECTION,
-  WXM_HEADING5 = GC_TYPE_HEADING5,
-  WXM_HEADING6 = GC_TYPE_HEADING6,
-  WXM_COMMENT = GC_TYPE_TEXT,
-  WXM_CAPTION = GC_TYPE_IMAGE,
-  WXM_PAGEBREAK = GC_TYPE_PAGEBREAK,
-  WXM_IMAGE,
-  WXM_ANSWER,
-  WXM_QUESTION,
-  WXM_FOLD, WXM_FOLD_END,
-  WXM_HIDE,
-  WXM_AUTOANSWER,
-
-  WXM_MAX // Must be the last member
-};
+// WXMHeaderId's elements must be synchronized with GroupType
+static_assert((int(WXM_INVALID) == GC_TYPE_INVALID) && (int(WXM_INPUT) == GC_TYPE_CODE) &&
+              (int(WXM_TITLE) == GC_TYPE_TITLE) && (int(WXM_SECTION) == GC_TYPE_SECTION) &&
+              (int(WXM_SUBSECTION) == GC_TYPE_SUBSECTION) &&
+              (int(WXM_SUBSUBSECTION) == GC_TYPE_SUBSUBSECTION) &&
+              (int(WXM_HEADING5) == GC_TYPE_HEADING5) && (int(WXM_HEADING6) == GC_TYPE_HEADING6) &&
+              (int(WXM_COMMENT) == GC_TYPE_TEXT) && (int(WXM_CAPTION) == GC_TYPE_IMAGE) &&
+              (int(WXM_PAGEBREAK) == GC_TYPE_PAGEBREAK),
+              "WXMHeaderId doesn't match GroupType");
 
 namespace Format
 {
@@ -68,25 +53,19 @@ wxString TreeToWXM(GroupCell *cell, bool wxm = true);
 //! Converts a wxm description into individual cells
 GroupCell *TreeFromWXM(const wxArrayString &wxmLines, Configuration **config);
 
+//! Converts the description of cells WXMParser or MACParser has returned into cells
+GroupCell *TreeFromWXM(std::vector<WXMCell> &&cells, Configuration **config);
+
 /*! Parses the contents of a .wxm file into individual cells.
- * Invokes TreeFromWXM on pre-processed data,
- * concatenates the results.
+ * \param lines The lines of the file, starting after WXMFirstLine
  * \returns the tree, or nullptr on failure.
  */
-GroupCell *ParseWXMFile(wxTextBuffer &buf, Configuration **config);
-
-/*! Parses the contents of a preloaded .mac file into individual cells.
- *
- * Invokes TreeFromWXM on pre-processed data.
- * \returns the cell tree, or nullptr on failure.
- */
-GroupCell *ParseMACContents(const wxString &macContents, Configuration **config);
+GroupCell *ParseWXMFile(WXMLineReader &lines, Configuration **config);
 
 /*! Parses the contents of a .mac or a .out file into individual cells.
- * Invokes ParseMACContents on pre-processed data.
  * \returns the cell tree, or nullptr on failure.
  */
-GroupCell *ParseMACFile(wxTextBuffer &buf, bool xMaximaFile, Configuration **config);
+GroupCell *ParseMACFile(WXMLineReader &lines, bool xMaximaFile, Configuration **config);
 
 //! First line of the WXM files - used by both loading and saving code.
 extern const wxString WXMFirstLine;
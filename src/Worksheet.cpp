@@ -50,6 +50,7 @@
 #include "SlideShowCell.h"
 #include "ImgCell.h"
 #include "MarkDown.h"
+#include "Utf8OutputStream.h"
 #include "ConfigDialogue.h"
 
 #include <wx/clipbrd.h>
@@ -67,8 +68,8 @@
 #include <wx/wfstream.h>
 #include <wx/txtstrm.h>
 #include <wx/filesys.h>
-#include <wx/fs_mem.h>
 #include <stdlib.h>
+#include <atomic>
 #include "memory"
 
 //! This class represents the worksheet shown in the middle of the wxMaxima window.
@@ -186,6 +187,11 @@ Worksheet::Worksheet(wxWindow *parent, int id, Worksheet* &observer, wxPoint pos
           wxZoomGestureEventHandler(Worksheet::OnZoom),
           NULL, this);
   #endif
+  #if wxCHECK_VERSION(3,1,3)
+  Connect(wxEVT_DPI_CHANGED,
+          wxDPIChangedEventHandler(Worksheet::OnDPIChanged),
+          NULL, this);
+  #endif
   Connect(SIDEBARKEYEVENT,
           wxCommandEventHandler(Worksheet::OnSidebarKey),
           NULL, this);
@@ -240,6 +246,16 @@ bool Worksheet::RedrawIfRequested()
 {
   bool redrawIssued = false;
 
+  // A headless worksheet is never drawn.
+  if (m_configuration->Headless())
+  {
+    m_redrawRequested = false;
+    m_redrawStart = NULL;
+    m_mouseMotionWas = false;
+    m_rectToRefresh = wxRect(-1, -1, -1, -1);
+    return false;
+  }
+
   RecalculateIfNeeded();
 
   if(m_mouseMotionWas)
@@ -390,6 +406,8 @@ Worksheet::~Worksheet()
 {
   TreeUndo_ClearRedoActionList();
   TreeUndo_ClearUndoActionList();
+  // The clipboard mustn't generate data from our cells after we are gone
+  m_clipboardCells.reset();
 
   #ifdef HAVE_OPENMP_TASKS
   #pragma omp taskwait
@@ -629,6 +647,7 @@ void Worksheet::OnPaint(wxPaintEvent &WXUNUSED(event))
   m_configuration->GetDC()->SetPen(*(wxThePenList->FindOrCreatePen(m_configuration->GetColor(TS_DEFAULT), 1, wxPENSTYLE_SOLID)));
   m_configuration->GetDC()->SetBrush(*(wxTheBrushList->FindOrCreateBrush(m_configuration->GetColor(TS_DEFAULT))));
   
+  bool layoutHintsDiscarded = false;
   for (GroupCell *tmp = GetTree(); tmp; )
   {
     wxRect cellRect = tmp->GetRect();
@@ -657,6 +676,15 @@ void Worksheet::OnPaint(wxPaintEvent &WXUNUSED(event))
     }
     
     tmp->SetCurrentPoint(point);
+    // Cells that only know the height they had when the file was saved are
+    // laid out the moment they scroll into view.
+    if (tmp->HasHeightHint() && tmp->DrawThisCell(point))
+    {
+      tmp->DiscardHeightHint();
+      tmp->Recalculate();
+      point = tmp->GetCurrentPoint();
+      layoutHintsDiscarded = true;
+    }
     if (tmp->DrawThisCell(point))
     {
       tmp->InEvaluationQueue(m_evaluationQueue.IsInQueue(tmp));
@@ -670,6 +698,12 @@ void Worksheet::OnPaint(wxPaintEvent &WXUNUSED(event))
       point = tmp->GetCurrentPoint();
     }
   }
+  // The exact height of the cells we have laid out may differ from their hint
+  if (layoutHintsDiscarded)
+  {
+    m_configuration->AdjustWorksheetSize(true);
+    RequestRedraw();
+  }
     
   #ifndef WORKING_AUTO_BUFFER
   // Blit the memory image to the window
@@ -686,8 +720,18 @@ void Worksheet::OnPaint(wxPaintEvent &WXUNUSED(event))
   m_configuration->ReportMultipleRedraws();
 }
 
+void Worksheet::FinishLoading()
+{
+  if (!m_finishLoading)
+    return;
+  std::function<void()> finishLoading;
+  std::swap(finishLoading, m_finishLoading);
+  finishLoading();
+}
+
 GroupCell *Worksheet::InsertGroupCells(GroupCell *cells, GroupCell *where)
 {
+  FinishLoading();
   return InsertGroupCells(cells, where, &treeUndoActions);
 }
 
@@ -920,7 +964,49 @@ void Worksheet::SetZoomFactor(double newzoom, bool recalc)
 
 bool Worksheet::RecalculateIfNeeded()
 {
+  // Nobody is going to look at a headless worksheet => no need to lay it out.
+  // It is recalculated completely as soon as it is displayed.
+  if (m_configuration->Headless())
+  {
+    m_configuration->AdjustWorksheetSize(false);
+    return false;
+  }
+
   UpdateConfigurationClientSize();
+
+  // Lay out the cells whose styled text a background task has generated
+  auto &cellsBeingStyled = m_cellPointers.m_cellsBeingStyled;
+  for (auto cell = cellsBeingStyled.begin(); cell != cellsBeingStyled.end();)
+  {
+    EditorCell *editor = cell->get();
+    if (editor && editor->BackgroundStylingPending() && !editor->BackgroundStylingDone())
+    {
+      ++cell;
+      continue;
+    }
+    // Cells that have been deleted or restyled in the foreground meanwhile
+    // need no layout
+    if (editor && editor->BackgroundStylingPending())
+    {
+      editor->ResetSize();
+      editor->GetGroup()->ResetSize();
+      Recalculate(editor);
+      RequestRedraw();
+    }
+    cell = cellsBeingStyled.erase(cell);
+  }
+
+  // If the environment the height hints of the cells have been calculated for
+  // has changed the hints are worthless.
+  if (!m_layoutHintSignature.IsEmpty() &&
+      (m_layoutHintSignature != m_configuration->LayoutSignature()))
+  {
+    m_layoutHintSignature.Clear();
+    for (GroupCell *tmp = GetTree(); tmp; tmp = tmp->GetNext())
+      tmp->DiscardHeightHint();
+    m_recalculateStart = GetTree();
+    m_configuration->AdjustWorksheetSize(true);
+  }
   if (!m_recalculateStart || !GetTree())
   {
     m_recalculateStart = {};
@@ -1075,6 +1161,11 @@ void Worksheet::ClearDocument()
   m_evaluationQueue.Clear();
   TreeUndo_ClearBuffers();
   DestroyTree();
+  // The user has either saved the closed document or discarded its changes.
+  DiscardAutosaveJournal();
+  // Don't keep the images and gnuplot files of the closed document in memory
+  Image::ClearBlobCache();
+  m_layoutHintSignature.Clear();
 
   m_blinkDisplayCaret = true;
   SetSaved(false);
@@ -2324,35 +2415,51 @@ bool Worksheet::Copy(bool astext)
   wxASSERT_MSG(!wxTheClipboard->IsOpened(),_("Bug: The clipboard is already opened"));
   if (wxTheClipboard->Open())
   {
-    wxDataObjectComposite *data = new wxDataObjectComposite;
+    // Only the cheap formats are generated right away. The others are
+    // generated from a copy of the selection when an application requests
+    // them.
+    auto *data = new CompositeDataObject;
+    auto clipboardCells = NewClipboardCells();
+    clipboardCells->cells = CopySelection();
+    clipboardCells->cellsAsData =
+      CopySelection(m_cellPointers.m_selectionStart, m_cellPointers.m_selectionEnd, true);
+    std::weak_ptr<ClipboardCells> source = clipboardCells;
 
     // Add the wxm code corresponding to the selected output to the clipboard
     wxString s = GetString(true);
     data->Add(new wxmDataObject(s));
 
-    std::unique_ptr<Cell> tmp(CopySelection());
-
     if(m_configuration->CopyMathML())
     {
       // Add a mathML representation of the data to the clipboard
-      s = ConvertSelectionToMathML();
-      if (s != wxEmptyString)
-      {
-        // We mark the MathML version of the data on the clipboard as "preferred"
-        // as if an application supports MathML neither bitmaps nor plain text
-        // makes much sense.
-        data->Add(new MathMLDataObject(s), true);
-        data->Add(new MathMLDataObject2(s), true);
-        if(m_configuration->CopyMathMLHTML())
-          data->Add(new wxHTMLDataObject(s), true);
-        // wxMathML is a HTML5 flavour, as well.
-        // See https://github.com/fred-wang/Mathzilla/blob/master/mathml-copy/lib/copy-mathml.js#L21
-        //
-        // Unfortunately MS Word and Libreoffice Writer don't like this idea so I have
-        // disabled the following line of code again:
-        //
-        // data->Add(new wxHTMLDataObject(s));
-      }
+      //
+      // We mark the MathML version of the data on the clipboard as "preferred"
+      // as if an application supports MathML neither bitmaps nor plain text
+      // makes much sense.
+      auto mathML = std::make_shared<wxString>();
+      auto generateMathML = [source, mathML]() -> bool {
+        auto cells = source.lock();
+        if (mathML->IsEmpty() && cells && cells->cellsAsData)
+          *mathML = CellsToMathML(cells->cellsAsData.get());
+        return !mathML->IsEmpty();
+      };
+      data->AddDeferred(new MathMLDataObject, [generateMathML, mathML]() -> wxDataObject * {
+          return generateMathML() ? new MathMLDataObject(*mathML) : nullptr;
+        }, true);
+      data->AddDeferred(new MathMLDataObject2, [generateMathML, mathML]() -> wxDataObject * {
+          return generateMathML() ? new MathMLDataObject2(*mathML) : nullptr;
+        }, true);
+      if(m_configuration->CopyMathMLHTML())
+        data->AddDeferred(new wxHTMLDataObject, [generateMathML, mathML]() -> wxDataObject * {
+            return generateMathML() ? new wxHTMLDataObject(*mathML) : nullptr;
+          }, true);
+      // wxMathML is a HTML5 flavour, as well.
+      // See https://github.com/fred-wang/Mathzilla/blob/master/mathml-copy/lib/copy-mathml.js#L21
+      //
+      // Unfortunately MS Word and Libreoffice Writer don't like this idea so I have
+      // disabled the following line of code again:
+      //
+      // data->Add(new wxHTMLDataObject(s));
     }
 
     if(m_configuration->CopyRTF())
@@ -2360,24 +2467,35 @@ bool Worksheet::Copy(bool astext)
       // Add a RTF representation of the currently selected text
       // to the clipboard: For some reason libreoffice likes RTF more than
       // it likes the MathML - which is standartized.
-      wxString rtf;
-      rtf = RTFStart() + tmp->ListToRTF() + wxT("\\par\n") + RTFEnd();
-      data->Add(new RtfDataObject(rtf));
-      data->Add(new RtfDataObject2(rtf), true);
+      auto rtf = std::make_shared<wxString>();
+      auto generateRTF = [this, source, rtf]() -> bool {
+        auto cells = source.lock();
+        if (rtf->IsEmpty() && cells && cells->cells)
+          *rtf = RTFStart() + cells->cells->ListToRTF() + wxT("\\par\n") + RTFEnd();
+        return !rtf->IsEmpty();
+      };
+      data->AddDeferred(new RtfDataObject, [generateRTF, rtf]() -> wxDataObject * {
+          return generateRTF() ? new RtfDataObject(*rtf) : nullptr;
+        });
+      data->AddDeferred(new RtfDataObject2, [generateRTF, rtf]() -> wxDataObject * {
+          return generateRTF() ? new RtfDataObject2(*rtf) : nullptr;
+        }, true);
     }
 
     // Add a string representation of the selected output to the clipboard
-    s = tmp->ListToString();
+    s = clipboardCells->cells->ListToString();
     data->Add(new wxTextDataObject(s));
 
     if(m_configuration->CopyBitmap())
-    {
       // Try to fill bmp with a high-res version of the cells
-      BitmapOut output(&m_configuration, std::move(tmp),
-                       BitmapOut::GetConfigScale(), BitmapOut::MAX_CLIPBOARD_SIZE);
-      if (output.IsOk())
-        data->Add(output.GetDataObject().release());
-    }
+      data->AddDeferred(new wxBitmapDataObject, [this, source]() -> wxDataObject * {
+          auto cells = source.lock();
+          if (!cells || !cells->cells)
+            return nullptr;
+          BitmapOut output(&m_configuration, cells->cells->CopyList(),
+                           BitmapOut::GetConfigScale(), BitmapOut::MAX_CLIPBOARD_SIZE);
+          return output.IsOk() ? output.GetDataObject().release() : nullptr;
+        });
     wxTheClipboard->SetData(data);
     wxTheClipboard->Close();
     Recalculate();
@@ -2387,6 +2505,14 @@ bool Worksheet::Copy(bool astext)
   return false;
 }
 
+std::shared_ptr<Worksheet::ClipboardCells> Worksheet::NewClipboardCells()
+{
+  // The data object that still refers to the old cells has been replaced or
+  // is about to be => the old cells aren't needed any more.
+  m_clipboardCells = std::make_shared<ClipboardCells>();
+  return m_clipboardCells;
+}
+
 wxString Worksheet::ConvertSelectionToMathML()
 {
   if (GetActiveCell())
@@ -2395,11 +2521,16 @@ wxString Worksheet::ConvertSelectionToMathML()
   if (!m_cellPointers.m_selectionStart || !m_cellPointers.m_selectionEnd)
     return {};
 
-  wxString s;
   std::unique_ptr<Cell> tmp(
     CopySelection(m_cellPointers.m_selectionStart, m_cellPointers.m_selectionEnd, true));
+  wxString s = CellsToMathML(tmp.get());
+  Recalculate();
+  return s;
+}
 
-  s = wxString(wxT("<math xmlns=\"http://www.w3.org/1998/Math/MathML\">\n")) +
+wxString Worksheet::CellsToMathML(const Cell *tmp)
+{
+  wxString s = wxString(wxT("<math xmlns=\"http://www.w3.org/1998/Math/MathML\">\n")) +
       wxT("<semantics>") +
       tmp->ListToMathML(true) +
       wxT("<annotation encoding=\"application/x-maxima\">") +
@@ -2437,7 +2568,6 @@ wxString Worksheet::ConvertSelectionToMathML()
       
     }
   }
-  Recalculate();
   return s;
 }
 
@@ -2593,14 +2723,16 @@ bool Worksheet::CopyCells()
 
   if (wxTheClipboard->Open())
   {
-#if wxUSE_ENH_METAFILE
+    // Only the cheap formats are generated right away. The others are
+    // generated from a copy of the selection when an application requests
+    // them.
     auto *data = new CompositeDataObject;
-#else
-    wxDataObjectComposite *data = new wxDataObjectComposite;
-#endif
+    auto clipboardCells = NewClipboardCells();
+    clipboardCells->cells = CopySelection();
+    std::weak_ptr<ClipboardCells> source = clipboardCells;
+
     wxString wxm;
     wxString str;
-    wxString rtf = RTFStart();
 
     GroupCell *end = m_cellPointers.m_selectionEnd->GetGroup();
     bool firstcell = true;
@@ -2612,46 +2744,64 @@ bool Worksheet::CopyCells()
       str += tmp->ToString();
       firstcell = false;
 
-      if (m_configuration->CopyRTF())
-        rtf += tmp->ToRTF();
       wxm += Format::TreeToWXM(tmp);
 
       if (tmp == end)
       	break;
     }
 
-    rtf += wxT("\\par") + RTFEnd();
-
     if (m_configuration->CopyRTF())
     {
-      data->Add(new RtfDataObject(rtf), true);
-      data->Add(new RtfDataObject2(rtf));
+      auto rtf = std::make_shared<wxString>();
+      auto generateRTF = [this, source, rtf]() -> bool {
+        auto cells = source.lock();
+        if (rtf->IsEmpty() && cells && cells->cells)
+        {
+          *rtf = RTFStart();
+          for (Cell *tmp = cells->cells.get(); tmp; tmp = tmp->m_next)
+            *rtf += tmp->ToRTF();
+          *rtf += wxT("\\par") + RTFEnd();
+        }
+        return !rtf->IsEmpty();
+      };
+      data->AddDeferred(new RtfDataObject, [generateRTF, rtf]() -> wxDataObject * {
+          return generateRTF() ? new RtfDataObject(*rtf) : nullptr;
+        }, true);
+      data->AddDeferred(new RtfDataObject2, [generateRTF, rtf]() -> wxDataObject * {
+          return generateRTF() ? new RtfDataObject2(*rtf) : nullptr;
+        });
     }
     data->Add(new wxTextDataObject(str));
     data->Add(new wxmDataObject(wxm));
 
     if (m_configuration->CopyBitmap())
-    {
-      BitmapOut output(&m_configuration, CopySelection(),
-                       BitmapOut::GetConfigScale(), BitmapOut::MAX_CLIPBOARD_SIZE);
-      if (output.IsOk())
-        data->Add(output.GetDataObject().release());
-    }
+      data->AddDeferred(new wxBitmapDataObject, [this, source]() -> wxDataObject * {
+          auto cells = source.lock();
+          if (!cells || !cells->cells)
+            return nullptr;
+          BitmapOut output(&m_configuration, cells->cells->CopyList(),
+                           BitmapOut::GetConfigScale(), BitmapOut::MAX_CLIPBOARD_SIZE);
+          return output.IsOk() ? output.GetDataObject().release() : nullptr;
+        });
 
 #if wxUSE_ENH_METAFILE
     if (m_configuration->CopyEMF())
-    {
-      Emfout emf(&m_configuration, CopySelection());
-      if (emf.IsOk())
-        data->Add(emf.GetDataObject().release());
-    }
+      data->AddDeferred(new wxEnhMetaFileDataObject, [this, source]() -> wxDataObject * {
+          auto cells = source.lock();
+          if (!cells || !cells->cells)
+            return nullptr;
+          Emfout emf(&m_configuration, cells->cells->CopyList());
+          return emf.IsOk() ? emf.GetDataObject().release() : nullptr;
+        });
 #endif
     if (m_configuration->CopySVG())
-    {
-      Svgout svg(&m_configuration, CopySelection());
-      if (svg.IsOk())
-        data->Add(svg.GetDataObject().release());
-    }
+      data->AddDeferred(Svgout::GetEmptyDataObject(), [this, source]() -> wxDataObject * {
+          auto cells = source.lock();
+          if (!cells || !cells->cells)
+            return nullptr;
+          Svgout svg(&m_configuration, cells->cells->CopyList());
+          return svg.IsOk() ? svg.GetDataObject().release() : nullptr;
+        });
 
     wxTheClipboard->SetData(data);
     wxTheClipboard->Close();
@@ -2675,6 +2825,7 @@ bool Worksheet::CanDeleteSelection() const
 
 void Worksheet::DeleteSelection()
 {
+  FinishLoading();
   DeleteRegion(
     m_cellPointers.m_selectionStart->GetGroup(),
     m_cellPointers.m_selectionEnd->GetGroup()
@@ -2687,6 +2838,7 @@ void Worksheet::DeleteSelection()
 
 void Worksheet::DeleteCurrentCell()
 {
+  FinishLoading();
   GroupCell *cellToDelete = m_hCaretActive ? m_hCaretPosition : GetActiveCell()->GetGroup();
 
   if (cellToDelete)
@@ -2798,6 +2950,7 @@ void Worksheet::TreeUndo_CellEntered()
 
 void Worksheet::SetCellStyle(GroupCell *group, GroupType style)
 {
+  FinishLoading();
   if (!group)
     return;
 
@@ -2818,6 +2971,7 @@ void Worksheet::SetCellStyle(GroupCell *group, GroupType style)
 
 void Worksheet::DeleteRegion(GroupCell *start, GroupCell *end)
 {
+  FinishLoading();
   DeleteRegion(start, end, &treeUndoActions);
 }
 
@@ -2980,6 +3134,7 @@ void Worksheet::OpenQuestionCaret(const wxString &txt)
 
 void Worksheet::OpenHCaret(const wxString &txt, GroupType type)
 {
+  FinishLoading();
   CloseAutoCompletePopup();
 
   // if we are inside cell maxima is currently evaluating
@@ -3061,6 +3216,23 @@ void Worksheet::OnKeyDown(wxKeyEvent &event)
   // to inactive again is done in wxMaxima.cpp
   m_keyboardInactiveTimer.StartOnce(10000);
 
+  // Keys that might modify the worksheet must wait until the whole file has been loaded.
+  switch (event.GetKeyCode())
+  {
+    case WXK_UP:
+    case WXK_DOWN:
+    case WXK_LEFT:
+    case WXK_RIGHT:
+    case WXK_PAGEUP:
+    case WXK_PAGEDOWN:
+    case WXK_SHIFT:
+    case WXK_CONTROL:
+    case WXK_ALT:
+      break;
+    default:
+      FinishLoading();
+  }
+
   // If Alt and Ctrl are down at the same time we are almost entirely sure that
   // this is a hotkey we need to pass to the main application. One exception is
   // curly brackets in - I think it was france.
@@ -4036,6 +4208,9 @@ void Worksheet::SetNotification(const wxString &message, int flags)
  */
 void Worksheet::OnChar(wxKeyEvent &event)
 {
+  // Edits must wait until the whole file has been loaded.
+  FinishLoading();
+
   // Alt+Up and Alt+Down are hotkeys. In order for the main application to realize
   // them they need to be passed to it using the event's Skip() function.
   if(event.AltDown())
@@ -4232,6 +4407,17 @@ void Worksheet::OnZoom(wxZoomGestureEvent &event)
 }
 #endif
 
+#if wxCHECK_VERSION(3,1,3)
+void Worksheet::OnDPIChanged(wxDPIChangedEvent &event)
+{
+  // The fonts now have a different size in pixels
+  m_configuration->FontChanged(true);
+  RecalculateForce();
+  RequestRedraw();
+  event.Skip();
+}
+#endif
+
 void Worksheet::OnMouseEnter(wxMouseEvent &WXUNUSED(event))
 {
   m_mouseOutside = false;
@@ -4640,11 +4826,64 @@ void Worksheet::CalculateReorderedCellIndices(GroupCell *tree, int &cellIndex, s
   }
 }
 
+/*! Writes an image to a file in a background task
+
+  The file receives the image's compressed data unchanged, which doesn't
+  involve the GUI.
+ */
+static void ExportImageInBackground(std::shared_ptr<Image> image, wxString file,
+                                    std::atomic<bool> *success)
+{
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp task firstprivate(image, file, success)
+  #endif
+  {
+    if (image->ToImageFile(file).x < 0)
+      *success = false;
+  }
+}
+
+/*! Writes an animation to a .gif file
+
+  Preparing the frames might need the GUI, so this is done here. Encoding
+  them doesn't and therefore happens in a background task.
+ */
+static void ExportGifInBackground(SlideShow *slideShow, wxString file,
+                                  std::atomic<bool> *success)
+{
+  wxImageArray *frames = new wxImageArray(slideShow->GifFrames());
+  int delay = slideShow->GetGifDelay();
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp task firstprivate(frames, delay, file, success)
+  #endif
+  {
+    if (!SlideShow::SaveGif(*frames, delay, file))
+      *success = false;
+    delete frames;
+  }
+}
+
+//! Encodes a rendered equation in a background task
+static void ExportBitmapInBackground(const BitmapOut &bitmap, wxString file,
+                                     std::atomic<bool> *success)
+{
+  wxImage *image = new wxImage(bitmap.ToImage());
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp task firstprivate(image, file, success)
+  #endif
+  {
+    if (!BitmapOut::SaveImage(*image, file))
+      *success = false;
+    delete image;
+  }
+}
+
 /***
  * Export content to a HTML file.
  */
 bool Worksheet::ExportToHTML(const wxString &file)
 {
+  FinishLoading();
   // Show a busy cursor as long as we export.
   wxBusyCursor crs;
 
@@ -4685,8 +4924,14 @@ bool Worksheet::ExportToHTML(const wxString &file)
 
   wxTextOutputStream css(cssfile);
 
-  wxString output;
-  
+  // The HTML code is streamed to the file as it is generated.
+  wxFileOutputStream outfile(file);
+  if (!outfile.IsOk())
+    return false;
+  Utf8OutputStream output(outfile);
+
+  // The images are written to disk by background tasks.
+  std::atomic<bool> imagesOK(true);
 
   m_configuration->ClipToDrawRegion(false);
   output << wxT("<!DOCTYPE html>\n");
@@ -5281,8 +5526,9 @@ bool Worksheet::ExportToHTML(const wxString &file)
 
           if (chunk->GetType() == MC_TYPE_SLIDE)
           {
-            dynamic_cast<SlideShow *>(&(*chunk))->ToGif(
-                    imgDir + wxT("/") + filename + wxString::Format(wxT("_%d.gif"), count));
+            ExportGifInBackground(dynamic_cast<SlideShow *>(&(*chunk)),
+                                  imgDir + wxT("/") + filename + wxString::Format(wxT("_%d.gif"), count),
+                                  &imagesOK);
             output << wxT("  <img src=\"") + filename_encoded + wxT("_htmlimg/") +
                       filename_encoded +
                       wxString::Format(_("_%d.gif\"  alt=\"Animated Diagram\" loading=\"lazy\" style=\"max-width:90%%;\" />\n"), count);
@@ -5336,9 +5582,14 @@ bool Worksheet::ExportToHTML(const wxString &file)
               int bitmapScale = 3;
               ext = wxT(".png");
               wxConfig::Get()->Read(wxT("bitmapScale"), &bitmapScale);
-              size = CopyToFile(imgDir + wxT("/") + filename + wxString::Format(wxT("_%d.png"), count),
-                                &(*chunk),
-                                NULL, true, bitmapScale);
+              {
+                // Rendering needs the GUI, encoding the .png file doesn't.
+                BitmapOut bitmap(&m_configuration, CopySelection(&(*chunk), NULL, true), bitmapScale);
+                ExportBitmapInBackground(bitmap,
+                                         imgDir + wxT("/") + filename + wxString::Format(wxT("_%d.png"), count),
+                                         &imagesOK);
+                size = bitmap.GetScaledSize();
+              }
               int borderwidth = 0;
               wxString alttext = EditorCell::EscapeHTMLChars(chunk->ListToString());
               borderwidth = chunk->GetImageBorderWidth();
@@ -5365,9 +5616,12 @@ bool Worksheet::ExportToHTML(const wxString &file)
           else
           {
             wxSize size;
-            ext = wxT(".") + dynamic_cast<ImgCell *>(&(*chunk))->GetExtension();
-            size = dynamic_cast<ImgCell *>(&(*chunk))->ToImageFile(
-              imgDir + wxT("/") + filename + wxString::Format(wxT("_%d"), count) + ext);
+            ImgCell *imgCell = dynamic_cast<ImgCell *>(&(*chunk));
+            ext = wxT(".") + imgCell->GetExtension();
+            size = imgCell->GetOriginalSize();
+            ExportImageInBackground(imgCell->GetImage(),
+                                    imgDir + wxT("/") + filename + wxString::Format(wxT("_%d"), count) + ext,
+                                    &imagesOK);
             int borderwidth = 0;
             wxString alttext = EditorCell::EscapeHTMLChars(chunk->ListToString());
             borderwidth = chunk->GetImageBorderWidth();
@@ -5464,8 +5718,9 @@ bool Worksheet::ExportToHTML(const wxString &file)
           output << wxT("<br/>\n");
           if (tmp->GetLabel()->GetType() == MC_TYPE_SLIDE)
           {
-            dynamic_cast<SlideShow *>(tmp->GetOutput())->ToGif(imgDir + wxT("/") + filename +
-                                                               wxString::Format(wxT("_%d.gif"), count));
+            ExportGifInBackground(dynamic_cast<SlideShow *>(tmp->GetOutput()),
+                                  imgDir + wxT("/") + filename + wxString::Format(wxT("_%d.gif"), count),
+                                  &imagesOK);
             output << wxT("  <img src=\"") + filename_encoded + wxT("_htmlimg/") +
                       filename_encoded +
                       wxString::Format(_("_%d.gif\" alt=\"Animated Diagram\" style=\"max-width:90%%;\" loading=\"lazy\" />"), count)
@@ -5474,9 +5729,10 @@ bool Worksheet::ExportToHTML(const wxString &file)
           else
           {
             ImgCell *imgCell = dynamic_cast<ImgCell *>(out);
-            imgCell->ToImageFile(
-                    imgDir + wxT("/") + filename + wxString::Format(wxT("_%d."), count) +
-                    imgCell->GetExtension());
+            ExportImageInBackground(imgCell->GetImage(),
+                                    imgDir + wxT("/") + filename + wxString::Format(wxT("_%d."), count) +
+                                    imgCell->GetExtension(),
+                                    &imagesOK);
             output << wxT("  <img src=\"") + filename_encoded + wxT("_htmlimg/") +
                       filename_encoded +
                       wxString::Format(wxT("_%d.%s\" alt=\"Diagram\" style=\"max-width:90%%;\" loading=\"lazy\" />"), count,
@@ -5522,50 +5778,19 @@ bool Worksheet::ExportToHTML(const wxString &file)
   output << wxT(" </body>\n");
   output << wxT("</html>\n");
 
-  m_configuration->ClipToDrawRegion(true);
-
-  // Indent the document and test it for validity.
-  wxXmlDocument doc;
-  {
-    wxMemoryOutputStream ostream;
-    wxTextOutputStream txtstrm(ostream);
-    txtstrm.WriteString(output);
-    wxMemoryInputStream istream(ostream);
-    doc.Load(istream);
-  }
-      
-  // Replace the raw document by the indented one. If that step worked, that ist.
-  if (doc.IsOk())
-  {
-    wxMemoryOutputStream ostream;
-    doc.Save(ostream);
-    output = wxString::FromUTF8((char *) ostream.GetOutputStreamBuffer()->GetBufferStart(),
-                                ostream.GetOutputStreamBuffer()->GetBufferSize());
-    
-    // Now the string has a header we want to drop again.
-    output = output.SubString(output.Find("\n") + 1, output.Length());
-  }
-  else
-    wxLogMessage(_("Bug: HTML output is no valid XML"));
-  
-  wxFileOutputStream outfile(file);
-  if (!outfile.IsOk())
-  {
-    return false;
-  }
-  
-  wxTextOutputStream outstream(outfile);
-  outstream << "<!DOCTYPE html>\n";
-  outstream << output;
+  // Wait for the images to be written
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp taskwait
+  #endif
 
-  bool outfileOK = !outfile.GetFile()->Error();
+  bool outfileOK = output.Flush() && output.IsOk() && !outfile.GetFile()->Error();
   bool cssOK = !cssfile.GetFile()->Error();
   outfile.Close();
   cssfile.Close();
 
   m_configuration->ClipToDrawRegion(true);
   RecalculateForce();
-  return outfileOK && cssOK;
+  return outfileOK && cssOK && imagesOK;
 }
 
 void Worksheet::CodeCellVisibilityChanged()
@@ -5581,9 +5806,15 @@ void Worksheet::CodeCellVisibilityChanged()
 }
 
 /*! Export the file as TeX code
+
+  The cells are converted to TeX and their images written in parallel, in
+  batches that are streamed to the file in order. Each cell is told the
+  number of its first image beforehand so the image numbering doesn't depend
+  on the order the tasks happen to run in.
  */
 bool Worksheet::ExportToTeX(const wxString &file)
 {
+  FinishLoading();
   // Show a busy cursor as long as we export.
   wxBusyCursor crs;
 
@@ -5670,9 +5901,7 @@ bool Worksheet::ExportToTeX(const wxString &file)
 
   // The animate package is only needed if we actually want to output animations
   // to LaTeX. Don't drag in this dependency if this feature was disabled in the settings.
-  bool AnimateLaTeX = true;
-  wxConfig::Get()->Read(wxT("AnimateLaTeX"), &AnimateLaTeX);
-  if (AnimateLaTeX)
+  if (m_configuration->AnimateLaTeX())
   {
     output << wxT("\\usepackage{animate} % This package is required because the wxMaxima configuration option\n");
     output << wxT("                      % \"Export animations to TeX\" was enabled when this file was generated.\n");
@@ -5692,10 +5921,39 @@ bool Worksheet::ExportToTeX(const wxString &file)
   //
   // Write contents
   //
+  std::vector<GroupCell *> cells;
+  // The number of the last image before each cell
+  std::vector<int> imgCounters;
   for (; tmp; tmp = tmp->GetNext())
   {
-    wxString s = tmp->ToTeX(imgDir, filename, &imgCounter);
-    output << s << wxT("\n");
+    cells.push_back(tmp);
+    imgCounters.push_back(imgCounter);
+    imgCounter += tmp->TeXImageCount();
+  }
+  // The tasks mustn't race for creating the image directory
+  if ((imgCounter > 0) && !wxDirExists(imgDir))
+    wxMkdir(imgDir);
+
+  // Only one batch of TeX code is held in memory at a time
+  const size_t batchSize = 256;
+  std::vector<wxString> tex(batchSize);
+  for (size_t batchStart = 0; batchStart < cells.size(); batchStart += batchSize)
+  {
+    size_t batchEnd = wxMin(batchStart + batchSize, cells.size());
+    #ifdef HAVE_OPENMP_TASKS
+    #pragma omp taskloop shared(cells, imgCounters, tex, imgDir, filename)
+    #endif
+    for (size_t i = batchStart; i < batchEnd; i++)
+    {
+      int counter = imgCounters[i];
+      tex[i - batchStart] = cells[i]->ToTeX(imgDir, filename, &counter);
+    }
+
+    for (size_t i = batchStart; i < batchEnd; i++)
+    {
+      output << tex[i - batchStart] << wxT("\n");
+      tex[i - batchStart].clear();
+    }
   }
 
   //
@@ -5818,6 +6076,7 @@ void Worksheet::ExportToMAC(wxTextFile &output, GroupCell *tree, bool wxm, const
 
 bool Worksheet::ExportToMAC(const wxString &file)
 {
+  FinishLoading();
   bool wasSaved = m_saved;
   
   // Show a busy cursor as long as we export or save.
@@ -5898,369 +6157,265 @@ bool Worksheet::ExportToMAC(const wxString &file)
   return true;
 }
 
-/*
-  Save the data as wxmx file
-
-  First saves the data to a backup file ending in .wxmx~ so if anything goes
-  horribly wrong in this stepp all that is lost is the data that was input
-  since the last save. Then the original .wxmx file is replaced in a
-  (hopefully) atomic operation.
-*/
-bool Worksheet::ExportToWXMX(const wxString &file, bool markAsSaved)
+wxString Worksheet::WXMXContentHeader()
 {
-  #ifdef OPENMP
-  #if OPENMP_VER >= 201511
-  #pragma omp taskwait
-  #endif
-  #endif
-  // Show a busy cursor as long as we export a file.
-  wxBusyCursor crs;
-  // Don't update the worksheet whilst exporting
-  wxWindowUpdateLocker noUpdates(this);
-  wxLogMessage(_("Starting to save the worksheet as .wxmx"));
-  // delete temp file if it already exists
-  wxString backupfile = file + wxT("~");
-  if (wxFileExists(backupfile))
-  {
-    if (!wxRemoveFile(backupfile))
-      return false;
-  }
-  {
-    wxFFileOutputStream out(backupfile);
-    if (!out.IsOk())
-      return false;
-    {
-      wxZipOutputStream zip(out);
-      if (!zip.IsOk())
-        return false;
-      {
-        wxTextOutputStream output(zip);
-
-        /* The first zip entry is a file named "mimetype": This makes sure that the mimetype
-           is always stored at the same position in the file. This is common practice. One
-           example from an ePub file:
-
-           00000000  50 4b 03 04 14 00 00 08  00 00 cd bd 0a 43 6f 61  |PK...........Coa|
-           00000010  ab 2c 14 00 00 00 14 00  00 00 08 00 00 00 6d 69  |.,............mi|
-           00000020  6d 65 74 79 70 65 61 70  70 6c 69 63 61 74 69 6f  |metypeapplicatio|
-           00000030  6e 2f 65 70 75 62 2b 7a  69 70 50 4b 03 04 14 00  |n/epub+zipPK....|
-
-        */
-
-        // Make sure that the mime type is stored as plain text.
-        //
-        // We will keep that setting for the rest of the file for the following reasons:
-        //  - Compression of the .zip file won't improve compression of the embedded .png images
-        //  - The text part of the file is too small to justify compression
-        //  - not compressing the text part of the file allows version control systems to
-        //    determine which lines have changed and to track differences between file versions
-        //    efficiently (in a compressed text virtually every byte might change when one
-        //    byte at the start of the uncompressed original is)
-        //  - and if anything crashes in a bad way chances are high that the uncompressed
-        //    contents of the .wxmx file can be rescued using a text editor.
-        //  Who would - under these circumstances - care about a kilobyte?
-        zip.SetLevel(0);
-        zip.PutNextEntry(wxT("mimetype"));
-        output << wxT("text/x-wxmathml");
-        zip.CloseEntry();
-        zip.PutNextEntry(wxT("format.txt"));
-        output << wxT(
-          "\n\nThis file contains a wxMaxima session in the .wxmx format.\n"
-          ".wxmx files are .xml-based files contained in a .zip container like .odt\n"
-          "or .docx files. After changing their name to end in .zip the .xml and\n"
-          "eventual bitmap files inside them can be extracted using any .zip file\n"
-          "viewer.\n"
-          "The reason why part of a .wxmx file still might still seem to make sense in a\n"
-          "ordinary text viewer is that the text portion of .wxmx by default\n"
-          "isn't compressed: The text is typically small and compressing it would\n"
-          "mean that changing a single character would (with a high probability) change\n"
-          "big parts of the  whole contents of the compressed .zip archive.\n"
-          "Even if version control tools like git and svn that remember all changes\n"
-          "that were ever made to a file can handle binary files compression would\n"
-          "make the changed part of the file bigger and therefore seriously reduce\n"
-          "the efficiency of version control\n\n"
-          "wxMaxima can be downloaded from https://github.com/wxMaxima-developers/wxmaxima.\n"
-          "It also is part of the windows installer for maxima\n"
-          "(https://wxmaxima-developers.github.io/wxmaxima/).\n\n"
-          "If a .wxmx file is broken but the content.xml portion of the file can still be\n"
-          "viewed using a text editor just save the xml's text as \"content.xml\"\n"
-          "and try to open it using a recent version of wxMaxima.\n"
-          "If it is valid XML (the XML header is intact, all opened tags are closed again,\n"
-          "the text is saved with the text encoding \"UTF8 without BOM\" and the few\n"
-          "special characters XML requires this for are properly escaped)\n"
-          "chances are high that wxMaxima will be able to recover all code and text\n"
-          "from the XML file.\n\n"
-          );
-        zip.CloseEntry();
-
-        // next zip entry is "content.xml", xml of GetTree()
-
-        zip.PutNextEntry(wxT("content.xml"));
-        wxString xmlText;
-
-        xmlText << wxT("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
-        xmlText << wxT("\n<!--   Created using wxMaxima ") << wxT(GITVERSION) << wxT("   -->");
-        xmlText << wxT("\n<!--https://wxMaxima-developers.github.io/wxmaxima/-->\n");
-
-        // write document
-        xmlText << wxT("\n<wxMaximaDocument version=\"");
-        xmlText << DOCUMENT_VERSION_MAJOR << wxT(".");
-        xmlText << DOCUMENT_VERSION_MINOR << wxT("\" zoom=\"");
-        xmlText << int(100.0 * m_configuration->GetZoomFactor()) << wxT("\"");
-
-        // **************************************************************************
-        // Find out the number of the cell the cursor is at and save this information
-        // if we find it
-
-        // Determine which cell the cursor is at.
-        long ActiveCellNumber = 1;
-        GroupCell *cursorCell = NULL;
-        if (m_hCaretActive)
-        {
-          cursorCell = GetHCaret();
+  wxString header;
 
-          // If the cursor is before the 1st cell in the worksheet the cell number
-          // is 0.
-          if (!cursorCell)
-            ActiveCellNumber = 0;
-        }
-        else
-        {
-          if (GetActiveCell())
-            cursorCell = GetActiveCell()->GetGroup();
-        }
+  header << wxT("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+  header << wxT("\n<!--   Created using wxMaxima ") << wxT(GITVERSION) << wxT("   -->");
+  header << wxT("\n<!--https://wxMaxima-developers.github.io/wxmaxima/-->\n");
 
-        if (cursorCell == NULL)
-          ActiveCellNumber = 0;
-        // We want to save the information that the cursor is in the nth cell.
-        // Count the cells until then.
-        GroupCell *tmp = GetTree();
-        if (tmp == NULL)
-          ActiveCellNumber = -1;
-        if (ActiveCellNumber > 0)
-        {
-          while ((tmp) && (tmp != cursorCell))
-          {
-            tmp = tmp->GetNext();
-            ActiveCellNumber++;
-          }
-        }
-        // Paranoia: What happens if we didn't find the cursor?
-        if (tmp == NULL) ActiveCellNumber = -1;
+  // write document
+  header << wxT("\n<wxMaximaDocument version=\"");
+  header << DOCUMENT_VERSION_MAJOR << wxT(".");
+  header << DOCUMENT_VERSION_MINOR << wxT("\" zoom=\"");
+  header << int(100.0 * m_configuration->GetZoomFactor()) << wxT("\"");
 
-        // If we know where the cursor was we save this piece of information.
-        // If not we omit it.
-        if (ActiveCellNumber >= 0)
-          xmlText << wxString::Format(wxT(" activecell=\"%li\""), ActiveCellNumber);
+  // The environment the heights of the cells have been calculated for
+  if (m_configuration->WxmxLayoutHints())
+    header << wxT(" layout=\"") << Cell::XMLescape(m_configuration->LayoutSignature()) << wxT("\"");
 
+  // **************************************************************************
+  // Find out the number of the cell the cursor is at and save this information
+  // if we find it
 
-        // Save the variables list for the "variables" sidepane.
-        wxArrayString variables = m_variablesPane->GetVarnames();
-        if(variables.GetCount() > 1)
-        {
-          long varcount = variables.GetCount() - 1;
-          xmlText += wxString::Format(" variables_num=\"%li\"", varcount);
-          for(unsigned long i = 0; i<variables.GetCount(); i++)
-            xmlText += wxString::Format(" variables_%li=\"%s\"", i, Cell::XMLescape(variables[i]).utf8_str());
-        }
-  
-        xmlText << ">\n";
+  // Determine which cell the cursor is at.
+  long ActiveCellNumber = 1;
+  GroupCell *cursorCell = NULL;
+  if (m_hCaretActive)
+  {
+    cursorCell = GetHCaret();
 
-        // Reset image counter
-        m_cellPointers.WXMXResetCounter();
+    // If the cursor is before the 1st cell in the worksheet the cell number
+    // is 0.
+    if (!cursorCell)
+      ActiveCellNumber = 0;
+  }
+  else
+  {
+    if (GetActiveCell())
+      cursorCell = GetActiveCell()->GetGroup();
+  }
 
-        if (GetTree())
-          xmlText += GetTree()->ListToXML();
+  if (cursorCell == NULL)
+    ActiveCellNumber = 0;
+  // We want to save the information that the cursor is in the nth cell.
+  // Count the cells until then.
+  GroupCell *tmp = GetTree();
+  if (tmp == NULL)
+    ActiveCellNumber = -1;
+  if (ActiveCellNumber > 0)
+  {
+    while ((tmp) && (tmp != cursorCell))
+    {
+      tmp = tmp->GetNext();
+      ActiveCellNumber++;
+    }
+  }
+  // Paranoia: What happens if we didn't find the cursor?
+  if (tmp == NULL) ActiveCellNumber = -1;
 
-        // Delete all but one control character from the string: there should be
-        // no way for them to enter this string, anyway. But sometimes they still
-        // do...
-        for (wxString::const_iterator it = xmlText.begin(); it != xmlText.end(); ++it)
-        {
-          wxChar c = *it;
-          if ((c < wxT('\t')) ||
-              ((c > wxT('\n')) && (c < wxT(' '))) ||
-              (c == wxChar((char) 0x7F))
-            )
-          {
-            // *it = wxT(' ');
-          }
-        }
+  // If we know where the cursor was we save this piece of information.
+  // If not we omit it.
+  if (ActiveCellNumber >= 0)
+    header << wxString::Format(wxT(" activecell=\"%li\""), ActiveCellNumber);
 
-        xmlText +=  wxT("\n</wxMaximaDocument>");
 
-        {
-          // Prepare reading the files we have stored in memory
-          std::unique_ptr<wxFileSystem> fsystem(new wxFileSystem);
-          fsystem->AddHandler(new wxMemoryFSHandler);
-          fsystem->ChangePathTo(wxT("memory:"), true);
-
-          // In wxWidgets 3.1.1 fsystem->FindFirst crashes if we don't have a file
-          // in the memory filesystem => Let's create a file just to make sure
-          // one exists.
-          wxMemoryBuffer dummyBuf;
-          wxMemoryFSHandler::AddFile("dummyfile",
-                                     dummyBuf.GetData(),
-                                     dummyBuf.GetDataLen());
-
-          // Let wxWidgets test if the document can be read again by the XML parser before
-          // the user finds out the hard way.
-          {
-            wxXmlDocument doc;
-            {
-              wxMemoryOutputStream ostream;
-              wxTextOutputStream txtstrm(ostream);
-              txtstrm.WriteString(xmlText);
-              wxMemoryInputStream istream(ostream);
-              doc.Load(istream);
-            }
+  // Save the variables list for the "variables" sidepane.
+  wxArrayString variables = m_variablesPane->GetVarnames();
+  if(variables.GetCount() > 1)
+  {
+    long varcount = variables.GetCount() - 1;
+    header += wxString::Format(" variables_num=\"%li\"", varcount);
+    for(unsigned long i = 0; i<variables.GetCount(); i++)
+      header += wxString::Format(" variables_%li=\"%s\"", i, Cell::XMLescape(variables[i]).utf8_str());
+  }
+  
+  header << ">\n";
+  return header;
+}
 
-            // If we fail to load the document we abort the safe process as it will
-            // only destroy data.
-            // But we can still put the erroneous data into the clipboard for debugging purposes.
-            if (!doc.IsOk())
-            {
-              if (wxTheClipboard->Open())
-              {
-                wxDataObjectComposite *data = new wxDataObjectComposite;
-                data->Add(new wxTextDataObject(xmlText));
-                wxTheClipboard->SetData(data);
-                wxLogMessage(_("Produced invalid XML. The erroneous XML data has therefore not been saved but has been put on the clipboard in order to allow to debug it."));
-                wxTheClipboard->Close();
-              }
+std::shared_ptr<WXMXSnapshot> Worksheet::TakeWXMXSnapshot()
+{
+  FinishLoading();
+  auto snapshot = std::make_shared<WXMXSnapshot>(WXMXContentHeader());
+  m_cellPointers.WXMXResetCounter();
+  for (GroupCell *cell = GetTree(); cell != NULL; cell = cell->GetNext())
+    snapshot->AddCell(cell->GetId(), cell->GetHighlight(), cell->ToXML());
+  // The snapshot shares the images and gnuplot files the cells have stored.
+  for (auto const &blob : m_cellPointers.WXMXBlobs())
+    snapshot->AddFile(blob.first, blob.second);
+  m_cellPointers.WXMXResetCounter();
+  return snapshot;
+}
 
-              // Remove all files from our internal filesystem
-              wxString memFsName = fsystem->FindFirst("*", wxFILE);
-              while(memFsName != wxEmptyString)
-              {
-                wxString name = memFsName.Right(memFsName.Length()-7);
-                wxMemoryFSHandler::RemoveFile(name);
-                memFsName = fsystem->FindNext();
-              }
-              return false;
-            }
-          }
+bool Worksheet::WXMXSnapshotWritten(WXMXSnapshot &snapshot, const wxString &file,
+                                    bool success, bool updateJournal)
+{
+  if (!success)
+  {
+    // If we produced XML the parser cannot read we have aborted the save process as
+    // it would only have destroyed data. But we can still put the erroneous data into
+    // the clipboard for debugging purposes.
+    if ((!snapshot.GetInvalidXML().IsEmpty()) && (wxTheClipboard->Open()))
+    {
+      wxDataObjectComposite *data = new wxDataObjectComposite;
+      data->Add(new wxTextDataObject(snapshot.GetInvalidXML()));
+      wxTheClipboard->SetData(data);
+      wxLogMessage(_("Produced invalid XML. The erroneous XML data has therefore not been saved but has been put on the clipboard in order to allow to debug it."));
+      wxTheClipboard->Close();
+    }
+    return false;
+  }
 
-          // wxWidgets could pretty-print the XML document now. But as no-one will
-          // look at it, anyway, there might be no good reason to do so.
-          if (GetTree() != NULL)output << xmlText;
+  // From now on autosaves only need to record what has changed since the snapshot.
+  if (updateJournal)
+    m_autosaveJournal.NewBase(file, snapshot.TakeJournalCells(),
+                              snapshot.TakeJournalHashes(), snapshot.TakeJournalFiles());
+  return true;
+}
 
-          // Move all files we have stored in memory during saving to zip file
-          wxString memFsName = fsystem->FindFirst("*", wxFILE);
-          while(memFsName != wxEmptyString)
-          {
-            wxString name = memFsName.Right(memFsName.Length()-7);
-            if(name != wxT("dummyfile"))
-            {
-              zip.CloseEntry();
+bool Worksheet::ExportToWXMX(const wxString &file, bool markAsSaved)
+{
+  #ifdef OPENMP
+  #if OPENMP_VER >= 201511
+  #pragma omp taskwait
+  #endif
+  #endif
+  FinishBackgroundSave();
+  // Show a busy cursor as long as we export a file.
+  wxBusyCursor crs;
+  // Don't update the worksheet whilst exporting
+  wxWindowUpdateLocker noUpdates(this);
 
-              wxFSFile *fsfile;
-#ifdef HAVE_OPENMP_TASKS
-#pragma omp critical (OpenFSFile)
-#endif
-              fsfile = fsystem->OpenFile(memFsName);
+  std::shared_ptr<WXMXSnapshot> snapshot = TakeWXMXSnapshot();
+  if (!WXMXSnapshotWritten(*snapshot, file, snapshot->Write(file), markAsSaved))
+    return false;
+  if (markAsSaved)
+    SetSaved(true);
+  return true;
+}
 
-              if (fsfile)
-              {
-                // The data for gnuplot is likely to change in its entirety if it
-                // ever changes => We can store it in a compressed form.
-                if(name.EndsWith(wxT(".data")))
-                  zip.SetLevel(9);
-                else
-                  zip.SetLevel(0);
+void Worksheet::ExportToWXMXInBackground(const wxString &file, bool markAsSaved,
+                                         std::function<void(int)> onProgress,
+                                         std::function<void(bool)> onFinished)
+{
+  // Only one save at a time may write to the disk, and only the newest one may
+  // rebase the autosave journal.
+  FinishBackgroundSave();
 
-                zip.PutNextEntry(name);
-                std::unique_ptr<wxInputStream> imagefile(fsfile->GetStream());
+  std::shared_ptr<WXMXSnapshot> snapshot = TakeWXMXSnapshot();
+  unsigned long changeCount = m_changeCount;
+  auto finished = [this, snapshot, file, markAsSaved, changeCount, onFinished](bool success) {
+    // Temp files aren't the user's document => the journal mustn't be based on them.
+    success = WXMXSnapshotWritten(*snapshot, file, success, markAsSaved);
+    // If the worksheet has been changed while it was saved the file is
+    // outdated already.
+    if (success && markAsSaved && (changeCount == m_changeCount))
+      SetSaved(true);
+    if (onFinished)
+      onFinished(success);
+  };
 
-                while (!(imagefile->Eof()))
-                  imagefile->Read(zip);
-              }
-            }
-            wxMemoryFSHandler::RemoveFile(name);
-            memFsName = fsystem->FindNext();
-          }
-        }
-      }
-      if(!zip.Close())
-        return false;
+#ifdef HAVE_OPENMP_TASKS
+  auto save = std::make_shared<BackgroundSave>();
+  save->finished = finished;
+  m_backgroundSave = save;
+  // The progress is reported in the GUI thread.
+  if (onProgress)
+    snapshot->SetProgressCallback([this, onProgress](int percent) {
+        CallAfter([onProgress, percent]{onProgress(percent);});
+      });
+  wxString target = file;
+  #pragma omp task firstprivate(snapshot, target, save)
+  {
+    bool success = snapshot->Write(target);
+    #pragma omp critical (WorksheetBackgroundSave)
+    {
+      save->success = success;
+      save->done = true;
     }
-    if (!out.Close())
-      return false;
+    // Unless the next save has finished this one already
+    CallAfter([this, save]{
+        if (m_backgroundSave == save)
+          FinishBackgroundSave();
+      });
   }
-  // If all data is saved now we can overwrite the actual save file.
-  // We will try to do so a few times if we suspect a MSW virus scanner or similar
-  // temporarily hindering us from doing so.
-  
-  // The following line is paranoia as closing (and thus writing) the file has
-  // succeeded.
-  if(!wxFileExists(backupfile))
-    return false;
-  
-  // Now we try to open the file in order to see if saving hasn't failed
-  // without returning an error - which can apparently happen on MSW.
-  wxString wxmxURI = wxURI(wxT("file://") + backupfile).BuildURI();
-  wxmxURI.Replace("#", "%23");
-#ifdef  __WXMSW__
-  // Fixes a missing "///" after the "file:". This works because we always get absolute
-  // file names.
-  wxRegEx uriCorector1("^file:([a-zA-Z]):");
-  wxRegEx uriCorector2("^file:([a-zA-Z][a-zA-Z]):");
-  uriCorector1.ReplaceFirst(&wxmxURI,wxT("file:///\\1:"));
-  uriCorector2.ReplaceFirst(&wxmxURI,wxT("file:///\\1:"));
+#else
+  wxBusyCursor crs;
+  snapshot->SetProgressCallback(onProgress);
+  finished(snapshot->Write(file));
 #endif
-  // The URI of the wxm code contained within the .wxmx file
-  wxString filename = wxmxURI + wxT("#zip:content.xml");
+}
 
-  // Open the file we have saved yet just in order to see if we
-  // actually managed to save it correctly.
+void Worksheet::FinishBackgroundSave()
+{
+  std::shared_ptr<BackgroundSave> save;
+  save.swap(m_backgroundSave);
+  if (!save)
+    return;
+
+  bool done, success;
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp critical (WorksheetBackgroundSave)
+  #endif
+  done = save->done;
+  if (!done)
   {
-    wxFileSystem fs;
-    wxFSFile *fsfile;
-#ifdef HAVE_OPENMP_TASKS
-#pragma omp critical (OpenFSFile)
-#endif
-    fsfile = fs.OpenFile(filename);
-    
-    // Did we succeed in opening the file?
-    if (!fsfile)
+    #ifdef HAVE_OPENMP_TASKS
+    #pragma omp taskwait
+    #endif
+  }
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp critical (WorksheetBackgroundSave)
+  #endif
+  success = save->success;
+  save->finished(success);
+}
+
+bool Worksheet::AppendToAutosaveJournal(const wxString &file)
+{
+  if (!m_autosaveJournal.CanAppend(file))
+    return false;
+
+  wxString header = WXMXContentHeader();
+  std::vector<AutosaveJournal::OrderEntry> order;
+  std::vector<AutosaveJournal::ChangedCell> cells;
+  bool valid = true;
+  m_cellPointers.WXMXResetCounter();
+  for (GroupCell *cell = GetTree(); cell != NULL; cell = cell->GetNext())
+  {
+    order.push_back({cell->GetId(), cell->GetHighlight()});
+    wxString cellXML = cell->ToXML();
+    size_t hash = wxStringHash()(cellXML);
+    if (m_autosaveJournal.CellChanged(cell->GetId(), hash))
     {
-      wxLogMessage(_(wxT("Saving succeeded, but the file could not be read again \u21D2 Not replacing the old saved file.")));
-      return false;
+      if (!WXMXSnapshot::IsValidContentXML(cellXML, false))
+      {
+        valid = false;
+        break;
+      }
+      cells.push_back({cell->GetId(), hash, cellXML});
     }
-    wxDELETE(fsfile);
   }
-  
+
+  // Only the images and gnuplot files the journal doesn't know yet need to be written.
+  std::vector<std::pair<wxString, SharedBlob>> blobs;
+  for (auto const &blob : m_cellPointers.WXMXBlobs())
   {
-    bool done;
-    SuppressErrorDialogs suppressor;
-    done = wxRenameFile(backupfile, file, true);
-    if(!done)
-    {
-      // We might have failed to move the file because an over-eager virus scanner wants to
-      // scan it and a design decision of a filesystem driver might hinder us from moving
-      // it during this action => Wait for a second and retry.
-      wxSleep(1);
-      done = wxRenameFile(backupfile, file, true);
-    }
-    if(!done)
-    {
-      // We might have failed to move the file because an over-eager virus scanner wants to
-      // scan it and a design decision of a filesystem driver might hinder us from moving
-      // it during this action => Wait for a second and retry.
-      wxSleep(1);
-      done = wxRenameFile(backupfile, file, true);
-    }
-    if(!done)
-    {
-      wxSleep(1);
-      if (!wxRenameFile(backupfile, file, true))
-        return false;
-    }
-    if (markAsSaved)
-      SetSaved(true);
-    
-    wxLogMessage(_("wxmx file saved"));
+    if (!m_autosaveJournal.HasBlob(blob.first))
+      blobs.emplace_back(blob.first, blob.second);
   }
+  m_cellPointers.WXMXResetCounter();
+
+  // If we produced invalid XML ExportToWXMX() will tell the user about it.
+  if (!valid)
+    return false;
+
+  if (!m_autosaveJournal.Append(header, order, cells, blobs))
+    return false;
+  wxLogMessage(wxString::Format(_("Autosave: %li changed cells recorded in the journal of %s"),
+                                static_cast<long>(cells.size()), file.utf8_str()));
   return true;
 }
 
@@ -6394,6 +6549,7 @@ bool Worksheet::ActivateNextInput(bool input)
 //
 void Worksheet::AddDocumentToEvaluationQueue()
 {
+  FinishLoading();
   FollowEvaluation(true);
   for (GroupCell *tmp = GetTree(); tmp; tmp = tmp->GetNext())
     AddToEvaluationQueue(tmp);
@@ -6403,6 +6559,7 @@ void Worksheet::AddDocumentToEvaluationQueue()
 
 void Worksheet::AddToEvaluationQueue(GroupCell *cell)
 {
+  FinishLoading();
   if (cell->GetGroupType() == GC_TYPE_CODE)
   {
     // Gray out the output of the cell in order to mark it as "not current".
@@ -6420,6 +6577,7 @@ void Worksheet::AddToEvaluationQueue(GroupCell *cell)
  */
 void Worksheet::AddEntireDocumentToEvaluationQueue()
 {
+  FinishLoading();
   FollowEvaluation(true);
   for (GroupCell *tmp = GetTree(); tmp; tmp = tmp->GetNext())
   {
@@ -6431,6 +6589,7 @@ void Worksheet::AddEntireDocumentToEvaluationQueue()
 
 void Worksheet::AddSectionToEvaluationQueue(GroupCell *start)
 {
+  FinishLoading();
   // Find the begin of the current section
   start = StartOfSectioningUnit(start);
 
@@ -6441,6 +6600,7 @@ void Worksheet::AddSectionToEvaluationQueue(GroupCell *start)
 
 void Worksheet::AddRestToEvaluationQueue()
 {
+  FinishLoading();
   GroupCell *start = {};
   if (HasCellsSelected())
     start = m_cellPointers.m_selectionStart->GetGroup();
@@ -6462,12 +6622,14 @@ void Worksheet::AddRestToEvaluationQueue()
 
 void Worksheet::AddSelectionToEvaluationQueue()
 {
+  FinishLoading();
   AddSelectionToEvaluationQueue(m_cellPointers.m_selectionStart.CastAs<GroupCell*>(),
                                 m_cellPointers.m_selectionEnd.CastAs<GroupCell*>());
 }
 
 void Worksheet::AddSelectionToEvaluationQueue(GroupCell *start, GroupCell *end)
 {
+  FinishLoading();
   FollowEvaluation(true);
   if (!start || !end)
     return;
@@ -6483,6 +6645,7 @@ void Worksheet::AddSelectionToEvaluationQueue(GroupCell *start, GroupCell *end)
 
 void Worksheet::AddDocumentTillHereToEvaluationQueue()
 {
+  FinishLoading();
   FollowEvaluation(true);
   GroupCell *stop = m_hCaretActive ? m_hCaretPosition : nullptr;
   if (!stop) {
@@ -6506,6 +6669,7 @@ void Worksheet::AddDocumentTillHereToEvaluationQueue()
 
 void Worksheet::AddCellToEvaluationQueue(GroupCell *gc)
 {
+  FinishLoading();
   AddToEvaluationQueue(gc);
   SetHCaret(gc);
 }
@@ -6543,6 +6707,8 @@ void Worksheet::ScrollToCellIfNeeded()
   if(!m_cellPointers.m_scrollToCell)
     return;
   m_cellPointers.m_scrollToCell = false;
+  if (m_configuration->Headless())
+    return;
 
   RecalculateIfNeeded();
 
@@ -6622,6 +6788,7 @@ void Worksheet::ScrollToCellIfNeeded()
 
 void Worksheet::Undo()
 {
+  FinishLoading();
   if (CanUndoInsideCell())
   {
     UndoInsideCell();
@@ -6692,6 +6859,7 @@ bool Worksheet::CanTreeRedo() const
 
 void Worksheet::Redo()
 {
+  FinishLoading();
   if (CanRedoInsideCell())
   {
     RedoInsideCell();
@@ -6809,6 +6977,7 @@ bool Worksheet::TreeUndoTextChange(UndoActions *sourcelist, UndoActions *undoFor
 
 bool Worksheet::TreeUndo(UndoActions *sourcelist, UndoActions *undoForThisOperation)
 {
+  FinishLoading();
   if (sourcelist->empty())
     return false;
 
@@ -7021,6 +7190,7 @@ void Worksheet::ShowPoint(wxPoint point)
 
 bool Worksheet::CutToClipboard()
 {
+  FinishLoading();
   if (GetActiveCell())
   {
     GetActiveCell()->CutToClipboard();
@@ -7050,6 +7220,7 @@ bool Worksheet::CutToClipboard()
  */
 void Worksheet::PasteFromClipboard()
 {
+  FinishLoading();
   bool cells = false;
 
   // Check for cell structure
@@ -7444,6 +7615,7 @@ void Worksheet::SaveValue()
 
 void Worksheet::RemoveAllOutput()
 {
+  FinishLoading();
   // We don't want to remove all output if maxima is currently evaluating.
   if (GetWorkingGroup())
     return;
@@ -7466,6 +7638,7 @@ void Worksheet::RemoveAllOutput()
 
 void Worksheet::RemoveAllOutput(GroupCell *cell)
 {
+  FinishLoading();
   if (!cell)
     cell = GetTree();
 
@@ -7593,19 +7766,37 @@ wxString Worksheet::GetOutputAboveCaret()
   return output;
 }
 
-bool Worksheet::FindIncremental(const wxString &str, bool down, bool ignoreCase)
+bool Worksheet::FindIncremental(const wxString &str, bool down, bool ignoreCase, bool regex)
 {
+  FinishLoading();
   if (SearchStart())
   {
     SetActiveCell(SearchStart());
     SearchStart()->CaretToPosition(IndexSearchStartedAt());
   }
 
-  return (!str.empty()) ? FindNext(str, down, ignoreCase, false) : true;
+  return (!str.empty()) ? FindNext(str, down, ignoreCase, regex, false) : true;
 }
 
-bool Worksheet::FindNext(const wxString &str, bool down, bool ignoreCase, bool warn)
+std::vector<EditorCell *> Worksheet::UpdateSearchIndex()
 {
+  std::vector<EditorCell *> editors;
+  m_searchIndex.BeginUpdate();
+  for (GroupCell *group = GetTree(); group; group = group->GetNext())
+  {
+    EditorCell *editor = group->GetEditable();
+    if (!editor)
+      continue;
+    m_searchIndex.Add(editor, editor->GetTextRevision(), editor->GetValue());
+    editors.push_back(editor);
+  }
+  m_searchIndex.EndUpdate();
+  return editors;
+}
+
+bool Worksheet::FindNext(const wxString &str, bool down, bool ignoreCase, bool regex, bool warn)
+{
+  FinishLoading();
   if (!GetTree())
     return false;
 
@@ -7649,58 +7840,43 @@ bool Worksheet::FindNext(const wxString &str, bool down, bool ignoreCase, bool w
 
   pos->GetEditable()->SearchStartedHere(pos->GetEditable()->GetCaretPosition());
 
-  // Remember where to go if we need to wrapp the search.
-  GroupCell *start = pos;
-
-  bool wrappedSearch = false;
-  while (pos != start || !wrappedSearch)
-  {
-    EditorCell *editor = pos->GetEditable();
+  std::vector<EditorCell *> editors = UpdateSearchIndex();
+  SearchIndex::Query query;
+  query.text = str;
+  query.ignoreCase = ignoreCase;
+  query.regex = regex;
+  if (!m_searchIndex.Search(query))
+    return false;
 
-    if (editor)
-    {
-      bool found = editor->FindNext(str, down, ignoreCase);
+  size_t startText = std::find(editors.begin(), editors.end(), pos->GetEditable()) - editors.begin();
+  size_t startPos = pos->GetEditable()->GetSearchStart(down);
+  SearchIndex::Match match;
+  if (!m_searchIndex.FindNext(startText, startPos, down, match))
+    return false;
 
-      if (found)
-      {
-        int strt, end;
-        editor->GetSelection(&strt, &end);
-        SetActiveCell(editor);
-        editor->SetSelection(strt, end);
-        ScrollToCaret();
-        UpdateTableOfContents();
-        RequestRedraw();
-        if ((wrappedSearch) && warn)
-        {
-          LoggingMessageDialog dialog(m_findDialog,
-                                 _("Wrapped search"),
-                                 wxEmptyString, wxCENTER | wxOK);
-          dialog.ShowModal();
-        }
-        return true;
-      }
-    }
+  // Has the search passed the end of the worksheet?
+  bool wrappedSearch;
+  if (down)
+    wrappedSearch = (match.text < startText) ||
+      ((match.text == startText) && (match.start < startPos));
+  else
+    wrappedSearch = (match.text > startText) ||
+      ((match.text == startText) && (match.start >= startPos));
 
-    if (down)
-    {
-      pos = pos->GetNext();
-      if (!pos)
-      {
-        wrappedSearch = true;
-        pos = GetTree();
-      }
-    }
-    else
-    {
-      pos = pos->GetPrevious();
-      if (!pos)
-      {
-        wrappedSearch = true;
-        pos = m_last;
-      }
-    }
+  EditorCell *editor = editors[match.text];
+  SetActiveCell(editor);
+  editor->SetSelection(match.start, match.start + match.length);
+  ScrollToCaret();
+  UpdateTableOfContents();
+  RequestRedraw();
+  if ((wrappedSearch) && warn)
+  {
+    LoggingMessageDialog dialog(m_findDialog,
+                                _("Wrapped search"),
+                                wxEmptyString, wxCENTER | wxOK);
+    dialog.ShowModal();
   }
-  return false;
+  return true;
 }
 
 bool Worksheet::CaretVisibleIs()
@@ -7743,6 +7919,8 @@ bool Worksheet::ScrollToCaretIfNeeded()
     return false;
 
   m_scrollToCaret = false;
+  if (m_configuration->Headless())
+    return false;
   
   RecalculateIfNeeded();
   if (m_hCaretActive)
@@ -7773,12 +7951,30 @@ bool Worksheet::ScrollToCaretIfNeeded()
   return true;
 }
 
-void Worksheet::Replace(const wxString &oldString, const wxString &newString, bool ignoreCase)
+void Worksheet::Replace(const wxString &oldString, const wxString &newString, bool ignoreCase,
+                        bool regex)
 {
+  FinishLoading();
   if (!GetActiveCell())
     return;
 
-  if (GetActiveCell()->ReplaceSelection(oldString, newString, false, ignoreCase))
+  bool replaced;
+  if (regex)
+  {
+    // The selection is replaced only if the regular expression matches all of it
+    SearchIndex::Query query;
+    query.text = oldString;
+    query.ignoreCase = ignoreCase;
+    query.regex = true;
+    wxString selection = GetActiveCell()->GetSelectionString();
+    wxString replacement;
+    replaced = SearchIndex::ReplaceRegexMatch(selection, query, newString, replacement) &&
+      GetActiveCell()->ReplaceSelection(selection, replacement, false, false);
+  }
+  else
+    replaced = GetActiveCell()->ReplaceSelection(oldString, newString, false, ignoreCase);
+
+  if (replaced)
   {
     SetSaved(false);
     GroupCell *group = GetActiveCell()->GetGroup();
@@ -7791,27 +7987,36 @@ void Worksheet::Replace(const wxString &oldString, const wxString &newString, bo
   GetActiveCell()->SearchStartedHere();
 }
 
-int Worksheet::ReplaceAll(const wxString &oldString, const wxString &newString, bool ignoreCase)
+int Worksheet::ReplaceAll(const wxString &oldString, const wxString &newString, bool ignoreCase,
+                          bool regex)
 {
+  FinishLoading();
   m_cellPointers.ResetSearchStart();
 
-  if (!GetTree())
+  if (!GetTree() || oldString.IsEmpty())
+    return 0;
+
+  std::vector<EditorCell *> editors = UpdateSearchIndex();
+  SearchIndex::Query query;
+  query.text = oldString;
+  query.ignoreCase = ignoreCase;
+  query.regex = regex;
+  if (!m_searchIndex.Search(query))
     return 0;
 
+  // The new texts are assembled in parallel, but the cells may only be
+  // restyled by the main thread.
   int count = 0;
-  for (GroupCell *tmp = GetTree(); tmp; tmp = tmp->GetNext())
-  {
-    EditorCell *editor = tmp->GetEditable();
-    if (editor)
-    {
-      int replaced = editor->ReplaceAll(oldString, newString, ignoreCase);
-      if (replaced > 0)
-      {
-        count += replaced;
-        tmp->ResetInputLabel();
-        tmp->ResetSize();
-      }
-    }
+  for (auto const &replacement : m_searchIndex.ReplaceAll(newString))
+  {
+    if (replacement.count == 0)
+      continue;
+    EditorCell *editor = editors[replacement.text];
+    editor->ReplaceAll(replacement.newText);
+    count += replacement.count;
+    GroupCell *group = editor->GetGroup();
+    group->ResetInputLabel();
+    group->ResetSize();
   }
 
   if (count > 0)
@@ -8078,6 +8283,7 @@ void Worksheet::OnComplete(wxCommandEvent &event)
 
 void Worksheet::SetActiveCellText(const wxString &text)
 {
+  FinishLoading();
   EditorCell *active = GetActiveCell();
   if (active)
   {
@@ -8102,6 +8308,7 @@ void Worksheet::SetActiveCellText(const wxString &text)
 
 bool Worksheet::InsertText(const wxString &text)
 {
+  FinishLoading();
   CloseAutoCompletePopup();
 
   if (GetActiveCell())
@@ -37,9 +37,13 @@
 #include <wx/textfile.h>
 #include <wx/fdrepdlg.h>
 #include <wx/dc.h>
+#include <functional>
 #include <list>
+#include <memory>
 
+#include "AutosaveJournal.h"
 #include "CellPointers.h"
+#include "WXMXSnapshot.h"
 #include "VariablesPane.h"
 #include "Notification.h"
 #include "Cell.h"
@@ -48,6 +52,7 @@
 #include "TextCell.h"
 #include "EvaluationQueue.h"
 #include "FindReplaceDialog.h"
+#include "SearchIndex.h"
 #include "Autocomplete.h"
 #include "AutocompletePopup.h"
 #include "TableOfContents.h"
@@ -95,6 +100,53 @@ private:
   bool m_scrollToCaret;
   //! The pointers to cells that can be deleted by these cells on deletion of the cells.
   CellPointers m_cellPointers;
+  //! Records the changes since the last time the worksheet was saved as .wxmx
+  AutosaveJournal m_autosaveJournal;
+  //! The matches of the last search in the editable cells
+  SearchIndex m_searchIndex;
+  /*! Tells m_searchIndex which editable cells the worksheet consists of
+
+    \return The editor of each text of m_searchIndex
+  */
+  std::vector<EditorCell *> UpdateSearchIndex();
+  //! The XML code the content.xml of a .wxmx file starts with
+  wxString WXMXContentHeader();
+  //! Copies everything a .wxmx file consists of
+  std::shared_ptr<WXMXSnapshot> TakeWXMXSnapshot();
+  /*! Does what needs to be done in the GUI thread after a snapshot has been written
+
+    \param snapshot The snapshot
+    \param file The file it has been written to
+    \param success Has writing the file succeeded?
+    \param updateJournal true = the autosave journal is based on the new file
+    \return success
+  */
+  bool WXMXSnapshotWritten(WXMXSnapshot &snapshot, const wxString &file,
+                           bool success, bool updateJournal);
+  //! A file ExportToWXMXInBackground() writes
+  struct BackgroundSave
+  {
+    //! What to do in the GUI thread once the file has been written
+    std::function<void(bool)> finished;
+    //! Is set by the task. Guarded by the WorksheetBackgroundSave critical section.
+    bool done = false;
+    bool success = false;
+  };
+  //! The background save whose finished() hasn't been called yet, if there is one
+  std::shared_ptr<BackgroundSave> m_backgroundSave;
+  /*! Waits for the background save to finish and calls its finished()
+
+    A save whose finished() is still queued as an event when the next save starts
+    must be finished first: Else it would rebase the autosave journal on an
+    outdated snapshot after the newer one has been written.
+  */
+  void FinishBackgroundSave();
+  //! Counts the calls to SetSaved(false)
+  unsigned long m_changeCount = 0;
+  //! The function SetLoading() has been called with
+  std::function<void()> m_finishLoading;
+  //! The layout signature the height hints of the cells are valid for. Empty = none.
+  wxString m_layoutHintSignature;
   // The x position to scroll to
   int m_newxPosition;
   // The y position to scroll to
@@ -456,6 +508,11 @@ private:
   void OnZoom(wxZoomGestureEvent &event);
   #endif
 
+  #if wxCHECK_VERSION(3,1,3)
+  //! Called if the window has been moved to a screen with a different resolution
+  void OnDPIChanged(wxDPIChangedEvent &event);
+  #endif
+
   void OnMouseExit(wxMouseEvent &event);
 
   void OnMouseEnter(wxMouseEvent &event);
@@ -654,6 +711,23 @@ public:
     with the print settings might be active.
    */
   Configuration *m_configuration;
+  /*! The copy of the selection the clipboard's deferred formats are generated from
+
+    The clipboard's data object only holds a weak reference to it: The
+    clipboard might keep its data object after this worksheet has been
+    destroyed, which deletes these cells and makes the deferred formats
+    unavailable.
+   */
+  struct ClipboardCells
+  {
+    //! The selected cells, in drawing order
+    std::unique_ptr<Cell> cells;
+    //! The selected cells, in data order
+    std::unique_ptr<Cell> cellsAsData;
+  };
+  std::shared_ptr<ClipboardCells> m_clipboardCells;
+  //! Start a new m_clipboardCells, invalidating the old one
+  std::shared_ptr<ClipboardCells> NewClipboardCells();
   //! The storage for the autocompletion feature
   AutoComplete m_autocomplete;
 
@@ -1063,6 +1137,8 @@ public:
 
   //! Convert the current selection to MathML
   wxString ConvertSelectionToMathML();
+  //! Convert a list of cells to MathML
+  static wxString CellsToMathML(const Cell *cells);
 
   //! Convert the current selection to a bitmap
   wxBitmap ConvertSelectionToBitmap();
@@ -1093,7 +1169,12 @@ public:
 
   void CalculateReorderedCellIndices(GroupCell *tree, int &cellIndex, std::vector<int> &cellMap);
 
-  //! Export the file to an html document
+  /*! Export the file to an html document
+
+    The HTML code is streamed to the file while it is generated. The images
+    are rendered in the main thread, but encoded and written to disk by
+    background tasks that run while the rest of the document is exported.
+   */
   bool ExportToHTML(const wxString &file);
 
   /*! Export a region of the file to a .wxm or .mac file maxima's load command can read
@@ -1113,6 +1194,64 @@ public:
   */
   bool ExportToWXMX(const wxString &file, bool markAsSaved = true);
 
+  /*! Record the changes since the last save in the autosave journal of a .wxmx file
+
+    Much faster than ExportToWXMX() as it only writes the cells that have changed.
+
+    \param file The .wxmx file the journal belongs to
+    \return false if the changes couldn't be recorded, which means that
+            ExportToWXMX() has to be used, instead: There is no .wxmx file
+            the journal could be based on or it is time for compacting the
+            journal into a new .wxmx file.
+  */
+  bool AppendToAutosaveJournal(const wxString &file);
+  //! Tell the autosave journal that the worksheet has just been loaded from a .wxmx file
+  void WXMXFileOpened(const wxString &file) { m_autosaveJournal.NewBase(file); }
+  //! Delete the autosave journal, as the user has discarded its changes
+  void DiscardAutosaveJournal() { m_autosaveJournal.Discard(); }
+
+  /*! Save the worksheet as .wxmx file in a background task
+
+    Only takes a snapshot of the worksheet in the GUI thread, which means that
+    the user can continue working while the file is written. Without OpenMP
+    tasks the file is written before this function returns.
+
+    \param file The file name
+    \param markAsSaved true = clear the worksheet's "modified" status, if it
+                       hasn't been modified while the file was written.
+    \param onProgress Is called in the GUI thread with the percentage of the
+                      file that has been written
+    \param onFinished Is called in the GUI thread when the file has been
+                      written. Its argument tells if saving has succeeded.
+  */
+  void ExportToWXMXInBackground(const wxString &file, bool markAsSaved,
+                                std::function<void(int)> onProgress,
+                                std::function<void(bool)> onFinished);
+
+  //! Is a .wxmx file being written by a background task?
+  bool IsSavingInBackground() const { return bool(m_backgroundSave); }
+
+  /*! Tell the worksheet that the rest of the file is still being loaded
+
+    \param finishLoading Loads the rest of the file. Is called before the user
+                         modifies, evaluates or saves the worksheet. An empty
+                         function means that the file is loaded completely.
+  */
+  void SetLoading(std::function<void()> finishLoading) { m_finishLoading = std::move(finishLoading); }
+  //! Is the rest of the file still being loaded?
+  bool IsLoading() const { return static_cast<bool>(m_finishLoading); }
+  //! If the rest of the file is still being loaded: Load it now.
+  void FinishLoading();
+
+  /*! Tell the worksheet that its cells use the heights stored in the file
+
+    \param signature The Configuration::LayoutSignature() the heights are valid
+                     for. As soon as it changes all cells are laid out exactly.
+  */
+  void SetLayoutHintSignature(const wxString &signature) { m_layoutHintSignature = signature; }
+  //! The layout signature the cells' height hints are valid for. Empty = none.
+  const wxString &GetLayoutHintSignature() const { return m_layoutHintSignature; }
+
   //! The start of a RTF document
   wxString RTFStart() const;
 
@@ -1317,12 +1456,16 @@ public:
   { return m_saved; }
 
   void SetSaved(bool saved)
-  { m_saved = saved; }
+  {
+    if (!saved)
+      m_changeCount++;
+    m_saved = saved;
+  }
 
   void OutputChanged()
     {
       if(m_currentFile.EndsWith(".wxmx"))
-        m_saved = false;
+        SetSaved(false);
     }
 
   void RemoveAllOutput();
@@ -1416,28 +1559,32 @@ public:
 
   /*! Do an incremental search from the cursor or the point the last search started at
 
-    Used by the find dialog.
-    \todo Keep a list of positions the last few letters were found at?
+    Used by the find dialog. As long as the search string is only extended only
+    the places the last search has found something at are looked at again.
    */
-  bool FindIncremental(const wxString &str, bool down, bool ignoreCase);
+  bool FindIncremental(const wxString &str, bool down, bool ignoreCase, bool regex);
 
   /*! Find the next occurrence of a string
 
-    Used by the find dialog.
+    Used by the find dialog. Only the cells that have changed since the last
+    search are searched again.
    */
-  bool FindNext(const wxString &str, bool down, bool ignoreCase, bool warn = true);
+  bool FindNext(const wxString &str, bool down, bool ignoreCase, bool regex, bool warn = true);
 
   /*! Replace the current occurrence of a string
 
     Used by the find dialog.
    */
-  void Replace(const wxString &oldString, const wxString &newString, bool ignoreCase);
+  void Replace(const wxString &oldString, const wxString &newString, bool ignoreCase, bool regex);
 
   /*! Replace all occurrences of a string
 
     Used by the find dialog.
    */
-  int ReplaceAll(const wxString &oldString, const wxString &newString, bool ignoreCase);
+  int ReplaceAll(const wxString &oldString, const wxString &newString, bool ignoreCase, bool regex);
+
+  //! The number of matches the last search has found in the whole worksheet
+  size_t GetSearchMatchCount() const { return m_searchIndex.GetMatchCount(); }
 
   wxString GetInputAboveCaret();
 
@@ -34,6 +34,7 @@
 #include <wx/cmdline.h>
 #include <wx/fileconf.h>
 #include <wx/sysopt.h>
+#include <wx/thread.h>
 #include "Dirstructure.h"
 #include <iostream>
 
@@ -68,7 +69,7 @@ int CommonMain()
     wxLogDebug("CellPtr: %zu live instances leaked", CellPtrBase::GetLiveInstanceCount());
   if(Observed::GetLiveInstanceCount() != 0)
     wxLogDebug("Cell:    %zu live instances leaked", Observed::GetLiveInstanceCount());
-  return 0;
+  return wxMaxima::GetExitCode();
 }
 
 #ifndef __WXMSW__
@@ -192,7 +193,11 @@ bool MyApp::OnInit()
       {wxCMD_LINE_SWITCH, "e", "eval",
        "evaluate the file after opening it.", wxCMD_LINE_VAL_NONE , 0},
       {wxCMD_LINE_SWITCH, "b", "batch",
-       "run the file and exit afterwards. Halts on questions and stops on errors.",  wxCMD_LINE_VAL_NONE, 0},
+       "run the file without displaying it and exit afterwards. Halts on questions and stops on errors, which displays the file.",  wxCMD_LINE_VAL_NONE, 0},
+      {wxCMD_LINE_OPTION, "j", "jobs",
+       "with --batch: evaluate up to <num> files at the same time, each using its own Maxima process. Default: the number of CPUs.",  wxCMD_LINE_VAL_NUMBER, 0},
+      {wxCMD_LINE_SWITCH, "", "reuse-maxima",
+       "with --batch: reset a Maxima process using kill(all) after it has evaluated a file and let it evaluate the next one instead of starting a new Maxima.",  wxCMD_LINE_VAL_NONE, 0},
                   {wxCMD_LINE_SWITCH, "", "logtostdout",
                    "Log all \"debug messages\" sidebar messages to stderr, too.",  wxCMD_LINE_VAL_NONE, 0},
                   {wxCMD_LINE_SWITCH, "", "pipe",
@@ -337,27 +342,52 @@ bool MyApp::OnInit()
     evalOnStartup = true;
 
   bool windowOpened = false;
-  
-  if (cmdLineParser.Found(wxT("o"), &file))
-  {
-    wxFileName FileName = file;
-    FileName.MakeAbsolute();
-    wxString canonicalFilename = FileName.GetFullPath();
-    NewWindow(canonicalFilename, evalOnStartup, exitAfterEval);
-    windowOpened = true;
-  }
 
-  if(cmdLineParser.GetParamCount() > 0)
+  if (exitAfterEval)
   {
+    wxArrayString files;
+    if (cmdLineParser.Found(wxT("o"), &file))
+      files.Add(file);
     for (unsigned int i=0; i < cmdLineParser.GetParamCount(); i++)
+      files.Add(cmdLineParser.GetParam(i));
+    for (auto &batchFile : files)
+    {
+      wxFileName FileName = batchFile;
+      FileName.MakeAbsolute();
+      batchFile = FileName.GetFullPath();
+    }
+
+    long jobs = wxThread::GetCPUCount();
+    cmdLineParser.Found(wxT("j"), &jobs);
+    if (!files.IsEmpty())
+    {
+      StartBatch(files, jobs, cmdLineParser.Found(wxT("reuse-maxima")));
+      windowOpened = true;
+    }
+  }
+  else
+  {
+    if (cmdLineParser.Found(wxT("o"), &file))
     {
-      wxFileName FileName = cmdLineParser.GetParam(i);
+      wxFileName FileName = file;
       FileName.MakeAbsolute();
-      
-      wxString CanonicalFilename = FileName.GetFullPath();
-      NewWindow(CanonicalFilename, evalOnStartup, exitAfterEval);
+      wxString canonicalFilename = FileName.GetFullPath();
+      NewWindow(canonicalFilename, evalOnStartup, exitAfterEval);
+      windowOpened = true;
+    }
+
+    if(cmdLineParser.GetParamCount() > 0)
+    {
+      for (unsigned int i=0; i < cmdLineParser.GetParamCount(); i++)
+      {
+        wxFileName FileName = cmdLineParser.GetParam(i);
+        FileName.MakeAbsolute();
+
+        wxString CanonicalFilename = FileName.GetFullPath();
+        NewWindow(CanonicalFilename, evalOnStartup, exitAfterEval);
+      }
+      windowOpened = true;
     }
-    windowOpened = true;
   }
 
   if(!windowOpened)
@@ -371,6 +401,68 @@ bool MyApp::OnInit()
   return true;
 }
 
+void MyApp::StartBatch(const wxArrayString &files, long jobs, bool reuseMaxima)
+{
+  for (auto const &file : files)
+    m_batchQueue.push_back(file);
+  m_batchJobs = wxMax(jobs, 1);
+  m_batchReuseMaxima = reuseMaxima;
+  m_batchStopWatch.Start();
+
+  while ((m_batchRunning < m_batchJobs) && !m_batchQueue.empty())
+  {
+    wxString file = m_batchQueue.front();
+    m_batchQueue.pop_front();
+    m_batchRunning++;
+    NewWindow(file, true, true);
+  }
+}
+
+wxString MyApp::BatchFileDone(const wxString &file, bool success, long milliseconds,
+                              bool maximaReusable)
+{
+  m_batchResults.push_back({file, success, milliseconds});
+
+  wxString next;
+  if (m_batchQueue.empty())
+    m_batchRunning--;
+  else
+  {
+    next = m_batchQueue.front();
+    m_batchQueue.pop_front();
+    if (!m_batchReuseMaxima || !maximaReusable)
+    {
+      NewWindow(next, true, true);
+      next.Clear();
+    }
+  }
+
+  if (m_batchRunning == 0)
+    ReportBatchSummary();
+  return next;
+}
+
+void MyApp::ReportBatchSummary() const
+{
+  // The timing of a single file has already been reported by its window.
+  if (m_batchResults.size() < 2)
+    return;
+
+  size_t failed = 0;
+  std::cout << _("Batch run summary:") << "\n";
+  for (auto const &result : m_batchResults)
+  {
+    if (!result.success)
+      failed++;
+    std::cout << wxString::Format(_("  %s: %s after %li ms"), result.file,
+                                  result.success ? _("done") : _("failed"),
+                                  result.milliseconds) << "\n";
+  }
+  std::cout << wxString::Format(_("%lu of %lu files failed, total time: %li ms"),
+                                (unsigned long)failed, (unsigned long)m_batchResults.size(),
+                                m_batchStopWatch.Time()) << "\n";
+}
+
 int MyApp::OnExit()
 {
   return 0;
@@ -424,8 +516,15 @@ void MyApp::NewWindow(const wxString &file, bool evalOnStartup, bool exitAfterEv
   m_topLevelWindows.push_back(frame);
 
   SetTopWindow(frame);
-  frame->Show(true);
-  frame->ShowTip(false);
+  // A batch run doesn't need to display the worksheet - unless it stops
+  // on an error or a question
+  if (exitAfterEval)
+    frame->Headless(true);
+  else
+  {
+    frame->Show(true);
+    frame->ShowTip(false);
+  }
 }
 
 void MyApp::OnFileMenu(wxCommandEvent &ev)
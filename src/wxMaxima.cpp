@@ -93,13 +93,14 @@
 #include <wx/wfstream.h>
 #include <wx/txtstrm.h>
 #include <wx/sckstrm.h>
-#include <wx/fs_mem.h>
 #include <wx/persist/toplevel.h>
 
 #include <wx/url.h>
 #include <wx/sstream.h>
+#include <wx/stopwatch.h>
 #include <list>
 #include <memory>
+#include <vector>
 
 #if defined __WXOSX__
 #define MACPREFIX "wxMaxima.app/Contents/Resources/"
@@ -203,7 +204,8 @@ wxMaxima::wxMaxima(wxWindow *parent, int id, wxLocale *locale, const wxString ti
   // Will be corrected by ConfigChanged()
   m_maxOutputCellsPerCommand = -1;
   m_exitAfterEval = false;
-  m_exitOnError = false;
+  m_batchMode = false;
+  m_batchEvalStart = 0;
   m_locale = locale;
   wxLogMessage(_("Selected language: ") + m_locale->GetCanonicalName() +
                " (" + wxString::Format("%i", m_locale->GetLanguage()) + ")");
@@ -248,9 +250,6 @@ wxMaxima::wxMaxima(wxWindow *parent, int id, wxLocale *locale, const wxString ti
   m_closing = false;
   m_fileSaved = true;
 
-
-  wxFileSystem::AddHandler(new wxMemoryFSHandler); // for saving wxmx
-
   UpdateRecentDocuments();
 
   m_worksheet->m_findDialog = NULL;
@@ -1441,13 +1440,16 @@ void wxMaxima::StripLispComments(wxString &s)
     m_blankStatementRegEx.Replace(&s, wxT(";"));
 }
 
-void wxMaxima::SendMaxima(wxString s, bool addToHistory)
+void wxMaxima::SendMaxima(wxString s, bool addToHistory, EditorCell *editor)
 {
   // Normally we catch parenthesis errors before adding cells to the
   // evaluation queue. But if the error is introduced only after the
   // cell is placed in the evaluation queue we need to catch it here.
-  int index;
-  wxString parenthesisError = GetUnmatchedParenthesisState(s,index);
+  // The editor has already analyzed its code, so this doesn't need to
+  // tokenize it again.
+  wxString parenthesisError;
+  if (editor)
+    parenthesisError = GetUnmatchedParenthesisState(editor);
   if (parenthesisError.IsEmpty())
   {
     s = m_worksheet->UnicodeToMaxima(s);
@@ -2245,6 +2247,7 @@ void wxMaxima::ReadFirstPrompt(wxString &data)
     {
       wxLogMessage(_("Starting evaluation of the document"));
       m_evalOnStartup = false;
+      m_batchEvalStart = m_batchStopWatch.Time();
       m_worksheet->AddDocumentToEvaluationQueue();
       EvaluationQueueLength(m_worksheet->m_evaluationQueue.Size(), m_worksheet->m_evaluationQueue.CommandsLeftInCell());
       TriggerEvaluation();
@@ -2256,7 +2259,10 @@ void wxMaxima::ReadFirstPrompt(wxString &data)
         m_worksheet->OpenNextOrCreateCell();
     }
     if (m_exitAfterEval && m_worksheet->m_evaluationQueue.Empty())
-      Close();
+    {
+      ReportBatchTiming(m_batchStopWatch.Time());
+      BatchFileDone(true);
+    }
   }
   else
     TriggerEvaluation();
@@ -2794,7 +2800,9 @@ void wxMaxima::ReadPrompt(wxString &data)
     m_outputCellsFromCurrentCommand = 0;
     if (m_worksheet->m_evaluationQueue.Empty())
     { // queue empty.
-      m_exitOnError = false;
+      // The other windows of a batch run still might need to exit on errors.
+      if (!m_batchMode)
+        m_exitOnError = false;
       StatusMaximaBusy(waiting);
       // If we have selected a cell in order to show we are evaluating it
       // we should now remove this marker.
@@ -2807,8 +2815,15 @@ void wxMaxima::ReadPrompt(wxString &data)
       m_worksheet->FollowEvaluation(false);
       if (m_exitAfterEval)
       {
-        SaveFile(false);
-        Close();
+        if (m_nextBatchFile.IsEmpty())
+          FinishBatchFile();
+        else
+        {
+          // Maxima has been reset => Start the next file of the batch run
+          wxString file = m_nextBatchFile;
+          m_nextBatchFile.Clear();
+          CallAfter([this, file]{EvaluateBatchFile(file);});
+        }
       }
       // Inform the user that the evaluation queue is empty.
       EvaluationQueueLength(0);
@@ -2832,9 +2847,6 @@ void wxMaxima::ReadPrompt(wxString &data)
       if ((m_worksheet->m_configuration->GetOpenHCaret()) && (m_worksheet->GetActiveCell() == NULL))
         m_worksheet->OpenNextOrCreateCell();
     }
-
-    if (m_exitAfterEval && m_worksheet->m_evaluationQueue.Empty())
-      Close();
   }
   else
   {  // We have a question
@@ -2868,6 +2880,13 @@ void wxMaxima::ReadPrompt(wxString &data)
     {
       m_worksheet->OpenQuestionCaret();
     }
+    // A batch run only continues on its own if the question is answered automatically.
+    if (m_worksheet->m_configuration->Headless())
+    {
+      EditorCell *answer = m_worksheet->GetCellPointers().m_answerCell.get();
+      if (!answer || answer->GetValue().IsEmpty() || !answer->GetGroup()->AutoAnswer())
+        Headless(false);
+    }
     StatusMaximaBusy(userinput);
   }
   o.Trim(false);
@@ -2946,9 +2965,9 @@ bool wxMaxima::OpenMACFile(const wxString &file, Worksheet *document, bool clear
   bool xMaximaFile = file.Lower().EndsWith(wxT(".out"));
 
   // open mac file
-  wxTextFile inputFile(file);
+  wxFFileInputStream inputFile(file);
 
-  if (!inputFile.Open())
+  if (!inputFile.IsOk())
   {
     LoggingMessageBox(_("wxMaxima encountered an error loading ") + file, _("Error"), wxOK | wxICON_EXCLAMATION);
     StatusMaximaBusy(waiting);
@@ -2959,7 +2978,10 @@ bool wxMaxima::OpenMACFile(const wxString &file, Worksheet *document, bool clear
   if (clearDocument)
     document->ClearDocument();
 
-  auto tree = Format::ParseMACFile(inputFile, xMaximaFile, &document->m_configuration);
+  Format::WXMLineReader lines(inputFile);
+  wxStopWatch stopwatch;
+  auto tree = Format::ParseMACFile(lines, xMaximaFile, &document->m_configuration);
+  wxLogMessage(wxString::Format(_("Parsing the .mac file took %li ms"), stopwatch.Time()));
 
   document->InsertGroupCells(tree, nullptr);
 
@@ -3001,9 +3023,9 @@ bool wxMaxima::OpenWXMFile(const wxString &file, Worksheet *document, bool clear
   wxWindowUpdateLocker noUpdates(document);
 
   // open wxm file
-  wxTextFile inputFile(file);
+  wxFFileInputStream inputFile(file);
 
-  if (!inputFile.Open())
+  if (!inputFile.IsOk())
   {
     LoggingMessageBox(_("wxMaxima encountered an error loading ") + file, _("Error"), wxOK | wxICON_EXCLAMATION);
     StatusMaximaBusy(waiting);
@@ -3011,16 +3033,19 @@ bool wxMaxima::OpenWXMFile(const wxString &file, Worksheet *document, bool clear
     return false;
   }
 
-  if (inputFile.GetFirstLine() != Format::WXMFirstLine)
+  Format::WXMLineReader lines(inputFile);
+  std::string firstLine;
+  lines.GetLine(firstLine);
+  if (Format::WXMTextToString(firstLine) != Format::WXMFirstLine)
   {
-    inputFile.Close();
     LoggingMessageBox(_("wxMaxima encountered an error loading ") + file, _("Error"), wxOK | wxICON_EXCLAMATION);
     return false;
   }
 
-  GroupCell *tree = Format::ParseWXMFile(inputFile,
+  wxStopWatch stopwatch;
+  GroupCell *tree = Format::ParseWXMFile(lines,
                                          &m_worksheet->m_configuration);
-  inputFile.Close();
+  wxLogMessage(wxString::Format(_("Parsing the .wxm file took %li ms"), stopwatch.Time()));
 
   // from here on code is identical for wxm and wxmx
   if (clearDocument)
@@ -3128,6 +3153,22 @@ bool wxMaxima::OpenWXMXFile(const wxString &file, Worksheet *document, bool clea
     return true;
   }
 
+  // If wxMaxima has crashed after an autosave the changes are in the file's journal.
+  if (AutosaveJournal::CrashDetected(file))
+  {
+    if (LoggingMessageBox(
+          wxString::Format(_("wxMaxima has not been closed properly while editing %s. "
+                             "Restore the changes that have been autosaved before?"), file),
+          _("Restore autosaved changes?"), wxYES_NO | wxICON_QUESTION, this) == wxYES)
+    {
+      if (AutosaveJournal::Replay(file))
+        wxLogMessage(wxString::Format(_("Restored the changes from the autosave journal of %s"),
+                                      file.utf8_str()));
+    }
+    else
+      AutosaveJournal::Remove(file);
+  }
+
   // open wxmx file
   wxXmlDocument xmldoc;
 
@@ -3348,18 +3389,41 @@ bool wxMaxima::OpenWXMXFile(const wxString &file, Worksheet *document, bool clea
   wxString doczoom = xmldoc.GetRoot()->GetAttribute(wxT("zoom"), wxT("100"));
 
   // Read the worksheet's contents.
-  wxXmlNode *xmlcells = xmldoc.GetRoot();
-  GroupCell *tree = CreateTreeFromXMLNode(xmlcells, wxmxURI);
-
-  // from here on code is identical for wxm and wxmx
+  //
+  // If we open a file we only convert the cells for the first screen now so the
+  // user sees them quickly. The rest of the cells is converted when wxMaxima is
+  // idle.
+  m_xmlLoadState.reset();
+  m_worksheet->SetLoading({});
+  std::unique_ptr<XMLLoadState> loadState;
+  GroupCell *tree;
+  wxString layoutSignature;
   if (clearDocument)
   {
-    document->ClearDocument();
-    StartMaxima();
     long int zoom = 100;
     if (!(doczoom.ToLong(&zoom)))
       zoom = 100;
     document->SetZoomFactor(double(zoom) / 100.0, false); // Set zoom if opening, don't recalculate
+
+    loadState = std::unique_ptr<XMLLoadState>(
+      new XMLLoadState(&m_worksheet->m_configuration, wxmxURI, xmldoc.DetachRoot()));
+    // The heights of the cells the file contains are only valid if it has
+    // been saved with the fonts, zoom factor and window width we use now.
+    layoutSignature = loadState->root->GetAttribute(wxT("layout"));
+    if (layoutSignature != m_worksheet->m_configuration->LayoutSignature())
+      layoutSignature.Clear();
+    loadState->parser->UseHeightHints(!layoutSignature.IsEmpty());
+    tree = CreateTreeFromXMLNodes(*loadState->parser, loadState->next, 50, loadState->warning);
+  }
+  else
+    tree = CreateTreeFromXMLNode(xmldoc.GetRoot(), wxmxURI);
+
+  // from here on code is identical for wxm and wxmx
+  if (clearDocument)
+  {
+    document->ClearDocument();
+    document->SetLayoutHintSignature(layoutSignature);
+    StartMaxima();
   }
 
   document->InsertGroupCells(tree); // this also requests a recalculate
@@ -3368,6 +3432,8 @@ bool wxMaxima::OpenWXMXFile(const wxString &file, Worksheet *document, bool clea
     m_worksheet->m_currentFile = file;
     ResetTitle(true, true);
     document->SetSaved(true);
+    // Even the first autosave only needs to append to the file's journal.
+    document->WXMXFileOpened(file);
   }
   else
     ResetTitle(false);
@@ -3391,6 +3457,23 @@ bool wxMaxima::OpenWXMXFile(const wxString &file, Worksheet *document, bool clea
     if (pos)
       m_worksheet->SetHCaret(pos);
   }
+
+  if (loadState && loadState->next && tree)
+  {
+    loadState->last = m_worksheet->GetLastCell();
+    // If the cursor is in a cell we haven't loaded, yet, we need to set it later.
+    if (ActiveCellNumber > 0)
+    {
+      long loadedCells = 0;
+      for (GroupCell *cell = m_worksheet->GetTree(); cell; cell = cell->GetNext())
+        loadedCells++;
+      if (ActiveCellNumber > loadedCells)
+        loadState->activeCellNumber = ActiveCellNumber;
+    }
+    m_xmlLoadState = std::move(loadState);
+    m_worksheet->SetLoading([this]{FinishLoadingXMLCells();});
+    RightStatusText(_("Loading the rest of the file"));
+  }
   StatusMaximaBusy(waiting);
 
   return true;
@@ -3487,51 +3570,178 @@ GroupCell *wxMaxima::CreateTreeFromXMLNode(wxXmlNode *xmlcells, const wxString &
   wxBusyCursor crs;
 
   MathParser mp(&m_worksheet->m_configuration, wxmxfilename);
-  GroupCell *tree = NULL;
-  GroupCell *last = NULL;
-
   bool warning = true;
 
   if (xmlcells)
     xmlcells = xmlcells->GetChildren();
 
-  while (xmlcells != NULL)
+  wxStopWatch stopwatch;
+  GroupCell *tree = CreateTreeFromXMLNodes(mp, xmlcells, -1, warning);
+  wxLogMessage(wxString::Format(_("Converting the XML to cells took %li ms"), stopwatch.Time()));
+  return tree;
+}
+
+//! Does the XML tree starting at node contain a tag named name?
+static bool ContainsXMLTag(const wxXmlNode *node, const wxString &name)
+{
+  for (; node != NULL; node = node->GetNext())
+  {
+    if ((node->GetType() == wxXML_ELEMENT_NODE) &&
+        ((node->GetName() == name) || ContainsXMLTag(node->GetChildren(), name)))
+      return true;
+  }
+  return false;
+}
+
+GroupCell *wxMaxima::CreateTreeFromXMLNodes(MathParser &mp, wxXmlNode *&xmlcells,
+                                            long maxCells, bool &warning)
+{
+  std::vector<wxXmlNode *> nodes;
+  for (; (xmlcells != NULL) && (maxCells != 0); xmlcells = xmlcells->GetNext())
   {
-    if (xmlcells->GetType() != wxXML_TEXT_NODE)
+    if (xmlcells->GetType() == wxXML_TEXT_NODE)
+      continue;
+    nodes.push_back(xmlcells);
+    if (maxCells > 0)
+      maxCells--;
+  }
+
+  // The top-level cells don't depend on each other, so batches of them can be
+  // converted in parallel, each by a MathParser of its own. Slideshows create
+  // a timer, though, which only the main thread may do => cells containing
+  // them are converted afterwards. For the same reason the text cells the
+  // tasks create are wrapped only when the main thread recalculates them.
+  std::vector<Cell *> cells(nodes.size(), NULL);
+  std::vector<char> convertLater(nodes.size(), false);
+  Configuration **configuration = &m_worksheet->m_configuration;
+  std::shared_ptr<wxFileSystem> filesystem = mp.GetFileSystem();
+  bool heightHints = mp.UsesHeightHints();
+  const size_t batchSize = 32;
+  for (size_t start = 0; start < nodes.size(); start += batchSize)
+  {
+    size_t end = wxMin(start + batchSize, nodes.size());
+    #ifdef HAVE_OPENMP_TASKS
+    #pragma omp task shared(nodes, cells, convertLater) firstprivate(start, end, configuration, filesystem, heightHints)
+    #endif
     {
-      Cell *mc;
-      mc = mp.ParseTag_(xmlcells, false);
-      if (mc != NULL)
+      MathParser parser(configuration, filesystem);
+      parser.UseHeightHints(heightHints);
+      for (size_t i = start; i < end; i++)
       {
-        GroupCell *cell = dynamic_cast<GroupCell *>(mc);
-
-        if (last == NULL)
-        {
-          // first cell
-          last = tree = cell;
-        }
+        if (ContainsXMLTag(nodes[i], wxT("slide")))
+          convertLater[i] = true;
         else
-        {
-          // The rest of the cells
-          last->m_next = cell;
-          last->SetNextToDraw(cell);
-          last->m_next->m_previous = last;
-
-          last = last->GetNext();
-        }
+          cells[i] = parser.ParseTag_(nodes[i], false);
       }
-      else if (warning)
+    }
+  }
+  #ifdef HAVE_OPENMP_TASKS
+  #pragma omp taskwait
+  #endif
+
+  // Stitch the cells together in document order
+  GroupCell *tree = NULL;
+  GroupCell *last = NULL;
+  for (size_t i = 0; i < nodes.size(); i++)
+  {
+    if (convertLater[i])
+      cells[i] = mp.ParseTag_(nodes[i], false);
+
+    GroupCell *cell = dynamic_cast<GroupCell *>(cells[i]);
+    if (cell == NULL)
+    {
+      wxDELETE(cells[i]);
+      if (warning)
       {
         LoggingMessageBox(_("Parts of the document will not be loaded correctly!"), _("Warning"),
-                     wxOK | wxICON_WARNING);
+                          wxOK | wxICON_WARNING);
         warning = false;
       }
+      continue;
+    }
+
+    if (last == NULL)
+    {
+      // first cell
+      last = tree = cell;
+    }
+    else
+    {
+      // The rest of the cells
+      last->m_next = cell;
+      last->SetNextToDraw(cell);
+      last->m_next->m_previous = last;
+
+      last = last->GetNext();
     }
-    xmlcells = xmlcells->GetNext();
   }
   return tree;
 }
 
+bool wxMaxima::LoadNextXMLCells(bool all)
+{
+  if (!m_xmlLoadState)
+    return false;
+
+  // If the cell we append to has been deleted the user has opened another
+  // file or has cleared the worksheet.
+  if (!m_xmlLoadState->last)
+  {
+    m_xmlLoadState.reset();
+    m_worksheet->SetLoading({});
+    return false;
+  }
+
+  // Don't block the user interface for longer than a few tens of milliseconds
+  // unless we are told to load everything.
+  // If the zoom factor, the fonts or the window width have changed since we
+  // started loading the heights the file contains are no more valid.
+  if (m_worksheet->GetLayoutHintSignature().IsEmpty())
+    m_xmlLoadState->parser->UseHeightHints(false);
+
+  wxStopWatch stopwatch;
+  while ((m_xmlLoadState->next != NULL) && (all || (stopwatch.Time() < 50)))
+  {
+    GroupCell *cells = CreateTreeFromXMLNodes(*m_xmlLoadState->parser, m_xmlLoadState->next,
+                                              all ? -1 : 100, m_xmlLoadState->warning);
+    if (cells)
+    {
+      // Appending the rest of the file doesn't modify the document, but
+      // edits the user has made while it was loading do.
+      bool wasSaved = m_worksheet->IsSaved();
+      m_xmlLoadState->last = m_worksheet->InsertGroupCells(cells, m_xmlLoadState->last, NULL);
+      if (wasSaved)
+        m_worksheet->SetSaved(true);
+    }
+  }
+  if (m_xmlLoadState->next != NULL)
+    return true;
+
+  // The file is loaded completely.
+  long activeCellNumber = m_xmlLoadState->activeCellNumber;
+  m_xmlLoadState.reset();
+  m_worksheet->SetLoading({});
+  ResetTitle(m_worksheet->IsSaved(), true);
+  // If the cursor was in a cell we hadn't loaded, yet, we can now move it there.
+  if (activeCellNumber > 0)
+  {
+    GroupCell *pos = m_worksheet->GetTree();
+    for (long i = 1; (i < activeCellNumber) && pos; i++)
+      pos = pos->GetNext();
+    if (pos)
+      m_worksheet->SetHCaret(pos);
+  }
+  m_worksheet->m_scheduleUpdateToc = true;
+  RightStatusText(_("File opened"));
+  return false;
+}
+
+void wxMaxima::FinishLoadingXMLCells()
+{
+  wxBusyCursor crs;
+  LoadNextXMLCells(true);
+}
+
 wxString wxMaxima::EscapeForLisp(wxString str)
 {
   str.Replace(wxT("\\"), wxT("\\\\"));
@@ -4355,7 +4565,9 @@ void wxMaxima::OnIdle(wxIdleEvent &event)
       {
         m_worksheet->FindIncremental(m_findData.GetFindString(),
                                      m_findData.GetFlags() & wxFR_DOWN,
-                                     !(m_findData.GetFlags() & wxFR_MATCHCASE));
+                                     !(m_findData.GetFlags() & wxFR_MATCHCASE),
+                                     m_findData.GetFlags() & FindReplacePane::regexFlag);
+        ShowSearchMatchCount();
       }
       
       m_worksheet->RequestRedraw();
@@ -4370,6 +4582,13 @@ void wxMaxima::OnIdle(wxIdleEvent &event)
     return;
   }
 
+  // Convert the next part of a file that is being opened.
+  if(LoadNextXMLCells())
+  {
+    event.RequestMore();
+    return;
+  }
+
   // If nothing which is visible has changed nothing that would cause us to need
   // update the menus and toolbars has.
   if (m_worksheet->UpdateControlsNeeded())
@@ -4923,6 +5142,7 @@ bool wxMaxima::OpenFile(const wxString &file, const wxString &command)
     {
       wxLogMessage(_("Starting evaluation of the document"));
       m_evalOnStartup = false;
+      m_batchEvalStart = m_batchStopWatch.Time();
       EvaluationQueueLength(m_worksheet->m_evaluationQueue.Size(), m_worksheet->m_evaluationQueue.CommandsLeftInCell());
       TriggerEvaluation();
     }
@@ -4938,7 +5158,7 @@ bool wxMaxima::OpenFile(const wxString &file, const wxString &command)
   return retval;
 }
 
-bool wxMaxima::SaveFile(bool forceSave)
+bool wxMaxima::SaveFile(bool forceSave, bool background)
 {
   // Show a busy cursor as long as we export a file.
   wxBusyCursor crs;
@@ -5026,6 +5246,26 @@ bool wxMaxima::SaveFile(bool forceSave)
           m_worksheet->m_currentFile = file;
       }
     }
+    else if (background)
+    {
+      // The user can continue working while the file is written.
+      m_worksheet->ExportToWXMXInBackground(
+        file, true,
+        [this](int percent){SaveProgress(percent);},
+        [this](bool saved){
+          m_saveProgress = -1;
+          if (saved)
+          {
+            RemoveTempAutosavefile();
+            StatusSaveFinished();
+          }
+          else
+            StatusSaveFailed();
+          ResetTitle(m_worksheet->IsSaved(), true);
+        });
+      if(file != m_tempfileName)
+        m_worksheet->m_currentFile = file;
+    }
     else
     {
       if (!m_worksheet->ExportToWXMX(file))
@@ -5045,7 +5285,8 @@ bool wxMaxima::SaveFile(bool forceSave)
     if(!m_exitAfterEval)
       m_recentDocuments.AddDocument(file);
     SetCWD(file);
-    StatusSaveFinished();
+    if (!m_worksheet->IsSavingInBackground())
+      StatusSaveFinished();
     UpdateRecentDocuments();
   }
 
@@ -5118,11 +5359,97 @@ void wxMaxima::ReadStdErr()
   }
 }
 
+void wxMaxima::Headless(bool headless)
+{
+  if (headless == m_worksheet->m_configuration->Headless())
+    return;
+
+  m_worksheet->m_configuration->Headless(headless);
+  if (!headless)
+  {
+    // Someone has to look at the worksheet => Lay it out and display it.
+    wxLogMessage(_("Displaying the worksheet"));
+    m_worksheet->RecalculateForce();
+    m_worksheet->m_configuration->AdjustWorksheetSize(true);
+    m_worksheet->RequestRedraw();
+    Show(true);
+  }
+}
+
+void wxMaxima::ReportBatchTiming(long evalEnd)
+{
+  wxString file = m_worksheet->m_currentFile;
+  if (file.IsEmpty())
+    file = _("unsaved document");
+  wxString report = wxString::Format(
+    _("%s: Startup and loading took %li ms, evaluation %li ms, saving %li ms"),
+    file, m_batchEvalStart, evalEnd - m_batchEvalStart, m_batchStopWatch.Time() - evalEnd);
+  wxLogMessage(report);
+  std::cout << report << "\n";
+}
+
+void wxMaxima::FinishBatchFile()
+{
+  long evalEnd = m_batchStopWatch.Time();
+  bool saved = SaveFile(false);
+  ReportBatchTiming(evalEnd);
+  BatchFileDone(saved);
+}
+
+void wxMaxima::BatchFileDone(bool success)
+{
+  if (!success)
+    m_exitCode = -1;
+
+  // After an error we don't know the state Maxima is in => Don't reuse it.
+  wxString next = wxGetApp().BatchFileDone(m_worksheet->m_currentFile, success,
+                                           m_batchStopWatch.Time(), success);
+  if (!success)
+    return;
+
+  if (next.IsEmpty())
+  {
+    Close();
+    return;
+  }
+
+  // Evaluate the next file using the Maxima we already have, once it has forgotten
+  // everything the last file has defined: kill(all) removes the values and
+  // functions and reset() sets the option variables back to their defaults.
+  // Both are sent as one command, as the next file is evaluated as soon as
+  // Maxima outputs its next prompt.
+  wxLogMessage(_("Resetting Maxima in order to evaluate %s"), next);
+  m_batchStopWatch.Start();
+  m_nextBatchFile = next;
+  SendMaxima(wxT("(reset(), kill(all))$"));
+}
+
+void wxMaxima::EvaluateBatchFile(const wxString &file)
+{
+  if (!OpenFile(file))
+  {
+    m_exitCode = -1;
+    wxGetApp().BatchFileDone(file, false, m_batchStopWatch.Time(), false);
+    m_fileSaved = true;
+    Close();
+    return;
+  }
+  wxLogMessage(_("Starting evaluation of the document"));
+  m_batchEvalStart = m_batchStopWatch.Time();
+  m_worksheet->AddDocumentToEvaluationQueue();
+  EvaluationQueueLength(m_worksheet->m_evaluationQueue.Size(), m_worksheet->m_evaluationQueue.CommandsLeftInCell());
+  if (m_worksheet->m_evaluationQueue.Empty())
+    FinishBatchFile();
+  else
+    TriggerEvaluation();
+}
+
 bool wxMaxima::AbortOnError()
 {
   // Maxima encountered an error.
   // The question is now if we want to try to send it something new to evaluate.
 
+  bool batchFileFailed = m_exitAfterEval;
   ExitAfterEval(false);
   EvalOnStartup(false);
 
@@ -5135,11 +5462,24 @@ bool wxMaxima::AbortOnError()
   }
 
   m_exitAfterEval = false;
+  // Let the other files of a batch run continue without us
+  if (batchFileFailed)
+    BatchFileDone(false);
   if(m_exitOnError)
   {
     wxMaxima::m_exitCode = -1;
+    if (m_batchMode)
+    {
+      // Other windows might still be evaluating their files => Close only this
+      // one, discarding its results like wxExit() would.
+      m_worksheet->m_evaluationQueue.Clear();
+      CallAfter([this]{m_fileSaved = true; Close();});
+      return true;
+    }
     wxExit();
   }
+  // The batch run has stopped => the user needs to see why.
+  Headless(false);
   if (m_worksheet->m_configuration->GetAbortOnError())
   {
     m_worksheet->m_evaluationQueue.Clear();
@@ -5333,6 +5673,11 @@ bool wxMaxima::AutoSave()
 {
   if(!SaveNecessary())
     return true;
+
+  // If the last save hasn't finished, yet, there is no need for another one.
+  // And if the file is still being loaded it doesn't contain any changes, yet.
+  if(m_worksheet->IsSavingInBackground() || m_worksheet->IsLoading())
+    return m_worksheet->IsSaved();
   
   bool savedWas = m_worksheet->IsSaved();
   wxString oldTempFile = m_tempfileName;
@@ -5345,28 +5690,40 @@ bool wxMaxima::AutoSave()
   if (m_worksheet->m_configuration->AutoSaveAsTempFile() ||
       m_worksheet->m_currentFile.IsEmpty())
   {
-    bool saved = m_worksheet->ExportToWXMX(m_tempfileName);
-
     wxLogMessage(wxString::Format(_("Autosaving as temp file %s"), m_tempfileName.utf8_str()));
-    if((m_tempfileName != oldTempFile) && saved)
-    {
-      if(!oldTempFile.IsEmpty())
-      {
-        if(wxFileExists(oldTempFile))
+    // The temp file is written in the background so the user can continue working.
+    wxString tempfileName = m_tempfileName;
+    m_worksheet->ExportToWXMXInBackground(
+      m_tempfileName, false,
+      [this](int percent){SaveProgress(percent);},
+      [this, tempfileName, oldTempFile](bool saved){
+        if((tempfileName != oldTempFile) && saved)
         {
-          SuppressErrorDialogs blocker;
-          wxLogMessage(wxString::Format(_("Trying to remove the old temp file %s"), oldTempFile.utf8_str()));
-          wxRemoveFile(oldTempFile);
+          if(!oldTempFile.IsEmpty())
+          {
+            if(wxFileExists(oldTempFile))
+            {
+              SuppressErrorDialogs blocker;
+              wxLogMessage(wxString::Format(_("Trying to remove the old temp file %s"), oldTempFile.utf8_str()));
+              wxRemoveFile(oldTempFile);
+            }
+          }
         }
-      }
-    }
+        SaveProgress(-1);
+      });
     RegisterAutoSaveFile();
   }
   else
   {
-    wxLogMessage(wxString::Format(_("Autosaving the .wxmx file as %s"),
-                                  m_worksheet->m_currentFile.utf8_str()));
-    savedWas = SaveFile(false);
+    // If the .wxmx file is up-to-date but for the changes we can record in
+    // its journal we don't need to re-write it. The file still counts as
+    // unsaved, then, as it doesn't contain the changes, yet.
+    if (!m_worksheet->AppendToAutosaveJournal(m_worksheet->m_currentFile))
+    {
+      wxLogMessage(wxString::Format(_("Autosaving the .wxmx file as %s"),
+                                    m_worksheet->m_currentFile.utf8_str()));
+      savedWas = SaveFile(false);
+    }
   }
 
   m_worksheet->SetSaved(savedWas);
@@ -5441,13 +5798,13 @@ void wxMaxima::FileMenu(wxCommandEvent &event)
     case wxID_SAVEAS:
       forceSave = true;
       m_fileSaved = false;
-      SaveFile(forceSave);
+      SaveFile(forceSave, true);
       // Seems like resetting the title on "file/save as" is a little bit
       // sluggish, otherwise.
       ResetTitle(m_worksheet->IsSaved(), true);
       break;
     case wxID_SAVE:
-      SaveFile(forceSave);
+      SaveFile(forceSave, true);
       // Seems like resetting the title on "file/save as" is a little bit
       // sluggish, otherwise.
       ResetTitle(m_worksheet->IsSaved(), true);
@@ -5973,8 +6330,17 @@ void wxMaxima::OnFind(wxFindDialogEvent &event)
 {
   if (!m_worksheet->FindNext(event.GetFindString(),
                            event.GetFlags() & wxFR_DOWN,
-                           !(event.GetFlags() & wxFR_MATCHCASE)))
+                           !(event.GetFlags() & wxFR_MATCHCASE),
+                           event.GetFlags() & FindReplacePane::regexFlag))
     LoggingMessageBox(_("No matches found!"));
+  ShowSearchMatchCount();
+}
+
+void wxMaxima::ShowSearchMatchCount()
+{
+  LeftStatusText(wxString::Format(_("%lu matches"),
+                                  static_cast<unsigned long>(m_worksheet->GetSearchMatchCount())),
+                 false);
 }
 
 void wxMaxima::OnFindClose(wxFindDialogEvent &WXUNUSED(event))
@@ -5989,17 +6355,20 @@ void wxMaxima::OnReplace(wxFindDialogEvent &event)
 {
   m_worksheet->Replace(event.GetFindString(),
                      event.GetReplaceString(),
-                     !(event.GetFlags() & wxFR_MATCHCASE)
+                     !(event.GetFlags() & wxFR_MATCHCASE),
+                     event.GetFlags() & FindReplacePane::regexFlag
   );
 
   if (!m_worksheet->FindNext(event.GetFindString(),
                            event.GetFlags() & wxFR_DOWN,
-                           !(event.GetFlags() & wxFR_MATCHCASE)
+                           !(event.GetFlags() & wxFR_MATCHCASE),
+                           event.GetFlags() & FindReplacePane::regexFlag
   )
           )
     LoggingMessageBox(_("No matches found!"));
   else
     m_worksheet->UpdateTableOfContents();
+  ShowSearchMatchCount();
 }
 
 void wxMaxima::OnReplaceAll(wxFindDialogEvent &event)
@@ -6007,7 +6376,8 @@ void wxMaxima::OnReplaceAll(wxFindDialogEvent &event)
   int count = m_worksheet->ReplaceAll(
           event.GetFindString(),
           event.GetReplaceString(),
-          !(event.GetFlags() & wxFR_MATCHCASE)
+          !(event.GetFlags() & wxFR_MATCHCASE),
+          event.GetFlags() & FindReplacePane::regexFlag
   );
 
   LoggingMessageBox(wxString::Format(_("Replaced %d occurrences."), count));
@@ -8422,6 +8792,8 @@ void wxMaxima::OnClose(wxCloseEvent &event)
   // We have saved the file and will close now => No need to have the
   // timer around any longer.
   m_autoSaveTimer.Stop();
+  // The changes the journal contains have been saved or discarded.
+  m_worksheet->DiscardAutosaveJournal();
   m_closing = true;
   wxConfigBase *config = wxConfig::Get();
   if (m_lastPath.Length() > 0)
@@ -9063,7 +9435,7 @@ void wxMaxima::EvaluateEvent(wxCommandEvent &WXUNUSED(event))
       // Add the answer to the current working cell or update the answer
       // that is stored within it.
       cell->SetAnswer(m_worksheet->GetLastQuestion(), answer);
-      SendMaxima(answer, true);
+      SendMaxima(answer, true, editor);
       StatusMaximaBusy(calculating);
       m_worksheet->SetHCaret(cell);
       m_worksheet->ScrollToCaret();
@@ -9087,98 +9459,51 @@ wxString wxMaxima::GetUnmatchedParenthesisState(wxString text,int &index)
 {
   text.Trim(true);
   text.Trim(false);
-  if(text.IsEmpty())
-    return (wxEmptyString);
-  if (text.EndsWith(wxT("\\")))
-    return (_("Cell ends in a backslash"));
-
-
-  index = 0;
-  bool endingNeeded = true;
-  wxChar lastnonWhitespace;
-  wxChar lastnonWhitespace_Next = wxT(' ');
-  std::list<wxChar> delimiters;
+  CodeStructure structure;
+  structure.Build(MaximaTokenizer(text, m_worksheet->m_configuration).PopTokens());
+  index = structure.GetErrorIndex();
+  return GetUnmatchedParenthesisState(structure);
+}
 
-  for (auto const &tok : MaximaTokenizer(text, m_worksheet->m_configuration).PopTokens())
+wxString wxMaxima::GetUnmatchedParenthesisState(EditorCell *editor)
+{
+  // The editor already knows the structure of its code, unless its text has
+  // been shortened for display
+  const CodeStructure *structure = editor->GetCodeStructure();
+  if (!structure)
   {
-    auto &itemText = tok.GetText();
-    const TextStyle itemStyle = tok.GetStyle();
-    index += itemText.Length();
-
-    lastnonWhitespace = lastnonWhitespace_Next;
-
-    // Handle comments
-    if(itemStyle == TS_CODE_COMMENT)
-    {
-      if(!itemText.EndsWith("*/"))
-        return (_("Unterminated comment."));
-      continue;
-    }
-
-    wxChar firstC = itemText[0];
-    wxChar lastC = itemText.Last();
-
-    // Remember the last non-whitespace character that isn't part
-    // of a comment.
-    if((firstC != ' ') && (firstC != '\t') && (firstC != '\r') && (firstC != '\n'))
-      lastnonWhitespace_Next = lastC;
-
-    // Handle opening parenthesis
-    if(itemText == "(")
-    {
-      delimiters.push_back(wxT(')'));
-      continue;
-    }
-    if(itemText == "[")
-    {
-      delimiters.push_back(wxT(']'));
-      continue;
-    }
-    if(itemText == "{")
-    {
-      delimiters.push_back(wxT('}'));
-      continue;
-    }
-
-    // Handle closing parenthesis
-    if((itemText == ')') || (itemText == ']') || (itemText == '}'))
-    {
-      endingNeeded = true;
-      if (delimiters.empty()) return (_("Mismatched parenthesis"));
-      if (firstC != delimiters.back()) return (_("Mismatched parenthesis"));
-      delimiters.pop_back();
-      if (lastnonWhitespace == wxT(','))
-        return (_("Comma directly followed by a closing parenthesis"));
-      continue;
-    }
-
-    if(itemStyle == TS_CODE_STRING)
-    {
-      endingNeeded = true;
-      if(!itemText.EndsWith("\""))
-        return (_("Unterminated string."));
-      continue;
-    }
-
-    if(itemStyle == TS_CODE_ENDOFLINE)
-    {
-      if(!delimiters.empty())
-        return _("Un-closed parenthesis on encountering ; or $");
-      endingNeeded = false;
-      continue;
-    }
-
-    if(itemStyle == TS_CODE_LISP)
-    {
-      endingNeeded = false;
-      continue;
-    }
+    int index;
+    return GetUnmatchedParenthesisState(editor->ToString(true), index);
   }
+  return GetUnmatchedParenthesisState(*structure);
+}
+
+wxString wxMaxima::GetUnmatchedParenthesisState(const CodeStructure &structure)
+{
+  if(structure.IsEmpty())
+    return (wxEmptyString);
+  if (structure.EndsInBackslash())
+    return (_("Cell ends in a backslash"));
 
-  if (!delimiters.empty())
+  switch (structure.GetError())
+  {
+  case CodeStructure::Error::unterminatedComment:
+    return (_("Unterminated comment."));
+  case CodeStructure::Error::mismatchedParenthesis:
+    return (_("Mismatched parenthesis"));
+  case CodeStructure::Error::commaBeforeClosingParenthesis:
+    return (_("Comma directly followed by a closing parenthesis"));
+  case CodeStructure::Error::unterminatedString:
+    return (_("Unterminated string."));
+  case CodeStructure::Error::unclosedParenthesisAtEnding:
+    return _("Un-closed parenthesis on encountering ; or $");
+  case CodeStructure::Error::unclosedParenthesis:
     return _("Un-closed parenthesis");
+  case CodeStructure::Error::none:
+    break;
+  }
 
-  if((endingNeeded) && (!m_worksheet->m_configuration->InLispMode()))
+  if((structure.EndingNeeded()) && (!m_worksheet->m_configuration->InLispMode()))
     return _("No dollar ($) or semicolon (;) at the end of command");
   else
     return wxEmptyString;
@@ -9271,8 +9596,7 @@ void wxMaxima::TriggerEvaluation()
   m_commandIndex = m_worksheet->m_evaluationQueue.GetIndex();
   if ((text != wxEmptyString) && (text != wxT(";")) && (text != wxT("$")))
   {
-    int index;
-    wxString parenthesisError = GetUnmatchedParenthesisState(tmp->GetEditable()->ToString(true),index);
+    wxString parenthesisError = GetUnmatchedParenthesisState(tmp->GetEditable());
     if (parenthesisError.IsEmpty())
     {
       if (m_worksheet->FollowEvaluation())
@@ -9289,7 +9613,7 @@ void wxMaxima::TriggerEvaluation()
       tmp->GetPrompt()->SetValue(m_lastPrompt);
 
       SendMaxima(m_configCommands);
-      SendMaxima(text, true);
+      SendMaxima(text, true, tmp->GetEditable());
       m_maximaBusy = true;
       // Now that we have sent a command we need to query all variable values anew
       m_varNamesToQuery = m_worksheet->m_variablesPane->GetEscapedVarnames();
@@ -9608,6 +9932,12 @@ void wxMaxima::InsertMenu(wxCommandEvent &event)
     m_worksheet->OpenHCaret(wxEmptyString, type);
 }
 
+void wxMaxima::SaveProgress(int percent)
+{
+  m_saveProgress = percent;
+  ResetTitle(m_worksheet->IsSaved(), true);
+}
+
 void wxMaxima::ResetTitle(bool saved, bool force)
 {
   SetRepresentedFilename(m_worksheet->m_currentFile);
@@ -9616,13 +9946,17 @@ void wxMaxima::ResetTitle(bool saved, bool force)
   if ((saved != m_fileSaved) || (force))
   {
     m_fileSaved = saved;
+    // Tell the user if the file is currently being saved in the background
+    wxString saveProgress;
+    if (m_saveProgress >= 0)
+      saveProgress = wxString::Format(_(" (saving: %i%%)"), m_saveProgress);
     if (m_worksheet->m_currentFile.Length() == 0)
     {
 #ifndef __WXOSX__
       if (saved)
-        SetTitle(wxString::Format(_("wxMaxima %s "), wxT(GITVERSION)) + _("[ unsaved ]"));
+        SetTitle(wxString::Format(_("wxMaxima %s "), wxT(GITVERSION)) + _("[ unsaved ]") + saveProgress);
       else
-        SetTitle(wxString::Format(_("wxMaxima %s "), wxT(GITVERSION)) + _("[ unsaved* ]"));
+        SetTitle(wxString::Format(_("wxMaxima %s "), wxT(GITVERSION)) + _("[ unsaved* ]") + saveProgress);
 #endif
     }
     else
@@ -9632,12 +9966,12 @@ void wxMaxima::ResetTitle(bool saved, bool force)
 #ifndef __WXOSX__
       if (m_fileSaved)
         SetTitle(wxString::Format(_("wxMaxima %s "), wxT(GITVERSION)) +
-                 wxT(" [ ") + name + wxT(".") + ext + wxT(" ]"));
+                 wxT(" [ ") + name + wxT(".") + ext + wxT(" ]") + saveProgress);
       else
         SetTitle(wxString::Format(_("wxMaxima %s "), wxT(GITVERSION)) +
-                 wxT(" [ ") + name + wxT(".") + ext + wxT("* ]"));
+                 wxT(" [ ") + name + wxT(".") + ext + wxT("* ]") + saveProgress);
 #else
-      SetTitle(name + wxT(".") + ext);
+      SetTitle(name + wxT(".") + ext + saveProgress);
 #endif
     }
 #if defined __WXOSX__
@@ -46,7 +46,10 @@
 #include <wx/txtstrm.h>
 #include <wx/sckstrm.h>
 #include <wx/buffer.h>
+#include <wx/stopwatch.h>
+#include <deque>
 #include <memory>
+#include <vector>
 #ifdef __WXMSW__
 #include <windows.h>
 #endif
@@ -89,6 +92,8 @@ public:
   static void ExitOnError(){m_exitOnError = true;}
   static void EnableIPC(){ MaximaIPC::EnableIPC(); }
   static void ExtraMaximaArgs(const wxString &args){m_extraMaximaArgs = args;}
+  //! The exit code the program returns: 0 = success
+  static int GetExitCode(){return m_exitCode;}
 
   //! An enum of individual IDs for all timers this class handles
   enum TimerIDs
@@ -146,16 +151,33 @@ public:
       m_exitAfterEval = exitaftereval;
       if(exitaftereval)
       {
+        m_batchMode = true;
         m_logPane->SetBatchMode();
       }
     }
   
+  /*! Evaluate the worksheet without displaying it?
+
+    A headless worksheet isn't laid out or drawn. Leaving headless mode shows
+    the window, which is what happens if a batch run stops on an error or on a
+    question it cannot answer itself.
+  */
+  void Headless(bool headless);
+
   void StripLispComments(wxString &s);
 
   //! Launches the help browser on the uri passed as an argument.
   void LaunchHelpBrowser(wxString uri);
   
-  void SendMaxima(wxString s, bool addToHistory = false);
+  /*! Sends code to maxima
+
+    \param s The code
+    \param addToHistory true = add the code to the history sidebar
+    \param editor The cell the code comes from. Its code structure tells if the
+                  code contains unmatched parenthesis. The commands wxMaxima
+                  generates itself aren't checked.
+  */
+  void SendMaxima(wxString s, bool addToHistory = false, EditorCell *editor = NULL);
 
   //! Open a file
   bool OpenFile(const wxString &file, const wxString &command ={});
@@ -243,6 +265,26 @@ private:
   bool m_evalOnStartup;
   //! Do we want to exit the program after the evaluation was successful?
   bool m_exitAfterEval;
+  //! Has this window been opened for evaluating files in batch mode?
+  bool m_batchMode;
+  //! Measures how long a batch run takes
+  wxStopWatch m_batchStopWatch;
+  //! When, according to m_batchStopWatch, the evaluation has been started
+  long m_batchEvalStart;
+  //! Tell the user how long loading, evaluating and saving the file took
+  void ReportBatchTiming(long evalEnd);
+  //! Save the file a batch run has evaluated and continue with the next file
+  void FinishBatchFile();
+  /*! Tell the application that the evaluation of a file in batch mode has ended
+
+    If the evaluation was successful this either closes the window or resets
+    Maxima so it can evaluate the next file the application hands us.
+  */
+  void BatchFileDone(bool success);
+  //! Open and evaluate a file using the Maxima process of a file evaluated before
+  void EvaluateBatchFile(const wxString &file);
+  //! The file to evaluate as soon as Maxima has been reset. Empty = none.
+  wxString m_nextBatchFile;
   //! Can we display the "ready" prompt right now?
   bool m_ready;
 
@@ -251,6 +293,10 @@ private:
     If text doesn't contain any error this function returns wxEmptyString
   */
   wxString GetUnmatchedParenthesisState(wxString text,int &index);
+  //! The unmatched-parenthesis type errors of the code in an editor
+  wxString GetUnmatchedParenthesisState(EditorCell *editor);
+  //! The unmatched-parenthesis type errors of code that has already been analyzed
+  wxString GetUnmatchedParenthesisState(const CodeStructure &structure);
   //! The buffer all text from maxima is stored in before converting it to a wxString.
   wxMemoryBuffer m_uncompletedChars;
 
@@ -380,6 +426,9 @@ protected:
   //! Is triggered when the "Replace All" button in the search dialog is pressed
   void OnReplaceAll(wxFindDialogEvent &event);
 
+  //! Displays the number of matches the last search has found in the status bar
+  void ShowSearchMatchCount();
+
   //! Is called if maxima connects to wxMaxima.
   void OnMaximaConnect();
   
@@ -602,6 +651,13 @@ protected:
    */
   void ResetTitle(bool saved, bool force = false);
 
+  /*! Show the progress of a save that runs in the background in the title bar
+
+    \param percent The percentage of the file that has been written, or -1
+                   if no save is running.
+   */
+  void SaveProgress(int percent);
+
   /*! Makes this window the debug log target of all windows from this maxima process
 
     Only necessary on the mac where the same process creates loads of windows.
@@ -629,11 +685,36 @@ protected:
   //! Loads a wxmx description
   GroupCell *CreateTreeFromXMLNode(wxXmlNode *xmlcells, const wxString &wxmxfilename = {});
 
+  /*! Converts up to maxCells cells of a wxmx description
+
+    \param mp The parser that converts the XML nodes
+    \param xmlcells The first node to convert. Is advanced to the first node that
+                    hasn't been converted.
+    \param maxCells The maximum number of cells to convert. -1 = all. The cells
+                    are converted in parallel, if possible.
+    \param warning true = warn the user if a cell cannot be read. Is set to false
+                   after the first warning.
+   */
+  GroupCell *CreateTreeFromXMLNodes(MathParser &mp, wxXmlNode *&xmlcells,
+                                    long maxCells, bool &warning);
+
+  /*! Converts the next chunk of cells of a .wxmx file that is being opened
+
+    \param all true = convert all remaining cells, not only as many as can be
+               converted without blocking the user interface.
+    \return true, if there are cells left to convert.
+   */
+  bool LoadNextXMLCells(bool all = false);
+  //! Converts all cells of a .wxmx file that haven't been converted, yet
+  void FinishLoadingXMLCells();
+
   /*! Saves the current file
 
     \param forceSave true means: Always ask for a file name before saving.
+    \param background true means: Write .wxmx files in a background task.
+                      The return value then only tells if saving has started.
    */
-  bool SaveFile(bool forceSave = false);
+  bool SaveFile(bool forceSave = false, bool background = false);
 
   //! Try to save the file before closing it - or return false 
   bool SaveOnClose();
@@ -734,6 +815,29 @@ protected:
   //! The directory with maxima's documentation
   wxString m_maximaDocDir;
   bool m_fileSaved;
+  //! The progress of a save that runs in the background, in percent. -1 = none.
+  int m_saveProgress = -1;
+  //! The part of a .wxmx file that is being opened that hasn't been converted to cells, yet
+  struct XMLLoadState
+  {
+    XMLLoadState(Configuration **config, const wxString &wxmxfilename, wxXmlNode *xmlroot) :
+      root(xmlroot), next(xmlroot ? xmlroot->GetChildren() : NULL),
+      parser(new MathParser(config, wxmxfilename))
+      {}
+    //! The document's root node. Owns all nodes.
+    std::unique_ptr<wxXmlNode> root;
+    //! The next node to convert
+    wxXmlNode *next;
+    std::unique_ptr<MathParser> parser;
+    //! The cell the next cells are inserted after. Becomes NULL if it is deleted.
+    CellPtr<GroupCell> last;
+    //! The cell the cursor is to be placed in once it has been loaded. -1 = none.
+    long activeCellNumber = -1;
+    //! Warn the user if a cell cannot be read?
+    bool warning = true;
+  };
+  //! The state of opening a .wxmx file, if we are doing so
+  std::unique_ptr<XMLLoadState> m_xmlLoadState;
   wxString m_maximaVersion;
   wxString m_maximaArch;
   wxString m_lispVersion;
@@ -802,6 +906,31 @@ public:
    */
   void NewWindow(const wxString &file = {}, bool evalOnStartup = false, bool exitAfterEval = false, unsigned char *wxmData = NULL, int wxmLen = 0);
 
+  /*! Evaluate files in batch mode
+
+    Each file is evaluated in a window of its own that is never displayed
+    unless the evaluation halts. At most jobs files are evaluated at the same
+    time, each by its own Maxima process.
+
+    \param files The files to evaluate
+    \param jobs The maximum number of files to evaluate concurrently
+    \param reuseMaxima true = A Maxima process that has evaluated a file
+           successfully is reset using kill(all) and then evaluates the next file
+           instead of being replaced by a freshly started one.
+   */
+  void StartBatch(const wxArrayString &files, long jobs, bool reuseMaxima);
+  /*! Called by a window whose evaluation in batch mode has ended
+
+    \param file The file that has been evaluated
+    \param success false = The evaluation has stopped on an error
+    \param milliseconds How long the file took
+    \param maximaReusable Can the window's Maxima evaluate another file?
+    \return The next file the window shall evaluate using its Maxima process.
+            Empty if there is none or if a new window has been opened for it.
+   */
+  wxString BatchFileDone(const wxString &file, bool success, long milliseconds,
+                         bool maximaReusable);
+
   static std::vector<wxMaxima *> m_topLevelWindows;
   static void DelistTopLevelWindow(wxMaxima *);
 
@@ -813,9 +942,31 @@ public:
   virtual void MacOpenFile(const wxString &file);
 
 private:
+  //! Print how long each file of a batch run took and which ones have failed
+  void ReportBatchSummary() const;
+
+  //! The outcome of evaluating a file in batch mode
+  struct BatchResult
+  {
+    wxString file;
+    bool success;
+    long milliseconds;
+  };
   //! The name of the config file. Empty = Use the default one.
   wxString m_configFileName;
   Dirstructure m_dirstruct;
+  //! The files a batch run hasn't started evaluating, yet
+  std::deque<wxString> m_batchQueue;
+  //! The files a batch run has evaluated
+  std::vector<BatchResult> m_batchResults;
+  //! How many files a batch run may evaluate at the same time
+  long m_batchJobs = 1;
+  //! How many files a batch run currently evaluates
+  long m_batchRunning = 0;
+  //! May a Maxima process evaluate more than one file?
+  bool m_batchReuseMaxima = false;
+  //! Measures how long the batch run takes
+  wxStopWatch m_batchStopWatch;
 };
 
 // cppcheck-suppress unknownMacro
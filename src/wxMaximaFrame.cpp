@@ -1535,6 +1535,7 @@ void wxMaximaFrame::RemoveTempAutosavefile()
     {
       SuppressErrorDialogs logNull;
       wxRemoveFile(m_tempfileName);
+      AutosaveJournal::Remove(m_tempfileName);
     }
   }
   m_tempfileName = wxEmptyString;
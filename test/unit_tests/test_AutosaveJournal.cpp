@@ -0,0 +1,172 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+#define CATCH_CONFIG_RUNNER
+#include "AutosaveJournal.cpp"
+#include <catch2/catch.hpp>
+#include <wx/init.h>
+#include <wx/filename.h>
+
+int ErrorRedirector::m_messages_logPaneOnly = 0;
+
+static const std::string header = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<wxMaximaDocument>\n";
+static const std::string cell1 = "<cell type=\"code\"><input>a</input></cell>\n";
+static const std::string cell2 = "<cell type=\"code\"><input>b</input></cell>\n";
+
+//! Writes a .wxmx file the way ExportToWXMX does
+static void WriteWXMX(const wxString &file)
+{
+  wxFFileOutputStream out(file);
+  wxZipOutputStream zip(out);
+  zip.SetLevel(0);
+  zip.PutNextEntry(wxT("mimetype"));
+  zip.Write("text/x-wxmathml", 15);
+  zip.PutNextEntry(wxT("content.xml"));
+  std::string content = header + cell1 + cell2 + "\n</wxMaximaDocument>";
+  zip.Write(content.data(), content.size());
+  zip.PutNextEntry(wxT("image_1.png"));
+  zip.Write("old image", 9);
+  zip.Close();
+}
+
+//! Reads a file from a .wxmx file
+static std::string ReadEntry(const wxString &file, const wxString &name)
+{
+  std::string result;
+  wxFFileInputStream in(file);
+  wxZipInputStream zip(in);
+  std::unique_ptr<wxZipEntry> entry;
+  while (entry.reset(zip.GetNextEntry()), entry)
+    if (entry->GetName() == name)
+    {
+      char buf[1024];
+      while (zip.Read(buf, sizeof(buf)).LastRead() > 0)
+        result.append(buf, zip.LastRead());
+    }
+  return result;
+}
+
+SCENARIO("The autosave journal can be merged into its .wxmx file") {
+  GIVEN("A .wxmx file with two cells") {
+    wxString tempFile = wxFileName::CreateTempFileName(wxT("journal"));
+    wxString file = tempFile + wxT(".wxmx");
+    WriteWXMX(file);
+    AutosaveJournal journal;
+    journal.NewBase(file,
+                    {{1, header.size(), cell1.size()},
+                     {2, header.size() + cell1.size(), cell2.size()}},
+                    {{1, 11}, {2, 22}},
+                    {wxT("image_1.png")});
+    REQUIRE(journal.CanAppend(file));
+    REQUIRE(!journal.CanAppend(file + wxT("x")));
+    REQUIRE(!journal.CellChanged(1, 11));
+    REQUIRE(journal.CellChanged(1, 12));
+    REQUIRE(journal.CellChanged(3, 33));
+
+    WHEN("the cells are swapped, one is changed and one is added") {
+      SharedBlob image = MakeSharedBlob("new image", 9);
+      REQUIRE(journal.Append(wxString::FromUTF8(header.c_str()),
+                             {{2, false}, {3, true}, {1, false}},
+                             {{3, 33, wxT("<cell type=\"text\"><editor>c</editor></cell>\n")}},
+                             {{wxT("image_2.png"), image}}));
+      // A second autosave whose commit is missing because of a "crash"
+      {
+        wxFile cutOff(AutosaveJournal::GetJournalName(file), wxFile::write_append);
+        cutOff.Write(wxString("cell 1 5\nbroken"));
+      }
+      REQUIRE(wxFileExists(AutosaveJournal::GetJournalName(file)));
+
+      THEN("the journal is locked by a process that still runs") {
+        REQUIRE(wxFileExists(AutosaveJournal::GetLockName(file)));
+        REQUIRE(!AutosaveJournal::CrashDetected(file));
+      }
+      THEN("Discard() deletes the journal and its lock") {
+        journal.Discard();
+        REQUIRE(!wxFileExists(AutosaveJournal::GetJournalName(file)));
+        REQUIRE(!wxFileExists(AutosaveJournal::GetLockName(file)));
+        REQUIRE(!journal.CanAppend(file));
+      }
+      THEN("Replay() produces a file containing the changes up to the last commit") {
+        REQUIRE(AutosaveJournal::Replay(file));
+        REQUIRE(!wxFileExists(AutosaveJournal::GetJournalName(file)));
+        REQUIRE(ReadEntry(file, wxT("content.xml")) ==
+                header + cell2 + "<hl>\n<cell type=\"text\"><editor>c</editor></cell>\n</hl>\n" +
+                cell1 + "\n</wxMaximaDocument>");
+        REQUIRE(ReadEntry(file, wxT("mimetype")) == "text/x-wxmathml");
+        REQUIRE(ReadEntry(file, wxT("image_1.png")) == "old image");
+        REQUIRE(ReadEntry(file, wxT("image_2.png")) == "new image");
+        REQUIRE(!wxFileExists(AutosaveJournal::GetLockName(file)));
+      }
+    }
+    WHEN("the .wxmx file has changed after the journal was written") {
+      REQUIRE(journal.Append(wxString::FromUTF8(header.c_str()), {{1, false}}, {}, {}));
+      wxSleep(1);
+      WriteWXMX(file);
+      THEN("the journal is discarded") {
+        REQUIRE(!AutosaveJournal::Replay(file));
+        REQUIRE(!wxFileExists(AutosaveJournal::GetJournalName(file)));
+        REQUIRE(ReadEntry(file, wxT("content.xml")) ==
+                header + cell1 + cell2 + "\n</wxMaximaDocument>");
+      }
+    }
+    wxRemoveFile(file);
+    wxRemoveFile(tempFile);
+  }
+  GIVEN("A .wxmx file that has just been opened") {
+    wxString tempFile = wxFileName::CreateTempFileName(wxT("journal"));
+    wxString file = tempFile + wxT(".wxmx");
+    WriteWXMX(file);
+    AutosaveJournal journal;
+    journal.NewBase(file);
+    THEN("all cells but none of the files the .wxmx file contains need to be written") {
+      REQUIRE(journal.CanAppend(file));
+      REQUIRE(journal.CellChanged(1, 11));
+      REQUIRE(journal.HasBlob(wxT("image_1.png")));
+      REQUIRE(!journal.HasBlob(wxT("content.xml")));
+    }
+    WHEN("the first autosave writes all cells to the journal") {
+      REQUIRE(journal.Append(wxString::FromUTF8(header.c_str()), {{1, false}, {2, false}},
+                             {{1, 12, wxT("<cell type=\"code\"><input>x</input></cell>\n")},
+                              {2, 22, wxString::FromUTF8(cell2.c_str())}},
+                             {}));
+      THEN("Replay() produces a file containing the changes and the old files") {
+        REQUIRE(AutosaveJournal::Replay(file));
+        REQUIRE(ReadEntry(file, wxT("content.xml")) ==
+                header + "<cell type=\"code\"><input>x</input></cell>\n" + cell2 +
+                "\n</wxMaximaDocument>");
+        REQUIRE(ReadEntry(file, wxT("image_1.png")) == "old image");
+      }
+    }
+    wxRemoveFile(file);
+    wxRemoveFile(tempFile);
+  }
+}
+
+// If we don't provide our own main when compiling on MinGW
+// we currently get an error message that WinMain@16 is missing
+// (https://github.com/catchorg/Catch2/issues/1287)
+int main(int argc, char* argv[])
+{
+  wxEntryStart(argc, argv);
+  int result = Catch::Session().run(argc, argv);
+  wxEntryCleanup();
+  return result;
+}
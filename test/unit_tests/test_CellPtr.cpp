@@ -25,8 +25,8 @@
 #include <stx/optional.hpp>
 #include <array>
 
-size_t Observed::m_instanceCount;
-size_t CellPtrBase::m_instanceCount;
+std::atomic<size_t> Observed::m_instanceCount;
+std::atomic<size_t> CellPtrBase::m_instanceCount;
 Observed::ControlBlock const Observed::ControlBlock::empty{nullptr};
 
 class Cell : public Observed {};
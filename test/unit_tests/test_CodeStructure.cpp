@@ -0,0 +1,288 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+#define CATCH_CONFIG_RUNNER
+#include "CodeStructure.cpp"
+#include "FontAttribs.cpp"
+#include "FontCache.cpp"
+#include "MaximaTokenizer.cpp"
+#include "TextStyle.cpp"
+#include "TokenLines.cpp"
+#include <catch2/catch.hpp>
+#include <wx/init.h>
+#include <random>
+
+Configuration::Configuration(wxDC *dc, InitOpt) : m_dc(dc)
+{
+  m_changeAsterisk = false;
+  m_inLispMode = false;
+}
+Configuration::~Configuration() {}
+
+//! The first error of the code, found like wxMaxima did before sending a command
+static CodeStructure::Error ScanForError(const MaximaTokenizer::TokenList &tokens,
+                                         size_t &index, bool &endingNeeded)
+{
+  using Error = CodeStructure::Error;
+  index = 0;
+  endingNeeded = true;
+  wxChar lastnonWhitespace;
+  wxChar lastnonWhitespace_Next = wxT(' ');
+  std::vector<wxChar> delimiters;
+
+  for (auto const &tok : tokens)
+  {
+    auto &itemText = tok.GetText();
+    const TextStyle itemStyle = tok.GetStyle();
+    index += itemText.Length();
+    lastnonWhitespace = lastnonWhitespace_Next;
+
+    if(itemStyle == TS_CODE_COMMENT)
+    {
+      if(!itemText.EndsWith("*/"))
+        return Error::unterminatedComment;
+      continue;
+    }
+
+    wxChar firstC = itemText[0];
+    wxChar lastC = itemText.Last();
+    if((firstC != ' ') && (firstC != '\t') && (firstC != '\r') && (firstC != '\n'))
+      lastnonWhitespace_Next = lastC;
+
+    if(itemText == "(")
+    {
+      delimiters.push_back(wxT(')'));
+      continue;
+    }
+    if(itemText == "[")
+    {
+      delimiters.push_back(wxT(']'));
+      continue;
+    }
+    if(itemText == "{")
+    {
+      delimiters.push_back(wxT('}'));
+      continue;
+    }
+
+    if((itemText == ')') || (itemText == ']') || (itemText == '}'))
+    {
+      endingNeeded = true;
+      if (delimiters.empty()) return Error::mismatchedParenthesis;
+      if (firstC != delimiters.back()) return Error::mismatchedParenthesis;
+      delimiters.pop_back();
+      if (lastnonWhitespace == wxT(','))
+        return Error::commaBeforeClosingParenthesis;
+      continue;
+    }
+
+    if(itemStyle == TS_CODE_STRING)
+    {
+      endingNeeded = true;
+      if(!itemText.EndsWith("\""))
+        return Error::unterminatedString;
+      continue;
+    }
+
+    if(itemStyle == TS_CODE_ENDOFLINE)
+    {
+      if(!delimiters.empty())
+        return Error::unclosedParenthesisAtEnding;
+      endingNeeded = false;
+      continue;
+    }
+
+    if(itemStyle == TS_CODE_LISP)
+      endingNeeded = false;
+  }
+
+  if (!delimiters.empty())
+    return Error::unclosedParenthesis;
+  return Error::none;
+}
+
+//! Does the structure give the same answers the old scan gives?
+static bool MatchesScan(const CodeStructure &structure, const MaximaTokenizer::TokenList &tokens)
+{
+  size_t index;
+  bool endingNeeded;
+  CodeStructure::Error error = ScanForError(tokens, index, endingNeeded);
+  if (structure.GetError() != error)
+    return false;
+  if (error != CodeStructure::Error::none)
+    return structure.GetErrorIndex() == index;
+  return structure.EndingNeeded() == endingNeeded;
+}
+
+//! Do both structures know the same delimiters and errors?
+static bool SameStructure(const CodeStructure &a, const CodeStructure &b, size_t length)
+{
+  if ((a.GetError() != b.GetError()) || (a.EndingNeeded() != b.EndingNeeded()) ||
+      (a.IsEmpty() != b.IsEmpty()) || (a.EndsInBackslash() != b.EndsInBackslash()))
+    return false;
+  if ((a.GetError() != CodeStructure::Error::none) && (a.GetErrorIndex() != b.GetErrorIndex()))
+    return false;
+  for (size_t pos = 0; pos <= length; pos++)
+  {
+    auto delimiterA = a.Find(pos);
+    auto delimiterB = b.Find(pos);
+    if ((delimiterA == nullptr) != (delimiterB == nullptr))
+      return false;
+    if (delimiterA && ((delimiterA->partner != delimiterB->partner) ||
+                       (delimiterA->isQuote != delimiterB->isQuote)))
+      return false;
+  }
+  return true;
+}
+
+//! A code cell that is re-tokenized and re-analyzed after each edit like EditorCell does
+struct Code
+{
+  explicit Code(const wxString &code) : text(code)
+  {
+    tokens = MaximaTokenizer(text, &config).PopTokens();
+    lines.Build(text, tokens, [](const MaximaTokenizer::Token &) { return size_t(1); });
+    structure.Build(tokens);
+  }
+
+  //! Replaces the chars start...end-1 by newText
+  void Edit(size_t start, size_t end, const wxString &newText)
+  {
+    lines.Replace(start, end, newText.Length());
+    text.replace(start, end - start, newText);
+    TokenLines::Change change;
+    if (lines.Update(text, &config, tokens,
+                     [](const MaximaTokenizer::Token &) { return size_t(1); }, change))
+      structure.Update(tokens, change.firstToken, change.oldTokens, change.newTokens);
+  }
+
+  //! Does the structure look like it had been built from scratch?
+  bool MatchesScratch() const
+  {
+    CodeStructure scratch;
+    scratch.Build(MaximaTokenizer(text, &config).PopTokens());
+    return SameStructure(structure, scratch, text.Length());
+  }
+
+  Configuration config;
+  wxString text;
+  MaximaTokenizer::TokenList tokens;
+  TokenLines lines;
+  CodeStructure structure;
+};
+
+SCENARIO("CodeStructure matches brackets and quotes") {
+  GIVEN("Code with nested brackets, a string and a comment") {
+    Configuration config;
+    //                   0123456789012345678901234567890
+    const wxString code = wxT("f(x):=[x,{\"(]\"}]; /* ( */ g()");
+    auto tokens = MaximaTokenizer(code, &config).PopTokens();
+    CodeStructure structure;
+    structure.Build(tokens);
+    THEN("each bracket knows its partner") {
+      REQUIRE(structure.Find(1)->partner == 3);
+      REQUIRE(structure.Find(3)->partner == 1);
+      REQUIRE(structure.Find(6)->partner == 15);
+      REQUIRE(structure.Find(9)->partner == 14);
+      REQUIRE(structure.Find(27)->partner == 28);
+    }
+    THEN("the quotes of the string belong together") {
+      REQUIRE(structure.Find(10)->isQuote);
+      REQUIRE(structure.Find(10)->partner == 13);
+    }
+    THEN("brackets within strings and comments are ignored") {
+      REQUIRE(structure.Find(11) == nullptr);
+      REQUIRE(structure.Find(12) == nullptr);
+      REQUIRE(structure.Find(21) == nullptr);
+    }
+    THEN("the missing ending is found like the old scan found it") {
+      REQUIRE(structure.GetError() == CodeStructure::Error::none);
+      REQUIRE(structure.EndingNeeded());
+      REQUIRE(MatchesScan(structure, tokens));
+    }
+  }
+}
+
+SCENARIO("CodeStructure finds the errors the old scan found") {
+  GIVEN("Commands with and without errors") {
+    Configuration config;
+    const wxString commands[] = {
+      wxT("a:1;"), wxT("a:1"), wxT("f(x"), wxT("f(x;"), wxT("f(x]"), wxT("f(x,)"),
+      wxT("[a,b)]"), wxT("a:\"abc"), wxT("a:1; /* b"), wxT("a:1;\n)"),
+      wxT(":lisp (+ 1 2)"), wxT("f(x) := (x, /* , */ )"), wxT("x\\")};
+    for (auto const &command : commands)
+    {
+      auto tokens = MaximaTokenizer(command, &config).PopTokens();
+      CodeStructure structure;
+      structure.Build(tokens);
+      INFO("Command: " << command);
+      REQUIRE(MatchesScan(structure, tokens));
+    }
+    THEN("a backslash at the end is recognized") {
+      CodeStructure structure;
+      structure.Build(MaximaTokenizer(wxT("x\\  \n"), &config).PopTokens());
+      REQUIRE(structure.EndsInBackslash());
+    }
+    THEN("whitespace is no code") {
+      CodeStructure structure;
+      structure.Build(MaximaTokenizer(wxT(" \n\t"), &config).PopTokens());
+      REQUIRE(structure.IsEmpty());
+    }
+  }
+}
+
+SCENARIO("CodeStructure follows edits like building it from scratch") {
+  GIVEN("Code that spans many checkpoints") {
+    wxString text;
+    for (int i = 0; i < 300; i++)
+      text << wxString::Format(wxT("f%i(x):=[x,{\"s%i\"}, (x+1)]; /* c */\n"), i, i);
+    Code code(text);
+    REQUIRE(code.MatchesScratch());
+    WHEN("random edits are made") {
+      std::mt19937 randomNumbers(42);
+      const wxString pieces[] = {wxT(""), wxT("x"), wxT("("), wxT(")"), wxT("]"), wxT("\""),
+                                 wxT(";\n"), wxT("/*"), wxT("*/"), wxT(","), wxT("{a}")};
+      bool matches = true;
+      for (int i = 0; (i < 200) && matches; i++)
+      {
+        size_t start = randomNumbers() % (code.text.Length() + 1);
+        size_t end = start + randomNumbers() % (code.text.Length() - start + 1) % 4;
+        code.Edit(start, end, pieces[randomNumbers() % WXSIZEOF(pieces)]);
+        matches = code.MatchesScratch();
+      }
+      THEN("the structure is the one the edited code has") {
+        REQUIRE(matches);
+        REQUIRE(MatchesScan(code.structure, code.tokens));
+      }
+    }
+  }
+}
+
+// If we don't provide our own main when compiling on MinGW
+// we currently get an error message that WinMain@16 is missing
+// (https://github.com/catchorg/Catch2/issues/1287)
+int main(int argc, char* argv[])
+{
+  wxEntryStart(argc, argv);
+  int result = Catch::Session().run(argc, argv);
+  wxEntryCleanup();
+  return result;
+}
@@ -0,0 +1,99 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+#define CATCH_CONFIG_RUNNER
+#include "CompositeDataObject.cpp"
+#include <catch2/catch.hpp>
+#include <wx/init.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+static wxDataFormat &TestFormat()
+{
+  static wxDataFormat format(wxT("application/x-wxmaxima-test"));
+  return format;
+}
+
+//! Returns the data the object provides in the test format
+static std::string GetTestData(const wxDataObject &data)
+{
+  std::vector<char> buffer(data.GetDataSize(TestFormat()));
+  if (!buffer.empty())
+    data.GetDataHere(TestFormat(), buffer.data());
+  return std::string(buffer.begin(), buffer.end());
+}
+
+SCENARIO("Deferred data objects are generated only when their data is requested") {
+  GIVEN("A composite data object with a text and a deferred object") {
+    CompositeDataObject data;
+    int generated = 0;
+    data.Add(new wxTextDataObject(wxT("text")));
+    data.AddDeferred(new wxCustomDataObject(TestFormat()), [&generated]() -> wxDataObject * {
+        generated++;
+        auto *object = new wxCustomDataObject(TestFormat());
+        object->SetData(9, "generated");
+        return object;
+      });
+    THEN("both formats are advertised") {
+      std::vector<wxDataFormat> formats(data.GetFormatCount());
+      data.GetAllFormats(formats.data());
+      REQUIRE(std::find(formats.begin(), formats.end(), TestFormat()) != formats.end());
+      REQUIRE(formats.size() > 1);
+    }
+    THEN("the deferred object hasn't been generated")
+      REQUIRE(generated == 0);
+    WHEN("the text is requested") {
+      data.GetDataSize(wxDF_UNICODETEXT);
+      THEN("the deferred object still hasn't been generated")
+        REQUIRE(generated == 0);
+    }
+    WHEN("the deferred data is requested twice") {
+      std::string first = GetTestData(data);
+      std::string second = GetTestData(data);
+      THEN("the data is the generated data")
+        REQUIRE(first == "generated");
+      THEN("the cached data is returned the second time")
+        REQUIRE(second == "generated");
+      THEN("the object has been generated only once")
+        REQUIRE(generated == 1);
+    }
+  }
+  GIVEN("A deferred object whose generator fails") {
+    CompositeDataObject data;
+    data.AddDeferred(new wxCustomDataObject(TestFormat()), []() -> wxDataObject * {
+        return nullptr;
+      });
+    THEN("no data is provided")
+      REQUIRE(data.GetDataSize(TestFormat()) == 0);
+  }
+}
+
+// If we don't provide our own main when compiling on MinGW
+// we currently get an error message that WinMain@16 is missing
+// (https://github.com/catchorg/Catch2/issues/1287)
+int main(int argc, char* argv[])
+{
+  wxEntryStart(argc, argv);
+  int result = Catch::Session().run(argc, argv);
+  wxEntryCleanup();
+  return result;
+}
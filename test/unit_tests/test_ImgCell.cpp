@@ -33,6 +33,9 @@
 #include "TextStyle.cpp"
 #include "VisiblyInvalidCell.cpp"
 #include <catch2/catch.hpp>
+#include <wx/file.h>
+#include <wx/filename.h>
+#include <vector>
 
 CellPointers pointers(nullptr);
 
@@ -47,6 +50,7 @@ CellPointers *Cell::GetCellPointers() const { return &pointers; }
 void Configuration::NotifyOfCellRedraw(const Cell *) {}
 
 wxBitmap SvgBitmap::RGBA2wxBitmap(unsigned char const *, int const &, int const &) { return {}; }
+wxImage SvgBitmap::RGBA2wxImage(unsigned char const *, int const &, int const &) { return {}; }
 
 int ErrorRedirector::m_messages_logPaneOnly;
 
@@ -81,6 +85,81 @@ SCENARIO("RTF Output represents the image") {
   }
 }
 
+//! Reads a whole file
+static std::vector<unsigned char> ReadFile(const wxString &name)
+{
+  wxFile file(name);
+  std::vector<unsigned char> contents(file.IsOpened() ? file.Length() : 0);
+  if (!contents.empty())
+    file.Read(contents.data(), contents.size());
+  return contents;
+}
+
+SCENARIO("Exporting an image in its own format writes its original bytes") {
+  wxMemoryBuffer image;
+  image.AppendData(wxmaxima_art_wxmac_doc_png, wxmaxima_art_wxmac_doc_png_size);
+  Configuration config;
+  Configuration *pConfig = &config;
+  std::vector<unsigned char> const original(
+    wxmaxima_art_wxmac_doc_png, wxmaxima_art_wxmac_doc_png + wxmaxima_art_wxmac_doc_png_size);
+  wxString const tempName = wxFileName::CreateTempFileName("wxmaxima_test_");
+  wxRemoveFile(tempName);
+  GIVEN("An image with test data") {
+    ImgCell cell(nullptr, &pConfig, image, "png");
+    WHEN("we export it to a .png file") {
+      wxString const file = tempName + ".png";
+      wxSize const size = cell.ToImageFile(file);
+      THEN("the export reports the image's size")
+        REQUIRE(size == wxSize(128, 128));
+      THEN("the file is byte-identical to the image data")
+        REQUIRE(ReadFile(file) == original);
+      THEN("the image knows that the file contains it")
+        REQUIRE(cell.IsStoredIn(file));
+      wxRemoveFile(file);
+    }
+    WHEN("we export it to a file whose extension is in upper case") {
+      wxString const file = tempName + ".PNG";
+      cell.ToImageFile(file);
+      THEN("the file is byte-identical to the image data")
+        REQUIRE(ReadFile(file) == original);
+      wxRemoveFile(file);
+    }
+    WHEN("a file of the same name contains a different image") {
+      wxString const file = tempName + ".png";
+      {
+        wxFile other(file, wxFile::write);
+        other.Write(wxmaxima_art_wxmac_doc_png, wxmaxima_art_wxmac_doc_png_size / 2);
+      }
+      THEN("the image knows that the file doesn't contain it")
+        REQUIRE(!cell.IsStoredIn(file));
+      wxRemoveFile(file);
+    }
+  }
+}
+
+SCENARIO("Saving an image shares its data instead of copying it") {
+  wxMemoryBuffer image;
+  image.AppendData(wxmaxima_art_wxmac_doc_png, wxmaxima_art_wxmac_doc_png_size);
+  Configuration config;
+  Configuration *pConfig = &config;
+  GIVEN("Two cells showing the same image") {
+    ImgCell cell(nullptr, &pConfig, image, "png");
+    ImgCell other(nullptr, &pConfig, image, "png");
+    WHEN("both are converted to the XML code of a .wxmx file") {
+      pointers.WXMXResetCounter();
+      wxString xml = cell.ToXML();
+      wxString otherXml = other.ToXML();
+      THEN("the image is stored once, and the data the .wxmx file gets is the cell's")
+      {
+        REQUIRE(xml == otherXml);
+        REQUIRE(pointers.WXMXBlobs().size() == 1);
+        REQUIRE(pointers.WXMXBlobs().begin()->second.get() == cell.GetCompressedImage().get());
+      }
+      pointers.WXMXResetCounter();
+    }
+  }
+}
+
 // If we don't provide our own main when compiling on MinGW
 // we currently get an error message that WinMain@16 is missing
 // (https://github.com/catchorg/Catch2/issues/1287)
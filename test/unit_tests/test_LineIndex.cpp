@@ -0,0 +1,208 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+#define CATCH_CONFIG_RUNNER
+#include "LineIndex.cpp"
+#include <catch2/catch.hpp>
+#include <wx/init.h>
+#include <wx/stopwatch.h>
+#include <random>
+
+//! The line and column of a position, found by scanning the text like EditorCell used to
+static void ScanPositionToXY(const wxString &text, size_t position, size_t &x, size_t &y)
+{
+  x = y = 0;
+  size_t pos = 0;
+  for (auto it = text.begin(); (pos < position) && (it != text.end()); ++it, ++pos)
+  {
+    if (LineIndex::IsLineEnding(*it))
+    {
+      x = 0;
+      y++;
+    }
+    else
+      x++;
+  }
+}
+
+//! The position of a line and column, found by scanning the text like EditorCell used to
+static size_t ScanXYToPosition(const wxString &text, size_t x, size_t y)
+{
+  size_t col = 0, lin = 0, pos = 0;
+  auto it = text.begin();
+  for (; (it != text.end()) && (lin < y); ++it, ++pos)
+    if (LineIndex::IsLineEnding(*it))
+      lin++;
+  for (; (it != text.end()) && (col < x) && !LineIndex::IsLineEnding(*it); ++it, ++pos)
+    ++col;
+  return pos;
+}
+
+//! The position of a line and column, looked up in the index
+static size_t IndexXYToPosition(const LineIndex &index, size_t length, size_t x, size_t y)
+{
+  if (y >= index.GetLineCount())
+    return length;
+  size_t lineEnd = length;
+  if (y + 1 < index.GetLineCount())
+    lineEnd = index.GetLineStart(y + 1) - 1;
+  return wxMin(index.GetLineStart(y) + x, lineEnd);
+}
+
+//! Does the index describe the same lines as scanning the text does?
+static bool MatchesText(const LineIndex &index, const wxString &text)
+{
+  for (size_t pos = 0; pos <= text.Length(); pos++)
+  {
+    size_t x, y;
+    ScanPositionToXY(text, pos, x, y);
+    size_t line = index.GetLine(pos);
+    if ((line != y) || (pos - index.GetLineStart(line) != x))
+      return false;
+  }
+  return true;
+}
+
+SCENARIO("LineIndex finds the lines of a text") {
+  GIVEN("An empty text") {
+    LineIndex index;
+    THEN("the text consists of one line") {
+      REQUIRE(index.GetLineCount() == 1);
+      REQUIRE(index.GetLine(0) == 0);
+    }
+  }
+  GIVEN("A text with hard and soft line breaks") {
+    wxString text = wxT("a:1;\nb:2;\r\nc");
+    LineIndex index(text);
+    THEN("each line ending starts a new line") {
+      REQUIRE(index.GetLineCount() == 4);
+      REQUIRE(index.GetLineStart(1) == 5);
+      REQUIRE(index.GetLineStart(2) == 10);
+      REQUIRE(index.GetLineStart(3) == 11);
+    }
+    THEN("the line ending belongs to the line it ends") {
+      REQUIRE(index.GetLine(4) == 0);
+      REQUIRE(index.GetLine(5) == 1);
+    }
+    THEN("the index agrees with scanning the text") {
+      REQUIRE(MatchesText(index, text));
+    }
+  }
+}
+
+SCENARIO("LineIndex follows edits") {
+  GIVEN("A text with a few lines") {
+    wxString text = wxT("first\nsecond\nthird\n\nfifth");
+    LineIndex index(text);
+    WHEN("a line ending is deleted") {
+      index.Replace(5, 6, wxEmptyString);
+      text.replace(5, 1, wxEmptyString);
+      THEN("the two lines are joined") {
+        REQUIRE(index.GetLineCount() == 4);
+        REQUIRE(MatchesText(index, text));
+      }
+    }
+    WHEN("a soft line break is replaced by a space") {
+      // What EditorCell does to the soft line breaks of code before styling it
+      index.Replace(8, 8, wxT("a\rb"));
+      text.replace(8, 0, wxT("a\rb"));
+      index.Replace(9, 10, wxT(" "));
+      text.replace(9, 1, wxT(" "));
+      THEN("the line ends no more") {
+        REQUIRE(index.GetLineCount() == 5);
+        REQUIRE(MatchesText(index, text));
+      }
+    }
+    WHEN("several lines are inserted") {
+      index.Replace(8, 8, wxT("a\nb\rc\n"));
+      text.replace(8, 0, wxT("a\nb\rc\n"));
+      THEN("all of them appear in the index") {
+        REQUIRE(index.GetLineCount() == 8);
+        REQUIRE(MatchesText(index, text));
+      }
+    }
+    WHEN("random edits are made") {
+      std::mt19937 randomNumbers(42);
+      const wxString pieces[] = {wxT(""), wxT("x"), wxT("\n"), wxT("ab\ncd"), wxT("\r\n\n")};
+      for (int i = 0; i < 500; i++)
+      {
+        size_t start = randomNumbers() % (text.Length() + 1);
+        size_t end = start + randomNumbers() % (text.Length() - start + 1) % 4;
+        const wxString &newText = pieces[randomNumbers() % WXSIZEOF(pieces)];
+        index.Replace(start, end, newText);
+        text.replace(start, end - start, newText);
+      }
+      THEN("the index still agrees with the text") {
+        REQUIRE(MatchesText(index, text));
+        LineIndex rebuilt(text);
+        REQUIRE(rebuilt.GetLineCount() == index.GetLineCount());
+      }
+    }
+  }
+}
+
+SCENARIO("Moving the caret through a long cell is fast", "[benchmark]") {
+  GIVEN("A cell with 20,000 lines") {
+    wxString text;
+    for (int i = 0; i < 20000; i++)
+      text << wxString::Format(wxT("a[%i]:sin(x)^%i;\n"), i, i % 7);
+    LineIndex index(text);
+    WHEN("the caret is moved down from the first to the last line") {
+      // Each step is what EditorCell does on a cursor down key press:
+      // Find the caret's column and line and move to the same column in the next line.
+      wxStopWatch stopwatch;
+      size_t indexedPos = 3;
+      for (size_t y = 0; y + 1 < index.GetLineCount(); y++)
+      {
+        size_t line = index.GetLine(indexedPos);
+        indexedPos = IndexXYToPosition(index, text.Length(),
+                                       indexedPos - index.GetLineStart(line), line + 1);
+      }
+      long indexed = stopwatch.Time();
+
+      stopwatch.Start();
+      size_t scannedPos = 3;
+      for (size_t y = 0; y + 1 < index.GetLineCount(); y++)
+      {
+        size_t col, line;
+        ScanPositionToXY(text, scannedPos, col, line);
+        scannedPos = ScanXYToPosition(text, col, line + 1);
+      }
+      long scanned = stopwatch.Time();
+      WARN("Line index: " << indexed << " ms, scanning the text: " << scanned << " ms");
+      THEN("both methods end up at the same position") {
+        REQUIRE(indexedPos == scannedPos);
+        REQUIRE(index.GetLine(indexedPos) == index.GetLineCount() - 1);
+      }
+    }
+  }
+}
+
+// If we don't provide our own main when compiling on MinGW
+// we currently get an error message that WinMain@16 is missing
+// (https://github.com/catchorg/Catch2/issues/1287)
+int main(int argc, char* argv[])
+{
+  wxEntryStart(argc, argv);
+  int result = Catch::Session().run(argc, argv);
+  wxEntryCleanup();
+  return result;
+}
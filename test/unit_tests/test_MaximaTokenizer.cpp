@@ -0,0 +1,582 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+#define CATCH_CONFIG_RUNNER
+#include "FontAttribs.cpp"
+#include "FontCache.cpp"
+#include "MaximaTokenizer.cpp"
+#include "TextStyle.cpp"
+#include <catch2/catch.hpp>
+#include <wx/dir.h>
+#include <wx/file.h>
+#include <wx/init.h>
+#include <wx/stopwatch.h>
+#include <random>
+
+Configuration::Configuration(wxDC *dc, InitOpt) : m_dc(dc)
+{
+  m_changeAsterisk = false;
+  m_inLispMode = false;
+}
+Configuration::~Configuration() {}
+
+/*! The tokenizer wxMaxima used before MaximaTokenizer classified chars by a table
+
+  It looks up each char in the lists of special chars. The tokens it generates
+  are the reference the table-driven tokenizer is tested against.
+ */
+class ReferenceTokenizer : public MaximaTokenizer
+{
+public:
+  ReferenceTokenizer(const wxString &commands, Configuration *configuration);
+
+  static bool ReferenceIsAlpha(wxChar ch)
+  {
+    if (wxIsalpha(ch))
+      return true;
+    if(m_not_alphas.Find(ch) != wxNOT_FOUND)
+      return false;
+    if(ReferenceIsSpace(ch))
+      return false;
+    if(ch > 127)
+      return true;
+    return (m_additional_alphas.Find(ch) != wxNOT_FOUND);
+  }
+  static bool ReferenceIsSpace(wxChar ch) { return m_spaces.Find(ch) != wxNOT_FOUND; }
+  static bool ReferenceIsNum(wxChar ch) { return ch >= '0' && ch <= '9'; }
+  static bool ReferenceIsAlphaNum(wxChar ch) { return ReferenceIsAlpha(ch) || ReferenceIsNum(ch); }
+};
+
+ReferenceTokenizer::ReferenceTokenizer(const wxString &commands, Configuration *configuration)
+  : MaximaTokenizer(wxEmptyString, configuration)
+{
+  wxString::const_iterator it = commands.begin();
+
+  if(configuration->InLispMode())
+  {
+    wxString token;
+    while(
+      (it < commands.end()) &&
+      ((!token.EndsWith("(to-maxima)"))) &&
+      ((!token.EndsWith(wxString("(to")+wxT("\u2212")+"maxima)"))))
+    {
+      token +=*it;
+      ++it;
+    }
+    token.Trim(true);
+    if(!token.IsEmpty())
+      m_tokens.emplace_back(token, TS_CODE_LISP);
+  }
+  while (it < commands.end())
+  {
+
+    // Determine the current char and the one that will follow it
+    wxChar Ch = *it;
+    wxString::const_iterator it2(it);
+    if(it2 < commands.end())
+      ++it2;
+    wxChar nextChar;
+
+    if(it2 < commands.end())
+      nextChar = *it2;
+    else
+      nextChar = wxT(' ');
+
+    // Handle newline characters (hard+soft line break)
+    if (m_linebreaks.Contains(Ch))
+    {
+      m_tokens.emplace_back(wxChar(Ch));
+      ++it;
+      continue;
+    }
+    // Check for comments
+    if ((Ch == '/') && ((nextChar == wxT('*')) || (nextChar == wxT('\u00B7'))))
+    {
+      wxString token;
+      // Add the comment start
+      token+=*it;++it;
+      token+=*it;++it;
+
+      int commentDepth = 0;
+      while (it < commands.end())
+      {
+        // Handle escaped chars
+        if(*it == '\\')
+        {
+          token += *it;
+          ++it;
+          if(it < commands.end())
+          {
+            token += *it;
+            ++it;
+          }
+          continue;
+        }
+        
+        wxString::const_iterator it3(it);
+        if(it3 < commands.end())
+          ++it3;
+        wxChar nextCh = ' ';
+        if(it3 < commands.end())
+          nextCh = *it3;
+
+        // handle comment begins within comments.
+        if((*it == '/') && ((nextCh == '*') || (nextCh == wxT('\u00B7'))))
+        {
+          commentDepth++;
+          token += *it;
+          ++it;
+          if(it < commands.end())
+          {
+            token += *it;
+            ++it;
+          }
+          continue;
+        }
+        // handle comment endings
+        if(((*it == '*') || (*it == wxT('\u00B7'))) && (nextCh == '/'))
+        {
+          commentDepth--;
+          token += *it;
+          ++it;
+          if(it < commands.end())
+          {
+            token += *it;
+            ++it;
+          }
+          if(commentDepth < 0)
+            break;
+          continue;
+        }
+        if(it < commands.end())
+        {
+          token += *it;
+          ++it;
+        }
+      }
+      m_tokens.emplace_back(token, TS_CODE_COMMENT);
+      continue;
+    }
+    // Handle operators and :lisp commands
+    if (m_operators.Find(Ch) != wxNOT_FOUND)
+    {
+      if(Ch == ':')
+      {
+        wxString breakCommand;
+        wxString::const_iterator it3(it);
+        int len = 14;
+        while((len>0) && (it3 < commands.end()))
+        {
+          len--;
+          breakCommand += wxString(*it3);
+          ++it3;
+        }
+        if(
+          breakCommand.StartsWith(":lisp ") ||
+          breakCommand.StartsWith(":lisp-quiet ") ||
+          breakCommand.StartsWith(":lisp\t") ||
+          breakCommand.StartsWith(":lisp-quiet\t"))
+        {
+          wxString token;
+          while((it < commands.end()) && (*it != '\n'))
+          {
+            token += wxString(*it);
+            ++it;
+          }
+          m_tokens.emplace_back(token, TS_CODE_LISP);
+        }
+          else
+          {
+            m_tokens.emplace_back(wxString(Ch), TS_CODE_OPERATOR);
+            ++it;
+          }
+      }
+      else
+      {
+        wxString token = wxString(Ch);
+        if (configuration->GetChangeAsterisk())
+        {
+          token.Replace(wxT("*"), wxT("\u00B7"));
+          token.Replace(wxT("-"), wxT("\u2212"));
+        }
+        
+        m_tokens.emplace_back(token, TS_CODE_OPERATOR);
+        ++it;
+      }
+      continue;
+    }
+    // Handle strings
+    if (Ch == wxT('\"'))
+    {
+      wxString token;
+      // Add the opening quote
+      token = Ch;
+      ++it;
+
+      // Add the string contents
+      while (it < commands.end())
+      {
+        Ch = *it;
+        token += Ch;
+        ++it;
+        if(Ch == wxT('\\'))
+        {
+          if(it < commands.end())
+          {
+            token += *it;
+            ++it;
+          }
+        }
+        else if(Ch == wxT('\"'))
+          break;
+      }
+      m_tokens.emplace_back(token, TS_CODE_STRING);
+      continue;
+    }
+    // Handle number-like symbols
+    if(m_unicodeNumbers.Find(Ch) != wxNOT_FOUND)
+    {
+       wxString token = Ch;
+       ++it;
+       m_tokens.emplace_back(token, TS_CODE_NUMBER);
+       continue;
+    } 
+    // Handle numbers. Numbers begin with a digit, but can continue with letters and can
+    // contain a + or - that follows an e, f, g, h or l.
+    if (ReferenceIsNum(Ch))
+    {
+      wxString token;
+      wxChar lastChar = *it;
+      while ((it < commands.end()) &&
+             (
+               (ReferenceIsNum(*it) ||
+                ((*it >= 'a') && (*it <= 'z')) ||
+                ((*it >= 'A') && (*it <= 'Z'))
+                 )
+               || (
+                 (
+                   (lastChar == 'e') || (lastChar == 'E') ||
+                   (lastChar == 'f') || (lastChar == 'F') ||
+                   (lastChar == 'g') || (lastChar == 'G') ||
+                   (lastChar == 'h') || (lastChar == 'H') ||
+                   (lastChar == 'l') || (lastChar == 'L')
+                   ) && (
+                     (m_plusSigns.Contains(*it)) ||
+                     (m_minusSigns.Contains(*it))
+                     )
+                 )))
+      {
+        wxChar ch = *it;
+        for (wxString::const_iterator it3 = m_plusSigns.begin(); it3 != m_plusSigns.end(); ++it3)
+          if(ch == *it3)
+            ch = '+';
+        for (wxString::const_iterator it3 = m_minusSigns.begin(); it3 != m_minusSigns.end(); ++it3)
+          if(ch == *it3)
+            ch = '-';
+        token += ch;
+        lastChar = *it;
+        ++it;
+      }
+      
+      m_tokens.emplace_back(token, TS_CODE_NUMBER);
+      continue;
+    }
+    if (m_plusSigns.Contains(Ch))
+    {
+      wxString token = "+";
+      m_tokens.emplace_back(token);
+      // The original code forgot to advance here, which made it loop forever
+      ++it;
+      continue;
+    }
+    if (m_minusSigns.Contains(Ch))
+    {
+      wxString token = "-";
+      m_tokens.emplace_back(token);
+      ++it;
+      continue;
+    }
+    // Merge consecutive spaces into one single token
+    if (ReferenceIsSpace(Ch))
+    {
+      wxString token;
+      while ((it < commands.end()) && ReferenceIsSpace(Ch))
+      {
+        if(Ch == '\t')
+          token += "\t";
+        else
+          token += " ";
+        if (++it < commands.end())
+          Ch = *it;
+      }
+      m_tokens.emplace_back(token);
+      continue;
+    }
+    // Handle keywords
+    if (ReferenceIsAlpha(Ch) || (Ch == '\\') || (Ch == '?'))
+    {
+      wxString token;
+      if(Ch == '?')
+      {
+        token += Ch;
+        ++it;
+        Ch = *it;
+      }
+
+      while ((it < commands.end()) && (ReferenceIsAlphaNum(*it) || (*it == '\\')))
+      {
+        Ch = *it;
+        token += Ch;
+        if (Ch == wxT('\\'))
+        {
+          ++it;
+          if (it < commands.end())
+          {
+            Ch = *it;
+            if (Ch != wxT('\n'))
+              token += Ch;
+            else
+            {
+              m_tokens.emplace_back(token);
+              token = wxEmptyString;
+
+              break;
+            }
+          }
+        }
+        if(it < commands.end())
+          ++it;
+      }
+      if(token == ("to_lisp"))
+      {
+        while((it < commands.end()) && ((!token.EndsWith("(to-maxima)"))) && ((!token.EndsWith(wxString("(to")+wxT("\u2212")+"maxima)"))))
+        {
+          token += wxString(*it);
+          ++it;
+        }
+        m_tokens.emplace_back(token, TS_CODE_LISP);
+      }
+      else
+      {
+        if(m_hardcodedFunctions.find(token) != m_hardcodedFunctions.end())
+          m_tokens.emplace_back(token, TS_CODE_FUNCTION);
+        else
+        {
+          // Let's look what the next char looks like
+          wxString::const_iterator it3(it);
+          while ((it3 < commands.end()) &&
+                 ((*it3 == ' ') || (*it3 == '\t') || (*it3 == '\n') || (*it3 == '\r')))
+            ++it3;
+          if(it3 >= commands.end())
+            m_tokens.emplace_back(token, TS_CODE_VARIABLE);
+          else
+          {
+            if(*it3 == '(')
+              m_tokens.emplace_back(token, TS_CODE_FUNCTION);
+            else
+              m_tokens.emplace_back(token, TS_CODE_VARIABLE);
+          }
+        }
+      }
+      continue;
+    }   
+    if((Ch == '$') || (Ch == ';'))
+    {
+      m_tokens.emplace_back(wxString(Ch), TS_CODE_ENDOFLINE);
+      ++it;
+      continue;
+    }
+
+    {
+      // Everything that hasn't been handled until now.
+      m_tokens.emplace_back(wxString(Ch));
+      ++it;
+      continue;
+    }
+  }
+}
+
+//! The tokens, without the empty ones the reference tokenizer generates after escaped line breaks
+static std::vector<std::pair<wxString, TextStyle>> Describe(const MaximaTokenizer::TokenList &tokens)
+{
+  std::vector<std::pair<wxString, TextStyle>> retval;
+  for (auto const &token : tokens)
+    if (!token.GetText().IsEmpty())
+      retval.emplace_back(token.GetText(), token.GetStyle());
+  return retval;
+}
+
+//! The contents of all .wxm and .mac files in the current directory
+static std::vector<wxString> ReadTestFiles(size_t &bytes)
+{
+  wxArrayString files;
+  wxDir::GetAllFiles(wxT("."), &files, wxT("*.wxm"), wxDIR_FILES);
+  wxDir::GetAllFiles(wxT("."), &files, wxT("*.mac"), wxDIR_FILES);
+  std::vector<wxString> retval;
+  bytes = 0;
+  for (auto const &file : files)
+  {
+    wxFile input(file);
+    wxString contents;
+    if (input.IsOpened() && input.ReadAll(&contents, wxConvUTF8))
+    {
+      bytes += input.Length();
+      retval.push_back(contents);
+    }
+  }
+  return retval;
+}
+
+SCENARIO("MaximaTokenizer classifies chars like maxima does") {
+  GIVEN("ASCII chars") {
+    THEN("letters and a few symbols are alphas") {
+      REQUIRE(MaximaTokenizer::IsAlpha(wxT('a')));
+      REQUIRE(MaximaTokenizer::IsAlpha(wxT('Z')));
+      REQUIRE(MaximaTokenizer::IsAlpha(wxT('_')));
+      REQUIRE(MaximaTokenizer::IsAlpha(wxT('%')));
+      REQUIRE(!MaximaTokenizer::IsAlpha(wxT('1')));
+      REQUIRE(!MaximaTokenizer::IsAlpha(wxT('(')));
+    }
+    THEN("digits are numbers and tabs are spaces") {
+      REQUIRE(MaximaTokenizer::IsNum(wxT('7')));
+      REQUIRE(MaximaTokenizer::IsSpace(wxT('\t')));
+      REQUIRE(MaximaTokenizer::IsSpace(wxT('\r')));
+      REQUIRE(!MaximaTokenizer::IsSpace(wxT('\n')));
+    }
+  }
+  GIVEN("Chars beyond ASCII") {
+    THEN("they are alphas unless they are known to be something else") {
+      REQUIRE(MaximaTokenizer::IsAlpha(wxT('\u03B1')));
+      REQUIRE(!MaximaTokenizer::IsAlpha(wxT('\u2212')));
+      REQUIRE(!MaximaTokenizer::IsAlpha(wxT('\u00A0')));
+      REQUIRE(MaximaTokenizer::IsSpace(wxT('\u00A0')));
+      REQUIRE(MaximaTokenizer::GetCharClass(wxT('\u2028')) & MaximaTokenizer::CC_LINEBREAK);
+      REQUIRE(MaximaTokenizer::GetCharClass(wxT('\uFE62')) & MaximaTokenizer::CC_PLUS);
+      REQUIRE(MaximaTokenizer::GetCharClass(wxT('\u00BD')) & MaximaTokenizer::CC_UNICODENUMBER);
+    }
+    THEN("the table agrees with looking the chars up in the lists of special chars") {
+      for (wxChar ch = 1; ch < 0xFFFF; ch++)
+      {
+        INFO("Char " << int(ch));
+        REQUIRE(MaximaTokenizer::IsAlpha(ch) == ReferenceTokenizer::ReferenceIsAlpha(ch));
+        REQUIRE(MaximaTokenizer::IsSpace(ch) == ReferenceTokenizer::ReferenceIsSpace(ch));
+      }
+    }
+  }
+}
+
+SCENARIO("MaximaTokenizer splits code into tokens") {
+  Configuration config;
+  GIVEN("A function call and a keyword") {
+    auto tokens = Describe(MaximaTokenizer(wxT("if f (x) then 1e+5;"), &config).PopTokens());
+    THEN("each token has the right style") {
+      REQUIRE(tokens.size() == 12);
+      REQUIRE(tokens[0] == std::make_pair(wxString(wxT("if")), TS_CODE_FUNCTION));
+      REQUIRE(tokens[2] == std::make_pair(wxString(wxT("f")), TS_CODE_FUNCTION));
+      REQUIRE(tokens[5] == std::make_pair(wxString(wxT("x")), TS_CODE_VARIABLE));
+      REQUIRE(tokens[10] == std::make_pair(wxString(wxT("1e+5")), TS_CODE_NUMBER));
+      REQUIRE(tokens[11] == std::make_pair(wxString(wxT(";")), TS_CODE_ENDOFLINE));
+    }
+  }
+  GIVEN("Unicode plus and minus signs") {
+    // These used to make the tokenizer loop forever
+    auto tokens = Describe(MaximaTokenizer(wxT("1\uFE622\uFF0Da"), &config).PopTokens());
+    THEN("they are converted to ASCII signs") {
+      REQUIRE(tokens.size() == 5);
+      REQUIRE(tokens[1].first == wxT("+"));
+      REQUIRE(tokens[3].first == wxT("-"));
+    }
+  }
+  GIVEN("Random text") {
+    std::mt19937 randomNumbers(42);
+    const wxString alphabet =
+      wxT("ab e1+-/*\\\"\n\r\t;$:?()[]{}\u00B7\u2212\uFE62\u2796\u00A0\u00BD_%\u03B1")
+      wxT("for if then 1e+5 to_lisp (to-maxima) :lisp :lisp-quiet ");
+    THEN("the tokens are the ones the reference tokenizer generates") {
+      for (int i = 0; i < 2000; i++)
+      {
+        wxString text;
+        for (int len = randomNumbers() % 60; len > 0; len--)
+          text += alphabet[randomNumbers() % alphabet.Length()];
+        for (bool lisp : {false, true})
+        {
+          INFO("Text: " << std::string(text.utf8_str()) << ", lisp mode: " << lisp);
+          config.InLispMode(lisp);
+          REQUIRE(Describe(MaximaTokenizer(text, &config).PopTokens()) ==
+                  Describe(ReferenceTokenizer(text, &config).PopTokens()));
+        }
+      }
+      config.InLispMode(false);
+    }
+  }
+  GIVEN("The test files") {
+    size_t bytes;
+    auto files = ReadTestFiles(bytes);
+    REQUIRE(!files.empty());
+    THEN("the tokens are the ones the reference tokenizer generates") {
+      for (auto const &text : files)
+        REQUIRE(Describe(MaximaTokenizer(text, &config).PopTokens()) ==
+                Describe(ReferenceTokenizer(text, &config).PopTokens()));
+    }
+  }
+}
+
+SCENARIO("MaximaTokenizer is fast", "[benchmark]") {
+  Configuration config;
+  GIVEN("The test files") {
+    size_t bytes;
+    auto files = ReadTestFiles(bytes);
+    REQUIRE(!files.empty());
+    WHEN("they are tokenized repeatedly") {
+      const int repetitions = 50;
+      size_t tableTokens = 0, referenceTokens = 0;
+      wxStopWatch stopwatch;
+      for (int i = 0; i < repetitions; i++)
+        for (auto const &text : files)
+          tableTokens += MaximaTokenizer(text, &config).PopTokens().size();
+      long table = stopwatch.Time();
+      stopwatch.Start();
+      for (int i = 0; i < repetitions; i++)
+        for (auto const &text : files)
+          referenceTokens += ReferenceTokenizer(text, &config).PopTokens().size();
+      long reference = stopwatch.Time();
+      const double megabytes = repetitions * double(bytes) / (1024 * 1024);
+      WARN("Table-driven tokenizer: " << megabytes * 1000 / wxMax(table, 1L) << " MB/s, " <<
+           "old tokenizer: " << megabytes * 1000 / wxMax(reference, 1L) << " MB/s");
+      THEN("both tokenizers find about the same number of tokens") {
+        // The old one adds empty tokens after escaped line breaks
+        REQUIRE(tableTokens <= referenceTokens);
+        REQUIRE(tableTokens > 0);
+      }
+    }
+  }
+}
+
+// If we don't provide our own main when compiling on MinGW
+// we currently get an error message that WinMain@16 is missing
+// (https://github.com/catchorg/Catch2/issues/1287)
+int main(int argc, char* argv[])
+{
+  wxEntryStart(argc, argv);
+  int result = Catch::Session().run(argc, argv);
+  wxEntryCleanup();
+  return result;
+}
@@ -0,0 +1,380 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+
+#define CATCH_CONFIG_RUNNER
+#include "SearchIndex.cpp"
+#include <catch2/catch.hpp>
+#include <wx/init.h>
+#include <wx/stopwatch.h>
+#include <random>
+
+//! All places needle occurs at in haystack, found by searching the text like Worksheet used to
+static std::vector<size_t> ScanMatches(wxString haystack, wxString needle, bool ignoreCase)
+{
+  if (ignoreCase)
+  {
+    haystack.MakeLower();
+    needle.MakeLower();
+  }
+  std::vector<size_t> matches;
+  for (size_t pos = haystack.find(needle); pos != wxString::npos;
+       pos = haystack.find(needle, pos + 1))
+    matches.push_back(pos);
+  return matches;
+}
+
+//! Does the index contain the same matches as searching each text does?
+static bool MatchesTexts(const SearchIndex &index, const std::vector<wxString> &texts,
+                         const wxString &needle, bool ignoreCase)
+{
+  if (index.GetTextCount() != texts.size())
+    return false;
+  for (size_t i = 0; i < texts.size(); i++)
+  {
+    auto expected = ScanMatches(texts[i], needle, ignoreCase);
+    if (index.GetMatchCount(i) != expected.size())
+      return false;
+    SearchIndex::Match match;
+    for (auto pos : expected)
+      if (!index.FindNext(i, pos, true, match) || (match.text != i) || (match.start != pos))
+        return false;
+  }
+  return true;
+}
+
+/*! Tells the index about all texts
+
+  The keys identify the texts like the addresses of the cells do. If there are
+  none, the texts are identified by their number.
+*/
+static void Update(SearchIndex &index, const std::vector<wxString> &texts,
+                   const std::vector<wxUint64> &revisions,
+                   const std::vector<size_t> &keys = {})
+{
+  index.BeginUpdate();
+  for (size_t i = 0; i < texts.size(); i++)
+    index.Add(reinterpret_cast<SearchIndex::Key>(keys.empty() ? i + 1 : keys[i]),
+              revisions[i], texts[i]);
+  index.EndUpdate();
+}
+
+SCENARIO("SearchIndex finds all matches") {
+  GIVEN("A few texts") {
+    std::vector<wxString> texts = {wxT("aaaa"), wxT("Sin(x)+sin(y)"), wxT(""), wxT("a:\r1;")};
+    SearchIndex index;
+    Update(index, texts, {1, 1, 1, 1});
+    WHEN("a string is searched for that overlaps itself") {
+      REQUIRE(index.Search({wxT("aa"), true, false}));
+      THEN("each place it occurs at is a match") {
+        REQUIRE(index.GetMatchCount() == 3);
+        REQUIRE(index.GetMatchCount(0) == 3);
+      }
+    }
+    WHEN("the case is ignored") {
+      REQUIRE(index.Search({wxT("SIN"), true, false}));
+      THEN("both spellings are found") {
+        REQUIRE(index.GetMatchCount() == 2);
+      }
+    }
+    WHEN("the case matters") {
+      REQUIRE(index.Search({wxT("sin"), false, false}));
+      THEN("only the exact spelling is found") {
+        REQUIRE(index.GetMatchCount() == 1);
+        SearchIndex::Match match;
+        REQUIRE(index.FindNext(0, 0, true, match));
+        REQUIRE(match.text == 1);
+        REQUIRE(match.start == 7);
+      }
+    }
+    WHEN("a string is searched for that spans a soft line break") {
+      REQUIRE(index.Search({wxT(": 1"), true, false}));
+      THEN("the line break counts as a space") {
+        REQUIRE(index.GetMatchCount() == 1);
+      }
+    }
+    WHEN("the search string is empty") {
+      REQUIRE(index.Search({wxEmptyString, true, false}));
+      THEN("nothing is found") {
+        REQUIRE(index.GetMatchCount() == 0);
+      }
+    }
+  }
+}
+
+SCENARIO("SearchIndex follows the search string and the texts") {
+  GIVEN("Texts and a search string that is typed char by char") {
+    std::vector<wxString> texts;
+    std::vector<wxUint64> revisions;
+    std::vector<size_t> keys;
+    for (int i = 0; i < 50; i++)
+    {
+      texts.push_back(wxString::Format(wxT("f(x):=Sum(x^%i,i,1,n)+sum(f(%i),k,0,%i);"), i, i, i % 7));
+      revisions.push_back(1);
+      keys.push_back(keys.size() + 1);
+    }
+    SearchIndex index;
+    Update(index, texts, revisions, keys);
+    const wxString needle = wxT("sum(f(1");
+    for (size_t length = 1; length <= needle.Length(); length++)
+      REQUIRE(index.Search({needle.Left(length), true, false}));
+    THEN("the refined matches agree with searching the texts") {
+      REQUIRE(MatchesTexts(index, texts, needle, true));
+    }
+    WHEN("the search string is shortened again") {
+      REQUIRE(index.Search({wxT("sum("), true, false}));
+      THEN("the matches agree with searching the texts") {
+        REQUIRE(MatchesTexts(index, texts, wxT("sum("), true));
+      }
+    }
+    WHEN("some texts are changed, added and removed") {
+      std::mt19937 randomNumbers(42);
+      for (int i = 0; i < 100; i++)
+      {
+        size_t text = randomNumbers() % texts.size();
+        switch (randomNumbers() % 3)
+        {
+        case 0:
+          texts[text] += wxT("SUM(f(1)");
+          revisions[text]++;
+          break;
+        case 1:
+          texts.push_back(wxT("sum(f(10))"));
+          revisions.push_back(1);
+          keys.push_back(keys.back() + 1);
+          break;
+        default:
+          texts.erase(texts.begin() + text);
+          revisions.erase(revisions.begin() + text);
+          keys.erase(keys.begin() + text);
+          break;
+        }
+        Update(index, texts, revisions, keys);
+        REQUIRE(index.Search({needle, true, false}));
+      }
+      THEN("the matches still agree with searching the texts") {
+        REQUIRE(MatchesTexts(index, texts, needle, true));
+      }
+    }
+  }
+}
+
+SCENARIO("SearchIndex finds the next match") {
+  GIVEN("Three texts with matches in the first and the last one") {
+    std::vector<wxString> texts = {wxT("x+x"), wxT("y"), wxT("x")};
+    SearchIndex index;
+    Update(index, texts, {1, 1, 1});
+    REQUIRE(index.Search({wxT("x"), true, false}));
+    SearchIndex::Match match;
+    THEN("searching down finds the match at or after the start") {
+      REQUIRE(index.FindNext(0, 1, true, match));
+      REQUIRE(match.text == 0);
+      REQUIRE(match.start == 2);
+      REQUIRE(match.length == 1);
+    }
+    THEN("searching down from a text without matches continues in the next one") {
+      REQUIRE(index.FindNext(1, 0, true, match));
+      REQUIRE(match.text == 2);
+    }
+    THEN("searching down from behind the last match wraps around") {
+      REQUIRE(index.FindNext(2, 1, true, match));
+      REQUIRE(match.text == 0);
+      REQUIRE(match.start == 0);
+    }
+    THEN("searching up finds the match before the start") {
+      REQUIRE(index.FindNext(0, 2, false, match));
+      REQUIRE(match.text == 0);
+      REQUIRE(match.start == 0);
+    }
+    THEN("searching up from before the first match wraps around") {
+      REQUIRE(index.FindNext(0, 0, false, match));
+      REQUIRE(match.text == 2);
+      REQUIRE(match.start == 0);
+    }
+    THEN("the start text is searched in full after wrapping around") {
+      REQUIRE(index.FindNext(0, 3, true, match));
+      REQUIRE(match.text == 2);
+      Update(index, {wxT("x+x")}, {1});
+      REQUIRE(index.Search({wxT("x"), true, false}));
+      REQUIRE(index.FindNext(0, 1, true, match));
+      REQUIRE(match.start == 2);
+      REQUIRE(index.FindNext(0, 3, true, match));
+      REQUIRE(match.start == 0);
+    }
+  }
+  GIVEN("Texts that don't contain the search string") {
+    SearchIndex index;
+    Update(index, {wxT("a"), wxT("b")}, {1, 1});
+    REQUIRE(index.Search({wxT("c"), true, false}));
+    THEN("nothing is found") {
+      SearchIndex::Match match;
+      REQUIRE(!index.FindNext(0, 0, true, match));
+      REQUIRE(!index.FindNext(1, 1, false, match));
+    }
+  }
+}
+
+SCENARIO("SearchIndex replaces all matches") {
+  GIVEN("Texts with matches that overlap") {
+    SearchIndex index;
+    Update(index, {wxT("aaaaa"), wxT("b"), wxT("xAAx")}, {1, 1, 1});
+    REQUIRE(index.Search({wxT("aa"), true, false}));
+    WHEN("all matches are replaced") {
+      auto replacements = index.ReplaceAll(wxT("b"));
+      THEN("each text with a match is replaced from left to right") {
+        REQUIRE(replacements.size() == 2);
+        REQUIRE(replacements[0].text == 0);
+        REQUIRE(replacements[0].newText == wxT("bba"));
+        REQUIRE(replacements[0].count == 2);
+        REQUIRE(replacements[1].text == 2);
+        REQUIRE(replacements[1].newText == wxT("xbx"));
+        REQUIRE(replacements[1].count == 1);
+      }
+    }
+  }
+  GIVEN("Random texts") {
+    std::mt19937 randomNumbers(7);
+    std::vector<wxString> texts;
+    for (int i = 0; i < 200; i++)
+    {
+      wxString text;
+      for (int j = randomNumbers() % 20; j > 0; j--)
+        text += wxChar(wxT('a') + randomNumbers() % 3);
+      texts.push_back(text);
+    }
+    SearchIndex index;
+    Update(index, texts, std::vector<wxUint64>(texts.size(), 1));
+    REQUIRE(index.Search({wxT("ab"), false, false}));
+    THEN("replacing all matches gives the same texts as wxString::Replace") {
+      auto replacements = index.ReplaceAll(wxT("c"));
+      for (auto const &replacement : replacements)
+      {
+        wxString expected = texts[replacement.text];
+        REQUIRE(size_t(expected.Replace(wxT("ab"), wxT("c"))) == replacement.count);
+        REQUIRE(expected == replacement.newText);
+      }
+      REQUIRE(replacements.size() ==
+              size_t(std::count_if(texts.begin(), texts.end(),
+                                   [](const wxString &text){ return text.Contains(wxT("ab")); })));
+    }
+  }
+}
+
+SCENARIO("SearchIndex searches for regular expressions") {
+  GIVEN("A few texts") {
+    SearchIndex index;
+    Update(index, {wxT("sin(x)+cos(y)"), wxT("x:1;\ny:22;")}, {1, 1});
+    WHEN("a regular expression is searched for") {
+      REQUIRE(index.Search({wxT("[a-z]+\\("), true, true}));
+      THEN("each match is found once") {
+        REQUIRE(index.GetMatchCount() == 2);
+        SearchIndex::Match match;
+        REQUIRE(index.FindNext(0, 1, true, match));
+        REQUIRE(match.start == 7);
+        REQUIRE(match.length == 4);
+      }
+    }
+    WHEN("a regular expression that starts at the beginning of a line is searched for") {
+      REQUIRE(index.Search({wxT("^[a-z]:"), true, true}));
+      THEN("it is found at the start of each line") {
+        REQUIRE(index.GetMatchCount() == 2);
+        REQUIRE(index.GetMatchCount(1) == 2);
+      }
+    }
+    WHEN("an invalid regular expression is searched for") {
+      THEN("the search fails and finds nothing") {
+        REQUIRE(!index.Search({wxT("sin("), true, true}));
+        REQUIRE(index.GetMatchCount() == 0);
+      }
+    }
+    WHEN("all matches of a regular expression are replaced") {
+      REQUIRE(index.Search({wxT("([0-9]+)"), true, true}));
+      auto replacements = index.ReplaceAll(wxT("(\\1)"));
+      THEN("the replacement can refer to the match") {
+        REQUIRE(replacements.size() == 1);
+        REQUIRE(replacements[0].newText == wxT("x:(1);\ny:(22);"));
+        REQUIRE(replacements[0].count == 2);
+      }
+    }
+  }
+  GIVEN("A selection") {
+    wxString newText;
+    THEN("it is only replaced if it matches as a whole") {
+      REQUIRE(SearchIndex::ReplaceRegexMatch(wxT("x^2"), {wxT("x\\^([0-9])"), true, true},
+                                             wxT("x**\\1"), newText));
+      REQUIRE(newText == wxT("x**2"));
+      REQUIRE(!SearchIndex::ReplaceRegexMatch(wxT("x^2+1"), {wxT("x\\^([0-9])"), true, true},
+                                              wxT("x**\\1"), newText));
+    }
+  }
+}
+
+SCENARIO("Searching while typing in a large worksheet is fast", "[benchmark]") {
+  GIVEN("A worksheet with 5,000 code cells") {
+    std::vector<wxString> texts;
+    for (int i = 0; i < 5000; i++)
+      texts.push_back(wxString::Format(wxT("f%i(x):=block([a:%i,b],b:integrate(sin(a*x),x,0,%i),"
+                                           "expand(b^2+Sum(x^k,k,0,n)));"), i, i, i % 13));
+    const wxString needle = wxT("integrate(sin(a");
+    WHEN("the search string is typed char by char, with one cell edited per key press") {
+      // Each key press searches the whole worksheet, like the find dialog does
+      // while the search string is typed.
+      wxStopWatch stopwatch;
+      SearchIndex index;
+      std::vector<wxUint64> revisions(texts.size(), 1);
+      size_t indexed = 0;
+      for (size_t length = 1; length <= needle.Length(); length++)
+      {
+        revisions[length * 97 % texts.size()]++;
+        Update(index, texts, revisions);
+        REQUIRE(index.Search({needle.Left(length), true, false}));
+        indexed = index.GetMatchCount();
+      }
+      long indexTime = stopwatch.Time();
+
+      stopwatch.Start();
+      size_t scanned = 0;
+      for (size_t length = 1; length <= needle.Length(); length++)
+      {
+        scanned = 0;
+        for (auto const &text : texts)
+          scanned += ScanMatches(text, needle.Left(length), true).size();
+      }
+      long scanTime = stopwatch.Time();
+      WARN("Search index: " << indexTime << " ms, searching all cells: " << scanTime << " ms");
+      THEN("both methods find the same number of matches") {
+        REQUIRE(indexed == scanned);
+        REQUIRE(indexed == texts.size());
+      }
+    }
+  }
+}
+
+// If we don't provide our own main when compiling on MinGW
+// we currently get an error message that WinMain@16 is missing
+// (https://github.com/catchorg/Catch2/issues/1287)
+int main(int argc, char* argv[])
+{
+  wxEntryStart(argc, argv);
+  int result = Catch::Session().run(argc, argv);
+  wxEntryCleanup();
+  return result;
+}
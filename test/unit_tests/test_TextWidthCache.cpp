@@ -0,0 +1,188 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+
+#define CATCH_CONFIG_RUNNER
+#include "FontAttribs.cpp"
+#include "FontCache.cpp"
+#include "TextStyle.cpp"
+#include "TextWidthCache.cpp"
+#include <catch2/catch.hpp>
+#include <wx/bitmap.h>
+#include <wx/dcmemory.h>
+#include <wx/init.h>
+#include <wx/stopwatch.h>
+#include <vector>
+
+/*! Breaks a line into parts that are narrower than lineWidth, like text cells do
+
+  \param measure Returns the width of the chars start...end of the line
+  \return The number of parts
+ */
+template <typename Measure>
+static size_t WrapLine(const wxString &line, int lineWidth, Measure &&measure)
+{
+  size_t parts = 1;
+  size_t lineStart = 0;
+  size_t lastSpace = 0;
+  for (size_t i = 0; i < line.Length(); i++)
+  {
+    if ((line[i] != wxT(' ')) && (i + 1 < line.Length()))
+      continue;
+    if ((measure(lineStart, i) >= lineWidth) && (lastSpace > lineStart))
+    {
+      parts++;
+      lineStart = lastSpace + 1;
+    }
+    lastSpace = i;
+  }
+  return parts;
+}
+
+SCENARIO("TextWidthCache remembers the sizes of text") {
+  wxBitmap bitmap(100, 100);
+  wxMemoryDC dc(bitmap);
+  dc.SetFont(*wxNORMAL_FONT);
+  TextWidthCache cache;
+  GIVEN("The sizes measured in a font") {
+    TextWidthCache::Widths &widths = cache.GetWidths(Style(AFontSize(10)));
+    wxSize size = cache.GetTextSize(widths, dc, wxT("sin(x)"));
+    THEN("the size is the one the dc measures") {
+      REQUIRE(size == dc.GetTextExtent(wxT("sin(x)")));
+      REQUIRE(cache.GetSize() == 1);
+    }
+    WHEN("the same text is measured again") {
+      cache.GetTextSize(widths, dc, wxT("sin(x)"));
+      THEN("it is looked up instead") {
+        REQUIRE(cache.GetSize() == 1);
+      }
+    }
+    WHEN("another font is used") {
+      TextWidthCache::Widths &otherWidths = cache.GetWidths(Style(AFontSize(12)));
+      THEN("its sizes are stored separately") {
+        REQUIRE(&otherWidths != &widths);
+        REQUIRE(otherWidths.empty());
+        REQUIRE(&cache.GetWidths(Style(AFontSize(10))) == &widths);
+        REQUIRE(&cache.GetWidths(Style(AFontSize(10)), true) != &widths);
+      }
+    }
+    WHEN("the cache is cleared") {
+      cache.Clear();
+      THEN("the sizes are forgotten, but the font is still known") {
+        REQUIRE(cache.GetSize() == 0);
+        REQUIRE(&cache.GetWidths(Style(AFontSize(10))) == &widths);
+      }
+    }
+    WHEN("more pieces of text than allowed are measured") {
+      for (size_t i = 0; i < TextWidthCache::maxWidthsPerFont + 10; i++)
+        cache.GetTextSize(widths, dc, wxString::Format(wxT("%zu"), i));
+      THEN("the old sizes are dropped") {
+        REQUIRE(widths.size() <= TextWidthCache::maxWidthsPerFont);
+        REQUIRE(cache.GetSize() == widths.size());
+      }
+    }
+    WHEN("more pieces of text than allowed for all fonts are measured") {
+      size_t fonts = TextWidthCache::maxWidths / TextWidthCache::maxWidthsPerFont + 1;
+      for (size_t font = 0; font < fonts; font++)
+      {
+        TextWidthCache::Widths &fontWidths = cache.GetWidths(Style(AFontSize(20 + font)));
+        for (size_t i = 0; i + 1 < TextWidthCache::maxWidthsPerFont; i++)
+          cache.GetTextSize(fontWidths, dc, wxString::Format(wxT("%zu"), i));
+      }
+      THEN("the cache doesn't grow beyond its limit") {
+        REQUIRE(cache.GetSize() <= TextWidthCache::maxWidths);
+      }
+    }
+  }
+}
+
+SCENARIO("Rewrapping a long text cell is fast", "[benchmark]") {
+  wxBitmap bitmap(100, 100);
+  wxMemoryDC dc(bitmap);
+  dc.SetFont(*wxNORMAL_FONT);
+  TextWidthCache cache;
+  GIVEN("A text cell with 2,000 lines") {
+    std::vector<wxString> lines;
+    const wxString words[] = {wxT("The"), wxT("integral"), wxT("of"), wxT("sin(x)"),
+                              wxT("is"), wxT("a"), wxT("periodic"), wxT("function,"),
+                              wxT("which"), wxT("maxima"), wxT("finds"), wxT("easily.")};
+    for (int i = 0; i < 2000; i++)
+    {
+      wxString line;
+      for (int j = 0; j < 20 + i % 15; j++)
+        line << words[(i + j * 7) % WXSIZEOF(words)] << wxT(" ");
+      lines.push_back(line);
+    }
+    WHEN("the cell is wrapped at 20 different widths") {
+      // The old way: Measure each line up to each space it can be broken at.
+      wxStopWatch stopwatch;
+      size_t measuredParts = 0;
+      for (int width = 200; width < 1200; width += 50)
+        for (auto const &line : lines)
+          measuredParts += WrapLine(line, width, [&](size_t start, size_t end) {
+            return dc.GetTextExtent(line.SubString(start, end)).GetWidth();
+          });
+      long measured = stopwatch.Time();
+
+      // The new way: Add up the cached widths of the words.
+      stopwatch.Start();
+      size_t cachedParts = 0;
+      TextWidthCache::Widths &widths = cache.GetWidths(Style(AFontSize(10)));
+      for (int width = 200; width < 1200; width += 50)
+        for (auto const &line : lines)
+        {
+          // Like EditorCell::StyleTextTexts() the width is measured anew
+          // from the start of each line on, but word by word.
+          size_t lineStart = 0, measuredUpTo = 0;
+          int measuredWidth = 0;
+          cachedParts += WrapLine(line, width, [&](size_t start, size_t end) {
+            if (start != lineStart)
+            {
+              lineStart = measuredUpTo = start;
+              measuredWidth = 0;
+            }
+            measuredWidth += cache.GetTextSize(
+              widths, dc, line.SubString(measuredUpTo, end)).GetWidth();
+            measuredUpTo = end + 1;
+            return measuredWidth;
+          });
+        }
+      long cached = stopwatch.Time();
+      WARN("Cached word widths: " << cached << " ms, measuring the lines: " << measured << " ms");
+      THEN("both find about the same number of lines") {
+        REQUIRE(cachedParts >= measuredParts * 95 / 100);
+        REQUIRE(cachedParts <= measuredParts * 105 / 100);
+        REQUIRE(cache.GetSize() < 1000);
+      }
+    }
+  }
+}
+
+// If we don't provide our own main when compiling on MinGW
+// we currently get an error message that WinMain@16 is missing
+// (https://github.com/catchorg/Catch2/issues/1287)
+int main(int argc, char* argv[])
+{
+  wxEntryStart(argc, argv);
+  int result = Catch::Session().run(argc, argv);
+  wxEntryCleanup();
+  return result;
+}
@@ -0,0 +1,270 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+#define CATCH_CONFIG_RUNNER
+#include "FontAttribs.cpp"
+#include "FontCache.cpp"
+#include "MaximaTokenizer.cpp"
+#include "TextStyle.cpp"
+#include "TokenLines.cpp"
+#include <catch2/catch.hpp>
+#include <wx/init.h>
+#include <wx/stopwatch.h>
+#include <random>
+
+Configuration::Configuration(wxDC *dc, InitOpt) : m_dc(dc)
+{
+  m_changeAsterisk = false;
+  m_inLispMode = false;
+}
+Configuration::~Configuration() {}
+
+//! Displays each char of a token as a snippet of its own
+static size_t CharSnippets(const MaximaTokenizer::Token &token)
+{
+  return token.GetText().Length();
+}
+
+//! The snippets the tokens are displayed as, one for each char
+static std::vector<wxChar> Snippets(const MaximaTokenizer::TokenList &tokens)
+{
+  std::vector<wxChar> snippets;
+  for (auto const &token : tokens)
+    for (auto const &ch : token.GetText())
+      snippets.push_back(ch);
+  return snippets;
+}
+
+//! A piece of code that is re-tokenized after each edit like EditorCell does
+struct Code
+{
+  explicit Code(const wxString &code) : text(code)
+  {
+    tokens = MaximaTokenizer(text, &config).PopTokens();
+    snippets = Snippets(tokens);
+    lines.Build(text, tokens, CharSnippets);
+  }
+
+  //! Replaces the chars start...end-1 by newText
+  void Edit(size_t start, size_t end, const wxString &newText)
+  {
+    ReplaceText(start, end, newText);
+    Restyle();
+  }
+
+  //! Replaces the chars start...end-1 by newText like EditorCell::ReplaceText() does
+  void ReplaceText(size_t start, size_t end, const wxString &newText)
+  {
+    if (reportEdits)
+      lines.Replace(start, end, newText.Length());
+    else
+      lines.ReplaceAll();
+    text.replace(start, end - start, newText);
+  }
+
+  //! Re-tokenizes the code like EditorCell::StyleTextCodeIncrementally() does
+  void Restyle()
+  {
+    TokenLines::Change change;
+    if (!lines.Update(text, &config, tokens, CharSnippets, change))
+      return;
+    std::vector<wxChar> newSnippets;
+    for (size_t i = change.firstToken; i < change.firstToken + change.newTokens; ++i)
+      for (auto const &ch : tokens[i].GetText())
+        newSnippets.push_back(ch);
+    TokenLines::ReplaceRange(snippets, change.firstSnippet, change.endSnippet,
+                             std::move(newSnippets));
+  }
+
+  //! Does the code look like it had been tokenized from scratch?
+  bool MatchesScratch() const
+  {
+    auto scratchTokens = MaximaTokenizer(text, &config).PopTokens();
+    if (scratchTokens.size() != tokens.size())
+      return false;
+    for (size_t i = 0; i < tokens.size(); ++i)
+      if ((scratchTokens[i].GetText() != tokens[i].GetText()) ||
+          (scratchTokens[i].GetStyle() != tokens[i].GetStyle()))
+        return false;
+    if (Snippets(scratchTokens) != snippets)
+      return false;
+
+    TokenLines scratchLines;
+    scratchLines.Build(text, scratchTokens, CharSnippets);
+    if (scratchLines.GetLineCount() != lines.GetLineCount())
+      return false;
+    for (size_t i = 0; i < lines.GetLineCount(); ++i)
+      if ((scratchLines.GetLineStart(i) != lines.GetLineStart(i)) ||
+          (scratchLines.GetLineToken(i) != lines.GetLineToken(i)) ||
+          (scratchLines.GetLineSnippet(i) != lines.GetLineSnippet(i)))
+        return false;
+    return true;
+  }
+
+  Configuration config;
+  wxString text;
+  MaximaTokenizer::TokenList tokens;
+  std::vector<wxChar> snippets;
+  TokenLines lines;
+  //! Tell TokenLines where the text has been edited?
+  bool reportEdits = true;
+};
+
+static const wxString code =
+  wxT("a:1;\n")
+  wxT("f (x):=x^2;\n")
+  wxT("/* a comment\n")
+  wxT("   over two lines */\n")
+  wxT("b:\"a string\n")
+  wxT("over two lines\";\n")
+  wxT("g\n")
+  wxT("  (y);\n")
+  wxT("c:3");
+
+SCENARIO("TokenLines re-tokenizes edited code like tokenizing it from scratch") {
+  GIVEN("Code with comments and strings that span lines") {
+    WHEN("a char is inserted, deleted or replaced by a newline at the start, in the middle or at the end") {
+      const size_t positions[] = {0, code.Length() / 2, code.Length() - 1};
+      for (auto pos : positions)
+      {
+        const std::pair<size_t, wxString> edits[] = {
+          {pos, wxT("x")}, {pos + 1, wxEmptyString}, {pos + 1, wxT("\n")},
+          {pos, wxT("\n")}, {pos, wxT(" ")}};
+        for (auto const &edit : edits)
+        {
+          INFO("Replacing the chars " << pos << "..." << edit.first << " by \"" <<
+               std::string(edit.second.utf8_str()) << "\"");
+          Code edited(code);
+          edited.Edit(pos, edit.first, edit.second);
+          CHECK(edited.MatchesScratch());
+        }
+      }
+    }
+    WHEN("comments and strings are edited, opened or closed") {
+      const std::pair<wxString, wxString> edits[] = {
+        {wxT("comment"), wxT("comment\n")},
+        {wxT("comment"), wxT("\"")},
+        {wxT(" */"), wxEmptyString},
+        {wxT("a:1;"), wxT("a:1;/*")},
+        {wxT("over two lines\""), wxT("over two lines")},
+        {wxT("a string"), wxT("a \" string")},
+        {wxT("b:"), wxT("\"b:")},
+        {wxT("c:3"), wxT("\"c:3")},
+        {wxT("g\n"), wxT("g;\n")},
+        {wxT("  (y)"), wxT("  y")},
+        {wxT("f (x)"), wxT("f\n(x)")}};
+      for (auto const &edit : edits)
+      {
+        INFO("Replacing \"" << std::string(edit.first.utf8_str()) << "\" by \"" <<
+             std::string(edit.second.utf8_str()) << "\"");
+        Code edited(code);
+        size_t pos = code.Find(edit.first);
+        edited.Edit(pos, pos + edit.first.Length(), edit.second);
+        CHECK(edited.MatchesScratch());
+      }
+    }
+    WHEN("many random edits are made one after another") {
+      for (bool reportEdits : {true, false})
+      {
+        std::mt19937 randomNumbers(42);
+        const wxString pieces[] = {wxT(""), wxT("x"), wxT("\n"), wxT(" "), wxT("("), wxT(")"),
+                                   wxT(";"), wxT("\""), wxT("/*"), wxT("*/"), wxT("a\nb")};
+        Code edited(code);
+        edited.reportEdits = reportEdits;
+        bool matches = true;
+        for (int i = 0; (i < 1000) && matches; i++)
+        {
+          size_t start = randomNumbers() % (edited.text.Length() + 1);
+          size_t end = start + randomNumbers() % (edited.text.Length() - start + 1) % 4;
+          edited.Edit(start, end, pieces[randomNumbers() % WXSIZEOF(pieces)]);
+          matches = edited.MatchesScratch();
+          INFO("After edit " << i << " the code is \"" << std::string(edited.text.utf8_str()) <<
+               "\", edits reported: " << reportEdits);
+          CHECK(matches);
+        }
+      }
+    }
+    WHEN("several edits are made before the code is re-tokenized") {
+      std::mt19937 randomNumbers(42);
+      const wxString pieces[] = {wxT(""), wxT("x"), wxT("\n"), wxT("\""), wxT("/*"), wxT("a\nb")};
+      Code edited(code);
+      bool matches = true;
+      for (int i = 0; (i < 300) && matches; i++)
+      {
+        for (int j = randomNumbers() % 4; j > 0; j--)
+        {
+          size_t start = randomNumbers() % (edited.text.Length() + 1);
+          size_t end = start + randomNumbers() % (edited.text.Length() - start + 1) % 4;
+          edited.ReplaceText(start, end, pieces[randomNumbers() % WXSIZEOF(pieces)]);
+        }
+        edited.Restyle();
+        matches = edited.MatchesScratch();
+        INFO("After edit " << i << " the code is \"" << std::string(edited.text.utf8_str()) << "\"");
+        CHECK(matches);
+      }
+    }
+  }
+}
+
+SCENARIO("Typing into a long code cell is fast", "[benchmark]") {
+  GIVEN("A code cell with 100,000 lines") {
+    wxString text;
+    for (int i = 0; i < 100000; i++)
+      text << wxString::Format(wxT("a[%i]:sin(x)^%i; /* %i */\n"), i, i % 7, i);
+    WHEN("100 chars are typed near its start") {
+      // Each keypress is followed by re-tokenizing the code, like
+      // EditorCell::StyleText() does.
+      long times[2];
+      bool matches[2];
+      for (bool reportEdits : {true, false})
+      {
+        Code edited(text);
+        edited.reportEdits = reportEdits;
+        wxStopWatch stopwatch;
+        for (size_t pos = 10; pos < 110; pos++)
+          edited.Edit(pos, pos, wxT("y"));
+        times[reportEdits] = stopwatch.Time();
+        matches[reportEdits] = edited.MatchesScratch();
+      }
+      wxStopWatch stopwatch;
+      Code scratch(text);
+      long scratchTime = stopwatch.Time();
+      WARN(text.Length() << " chars, 100 edits: " << times[true] << " ms with the edits reported, " <<
+           times[false] << " ms finding the changed lines by their hashes. Tokenizing once from scratch: " <<
+           scratchTime << " ms");
+      THEN("both ways arrive at the tokens of the edited code") {
+        REQUIRE(matches[true]);
+        REQUIRE(matches[false]);
+      }
+    }
+  }
+}
+
+// If we don't provide our own main when compiling on MinGW
+// we currently get an error message that WinMain@16 is missing
+// (https://github.com/catchorg/Catch2/issues/1287)
+int main(int argc, char* argv[])
+{
+  wxEntryStart(argc, argv);
+  int result = Catch::Session().run(argc, argv);
+  wxEntryCleanup();
+  return result;
+}
@@ -0,0 +1,136 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+#define CATCH_CONFIG_RUNNER
+#include "UndoHistory.cpp"
+#include <catch2/catch.hpp>
+#include <wx/init.h>
+#include <random>
+
+//! Makes a random edit to text
+static void RandomEdit(std::mt19937 &randomNumbers, wxString &text)
+{
+  const wxString pieces[] = {wxT(""), wxT("x"), wxT("\n"), wxT("sin(x)"), wxT("a:b;")};
+  size_t start = randomNumbers() % (text.Length() + 1);
+  size_t end = start + randomNumbers() % (text.Length() - start + 1) % 6;
+  text.replace(start, end - start, pieces[randomNumbers() % WXSIZEOF(pieces)]);
+}
+
+SCENARIO("UndoHistory restores every state") {
+  GIVEN("A history of 1000 random edits") {
+    std::mt19937 randomNumbers(42);
+    std::vector<wxString> states;
+    UndoHistory history;
+    wxString text = wxT("f(x):=x^2;\nplot2d(f(x),[x,-1,1]);");
+    for (int i = 0; i < 1000; i++)
+    {
+      RandomEdit(randomNumbers, text);
+      states.push_back(text);
+      history.Append(text, i, -1, -1);
+    }
+    THEN("the history contains checkpoints") {
+      REQUIRE(history.GetSize() == states.size());
+      REQUIRE(history.GetCheckpoints() == states.size() / UndoHistory::checkpointInterval);
+    }
+    WHEN("the states are undone one after another") {
+      bool allEqual = true;
+      for (size_t i = states.size(); i-- > 0;)
+        allEqual = allEqual && (history.GetText(i) == states[i]);
+      THEN("each state has the right text") {
+        REQUIRE(allEqual);
+        REQUIRE(history.GetCaret(17).position == 17);
+      }
+    }
+    WHEN("the states are accessed in random order") {
+      bool allEqual = true;
+      for (int i = 0; i < 1000; i++)
+      {
+        size_t index = randomNumbers() % states.size();
+        allEqual = allEqual && (history.GetText(index) == states[index]);
+      }
+      THEN("each state has the right text") {
+        REQUIRE(allEqual);
+      }
+    }
+    WHEN("the history is truncated and new states are added") {
+      history.Truncate(500);
+      states.resize(500);
+      text = states.back();
+      for (int i = 0; i < 50; i++)
+      {
+        RandomEdit(randomNumbers, text);
+        states.push_back(text);
+        history.Append(text, i, -1, -1);
+      }
+      THEN("the old and the new states are restored") {
+        REQUIRE(history.GetSize() == states.size());
+        REQUIRE(history.GetText(0) == states[0]);
+        REQUIRE(history.GetLastText() == states.back());
+        REQUIRE(history.GetText(499) == states[499]);
+      }
+    }
+    WHEN("the history is trimmed to half its size") {
+      size_t usage = history.GetMemoryUsage();
+      size_t dropped = history.Trim(usage / 2);
+      states.erase(states.begin(), states.begin() + dropped);
+      THEN("the oldest states are dropped") {
+        REQUIRE(dropped > 0);
+        REQUIRE(history.GetMemoryUsage() <= usage / 2);
+        REQUIRE(history.GetSize() == states.size());
+        REQUIRE(history.GetText(0) == states[0]);
+        REQUIRE(history.GetLastText() == states.back());
+      }
+    }
+  }
+}
+
+SCENARIO("UndoHistory doesn't copy big texts for each step") {
+  GIVEN("A text of 1 MB") {
+    wxString text;
+    for (int i = 0; i < 20000; i++)
+      text << wxString::Format(wxT("a[%i]:sin(x)^%i;\n"), i, i % 7);
+    UndoHistory history;
+    history.Append(text, 0, -1, -1);
+    WHEN("500 chars are typed into it one after another") {
+      for (int i = 0; i < 500; i++)
+      {
+        text.insert(text.Length() / 2 + i, wxT("x"));
+        history.Append(text, i, -1, -1);
+      }
+      THEN("the history contains only a few copies of the text") {
+        size_t textBytes = text.Length() * sizeof(wxChar);
+        REQUIRE(history.GetMemoryUsage() < 10 * textBytes);
+        REQUIRE(history.GetText(0).Length() == text.Length() - 500);
+      }
+    }
+  }
+}
+
+// If we don't provide our own main when compiling on MinGW
+// we currently get an error message that WinMain@16 is missing
+// (https://github.com/catchorg/Catch2/issues/1287)
+int main(int argc, char* argv[])
+{
+  wxEntryStart(argc, argv);
+  int result = Catch::Session().run(argc, argv);
+  wxEntryCleanup();
+  return result;
+}
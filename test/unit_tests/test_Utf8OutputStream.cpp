@@ -0,0 +1,124 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+#define CATCH_CONFIG_RUNNER
+#include "Utf8OutputStream.cpp"
+#include <catch2/catch.hpp>
+#include <wx/init.h>
+#include <wx/mstream.h>
+#include <wx/stopwatch.h>
+#include <wx/txtstrm.h>
+#include <cstring>
+
+//! Generates the XML a worksheet with a few thousand cells would produce
+static std::vector<wxString> GenerateCells(int count)
+{
+  std::vector<wxString> cells;
+  cells.reserve(count);
+  for (int i = 0; i < count; i++)
+    cells.emplace_back(
+      wxString::Format(
+        wxT("\n<cell type=\"code\">\n<input>\n<editor type=\"input\">\n"
+            "<line>f_%i(x):=sin(x)^%i+α*cos(x);</line>\n</editor>\n</input>\n"
+            "<output>\n<mth><lbl>(%%o%i) </lbl><v>α</v><h>*</h>"
+            "<fn><r><fnm>cos</fnm></r><r><p><v>x</v></p></r></fn></mth></output>\n</cell>\n"),
+        i, i, i));
+  return cells;
+}
+
+SCENARIO("Utf8OutputStream writes the same bytes as a wxTextOutputStream") {
+  GIVEN("A large set of cells") {
+    auto const cells = GenerateCells(20000);
+    wxString const header = wxT("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<wxMaximaDocument>");
+    wxString const footer = wxT("\n</wxMaximaDocument>");
+
+    WHEN("the document is written as one string and streamed cell by cell") {
+      wxStopWatch concatenatedTime;
+      wxMemoryOutputStream concatenated;
+      size_t concatenatedSize;
+      {
+        wxString xmlText = header;
+        for (auto const &cell : cells)
+          xmlText += cell;
+        xmlText += footer;
+        concatenatedSize = xmlText.utf8_str().length();
+        wxTextOutputStream output(concatenated, wxEOL_UNIX, wxConvUTF8);
+        output << xmlText;
+      }
+      long concatenatedMs = concatenatedTime.Time();
+
+      wxStopWatch streamedTime;
+      wxMemoryOutputStream streamed;
+      size_t peakBuffer;
+      {
+        Utf8OutputStream output(streamed);
+        output << header;
+        for (auto const &cell : cells)
+          output << cell;
+        output << footer;
+        REQUIRE(output.Flush());
+        peakBuffer = output.GetPeakBufferSize();
+      }
+      long streamedMs = streamedTime.Time();
+
+      WARN("Concatenating: " << concatenatedMs << " ms, "
+           << concatenatedSize << " bytes of text held in memory");
+      WARN("Streaming: " << streamedMs << " ms, peak buffer " << peakBuffer << " bytes");
+
+      THEN("both outputs are byte-identical") {
+        REQUIRE(streamed.GetLength() == concatenated.GetLength());
+        auto const *a = static_cast<const char *>(streamed.GetOutputStreamBuffer()->GetBufferStart());
+        auto const *b = static_cast<const char *>(concatenated.GetOutputStreamBuffer()->GetBufferStart());
+        REQUIRE(memcmp(a, b, streamed.GetLength()) == 0);
+      }
+      THEN("streaming needs only a fraction of the memory") {
+        REQUIRE(peakBuffer * 10 < concatenatedSize);
+      }
+    }
+  }
+}
+
+SCENARIO("Utf8OutputStream handles chunks bigger than its buffer") {
+  GIVEN("A tiny buffer") {
+    wxMemoryOutputStream stream;
+    wxString const text = wxString(wxT('ä'), 1000);
+    {
+      Utf8OutputStream output(stream, 16);
+      output << text << "x" << 42L;
+    }
+    THEN("all bytes arrive in order") {
+      REQUIRE(stream.GetLength() == 2000 + 1 + 2);
+      auto const *data = static_cast<const char *>(stream.GetOutputStreamBuffer()->GetBufferStart());
+      REQUIRE(wxString::FromUTF8(data, stream.GetLength()) == text + wxT("x42"));
+    }
+  }
+}
+
+// If we don't provide our own main when compiling on MinGW
+// we currently get an error message that WinMain@16 is missing
+// (https://github.com/catchorg/Catch2/issues/1287)
+int main(int argc, char* argv[])
+{
+  wxEntryStart(argc, argv);
+  int result = Catch::Session().run(argc, argv);
+  wxEntryCleanup();
+  return result;
+}
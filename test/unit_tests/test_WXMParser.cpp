@@ -0,0 +1,593 @@
+// -*- mode: c++; c-file-style: "linux"; c-basic-offset: 2; indent-tabs-mode: nil -*-
+//
+//  Copyright (C) 2021 Gunter Königsmann <wxMaxima@physikbuch.de>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 2 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+//
+//  SPDX-License-Identifier: GPL-2.0+
+
+#define CATCH_CONFIG_RUNNER
+#include "WXMParser.cpp"
+#include <catch2/catch.hpp>
+#include <wx/init.h>
+#include <wx/filename.h>
+#include <wx/stopwatch.h>
+#include <wx/textfile.h>
+#include <wx/tokenzr.h>
+#include <wx/wfstream.h>
+#include <random>
+
+using namespace Format;
+
+static const wxString wxmFirstLine = wxT("/* [wxMaxima batch file version 1] [ DO NOT EDIT BY HAND! ]*/");
+
+namespace Format
+{
+// Needs to be in the namespace of WXMCell, else std::vector doesn't find it.
+static bool operator==(const WXMCell &a, const WXMCell &b)
+{
+  return (a.type == b.type) && (a.text == b.text) && (a.hide == b.hide) &&
+    (a.autoAnswer == b.autoAnswer) && (a.answers == b.answers) &&
+    (a.hasImage == b.hasImage) && (a.imageType == b.imageType) &&
+    (a.imageData == b.imageData) && (a.hiddenTree == b.hiddenTree);
+}
+}
+
+//! A human-readable description of a list of cells
+static std::string Describe(const std::vector<WXMCell> &cells)
+{
+  wxString retval;
+  for (auto const &cell : cells)
+  {
+    retval << wxString::Format(wxT("[type %i hide %i autoanswer %i image %i \""),
+                               int(cell.type), int(cell.hide), int(cell.autoAnswer), int(cell.hasImage))
+           << cell.text << wxT("\"");
+    for (auto const &answer : cell.answers)
+      retval << wxT(" \"") << answer.first << wxT("\"->\"") << answer.second << wxT("\"");
+    if (!cell.hiddenTree.empty())
+      retval << wxT(" folded: ") << wxString::FromUTF8(Describe(cell.hiddenTree).c_str());
+    retval << wxT("]\n");
+  }
+  return std::string(retval.utf8_str());
+}
+
+/* The parsers wxMaxima used before WXMParser and MACParser existed, with the
+   only difference that they return cell descriptions instead of cells. Only
+   two bugs have been fixed: A folded tree at the start of the file no more
+   causes a crash and a wxMaxima comment that isn't closed before the end of a
+   .mac file no more causes an endless loop. */
+
+static std::vector<WXMCell> ReferenceTreeFromWXM(const wxArrayString &wxmLines)
+{
+  auto wxmLine = wxmLines.begin();
+  auto const end = wxmLines.end();
+
+  const auto getLinesUntil = [&wxmLine, end](const wxString &tag) -> wxString
+  {
+    wxString line;
+    while (wxmLine != end)
+    {
+      auto const thisLn = wxmLine++;
+      if (*thisLn == tag)
+        break;
+      if (!line.empty())
+        line << '\n';
+      line << *thisLn;
+    }
+    return line;
+  };
+
+  bool hide = false;
+  std::vector<WXMCell> tree;
+  wxString question;
+
+  while (wxmLine != end)
+  {
+    WXMCell cell;
+    WXMHeaderId headerId = WXMHeaderCollection::LookupStart(*wxmLine ++);
+    wxString line;
+
+    switch (headerId)
+    {
+    case WXM_HIDE:
+      hide = true;
+      break;
+    case WXM_TITLE:
+    case WXM_SECTION:
+    case WXM_SUBSECTION:
+    case WXM_SUBSUBSECTION:
+    case WXM_HEADING5:
+    case WXM_HEADING6:
+    case WXM_COMMENT:
+    case WXM_INPUT:
+    case WXM_CAPTION:
+      cell.type = headerId;
+      cell.text = getLinesUntil(WXMHeaderCollection::GetEnd(headerId));
+      cell.hide = hide;
+      hide = false;
+      break;
+    case WXM_IMAGE:
+      if (wxmLine != end)
+      {
+        wxString const imgtype = *wxmLine ++;
+        auto ln = getLinesUntil(WXMHeaderCollection::GetEnd(headerId));
+        if (!tree.empty() && tree.back().type == WXM_CAPTION)
+        {
+          tree.back().hasImage = true;
+          tree.back().imageType = imgtype;
+          tree.back().imageData = ln;
+        }
+      }
+      break;
+    case WXM_ANSWER:
+      line = getLinesUntil(WXMHeaderCollection::GetEnd(headerId));
+      if (!tree.empty() && !question.empty())
+        tree.back().answers.emplace_back(question, line);
+      break;
+    case WXM_QUESTION:
+      question = getLinesUntil(WXMHeaderCollection::GetEnd(headerId));
+      break;
+    case WXM_AUTOANSWER:
+      if (!tree.empty())
+        tree.back().autoAnswer = true;
+      break;
+    case WXM_PAGEBREAK:
+      cell.type = WXM_PAGEBREAK;
+      break;
+    case WXM_FOLD:
+    {
+      wxArrayString hiddenTree;
+      auto const &endHeader = WXMHeaderCollection::GetEnd(headerId);
+      while (wxmLine != end && *wxmLine != endHeader)
+        hiddenTree.Add(*wxmLine ++);
+
+      if (!tree.empty())
+        tree.back().hiddenTree = ReferenceTreeFromWXM(hiddenTree);
+    }
+    break;
+    case WXM_INVALID:
+    case WXM_FOLD_END:
+    case WXM_MAX:
+      ;
+    }
+
+    if (cell.type != WXM_INVALID)
+      tree.push_back(std::move(cell));
+  }
+  return tree;
+}
+
+static std::vector<WXMCell> ReferenceParseMACContents(const wxString &macContents)
+{
+  wxString wxmLines;
+  std::vector<WXMCell> tree;
+  auto const appendCell = [&tree](WXMHeaderId type, const wxString &text)
+  {
+    tree.emplace_back();
+    tree.back().type = type;
+    tree.back().text = text;
+  };
+  auto const appendWXM = [&tree, &appendCell](wxString &wxmLines)
+  {
+    wxStringTokenizer tokenizer(wxmLines, "\n");
+    wxArrayString commentLines;
+    while (tokenizer.HasMoreTokens())
+      commentLines.Add(tokenizer.GetNextToken());
+
+    std::vector<WXMCell> cells = ReferenceTreeFromWXM(commentLines);
+    if (!cells.empty())
+      std::move(cells.begin(), cells.end(), std::back_inserter(tree));
+    else
+      appendCell(WXM_COMMENT, wxmLines);
+    wxmLines = wxEmptyString;
+  };
+
+  auto const end = macContents.end();
+
+  struct State { wxChar lastChar; wxString::const_iterator ch; };
+  auto const readUntil = [end](wxString &line, State s, wxChar until)
+  {
+    while (s.ch != end)
+    {
+      wxChar c = *s.ch++;
+      line += s.lastChar = c;
+      if (c == until)
+        break;
+    }
+    return s;
+  };
+
+  wxString line;
+  for (State s{' ', macContents.begin()}; s.ch != macContents.end(); )
+  {
+    wxChar c = *s.ch;
+    if (s.lastChar == '/' && c == '*')
+    {
+      bool isCommentLine = false;
+      wxString trimmed = line;
+      trimmed.Trim(false);
+      if (trimmed == wxT('/'))
+      {
+        isCommentLine = true;
+        line = trimmed;
+      }
+
+      while (s.ch != macContents.end())
+      {
+        wxChar ch = *s.ch++;
+        bool finished = (s.lastChar == wxT('*') && ch == wxT('/'));
+        line += s.lastChar = ch;
+        if (finished) break;
+      }
+
+      if (isCommentLine)
+      {
+        line.Trim(true);
+        line.Trim(false);
+
+        if (line.StartsWith(wxT("/* [wxMaxima: ")))
+        {
+          while(
+            !line.EndsWith(" end   ] */") &&
+            !line.EndsWith(" end   ] */\n") &&
+            (s.ch != macContents.end())
+            )
+          {
+            s = readUntil(line, s, '\n');
+          }
+
+          if (line.StartsWith(WXMHeaderCollection::GetStart(WXM_CAPTION)))
+          {
+            if (s.ch != macContents.end())
+              line += s.lastChar = *s.ch++;
+
+            s = readUntil(line, s, '\n');
+
+            while(
+              !line.EndsWith(" end   ] */") &&
+              !line.EndsWith(" end   ] */\n") &&
+              (s.ch != macContents.end())
+              )
+            {
+              s = readUntil(line, s, '\n');
+            }
+          }
+
+          wxmLines += line;
+        }
+        else
+        {
+          if(!wxmLines.IsEmpty())
+            appendWXM(wxmLines);
+          if ((line.EndsWith(" */")) || (line.EndsWith("\n*/")))
+            line.Truncate(line.length() - 3);
+          else
+            line.Truncate(line.length() - 2);
+
+          if ((line.StartsWith("/* ")) || (line.StartsWith("/*\n")))
+            line.erase(0, 3);
+          else
+            line.erase(0, 2);
+
+          appendCell(WXM_COMMENT, line);
+        }
+        line.clear();
+      }
+    }
+    else if (c == '\"')
+    {
+      s = readUntil(line, s, '"');
+    }
+    else if (c == '\\')
+    {
+      line += s.lastChar = c;
+      ++s.ch;
+    }
+    else
+    {
+      line += c;
+
+      if ((s.lastChar == wxT('$') || s.lastChar == wxT(';')) && (c == wxT('\n')))
+      {
+        line.Trim(true);
+        line.Trim(false);
+        appendCell(WXM_INPUT, line);
+        line.clear();
+      }
+      s.lastChar = c;
+      ++s.ch;
+    }
+  }
+  if(!wxmLines.IsEmpty())
+    appendWXM(wxmLines);
+
+  line.Trim(true);
+  line.Trim(false);
+  if (!line.empty())
+    appendCell(WXM_INPUT, line);
+
+  return tree;
+}
+
+static std::vector<WXMCell> ReferenceParseWXMFile(const wxString &file)
+{
+  wxTextFile text(file);
+  REQUIRE(text.Open());
+  wxArrayString wxmLines;
+  for (auto line = text.GetFirstLine(); ; line = text.GetNextLine())
+  {
+    wxmLines.Add(line);
+    if (text.Eof())
+      break;
+  }
+  return ReferenceTreeFromWXM(wxmLines);
+}
+
+static std::vector<WXMCell> ReferenceParseMACFile(const wxString &file, bool xMaximaFile)
+{
+  wxTextFile text(file);
+  REQUIRE(text.Open());
+  bool input = true;
+  wxString macContents;
+
+  for (auto line = text.GetFirstLine(); ; line = text.GetNextLine())
+  {
+    if (xMaximaFile)
+    {
+      if (line.StartsWith(wxT("(%o")))
+        input = false;
+
+      if (line.StartsWith(wxT("(%i")))
+      {
+        int end = line.Find(wxT(")"));
+        if (end > 0)
+        {
+          line = line.Right(line.Length() - end - 2);
+          input = true;
+        }
+      }
+    }
+
+    if (input)
+      macContents << line << wxT('\n');
+
+    if (text.Eof())
+      break;
+  }
+  return ReferenceParseMACContents(macContents);
+}
+
+static std::vector<WXMCell> ParseWXMFile(const wxString &file)
+{
+  wxFFileInputStream in(file);
+  REQUIRE(in.IsOk());
+  WXMLineReader lines(in);
+  std::string line;
+  REQUIRE(lines.GetLine(line));
+  REQUIRE(WXMTextToString(line) == wxmFirstLine);
+  WXMParser parser;
+  while (lines.GetLine(line))
+    parser.AddLine(line);
+  return parser.Finish();
+}
+
+static std::vector<WXMCell> ParseMACFile(const wxString &file, bool xMaximaFile)
+{
+  wxFFileInputStream in(file);
+  REQUIRE(in.IsOk());
+  WXMLineReader lines(in);
+  MACParser parser(lines, xMaximaFile);
+  return parser.Parse();
+}
+
+static void WriteFile(const wxString &file, const std::string &contents)
+{
+  wxFFileOutputStream out(file);
+  out.Write(contents.data(), contents.size());
+}
+
+//! Pieces of .wxm and .mac files the fuzzer assembles files from
+static std::vector<std::string> Fragments()
+{
+  std::vector<std::string> fragments;
+  for (int i = 0; i < WXM_MAX; i++)
+  {
+    fragments.push_back(std::string(WXMHeaderCollection::GetStart(WXMHeaderId(i)).utf8_str()));
+    fragments.push_back(std::string(WXMHeaderCollection::GetEnd(WXMHeaderId(i)).utf8_str()));
+  }
+  for (const char *fragment : {"", " ", "a", "b:c", ";", "$", "\"", "\\", "/", "*", "/*", "*/",
+                               "/* comment */", "x+y;", "f(x):=x^2$", "\xC3\xA9", "\xE2\x88\x9A",
+                               "(%i1) ", "(%i2)", "(%o1) ", ")", "png", "iVBORw0KGgo="})
+    fragments.push_back(fragment);
+  return fragments;
+}
+
+//! Assembles a random file
+static std::string RandomFile(std::mt19937 &random, const std::vector<std::string> &fragments)
+{
+  static const char *lineEndings[] = {"\n", "\n", "\n", "\r\n", "\r"};
+  std::string file;
+  size_t lines = random() % 40;
+  for (size_t i = 0; i < lines; i++)
+  {
+    size_t pieces = 1 + random() % 3;
+    for (size_t j = 0; j < pieces; j++)
+      file += fragments[random() % fragments.size()];
+    if ((i + 1 < lines) || (random() % 2))
+      file += lineEndings[random() % 5];
+  }
+  return file;
+}
+
+SCENARIO("WXMParser reads .wxm files") {
+  GIVEN("A .wxm file with all kinds of cells") {
+    wxString file = wxFileName::CreateTempFileName(wxT("wxmparser"));
+    WriteFile(file,
+              std::string(wxmFirstLine.utf8_str()) + "\n\n"
+              "/* [wxMaxima: title   start ]\nTitle\n   [wxMaxima: title   end   ] */\n\n"
+              "/* [wxMaxima: hide output   ] */\n"
+              "/* [wxMaxima: input   start ] */\na:1;\nb:2;\n/* [wxMaxima: input   end   ] */\n"
+              "/* [wxMaxima: question  start ] */\nq?\n/* [wxMaxima: question  end   ] */\n"
+              "/* [wxMaxima: answer  start ] */\nyes;\n/* [wxMaxima: answer  end   ] */\n"
+              "/* [wxMaxima: autoanswer    ] */\n"
+              "/* [wxMaxima: fold    start ] */\n"
+              "/* [wxMaxima: comment start ]\nfolded \xC3\xA9\n   [wxMaxima: comment end   ] */\n"
+              "/* [wxMaxima: fold    end   ] */\n"
+              "/* [wxMaxima: page break    ] */\r\n"
+              "/* [wxMaxima: caption start ]\r\nA plot\r\n   [wxMaxima: caption end   ] */\r\n"
+              "/* [wxMaxima: image   start ]\r\npng\r\niVBORw0KGgo=\r\n   [wxMaxima: image   end   ] */\r\n");
+    WHEN("the file is parsed") {
+      std::vector<WXMCell> cells = ParseWXMFile(file);
+      THEN("the parser finds all cells") {
+        REQUIRE(cells.size() == 4);
+        REQUIRE(cells[0].type == WXM_TITLE);
+        REQUIRE(cells[0].text == wxT("Title"));
+        REQUIRE(cells[1].type == WXM_INPUT);
+        REQUIRE(cells[1].text == wxT("a:1;\nb:2;"));
+        REQUIRE(cells[1].hide);
+        REQUIRE(cells[1].autoAnswer);
+        REQUIRE(cells[1].answers.size() == 1);
+        REQUIRE(cells[1].answers[0].first == wxT("q?"));
+        REQUIRE(cells[1].answers[0].second == wxT("yes;"));
+        REQUIRE(cells[1].hiddenTree.size() == 1);
+        REQUIRE(cells[1].hiddenTree[0].type == WXM_COMMENT);
+        REQUIRE(cells[1].hiddenTree[0].text == wxString::FromUTF8("folded \xC3\xA9"));
+        REQUIRE(cells[2].type == WXM_PAGEBREAK);
+        REQUIRE(cells[3].type == WXM_CAPTION);
+        REQUIRE(cells[3].text == wxT("A plot"));
+        REQUIRE(cells[3].hasImage);
+        REQUIRE(cells[3].imageType == wxT("png"));
+        REQUIRE(cells[3].imageData == wxT("iVBORw0KGgo="));
+      }
+      THEN("the result matches the one of the old line-based parser") {
+        REQUIRE(cells == ReferenceParseWXMFile(file));
+      }
+    }
+    wxRemoveFile(file);
+  }
+}
+
+SCENARIO("MACParser reads .mac files") {
+  GIVEN("A .mac file with code, comments and wxMaxima comments") {
+    wxString file = wxFileName::CreateTempFileName(wxT("macparser"));
+    WriteFile(file,
+              "/* A comment */\n"
+              "a:1$\n"
+              "f(x):=x^2;\n\n"
+              "/* [wxMaxima: section start ]\nSection\n   [wxMaxima: section end   ] */\n"
+              "b;");
+    WHEN("the file is parsed") {
+      std::vector<WXMCell> cells = ParseMACFile(file, false);
+      THEN("the result matches the one of the old parser") {
+        REQUIRE(cells == ReferenceParseMACFile(file, false));
+        REQUIRE(cells.size() == 5);
+        REQUIRE(cells[0].type == WXM_COMMENT);
+        REQUIRE(cells[0].text == wxT("A comment"));
+        REQUIRE(cells[2].text == wxT("f(x):=x^2;"));
+        REQUIRE(cells[4].type == WXM_SECTION);
+        REQUIRE(cells[4].text == wxT("Section"));
+      }
+    }
+    wxRemoveFile(file);
+  }
+  GIVEN("The output of xMaxima") {
+    wxString file = wxFileName::CreateTempFileName(wxT("macparser"));
+    WriteFile(file, "(%i1) a:1;\n(%o1) 1\n(%i2) \xC3\xA9:2$\n");
+    WHEN("the file is parsed") {
+      std::vector<WXMCell> cells = ParseMACFile(file, true);
+      THEN("only the input remains") {
+        REQUIRE(cells == ReferenceParseMACFile(file, true));
+        REQUIRE(cells.size() == 2);
+        REQUIRE(cells[0].text == wxT("a:1;"));
+        REQUIRE(cells[1].text == wxString::FromUTF8("\xC3\xA9:2$"));
+      }
+    }
+    wxRemoveFile(file);
+  }
+}
+
+SCENARIO("The single-pass parsers produce the same cells as the old parsers") {
+  GIVEN("Random files assembled from pieces of .wxm and .mac files") {
+    wxString file = wxFileName::CreateTempFileName(wxT("parserfuzz"));
+    std::mt19937 random(4711);
+    auto const fragments = Fragments();
+    for (int i = 0; i < 2000; i++)
+    {
+      std::string contents = RandomFile(random, fragments);
+      INFO("File contents: \"" << contents << "\"");
+
+      WriteFile(file, std::string(wxmFirstLine.utf8_str()) + "\n" + contents);
+      std::vector<WXMCell> wxmCells = ParseWXMFile(file);
+      std::vector<WXMCell> wxmReference = ReferenceParseWXMFile(file);
+      INFO("WXMParser: " << Describe(wxmCells) << "Reference: " << Describe(wxmReference));
+      REQUIRE(wxmCells == wxmReference);
+
+      WriteFile(file, contents);
+      for (bool xMaxima : {false, true})
+      {
+        std::vector<WXMCell> macCells = ParseMACFile(file, xMaxima);
+        std::vector<WXMCell> macReference = ReferenceParseMACFile(file, xMaxima);
+        INFO("xMaxima: " << xMaxima << "\nMACParser: " << Describe(macCells) <<
+             "Reference: " << Describe(macReference));
+        REQUIRE(macCells == macReference);
+      }
+    }
+    wxRemoveFile(file);
+  }
+}
+
+SCENARIO("MACParser reads big files fast", "[benchmark]") {
+  GIVEN("A 50 MB .mac file") {
+    wxString file = wxFileName::CreateTempFileName(wxT("macbenchmark"));
+    {
+      wxFFileOutputStream out(file);
+      std::string chunk;
+      for (int i = 0; i < 100; i++)
+        chunk += "/* [wxMaxima: section start ]\nSection " + std::to_string(i) +
+          "\n   [wxMaxima: section end   ] */\n"
+          "/* The square of " + std::to_string(i) + " */\n"
+          "a[" + std::to_string(i) + "]:sin(x)^2+\"" + std::to_string(i) + "\"$\n"
+          "plot2d(a[" + std::to_string(i) + "],[x,-1,1]);\n\n";
+      for (size_t size = 0; size < 50 * 1024 * 1024; size += chunk.size())
+        out.Write(chunk.data(), chunk.size());
+    }
+    WHEN("the file is parsed") {
+      wxStopWatch stopwatch;
+      std::vector<WXMCell> cells = ParseMACFile(file, false);
+      long singlePass = stopwatch.Time();
+      stopwatch.Start();
+      std::vector<WXMCell> reference = ReferenceParseMACFile(file, false);
+      long old = stopwatch.Time();
+      WARN("Single-pass parser: " << singlePass << " ms, old parser: " << old << " ms");
+      THEN("both parsers find the same cells") {
+        REQUIRE(cells.size() == reference.size());
+        REQUIRE(cells == reference);
+      }
+    }
+    wxRemoveFile(file);
+  }
+}
+
+// If we don't provide our own main when compiling on MinGW
+// we currently get an error message that WinMain@16 is missing
+// (https://github.com/catchorg/Catch2/issues/1287)
+int main(int argc, char* argv[])
+{
+  wxEntryStart(argc, argv);
+  int result = Catch::Session().run(argc, argv);
+  wxEntryCleanup();
+  return result;
+}